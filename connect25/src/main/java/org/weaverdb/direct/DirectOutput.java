@@ -66,13 +66,23 @@ class DirectOutput<T> {
                 if (type == DirectWeaverConnection.META) {
                     column = new String(var.toArray(ValueLayout.JAVA_BYTE));
                 } else {
-                    value = (T)this.type.read(type, var, varSize);
+                    load(type, var, varSize);
                 }
             }
+        }
+        return varSize;
+    }
+    
+    void load(int type, MemorySegment var, int varSize) {
+        try {
+            value = (T)this.type.read(type, var, varSize);
         } catch (ExecutionException ee) {
             value = null;
         }
-        return varSize;
+    }
+    
+    void loadNull() {
+        value = null;
     }
     
     T get() {
@@ -98,6 +108,10 @@ class DirectOutput<T> {
         return column;
     }
     
+    void setName(String name) {
+        column = name;
+    }
+    
     int getIndex() {
         return index;
     }
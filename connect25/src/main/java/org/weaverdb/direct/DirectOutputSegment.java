@@ -0,0 +1,144 @@
+/*-------------------------------------------------------------------------
+ *
+ *
+ * Copyright (c) 2000-2024, Myron Scott  <myron@weaverdb.org>
+ *
+ * All rights reserved.
+ * Use of this source code is governed by a BSD-style
+ * license that can be found in the LICENSE file.
+ *
+ *-------------------------------------------------------------------------
+ */
+package org.weaverdb.direct;
+
+import java.lang.foreign.Arena;
+import java.lang.foreign.MemorySegment;
+import java.lang.foreign.ValueLayout;
+import java.util.Collection;
+import java.util.Comparator;
+import java.util.Set;
+
+/**
+ * Off-heap block the native side fetches a batch of result rows into,
+ * one array of values and one null bitmap per column with variable
+ * length values in a shared area at the end.  The layout matches
+ * OutputSegment in WeaverInterface.h.  Rows are handed to the linked
+ * outputs one at a time so the statement looks the same to the caller
+ * as a fetch per row.
+ */
+class DirectOutputSegment {
+
+    private static final long NCOLS = 0;
+    private static final long MAXROWS = 4;
+    private static final long NROWS = 8;
+    private static final long VARDATA = 24;
+    private static final long COLUMNS = 48;
+
+    private static final long COLUMN_INDEX = 0;
+    private static final long COLUMN_TYPE = 4;
+    private static final long COLUMN_WIDTH = 8;
+    private static final long COLUMN_VALUES = 16;
+    private static final long COLUMN_NULLS = 24;
+    private static final long COLUMN_NAME = 32;
+    private static final long COLUMN_SIZE = 96;
+
+    private static final Set<Integer> FIXED = Set.of(
+            DirectWeaverConnection.SHORT,
+            DirectWeaverConnection.INT,
+            DirectWeaverConnection.FLOAT,
+            DirectWeaverConnection.LONG,
+            DirectWeaverConnection.DOUBLE,
+            DirectWeaverConnection.TIMESTAMP
+    );
+
+    private final MemorySegment segment;
+    private final DirectOutput<?>[] columns;
+    private boolean named = false;
+    private int rows = 0;
+    private int row = 0;
+
+    DirectOutputSegment(Collection<DirectOutput<?>> outputs, long size) {
+        columns = outputs.stream()
+                .sorted(Comparator.comparingInt(DirectOutput::getIndex))
+                .toArray(DirectOutput<?>[]::new);
+        segment = Arena.ofAuto().allocate(Math.max(size, COLUMNS + columns.length * COLUMN_SIZE), Long.BYTES);
+        segment.set(ValueLayout.JAVA_INT, NCOLS, columns.length);
+        segment.set(ValueLayout.JAVA_INT, MAXROWS, 0);
+        for (int c = 0; c < columns.length; c++) {
+            long base = COLUMNS + c * COLUMN_SIZE;
+            segment.set(ValueLayout.JAVA_INT, base + COLUMN_INDEX, columns[c].getIndex());
+            segment.set(ValueLayout.JAVA_INT, base + COLUMN_TYPE, columns[c].getType());
+        }
+    }
+
+    /**
+     * outputs of these types can be read out of a segment, anything else
+     * keeps the per value transfer.
+     */
+    static boolean eligible(DirectOutput<?> output) {
+        return output.getClass() == DirectOutput.class &&
+                (FIXED.contains(output.getType()) || output.getType() == DirectWeaverConnection.STRING);
+    }
+
+    MemorySegment address() {
+        return segment;
+    }
+
+    long size() {
+        return segment.byteSize();
+    }
+
+    /**
+     * pick up the rows of the last native fetch.
+     */
+    void loaded() {
+        rows = segment.get(ValueLayout.JAVA_INT, NROWS);
+        row = 0;
+        if (!named && rows > 0) {
+            for (int c = 0; c < columns.length; c++) {
+                columns[c].setName(segment.getString(COLUMNS + c * COLUMN_SIZE + COLUMN_NAME));
+            }
+            named = true;
+        }
+    }
+
+    boolean pending() {
+        return row < rows;
+    }
+
+    /**
+     * move the next row into the linked outputs, false once the rows of
+     * the last fetch are used up.
+     */
+    boolean next() {
+        if (row >= rows) {
+            return false;
+        }
+        for (int c = 0; c < columns.length; c++) {
+            long base = COLUMNS + c * COLUMN_SIZE;
+            long nulls = segment.get(ValueLayout.JAVA_LONG, base + COLUMN_NULLS);
+            if ((segment.get(ValueLayout.JAVA_BYTE, nulls + (row >> 3)) & (1 << (row & 0x07))) != 0) {
+                columns[c].loadNull();
+                continue;
+            }
+            int type = segment.get(ValueLayout.JAVA_INT, base + COLUMN_TYPE);
+            int width = segment.get(ValueLayout.JAVA_INT, base + COLUMN_WIDTH);
+            long entry = segment.get(ValueLayout.JAVA_LONG, base + COLUMN_VALUES) + (long)row * width;
+            if (FIXED.contains(type)) {
+                columns[c].load(type, segment.asSlice(entry, width), width);
+            } else {
+                long vardata = segment.get(ValueLayout.JAVA_LONG, VARDATA);
+                int offset = segment.get(ValueLayout.JAVA_INT, entry);
+                int length = segment.get(ValueLayout.JAVA_INT, entry + Integer.BYTES);
+                columns[c].load(type, segment.asSlice(vardata + offset, length), length);
+            }
+        }
+        row++;
+        return true;
+    }
+
+    void reset() {
+        rows = 0;
+        row = 0;
+    }
+}
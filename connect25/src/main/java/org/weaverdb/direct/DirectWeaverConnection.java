@@ -76,6 +76,8 @@ class DirectWeaverConnection implements DBReference {
     private static final MethodHandle WGetErrorCode;
     private static final MethodHandle WBindTransfer;
     private static final MethodHandle WOutputTransfer;
+    private static final MethodHandle WOutputSegment;
+    private static final MethodHandle WFetchSegment;
     private static final MethodHandle WConnectStdIO;
     private static final MethodHandle WDisconnectStdIO;
     
@@ -124,6 +126,10 @@ class DirectWeaverConnection implements DBReference {
                 FunctionDescriptor.of(JAVA_LONG, ADDRESS, ADDRESS, JAVA_INT, ADDRESS, ADDRESS));
         WOutputTransfer = LINKER.downcallHandle(LOADER.find("WOutputTransfer").orElseThrow(),
                 FunctionDescriptor.of(JAVA_LONG, ADDRESS, JAVA_SHORT, JAVA_INT, ADDRESS, ADDRESS));
+        WOutputSegment = LOADER.find("WOutputSegment").map(s->LINKER.downcallHandle(s,
+                FunctionDescriptor.of(JAVA_LONG, ADDRESS, ADDRESS, JAVA_LONG))).orElse(null);
+        WFetchSegment = LOADER.find("WFetchSegment").map(s->LINKER.downcallHandle(s,
+                FunctionDescriptor.of(JAVA_LONG, ADDRESS))).orElse(null);
         WConnectStdIO = LINKER.downcallHandle(LOADER.find("WConnectStdIO").orElseThrow(),
                 FunctionDescriptor.ofVoid(ADDRESS, ADDRESS, ADDRESS, ADDRESS));
         WDisconnectStdIO = LINKER.downcallHandle(LOADER.find("WDisconnectStdIO").orElseThrow(),
@@ -157,6 +163,9 @@ class DirectWeaverConnection implements DBReference {
     public final static int  STREAM=	1834;
     public final static int GENERIC = 0;
     
+    /*  bytes of off-heap memory a statement fetches rows into, 0 fetches row by row  */
+    private final static long FETCH_SEGMENT = Long.getLong("org.weaverdb.fetchsegment", 1024 * 1024);
+    
     public final static int PIPING_ERROR=  -2;
     public final static int NULL_VALUE=  -1;
     public final static int TRUNCATION_VALUE= -32;
@@ -659,9 +668,12 @@ class DirectWeaverConnection implements DBReference {
         
         private final Map<Integer,DirectOutput<?>> outputs = new HashMap<>();
         private final Map<String,DirectInput<?>> inputs = new HashMap<>();
+        private DirectOutputSegment segment;
+        private boolean segmentChecked = false;
             
         @Override
         public <T> Output<T> linkOutput(int index, Class<T> type)  throws ExecutionException {
+            dropSegment();
             DirectOutput<T> bo = new DirectOutput(index, type);
             Optional.ofNullable(outputs.put(index, bo)).ifPresent(DirectOutput::deactivate);
             try {
@@ -709,6 +721,7 @@ class DirectWeaverConnection implements DBReference {
         
         @Override
         public <T> Output<T> linkOutputChannel(int index, Output.Channel<T> transform) throws ExecutionException {
+            dropSegment();
             DirectOutputChannel<T> channel = new DirectOutputChannel<>(this, transformer, index, transform);
             Optional.ofNullable(outputs.put(index, channel)).ifPresent(DirectOutput::deactivate);
             try {
@@ -728,6 +741,7 @@ class DirectWeaverConnection implements DBReference {
         
         @Override
         public <T extends WritableByteChannel> Output<T> linkOutputChannel(int index, Supplier<T> cstor) throws ExecutionException {
+            dropSegment();
             DirectOutputReceiver<T> receiver = new DirectOutputReceiver<>(this, index, cstor);
             Optional.ofNullable(outputs.put(index, receiver)).ifPresent(DirectOutput::deactivate);
             try {
@@ -752,6 +766,13 @@ class DirectWeaverConnection implements DBReference {
             for (DirectOutput<?> out : outputs.values()) {
                 out.reset();
             }
+            if (!segmentChecked) {
+                segment = createSegment();
+                segmentChecked = true;
+            }
+            if (segment != null) {
+                return fetchSegment();
+            }
             long result = 0;
             try {
                 result = (long)WFetch.invokeExact(link);
@@ -770,6 +791,72 @@ class DirectWeaverConnection implements DBReference {
             return false;
         }
         
+        /*
+         *  rows come out of the segment until it is used up, then the
+         *  native side refills it
+         */
+        private boolean fetchSegment() throws ExecutionException {
+            if (!segment.pending()) {
+                long result = 0;
+                try {
+                    result = (long)WFetchSegment.invokeExact(link);
+                } catch (Throwable t) {
+                    throw new ExecutionException(t);
+                }
+
+                if (result == 4) { /* EOT (End of Transmission) */
+                    segment.reset();
+                    return false;
+                } else if (result != 0) {
+                    handleError(result);
+                    return false;
+                }
+                segment.loaded();
+            }
+            return segment.next();
+        }
+        
+        /*
+         *  fetch into a segment when every linked output is a plain value
+         *  of a type the segment carries
+         */
+        private DirectOutputSegment createSegment() throws ExecutionException {
+            if (FETCH_SEGMENT <= 0 || WOutputSegment == null || WFetchSegment == null || outputs.isEmpty()) {
+                return null;
+            }
+            for (DirectOutput<?> out : outputs.values()) {
+                if (!DirectOutputSegment.eligible(out)) {
+                    return null;
+                }
+            }
+            DirectOutputSegment created = new DirectOutputSegment(outputs.values(), FETCH_SEGMENT);
+            try {
+                check((long)WOutputSegment.invokeExact(link, created.address(), created.size()));
+            } catch (ExecutionException ee) {
+                throw ee;
+            } catch (Throwable t) {
+                throw new ExecutionException(t);
+            }
+            return created;
+        }
+        
+        private void dropSegment() throws ExecutionException {
+            if (segment != null) {
+                if (segment.pending()) {
+                    throw new ExecutionException("cannot link outputs while fetched rows are pending");
+                }
+                try {
+                    check((long)WOutputSegment.invokeExact(link, MemorySegment.NULL, 0L));
+                } catch (ExecutionException ee) {
+                    throw ee;
+                } catch (Throwable t) {
+                    throw new ExecutionException(t);
+                }
+                segment = null;
+            }
+            segmentChecked = false;
+        }
+        
         @Override
         public Collection<Output<?>> outputs() {
             List<Output<?>> send = new ArrayList<>(outputs.size());
@@ -793,6 +880,9 @@ class DirectWeaverConnection implements DBReference {
         public long execute() throws ExecutionException {
             long processed = 0;
             
+            if (segment != null) {
+                segment.reset();
+            }
             try {
                 processed = (long) WExec.invokeExact(link);
                 check(processed);
@@ -45,6 +45,7 @@ public class DirectWeaverInitializer {
     private static final MethodHandle initWeaverBackend;
     private static final MethodHandle wrapupWeaverBackend;
     private static final MethodHandle registerJavaInvoker;
+    private static final MethodHandle registerJavaBatchInvoker;
 
     // Strong reference to the JavaFunctionInvoker so the upcall stub (registered
     // via Arena.global()) remains reachable for the lifetime of the process.
@@ -71,6 +72,11 @@ public class DirectWeaverInitializer {
             lookup.find("WRegisterJavaFunctionInvoker").orElseThrow(),
             FunctionDescriptor.ofVoid(ValueLayout.ADDRESS)
         );
+
+        // batched form of the invoker, optional so older engines still load
+        registerJavaBatchInvoker = lookup.find("WRegisterJavaBatchInvoker")
+            .map(addr -> linker.downcallHandle(addr, FunctionDescriptor.ofVoid(ValueLayout.ADDRESS)))
+            .orElse(null);
     }
     
     public DirectWeaverInitializer() {
@@ -93,6 +99,10 @@ public class DirectWeaverInitializer {
                 javaFunctionInvoker = new JavaFunctionInvoker();
                 MemorySegment stub = javaFunctionInvoker.createUpcallStub();
                 registerJavaInvoker.invokeExact(stub);
+                if (registerJavaBatchInvoker != null) {
+                    MemorySegment batchStub = javaFunctionInvoker.createBatchUpcallStub();
+                    registerJavaBatchInvoker.invokeExact(batchStub);
+                }
             } catch (Throwable t) {
                 System.err.println("Warning: Failed to register Java function invoker via FFM. " +
                                    "LANGUAGE 'java' functions may fall back to legacy JNI or be unavailable: " + t);
@@ -2,7 +2,11 @@ package org.weaverdb.direct;
 
 import java.lang.foreign.MemorySegment;
 import java.lang.foreign.ValueLayout;
+import java.nio.ByteBuffer;
+import java.nio.ByteOrder;
 import java.nio.charset.StandardCharsets;
+import java.util.Arrays;
+import java.util.function.Function;
 
 /**
  * Defines the binary protocol used for FFM upcall-based Java function invocation
@@ -200,6 +204,157 @@ public final class JavaCallProtocol {
         }
     }
 
+    // ====================== Batch Block Format (batch v1) ======================
+    //
+    // One batch upcall evaluates a function over many rows.  The arg block is
+    // columnar, all the values of one argument follow its tag:
+    //   [int32 numRows][int32 numArgs]
+    //   for each arg:
+    //       [int32 typeTag]
+    //       numRows values, packed for INT4 (4 bytes), INT8 (8), FLOAT8 (8) and
+    //       BOOL (1), [int32 length][bytes] each for VARCHAR and JAVA_OBJECT
+    //
+    // Rows with a null argument are never sent.  The result block is
+    //   [int32 numRows] followed by one v1 value ([tag][length][bytes]) per row,
+    // or a single TAG_ERROR value as written by writeError.
+    //
+    // Nothing in a batch block is aligned.
+
+    public static final int BATCH_HEADER_SIZE = 8; // numRows, numArgs
+
+    /**
+     * Decodes a batch arg block into rows of arguments.
+     * @param argData       the columnar block
+     * @param len           length of the block
+     * @param objectReader  turns a serialized JAVA_OBJECT into its object
+     * @return one argument array per row
+     */
+    public static Object[][] readBatchArgs(MemorySegment argData, int len, Function<byte[], Object> objectReader) {
+        if (len < BATCH_HEADER_SIZE) return new Object[0][];
+
+        int numRows = argData.get(ValueLayout.JAVA_INT_UNALIGNED, 0);
+        int numArgs = argData.get(ValueLayout.JAVA_INT_UNALIGNED, 4);
+        Object[][] rows = new Object[numRows][numArgs];
+        long offset = BATCH_HEADER_SIZE;
+
+        for (int a = 0; a < numArgs; a++) {
+            int tag = argData.get(ValueLayout.JAVA_INT_UNALIGNED, offset); offset += 4;
+            for (int r = 0; r < numRows; r++) {
+                switch (tag) {
+                    case TAG_INT4:
+                        rows[r][a] = argData.get(ValueLayout.JAVA_INT_UNALIGNED, offset);
+                        offset += 4;
+                        break;
+                    case TAG_INT8:
+                        rows[r][a] = argData.get(ValueLayout.JAVA_LONG_UNALIGNED, offset);
+                        offset += 8;
+                        break;
+                    case TAG_FLOAT8:
+                        rows[r][a] = argData.get(ValueLayout.JAVA_DOUBLE_UNALIGNED, offset);
+                        offset += 8;
+                        break;
+                    case TAG_BOOL:
+                        rows[r][a] = argData.get(ValueLayout.JAVA_BYTE, offset) != 0;
+                        offset += 1;
+                        break;
+                    case TAG_VARCHAR: {
+                        int valueLen = argData.get(ValueLayout.JAVA_INT_UNALIGNED, offset); offset += 4;
+                        rows[r][a] = readString(argData, offset, valueLen);
+                        offset += valueLen;
+                        break;
+                    }
+                    case TAG_JAVA_OBJECT: {
+                        int valueLen = argData.get(ValueLayout.JAVA_INT_UNALIGNED, offset); offset += 4;
+                        rows[r][a] = objectReader.apply(readBytes(argData, offset, valueLen));
+                        offset += valueLen;
+                        break;
+                    }
+                    default:
+                        throw new IllegalArgumentException("Unknown batch argument tag " + tag);
+                }
+            }
+        }
+        return rows;
+    }
+
+    /**
+     * Collects the results of a batch, one v1 value per row, in native byte order.
+     */
+    public static final class BatchResultWriter {
+        private ByteBuffer buffer;
+        private int count = 0;
+
+        public BatchResultWriter(int estimatedRows) {
+            buffer = ByteBuffer.allocate(4 + estimatedRows * 16).order(ByteOrder.nativeOrder());
+            buffer.putInt(0); // numRows, filled in by finish
+        }
+
+        public BatchResultWriter addNull() {
+            ensureCapacity(8);
+            buffer.putInt(TAG_NULL).putInt(0);
+            count++;
+            return this;
+        }
+
+        public BatchResultWriter addInt4(int v) {
+            ensureCapacity(12);
+            buffer.putInt(TAG_INT4).putInt(4).putInt(v);
+            count++;
+            return this;
+        }
+
+        public BatchResultWriter addInt8(long v) {
+            ensureCapacity(16);
+            buffer.putInt(TAG_INT8).putInt(8).putLong(v);
+            count++;
+            return this;
+        }
+
+        public BatchResultWriter addFloat8(double v) {
+            ensureCapacity(16);
+            buffer.putInt(TAG_FLOAT8).putInt(8).putDouble(v);
+            count++;
+            return this;
+        }
+
+        public BatchResultWriter addBool(boolean v) {
+            ensureCapacity(9);
+            buffer.putInt(TAG_BOOL).putInt(1).put((byte) (v ? 1 : 0));
+            count++;
+            return this;
+        }
+
+        public BatchResultWriter addVarchar(String v) {
+            return addBytes(TAG_VARCHAR, v.getBytes(StandardCharsets.UTF_8));
+        }
+
+        public BatchResultWriter addJavaObject(byte[] serialized) {
+            return addBytes(TAG_JAVA_OBJECT, serialized);
+        }
+
+        public byte[] finish() {
+            buffer.putInt(0, count);
+            return Arrays.copyOf(buffer.array(), buffer.position());
+        }
+
+        private BatchResultWriter addBytes(int tag, byte[] data) {
+            ensureCapacity(8 + data.length);
+            buffer.putInt(tag).putInt(data.length).put(data);
+            count++;
+            return this;
+        }
+
+        private void ensureCapacity(int needed) {
+            if (buffer.remaining() < needed) {
+                int size = Math.max(buffer.capacity() * 2, buffer.position() + needed);
+                ByteBuffer grown = ByteBuffer.allocate(size).order(ByteOrder.nativeOrder());
+                buffer.flip();
+                grown.put(buffer);
+                buffer = grown;
+            }
+        }
+    }
+
     // =====================================================================
     // Error support for better exception propagation from Java to C
     // =====================================================================
@@ -91,25 +91,7 @@ public final class JavaFunctionInvoker {
             String methodStr = methodName.getString(0);
             String descStr = methodDesc.getString(0);
 
-            String cacheKey = classStr + "." + methodStr + ":" + descStr;
-
-            MethodHandle mh = methodCache.computeIfAbsent(cacheKey, key -> {
-                try {
-                    Class<?> clazz = Class.forName(classStr);
-                    MethodType fullMt = MethodType.fromMethodDescriptorString(descStr, clazz.getClassLoader());
-
-                    if (isStaticFlag == 1) {
-                        return lookup.findStatic(clazz, methodStr, fullMt);
-                    } else {
-                        // For instance methods, the descriptor from the catalog includes the receiver
-                        // as the first parameter (thanks to FunctionInstaller). We must drop it.
-                        MethodType realMt = fullMt.dropParameterTypes(0, 1);
-                        return lookup.findVirtual(clazz, methodStr, realMt);
-                    }
-                } catch (Exception e) {
-                    throw new RuntimeException("Failed to resolve Java function handle: " + key, e);
-                }
-            });
+            MethodHandle mh = resolve(classStr, methodStr, descStr, isStaticFlag);
 
             // Always parse the actual number of arguments sent from C (includes receiver for instance methods)
             int numArgsFromProtocol = JavaCallProtocol.readInt4(argData, 0);
@@ -149,6 +131,120 @@ public final class JavaFunctionInvoker {
         }
     }
 
+    private MethodHandle resolve(String classStr, String methodStr, String descStr, int isStaticFlag) {
+        String cacheKey = classStr + "." + methodStr + ":" + descStr;
+
+        return methodCache.computeIfAbsent(cacheKey, key -> {
+            try {
+                Class<?> clazz = Class.forName(classStr);
+                MethodType fullMt = MethodType.fromMethodDescriptorString(descStr, clazz.getClassLoader());
+
+                if (isStaticFlag == 1) {
+                    return lookup.findStatic(clazz, methodStr, fullMt);
+                } else {
+                    // For instance methods, the descriptor from the catalog includes the receiver
+                    // as the first parameter (thanks to FunctionInstaller). We must drop it.
+                    MethodType realMt = fullMt.dropParameterTypes(0, 1);
+                    return lookup.findVirtual(clazz, methodStr, realMt);
+                }
+            } catch (Exception e) {
+                throw new RuntimeException("Failed to resolve Java function handle: " + key, e);
+            }
+        });
+    }
+
+    /**
+     * Results of a batch that did not fit the native result buffer.  The native
+     * side retries right away on the same thread with a buffer of the reported
+     * size and gets these without the method being called a second time.
+     */
+    private record PendingBatch(String key, int argDataLen, byte[] encoded) {}
+
+    private final ThreadLocal<PendingBatch> pendingBatch = new ThreadLocal<>();
+
+    /**
+     * Batched upcall, evaluates one function over every row of a columnar
+     * argument block (see the batch format in JavaCallProtocol).
+     *
+     * Returns 0 when the results were written, the size needed when
+     * resultSize is too small and -1 with an error result written on failure.
+     */
+    private int invokeBatch(
+            MemorySegment className,
+            MemorySegment methodName,
+            MemorySegment methodDesc,
+            int isStaticFlag,
+            MemorySegment argData,
+            int argDataLen,
+            MemorySegment resultOut,
+            int resultSize
+    ) {
+        MemorySegment results = resultOut.reinterpret(resultSize);
+        try {
+            String classStr = className.reinterpret(Long.MAX_VALUE).getString(0);
+            String methodStr = methodName.reinterpret(Long.MAX_VALUE).getString(0);
+            String descStr = methodDesc.reinterpret(Long.MAX_VALUE).getString(0);
+            String key = classStr + "." + methodStr + ":" + descStr;
+
+            byte[] encoded;
+            PendingBatch pending = pendingBatch.get();
+            pendingBatch.remove();
+            if (pending != null && pending.key().equals(key) && pending.argDataLen() == argDataLen) {
+                encoded = pending.encoded();
+            } else {
+                MethodHandle mh = resolve(classStr, methodStr, descStr, isStaticFlag);
+                boolean textResult = mh.type().returnType() == String.class;
+                Object[][] rows = JavaCallProtocol.readBatchArgs(argData.reinterpret(argDataLen), argDataLen,
+                        WeaverObjectLoader::java_out);
+
+                JavaCallProtocol.BatchResultWriter out = new JavaCallProtocol.BatchResultWriter(rows.length);
+                for (Object[] row : rows) {
+                    if (isStaticFlag != 1 && row.length == 0) {
+                        throw new IllegalStateException("Instance method called with no receiver argument");
+                    }
+                    // findVirtual handles take the receiver as their first argument
+                    Object result = mh.invokeWithArguments(row);
+
+                    if (result == null) {
+                        out.addNull();
+                    } else if (result instanceof Integer i) {
+                        out.addInt4(i);
+                    } else if (result instanceof Long l) {
+                        out.addInt8(l);
+                    } else if (result instanceof Double d) {
+                        out.addFloat8(d);
+                    } else if (result instanceof Boolean b) {
+                        out.addBool(b);
+                    } else if (textResult) {
+                        out.addVarchar((String) result);
+                    } else {
+                        out.addJavaObject(WeaverObjectLoader.java_in(result));
+                    }
+                }
+                encoded = out.finish();
+            }
+
+            if (encoded.length > resultSize) {
+                pendingBatch.set(new PendingBatch(key, argDataLen, encoded));
+                return encoded.length;
+            }
+            MemorySegment.copy(MemorySegment.ofArray(encoded), 0, results, 0, encoded.length);
+            return 0;
+
+        } catch (Throwable t) {
+            String msg = t.getClass().getSimpleName() + ": " + t.getMessage();
+            if (t.getCause() != null) {
+                msg += " (caused by " + t.getCause().getClass().getSimpleName() + ")";
+            }
+            // leave room for the header in the native buffer
+            if (msg.length() > (resultSize - 12) / 4) {
+                msg = msg.substring(0, (resultSize - 12) / 4);
+            }
+            JavaCallProtocol.writeError(results, msg);
+            return -1;
+        }
+    }
+
     /**
      * Parses arguments from the protocol block.
      * @param argData        the serialized argument data (per JavaCallProtocol)
@@ -297,6 +393,51 @@ public final class JavaFunctionInvoker {
         return LINKER.upcallStub(target, desc, Arena.global());
     }
 
+    /**
+     * Creates the upcall stub passed to native code via WRegisterJavaBatchInvoker.
+     *
+     * The resulting function pointer must match this exact C signature:
+     *
+     *   int batchInvoker(
+     *       const char *className,
+     *       const char *methodName,
+     *       const char *methodDesc,
+     *       int         isStatic,
+     *       const char *argData,     // columnar block per JavaCallProtocol batch v1
+     *       int         argDataLen,
+     *       char       *resultOut,
+     *       int         resultSize   // bytes writable at resultOut
+     *   );
+     */
+    public MemorySegment createBatchUpcallStub() {
+        MethodHandle target;
+        try {
+            target = MethodHandles.lookup()
+                    .findVirtual(JavaFunctionInvoker.class, "invokeBatch",
+                            MethodType.methodType(int.class,
+                                    MemorySegment.class, MemorySegment.class, MemorySegment.class,
+                                    int.class, MemorySegment.class, int.class, MemorySegment.class, int.class))
+                    .bindTo(this);
+        } catch (NoSuchMethodException | IllegalAccessException e) {
+            throw new RuntimeException("Failed to create batch invoker upcall", e);
+        }
+
+        FunctionDescriptor desc = FunctionDescriptor.of(
+                JAVA_INT,
+                ADDRESS,   // className
+                ADDRESS,   // methodName
+                ADDRESS,   // methodDesc
+                JAVA_INT,  // isStatic
+                ADDRESS,   // argData     (columnar argument block)
+                JAVA_INT,  // argDataLen
+                ADDRESS,   // resultOut
+                JAVA_INT   // resultSize
+        );
+
+        // Arena.global() for the same reason as createUpcallStub
+        return LINKER.upcallStub(target, desc, Arena.global());
+    }
+
     // Convenience for testing / future direct Java usage
     public static JavaFunctionInvoker getDefault() {
         return new JavaFunctionInvoker();
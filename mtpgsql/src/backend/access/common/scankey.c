@@ -40,6 +40,7 @@ ScanKeyEntrySetIllegal(ScanKey entry)
 	entry->sk_flags = 0;		/* just in case... */
 	entry->sk_attno = InvalidAttrNumber;
 	entry->sk_procedure = 0;	/* should be InvalidRegProcedure */
+	entry->sk_cmptype = 0;
 }
 
 /*
@@ -65,6 +66,7 @@ ScanKeyEntryInitialize(ScanKey entry,
 	entry->sk_argument = argument;
 	fmgr_info(procedure, &entry->sk_func);
 	entry->sk_nargs = entry->sk_func.fn_nargs;
+	entry->sk_cmptype = 0;
 
 	Assert(ScanKeyEntryIsLegal(entry));
 }
@@ -12,13 +12,18 @@
  *-------------------------------------------------------------------------
 */
 
-
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <dirent.h>
 
 #include "postgres.h"
 #include "env/env.h"
 
 #include "env/properties.h"
 #include "env/freespace.h"
+#include "env/visibilitymap.h"
 #include "access/blobstorage.h"
 
 #include "utils/tqual.h"
@@ -28,21 +33,30 @@
 #include "catalog/pg_extstore.h"
 #include "catalog/catname.h"
 #include "access/tupmacs.h"
+#include "access/transam.h"
+#include "storage/sinval.h"
 
 #include "access/hio.h"
 #include "catalog/catalog.h"
 #include "miscadmin.h"
 #include "storage/smgr.h"
+#include "storage/fd.h"
 #include "utils/builtins.h"
 #include "utils/inval.h"
 #include "utils/relcache.h"
 
 #include "env/pg_crc.h"
+#include "utils/lzf.h"
+#include "utils/sha2.h"
+#include "utils/hsearch.h"
+#include "utils/memutils.h"
+#include "nodes/pg_list.h"
 
 typedef struct blobseg {
 	ItemPointerData seg_next;
 	int32           seg_length;
         bool            seg_blobhead;
+        int32           seg_flags;      /* SEGMENT_ bits kept in the header length */
 	char           *seg_data;
 } blob_segment_data;
 
@@ -65,6 +79,14 @@ typedef struct read_pipeline {
         int16               cache_length;
         bool                read_only;
         MemoryContext       cxt;
+        Relation            relation;       /* open and share locked for the life of the pipe */
+        BlockNumber         ahead_start;    /* blocks already asked for by read-ahead */
+        BlockNumber         ahead;
+        BlobIndex*          chain;          /* segment chain when it is known up front */
+        int                 chain_length;
+        int                 chain_read;     /* segments consumed */
+        int                 chain_ahead;    /* segments asked for */
+        File                extent;         /* extent file of the blob once it is found */
 }   read_pipeline;
 
 typedef struct write_pipeline {
@@ -78,6 +100,13 @@ typedef struct write_pipeline {
         bytea*               cache_data;
         uint32              cache_limit;
         MemoryContext       cxt;
+        char*               stage;          /* data held back until it is known where it goes */
+        int32               stage_fill;
+        int32               stage_size;
+        File                extent;         /* extent file once the blob outgrows the threshold */
+        uint64              extent_pos;
+        bool                staging;        /* new data goes to the stage */
+        SHA256_CTX*         digest;         /* content hash when deduplicating */
 } write_pipeline;
 
 typedef struct segmentheader {
@@ -88,6 +117,117 @@ typedef struct segmentheader {
 
 static long     SEGHDRSZ = MAXALIGN(offsetof(segment_header, data));
 
+/*
+ *  a compressed segment is flagged in the length of the segment header,
+ *  the data is the uncompressed length followed by the lzf bytes
+ */
+#define SEGMENT_COMPRESSED      0x40000000
+#define SEGCOMPRESSED(seg)      (((seg)->length & SEGMENT_COMPRESSED) != 0)
+/*
+ *  an extent segment is the only segment of a blob stored in an extent
+ *  file, its data is the extent descriptor
+ */
+#define SEGMENT_EXTENT          0x20000000
+#define SEGEXTENT(seg)          (((seg)->length & SEGMENT_EXTENT) != 0)
+/*
+ *  deduplicated content is a chain owned by a shared segment holding
+ *  the digest and a reference count, each blob that uses it is a link
+ *  segment pointing at the shared one.  Vacuum marks a dead link
+ *  released once its reference has been given back.
+ */
+#define SEGMENT_SHARED          0x10000000
+#define SEGMENT_LINK            0x08000000
+#define SEGMENT_RELEASED        0x04000000
+#define SEGSHARED(seg)          (((seg)->length & SEGMENT_SHARED) != 0)
+#define SEGLINK(seg)            (((seg)->length & SEGMENT_LINK) != 0)
+#define SEGRELEASED(seg)        (((seg)->length & SEGMENT_RELEASED) != 0)
+#define SEGMENT_FLAGS           (SEGMENT_COMPRESSED | SEGMENT_EXTENT | SEGMENT_SHARED | SEGMENT_LINK | SEGMENT_RELEASED)
+#define SEGLENGTH(seg)          ((seg)->length & ~SEGMENT_FLAGS)
+/*  get_segment found an extent segment, the pointer is left on it  */
+#define EXTENT_LINK             (-2)
+/*  get_segment moved the pointer on from a link or shared segment  */
+#define SHARED_LINK             (-3)
+/*  segments smaller than this are not worth compressing  */
+#define SEGMENT_COMPRESS_MIN    256
+
+typedef struct extentdesc {
+	Oid             extent;
+}               extent_descriptor;
+
+typedef struct sharedhead {
+	uint8           digest[SHA256_DIGEST_LENGTH];
+	int32           refs;
+}               shared_head;
+
+typedef struct sharedlink {
+	ItemPointerData shared;
+	uint8           digest[SHA256_DIGEST_LENGTH];
+}               shared_link;
+
+/*
+ *  shared segments by content, only blobs written since startup are
+ *  found, a stale entry is caught by checking the segment it points at
+ */
+typedef struct dedupkey {
+	Oid             relid;
+	Oid             dbid;
+	uint8           digest[SHA256_DIGEST_LENGTH];
+}               DedupKey;
+
+typedef struct dedupentry {
+	DedupKey        key;
+	ItemPointerData shared;
+}               DedupEntry;
+
+static HTAB*            dedup_table;
+static MemoryContext    dedup_cxt;
+static pthread_mutex_t  dedup_guard;
+
+/*
+ *  extent files are written under a pending name that carries the
+ *  writing transaction and take their real name once it commits, so a
+ *  crash never leaves an extent file without a durable segment.  Pending
+ *  files left by a crash are settled by the first connection to the
+ *  database.
+ */
+typedef struct pendingextent {
+    TransactionId           xid;
+    char*                   pending;
+    char*                   path;
+    struct pendingextent*   next;
+}               pending_extent;
+
+/*
+ *  read pipes hold their relation open and share locked until they are
+ *  closed, a pipe still open when its transaction aborts is released by
+ *  AtEOXact_Blobs
+ */
+typedef struct openpipe {
+    TransactionId           xid;
+    read_pipeline*          pipe;
+    struct openpipe*        next;
+}               open_pipe;
+
+static MemoryContext    extent_cxt;
+static pthread_mutex_t  extent_guard;   /* guards extent_cxt and both lists */
+static pending_extent*  pending_extents = NULL;
+static open_pipe*       open_pipes = NULL;
+static Oid*             swept_databases = NULL;
+static int              swept_count = 0;
+static int              swept_max = 0;
+static long             dedup_count = 0;
+static long             dedup_limit = -1;
+static int              dedup_blobs = -1;
+
+/*  staging starts at this size and doubles up to the extent threshold  */
+#define EXTENT_STAGE_MIN        (64 * 1024)
+/*  smallest threshold honored so extent I/O stays large  */
+#define EXTENT_THRESHOLD_MIN    (1024 * 1024)
+/*  largest threshold honored, the pipe stages this much in one allocation  */
+#define EXTENT_THRESHOLD_MAX    (64 * 1024 * 1024)
+/*  without extents a deduplicating pipe stages this much before writing  */
+#define DEDUP_STAGE_MAX         (1024 * 1024)
+
 typedef struct bloblist {
 	int16           attnum;
 	Datum           data;
@@ -97,6 +237,9 @@ typedef struct bloblist {
 typedef blob_segment_data *blob_segment;
 
 int    segment_size = 0;
+static int  read_ahead = -1;
+static int  compress_blobs = -1;
+static long extent_threshold = -1;
 
 static HeapTuple store_segment(Relation rel, blob_segment segment, BlockNumber limit);
 static int  delete_segment(Relation rel, ItemPointer pointer);
@@ -112,6 +255,34 @@ static bool lock_segment_for_update(Relation relation, Buffer*  buf, HeapTuple t
 static void unlock_segment(Relation relation, Buffer buf, HeapTuple tuple);
 
 static void  blob_log(Relation rel, char* pattern, ...);
+static int  blob_read_ahead(void);
+static bool blob_compression(void);
+static bool compress_segment(blob_segment segment);
+static long blob_extent_threshold(void);
+static char* extent_path(Oid relid, Oid extent);
+static char* extent_pending_path(Oid relid, Oid extent, TransactionId xid);
+static void settle_extent(char* pending, TransactionId xid);
+static File open_extent(Relation rel, ItemPointer pointer, bool read_only);
+static bool blob_in_place(blob_header* header);
+static void stage_pipeline_data(write_pipeline* pipe, char* data, int length);
+static void begin_extent(write_pipeline* pipe);
+static void flush_extent(write_pipeline* pipe);
+static void close_extent(write_pipeline* pipe);
+static void store_staged_data(write_pipeline* pipe);
+static bool pipeline_segments(write_pipeline* header, bytea* data);
+static bool blob_dedup(void);
+static void* DedupAlloc(Size size, void* cxt);
+static void DedupFree(void* pointer, void* cxt);
+static bool dedup_lookup(Relation rel, uint8* digest, ItemPointer shared);
+static void dedup_remember(Relation rel, uint8* digest, ItemPointer shared);
+static void dedup_forget(Relation rel, uint8* digest, ItemPointer shared);
+static bool share_blob(Relation rel, uint8* digest, ItemPointer shared);
+static void link_blob(Relation rel, uint8* digest, ItemPointer shared, ItemPointer link);
+static void publish_blob(Relation rel, uint8* digest, write_pipeline* pipe);
+static void prefetch_segments(read_pipeline* pipe);
+static void register_read_pipe(read_pipeline* pipe);
+static void unregister_read_pipe(read_pipeline* pipe);
+static void release_read_pipe(read_pipeline* pipe);
 
 int
 sizeof_max_tuple_blob()
@@ -130,6 +301,609 @@ sizeof_max_tuple_blob()
     return segment_size;
 }
 
+/*
+ *  number of segments a read pipeline asks the storage manager for
+ *  ahead of the one being read, 0 turns read-ahead off
+ */
+static int
+blob_read_ahead()
+{
+    if ( read_ahead < 0 ) {
+        if ( PropertyIsValid("blobreadahead") ) {
+            int ref = GetIntProperty("blobreadahead");
+            read_ahead = ( ref > 0 ) ? ref : 0;
+        } else {
+            read_ahead = 16;
+        }
+    }
+    return read_ahead;
+}
+
+/*
+ *  segments of new blobs are compressed when the blobcompression
+ *  property is set, existing segments are read either way
+ */
+static bool
+blob_compression()
+{
+    if ( compress_blobs < 0 ) {
+        compress_blobs = ( PropertyIsValid("blobcompression") && GetBoolProperty("blobcompression") ) ? 1 : 0;
+    }
+    return ( compress_blobs > 0 );
+}
+
+/*
+ *  replace the data of the segment with its compressed form, the segment
+ *  is left alone unless compressing saves at least an eighth of it so
+ *  data that is already packed is stored as it is
+ */
+static bool
+compress_segment(blob_segment segment)
+{
+    int32           rawlength = segment->seg_length;
+    char*           packed;
+    unsigned int    put;
+
+    if ( !blob_compression() || rawlength < SEGMENT_COMPRESS_MIN ) return false;
+
+    packed = palloc(rawlength);
+    put = lzf_compress(segment->seg_data, rawlength, packed + sizeof(int32),
+            rawlength - (rawlength >> 3) - sizeof(int32));
+    if ( put == 0 ) {
+        pfree(packed);
+        return false;
+    }
+    memmove(packed, &rawlength, sizeof(int32));
+    segment->seg_data = packed;
+    segment->seg_length = put + sizeof(int32);
+    segment->seg_flags |= SEGMENT_COMPRESSED;
+
+    return true;
+}
+
+/*
+ *  blobs that grow past this many bytes are moved out of the heap into
+ *  an extent file of their own, 0 keeps every blob in segments
+ */
+static long
+blob_extent_threshold()
+{
+    if ( extent_threshold < 0 ) {
+        if ( PropertyIsValid("blobextentthreshold") ) {
+            long ref = GetIntProperty("blobextentthreshold");
+            if ( ref <= 0 ) {
+                extent_threshold = 0;
+            } else {
+                if ( ref < EXTENT_THRESHOLD_MIN ) {
+                    extent_threshold = EXTENT_THRESHOLD_MIN;
+                } else if ( ref > EXTENT_THRESHOLD_MAX ) {
+                    extent_threshold = EXTENT_THRESHOLD_MAX;
+                } else {
+                    extent_threshold = ref;
+                }
+            }
+        } else {
+            extent_threshold = 0;
+        }
+    }
+    return extent_threshold;
+}
+
+/*
+ *  extent files sit in the database directory beside the relation
+ *  that owns them, named by relation and extent so a rename of the
+ *  relation leaves them alone
+ */
+static char*
+extent_path(Oid relid, Oid extent)
+{
+    char    name[NAMEDATALEN];
+
+    snprintf(name, NAMEDATALEN, "%lu.%lu.extent", relid, extent);
+    return relpath_blind(GetDatabaseName(), name, GetDatabaseId(), relid);
+}
+
+static char*
+extent_pending_path(Oid relid, Oid extent, TransactionId xid)
+{
+    char    name[NAMEDATALEN];
+
+    snprintf(name, NAMEDATALEN, "%lu.%lu.%llu.extent.tmp", relid, extent, (unsigned long long)xid);
+    return relpath_blind(GetDatabaseName(), name, GetDatabaseId(), relid);
+}
+
+/*
+ *  open the extent file of the extent segment at pointer, the writing
+ *  transaction still has it under the pending name
+ */
+static File
+open_extent(Relation rel, ItemPointer pointer, bool read_only)
+{
+    HeapTupleData       tp;
+    Buffer              buffer;
+    extent_descriptor   desc;
+    TransactionId       xmin;
+    char*               path;
+    File                extent;
+
+    tp.t_self = *pointer;
+    tp.t_info = ( read_only ) ? TUPLE_READONLY : 0;
+    buffer = RelationGetHeapTuple(rel,&tp);
+    if ( !BufferIsValid(buffer) ) {
+        elog(ERROR,"open_extent -- bad extent pointer blk: %lu offset: %d",
+                ItemPointerGetBlockNumber(pointer),ItemPointerGetOffsetNumber(pointer));
+    }
+    LockHeapTuple(rel,buffer,&tp,TUPLE_LOCK_READ);
+    memmove(&desc, ((segment_header*)GETSTRUCT(&tp))->data, sizeof(extent_descriptor));
+    xmin = tp.t_data->t_xmin;
+    LockHeapTuple(rel,buffer,&tp,TUPLE_LOCK_UNLOCK);
+    ReleaseBuffer(rel, buffer);
+
+    path = extent_path(RelationGetRelid(rel), desc.extent);
+    extent = FileNameOpenFile(path, O_RDONLY | O_LARGEFILE, 0600);
+    if ( extent < 0 ) {
+        pfree(path);
+        path = extent_pending_path(RelationGetRelid(rel), desc.extent, xmin);
+        extent = FileNameOpenFile(path, O_RDONLY | O_LARGEFILE, 0600);
+    }
+    if ( extent < 0 ) {
+        elog(ERROR,"open_extent -- could not open %s: %m", path);
+    }
+    pfree(path);
+
+    return extent;
+}
+
+/*
+ *  true if the blob is stored in an extent file or shares its content,
+ *  either way rewriting it would only cost space
+ */
+static bool
+blob_in_place(blob_header* header)
+{
+    ItemPointerData link = header->forward_pointer;
+    Relation        rel;
+    int             len;
+
+    if ( !ItemPointerIsValid(&link) ) return false;
+
+    rel = RelationIdGetRelation(header->relid, DEFAULTDBOID);
+    len = get_segment(rel, &link, true, NULL, 0);
+    RelationClose(rel);
+
+    return ( len == EXTENT_LINK || len == SHARED_LINK );
+}
+
+/*
+ *  with extents enabled the write pipeline holds data back until the
+ *  blob is either closed, and goes to segments, or outgrows the
+ *  threshold, and goes to an extent file.  After that the stage
+ *  gathers data into large sequential writes.
+ */
+static void
+stage_pipeline_data(write_pipeline* pipe, char* data, int length)
+{
+    while ( length > 0 ) {
+        int     room = pipe->stage_size - pipe->stage_fill;
+
+        if ( pipe->stage == NULL ) {
+            pipe->stage_size = EXTENT_STAGE_MIN;
+            pipe->stage = MemoryContextAlloc(pipe->cxt, pipe->stage_size + VARHDRSZ);
+            continue;
+        } else if ( room == 0 ) {
+            long    stage_max = ( blob_extent_threshold() > 0 ) ? blob_extent_threshold() : DEDUP_STAGE_MAX;
+
+            if ( pipe->extent >= 0 ) {
+                flush_extent(pipe);
+            } else if ( pipe->stage_size < stage_max ) {
+                int     size = pipe->stage_size * 2;
+                if ( size > stage_max ) size = stage_max;
+                pipe->stage = repalloc(pipe->stage, size + VARHDRSZ);
+                pipe->stage_size = size;
+            } else if ( blob_extent_threshold() > 0 ) {
+                begin_extent(pipe);
+                flush_extent(pipe);
+            } else {
+        /*  too big to hold back, the stage goes on to segments  */
+                store_staged_data(pipe);
+            }
+            continue;
+        }
+
+        if ( room > length ) room = length;
+        memmove(pipe->stage + VARHDRSZ + pipe->stage_fill, data, room);
+        pipe->stage_fill += room;
+        data += room;
+        length -= room;
+    }
+}
+
+/*
+ *  the extent segment is stored before the file is created so an
+ *  aborted writer leaves a dead segment behind and vacuum removes the
+ *  file along with it.  The file keeps its pending name until the
+ *  transaction commits, AtEOXact_Blobs renames or removes it.  Readers
+ *  only find the extent once the blob pointer is returned from
+ *  close_write_pipeline_blob after the file is synced.
+ */
+static void
+begin_extent(write_pipeline* pipe)
+{
+    Relation            rel = RelationIdGetRelation(pipe->rel, DEFAULTDBOID);
+    extent_descriptor   desc;
+    blob_segment_data   segment;
+    HeapTuple           tuple;
+    TransactionId       xid = GetCurrentTransactionId();
+    pending_extent*     pending;
+    char*               path;
+
+    desc.extent = GetNewObjectId();
+
+    ItemPointerSetInvalid(&segment.seg_next);
+    segment.seg_length = sizeof(extent_descriptor);
+    segment.seg_blobhead = TRUE;
+    segment.seg_flags = SEGMENT_EXTENT;
+    segment.seg_data = (char*)&desc;
+
+    tuple = store_segment(rel, &segment,
+            GetFreespace(rel, segment.seg_length + sizeof(HeapTupleHeader) + (SEGHDRSZ), 0));
+    ItemPointerCopy(&tuple->t_self, &pipe->head_pointer);
+    ItemPointerCopy(&tuple->t_self, &pipe->tail_pointer);
+    heap_freetuple(tuple);
+
+    path = extent_pending_path(pipe->rel, desc.extent, xid);
+    pipe->extent = FileNameOpenFile(path, O_RDWR | O_CREAT | O_EXCL | O_LARGEFILE, 0600);
+    if ( pipe->extent < 0 ) {
+        elog(ERROR,"begin_extent -- could not create %s: %m", path);
+    }
+    pipe->extent_pos = 0;
+
+    pthread_mutex_lock(&extent_guard);
+    pending = MemoryContextAlloc(extent_cxt, sizeof(pending_extent));
+    pending->xid = xid;
+    pending->pending = MemoryContextStrdup(extent_cxt, path);
+    pfree(path);
+    path = extent_path(pipe->rel, desc.extent);
+    pending->path = MemoryContextStrdup(extent_cxt, path);
+    pending->next = pending_extents;
+    pending_extents = pending;
+    pthread_mutex_unlock(&extent_guard);
+    pfree(path);
+
+    RelationClose(rel);
+}
+
+static void
+flush_extent(write_pipeline* pipe)
+{
+    if ( pipe->stage_fill == 0 ) return;
+
+    if ( FileWriteAt(pipe->extent, pipe->stage + VARHDRSZ, pipe->stage_fill, pipe->extent_pos) != pipe->stage_fill ) {
+        elog(ERROR,"flush_extent -- write failed %s: %m", FileGetName(pipe->extent));
+    }
+    pipe->extent_pos += pipe->stage_fill;
+    pipe->length += pipe->stage_fill;
+    pipe->stage_fill = 0;
+}
+
+static void
+close_extent(write_pipeline* pipe)
+{
+    int     err;
+
+    flush_extent(pipe);
+
+    FilePin(pipe->extent, 0);
+    err = FileSync(pipe->extent);
+    FileUnpin(pipe->extent, 0);
+    if ( err != 0 ) {
+        elog(ERROR,"close_extent -- sync failed %s: %m", FileGetName(pipe->extent));
+    }
+    FileClose(pipe->extent);
+    pipe->extent = -1;
+}
+
+/*
+ *  move the stage on to segments
+ */
+static void
+store_staged_data(write_pipeline* pipe)
+{
+    SETVARSIZE(pipe->stage, pipe->stage_fill + VARHDRSZ);
+    pipeline_segments(pipe, (bytea*)pipe->stage);
+    pipe->stage_fill = 0;
+}
+
+/*
+ *  new blobs are stored once per distinct content in each storage
+ *  relation when the blobdedup property is set
+ */
+static bool
+blob_dedup()
+{
+    if ( dedup_blobs < 0 ) {
+        dedup_blobs = ( PropertyIsValid("blobdedup") && GetBoolProperty("blobdedup") ) ? 1 : 0;
+    }
+    return ( dedup_blobs > 0 && dedup_table != NULL );
+}
+
+static void*
+DedupAlloc(Size size, void* cxt)
+{
+    return MemoryContextAlloc(cxt,size);
+}
+
+static void
+DedupFree(void* pointer, void* cxt)
+{
+    pfree(pointer);
+}
+
+void
+InitBlobStorage()
+{
+    HASHCTL         ctl;
+    MemoryContext   hash_cxt;
+
+    dedup_cxt = AllocSetContextCreate((MemoryContext) NULL,
+                                        "BlobDedupMemoryContext",
+                                        ALLOCSET_DEFAULT_MINSIZE,
+                                        ALLOCSET_DEFAULT_INITSIZE,
+                                        ALLOCSET_DEFAULT_MAXSIZE);
+
+    hash_cxt = AllocSetContextCreate(dedup_cxt,
+                                        "BlobDedupHashCxt",
+                                        ALLOCSET_DEFAULT_MINSIZE,
+                                        ALLOCSET_DEFAULT_INITSIZE,
+                                        ALLOCSET_DEFAULT_MAXSIZE);
+
+    memset(&ctl,0,sizeof(HASHCTL));
+    ctl.keysize = sizeof(DedupKey);
+    ctl.entrysize = sizeof(DedupEntry);
+    ctl.hash = tag_hash;
+    ctl.alloc = DedupAlloc;
+    ctl.free = DedupFree;
+    ctl.hcxt = hash_cxt;
+
+    dedup_table = hash_create("blob dedup hash",1024,&ctl,HASH_ELEM | HASH_ALLOC | HASH_FUNCTION | HASH_CONTEXT);
+    pthread_mutex_init(&dedup_guard,&process_mutex_attr);
+
+    extent_cxt = AllocSetContextCreate((MemoryContext) NULL,
+                                        "BlobExtentMemoryContext",
+                                        ALLOCSET_DEFAULT_MINSIZE,
+                                        ALLOCSET_DEFAULT_INITSIZE,
+                                        ALLOCSET_DEFAULT_MAXSIZE);
+    pthread_mutex_init(&extent_guard,&process_mutex_attr);
+
+    if ( PropertyIsValid("blobdedupentries") ) {
+        dedup_limit = GetIntProperty("blobdedupentries");
+    } else {
+        dedup_limit = 65536;
+    }
+}
+
+static bool
+dedup_lookup(Relation rel, uint8* digest, ItemPointer shared)
+{
+    DedupKey        key;
+    DedupEntry*     entry;
+    bool            found = false;
+
+    MemSet(&key, 0, sizeof(DedupKey));
+    key.relid = RelationGetRelid(rel);
+    key.dbid = GetDatabaseId();
+    memmove(key.digest, digest, SHA256_DIGEST_LENGTH);
+
+    pthread_mutex_lock(&dedup_guard);
+    entry = hash_search(dedup_table, &key, HASH_FIND, &found);
+    if ( found ) ItemPointerCopy(&entry->shared, shared);
+    pthread_mutex_unlock(&dedup_guard);
+
+    return found;
+}
+
+/*
+ *  a newer shared segment replaces the entry, the old one may belong
+ *  to a writer that aborted
+ */
+static void
+dedup_remember(Relation rel, uint8* digest, ItemPointer shared)
+{
+    DedupKey        key;
+    DedupEntry*     entry;
+    bool            found = false;
+
+    MemSet(&key, 0, sizeof(DedupKey));
+    key.relid = RelationGetRelid(rel);
+    key.dbid = GetDatabaseId();
+    memmove(key.digest, digest, SHA256_DIGEST_LENGTH);
+
+    pthread_mutex_lock(&dedup_guard);
+    entry = hash_search(dedup_table, &key, HASH_FIND, &found);
+    if ( !found && dedup_count < dedup_limit ) {
+        entry = hash_search(dedup_table, &key, HASH_ENTER, &found);
+        if ( entry != NULL ) dedup_count++;
+    }
+    if ( entry != NULL ) ItemPointerCopy(shared, &entry->shared);
+    pthread_mutex_unlock(&dedup_guard);
+}
+
+static void
+dedup_forget(Relation rel, uint8* digest, ItemPointer shared)
+{
+    DedupKey        key;
+    DedupEntry*     entry;
+    bool            found = false;
+
+    if ( dedup_table == NULL ) return;
+
+    MemSet(&key, 0, sizeof(DedupKey));
+    key.relid = RelationGetRelid(rel);
+    key.dbid = GetDatabaseId();
+    memmove(key.digest, digest, SHA256_DIGEST_LENGTH);
+
+    pthread_mutex_lock(&dedup_guard);
+    entry = hash_search(dedup_table, &key, HASH_FIND, &found);
+    if ( found && ItemPointerEquals(&entry->shared, shared) ) {
+        hash_search(dedup_table, &key, HASH_REMOVE, &found);
+        dedup_count--;
+    }
+    pthread_mutex_unlock(&dedup_guard);
+}
+
+/*
+ *  take a reference on stored content with this digest.  The shared
+ *  segment has to be visible to this transaction and still referenced,
+ *  once the count drops to zero vacuum is freeing it.
+ */
+static bool
+share_blob(Relation rel, uint8* digest, ItemPointer shared)
+{
+    HeapTupleData   tp;
+    Buffer          buffer;
+    segment_header* seg;
+    bool            taken = false;
+
+    if ( !dedup_lookup(rel, digest, shared) ) return false;
+
+    tp.t_self = *shared;
+    tp.t_info = 0;
+    buffer = RelationGetHeapTuple(rel,&tp);
+    if ( !BufferIsValid(buffer) ) return false;
+
+    LockHeapTuple(rel,buffer,&tp,TUPLE_LOCK_WRITE);
+    if ( HeapTupleSatisfies(rel,buffer,&tp,GetSnapshotQuery(RelationGetSnapshotCxt(rel)),0,NULL) ) {
+        seg = (segment_header*)GETSTRUCT(&tp);
+        if ( SEGSHARED(seg) ) {
+            shared_head* head = (shared_head*)seg->data;
+            if ( head->refs > 0 && memcmp(head->digest, digest, SHA256_DIGEST_LENGTH) == 0 ) {
+                head->refs += 1;
+                taken = true;
+            }
+        }
+    }
+    LockHeapTuple(rel,buffer,&tp,TUPLE_LOCK_UNLOCK);
+
+    if ( taken ) {
+        WriteBuffer(rel, buffer);
+    } else {
+        ReleaseBuffer(rel, buffer);
+    }
+    return taken;
+}
+
+/*
+ *  store the link segment that stands for one use of shared content
+ */
+static void
+link_blob(Relation rel, uint8* digest, ItemPointer shared, ItemPointer link)
+{
+    shared_link         data;
+    blob_segment_data   segment;
+    HeapTuple           tuple;
+
+    ItemPointerCopy(shared, &data.shared);
+    memmove(data.digest, digest, SHA256_DIGEST_LENGTH);
+
+    ItemPointerSetInvalid(&segment.seg_next);
+    segment.seg_length = sizeof(shared_link);
+    segment.seg_blobhead = TRUE;
+    segment.seg_flags = SEGMENT_LINK;
+    segment.seg_data = (char*)&data;
+
+    tuple = store_segment(rel, &segment,
+            GetFreespace(rel, segment.seg_length + sizeof(HeapTupleHeader) + (SEGHDRSZ), 0));
+    ItemPointerCopy(&tuple->t_self, link);
+    heap_freetuple(tuple);
+}
+
+/*
+ *  put the chain just written under a shared segment with one
+ *  reference, held by the link this blob gets
+ */
+static void
+publish_blob(Relation rel, uint8* digest, write_pipeline* pipe)
+{
+    shared_head         data;
+    blob_segment_data   segment;
+    HeapTuple           tuple;
+    ItemPointerData     shared;
+
+    if ( !ItemPointerIsValid(&pipe->head_pointer) ) return;
+
+    memmove(data.digest, digest, SHA256_DIGEST_LENGTH);
+    data.refs = 1;
+
+    ItemPointerCopy(&pipe->head_pointer, &segment.seg_next);
+    segment.seg_length = sizeof(shared_head);
+    segment.seg_blobhead = FALSE;
+    segment.seg_flags = SEGMENT_SHARED;
+    segment.seg_data = (char*)&data;
+
+    tuple = store_segment(rel, &segment,
+            GetFreespace(rel, segment.seg_length + sizeof(HeapTupleHeader) + (SEGHDRSZ), 0));
+    ItemPointerCopy(&tuple->t_self, &shared);
+    heap_freetuple(tuple);
+
+    link_blob(rel, digest, &shared, &pipe->head_pointer);
+    dedup_remember(rel, digest, &shared);
+}
+
+/*
+ *  start reading the blocks of the next segments.  With the chain
+ *  from index_blob the exact blocks are known, otherwise the segments
+ *  are assumed to follow each other on disk the way the write pipeline
+ *  lays them out and a window of blocks from the next one is asked for.
+ *  The window is moved on once the reader is half way through it.
+ */
+static void
+prefetch_segments(read_pipeline* pipe)
+{
+    int         window = blob_read_ahead();
+    SmgrInfo    smgr = pipe->relation->rd_smgr;
+
+    if ( window <= 0 || smgr == NULL || !ItemPointerIsValid(&pipe->tail_pointer) ) return;
+
+    if ( pipe->chain != NULL ) {
+        int     limit = pipe->chain_read + window;
+
+        if ( pipe->chain_ahead < pipe->chain_read ) pipe->chain_ahead = pipe->chain_read;
+        if ( limit > pipe->chain_length ) limit = pipe->chain_length;
+        if ( pipe->chain_ahead - pipe->chain_read > window / 2 ) return;
+
+        while ( pipe->chain_ahead < limit ) {
+            BlockNumber start = ItemPointerGetBlockNumber(&pipe->chain[pipe->chain_ahead++].pointer);
+            int         count = 1;
+
+            while ( pipe->chain_ahead < limit ) {
+                BlockNumber blk = ItemPointerGetBlockNumber(&pipe->chain[pipe->chain_ahead].pointer);
+                if ( blk == start + count - 1 ) {
+                    pipe->chain_ahead++;
+                } else if ( blk == start + count ) {
+                    count++;
+                    pipe->chain_ahead++;
+                } else {
+                    break;
+                }
+            }
+            smgrprefetch(smgr, start, count);
+        }
+    } else {
+        BlockNumber blk = ItemPointerGetBlockNumber(&pipe->tail_pointer);
+        BlockNumber start;
+
+        if ( blk >= pipe->ahead_start && blk < pipe->ahead ) {
+            if ( pipe->ahead - blk > window / 2 ) return;
+            start = pipe->ahead;
+        } else {
+            start = blk;
+            pipe->ahead_start = blk;
+        }
+        pipe->ahead = blk + window;
+        smgrprefetch(smgr, start, pipe->ahead - start);
+    }
+}
+
 HeapTuple
 store_segment(Relation rel, blob_segment segment, BlockNumber limit)
 {
@@ -141,6 +915,7 @@ store_segment(Relation rel, blob_segment segment, BlockNumber limit)
 
 	header = (segment_header *) palloc(structsz);
 	header->length = segment->seg_length;
+        header->length |= segment->seg_flags;
 	header->forward = segment->seg_next;
 	memmove(header->data, segment->seg_data, segment->seg_length);
 	seg_tuple = heap_addheader(3, structsz, (char *) header);
@@ -204,6 +979,9 @@ delete_segment(Relation rel, ItemPointer pointer)
 	}
 
         LockHeapTuple(rel,buffer,&tp,TUPLE_LOCK_WRITE);
+        /*  the page is no longer all visible, vacuum has to visit it to
+         *  reclaim the segment and release its extent or link  */
+        VisibilityMapClear(rel, ItemPointerGetBlockNumber(&tp.t_self));
         tp.t_data->t_xmax = myXID;
 
         tp.t_data->progress.cmd.t_cmax = myCID;
@@ -248,8 +1026,16 @@ get_segment(Relation rel, ItemPointer pointer, bool read_only, char *target, int
 
             	if (MAXALIGN(data) != (Size)data) {
                	    len = -1;
-            	} else if ( data->length > MaxAttrSize ) {
+            	} else if ( SEGLENGTH(data) > MaxAttrSize ) {
                     len = -1;
+           	} else if ( SEGEXTENT(data) ) {
+                    len = EXTENT_LINK;
+           	} else if ( SEGLINK(data) || SEGSHARED(data) ) {
+                    len = SHARED_LINK;
+           	} else if ( SEGCOMPRESSED(data) ) {
+            /*  callers see the uncompressed length  */
+                    memmove(&len, data->data, sizeof(int32));
+                    if ( len <= 0 || len > MaxAttrSize ) len = -1;
            	} else {
                	    len = data->length;
               	}
@@ -260,7 +1046,16 @@ get_segment(Relation rel, ItemPointer pointer, bool read_only, char *target, int
                 return -1;
         }
             
-        if ( (len < 0) ) {
+        if ( len == EXTENT_LINK ) {
+   /*  the caller reads the extent file instead  */
+        } else if ( len == SHARED_LINK ) {
+   /*  a link moves on to its shared segment, that one on to the content  */
+            if ( SEGLINK(data) ) {
+                ItemPointerCopy(&((shared_link*)data->data)->shared, pointer);
+            } else {
+                ItemPointerCopy(&data->forward, pointer);
+            }
+        } else if ( (len < 0) ) {
              blob_log(rel,"get_segment -- inconsistent blob data detected blk: %ld offset: %d",
                         ItemPointerGetBlockNumber(pointer),ItemPointerGetOffsetNumber(pointer));
             len = -1;
@@ -272,12 +1067,21 @@ get_segment(Relation rel, ItemPointer pointer, bool read_only, char *target, int
     *  and return 0
     */
                 len = 0;
-            } else {
+            } else if ( target == NULL ) {
                 ItemPointerCopy(&data->forward, pointer);
-                if ( target != NULL ) {
-                    Assert(data->length == len);
-                    memmove(target, data->data, len);
+            } else if ( SEGCOMPRESSED(data) ) {
+                if ( lzf_decompress(data->data + sizeof(int32), SEGLENGTH(data) - sizeof(int32), target, len) != len ) {
+                    blob_log(rel,"get_segment -- bad compressed segment blk: %ld offset: %d",
+                            ItemPointerGetBlockNumber(pointer),ItemPointerGetOffsetNumber(pointer));
+                    len = -1;
+                    ItemPointerSetInvalid(pointer);
+                } else {
+                    ItemPointerCopy(&data->forward, pointer);
                 }
+            } else {
+                Assert(data->length == len);
+                memmove(target, data->data, len);
+                ItemPointerCopy(&data->forward, pointer);
             }
         }
         
@@ -317,6 +1121,17 @@ open_read_pipeline_blob(Datum pointer, bool read_only) {
     
     pipe->cxt = MemoryContextGetCurrentContext();
 
+    pipe->relation = RelationIdGetRelation(header.relid, DEFAULTDBOID);
+    LockRelation(pipe->relation, AccessShareLock);
+    register_read_pipe(pipe);
+    pipe->ahead_start = 0;
+    pipe->ahead = 0;
+    pipe->chain = NULL;
+    pipe->chain_length = 0;
+    pipe->chain_read = 0;
+    pipe->chain_ahead = 0;
+    pipe->extent = -1;
+
     SETVARSIZE(pipe,sizeof(read_pipeline));
     SETBUFFERED(pipe);
 
@@ -340,6 +1155,18 @@ open_write_pipeline_blob(Relation rel) {
 
     pipe->cxt = MemoryContextGetCurrentContext();
 
+    pipe->stage = NULL;
+    pipe->stage_fill = 0;
+    pipe->stage_size = 0;
+    pipe->extent = -1;
+    pipe->extent_pos = 0;
+    pipe->staging = ( blob_extent_threshold() > 0 || blob_dedup() );
+    pipe->digest = NULL;
+    if ( blob_dedup() ) {
+        pipe->digest = palloc(sizeof(SHA256_CTX));
+        SHA256_Init(pipe->digest);
+    }
+
     SETVARSIZE(pipe,sizeof(write_pipeline));
     SETBUFFERED(pipe);
 
@@ -348,7 +1175,48 @@ open_write_pipeline_blob(Relation rel) {
 
 void
 close_read_pipeline_blob(Datum pointer) {
-    pfree(DatumGetPointer(pointer));
+    read_pipeline* pipe = (read_pipeline*)DatumGetPointer(pointer);
+
+    unregister_read_pipe(pipe);
+    release_read_pipe(pipe);
+    pfree(pipe);
+}
+
+static void
+release_read_pipe(read_pipeline* pipe) {
+    if ( pipe->extent >= 0 ) FileClose(pipe->extent);
+    pipe->extent = -1;
+    UnlockRelation(pipe->relation, AccessShareLock);
+    RelationClose(pipe->relation);
+}
+
+static void
+register_read_pipe(read_pipeline* pipe) {
+    open_pipe*  entry;
+
+    pthread_mutex_lock(&extent_guard);
+    entry = MemoryContextAlloc(extent_cxt, sizeof(open_pipe));
+    entry->xid = GetCurrentTransactionId();
+    entry->pipe = pipe;
+    entry->next = open_pipes;
+    open_pipes = entry;
+    pthread_mutex_unlock(&extent_guard);
+}
+
+static void
+unregister_read_pipe(read_pipeline* pipe) {
+    open_pipe**  setter;
+
+    pthread_mutex_lock(&extent_guard);
+    for (setter = &open_pipes; *setter != NULL; setter = &(*setter)->next) {
+        open_pipe*  entry = *setter;
+        if ( entry->pipe == pipe ) {
+            *setter = entry->next;
+            pfree(entry);
+            break;
+        }
+    }
+    pthread_mutex_unlock(&extent_guard);
 }
 
 Datum 
@@ -357,11 +1225,51 @@ close_write_pipeline_blob(Datum pointer) {
     blob_header* header = (blob_header *) palloc(sizeof(blob_header));
 
     write_pipeline* pipe = (write_pipeline*)DatumGetPointer(pointer);
-    
+    Relation        rel = NULL;
+    uint8           digest[SHA256_DIGEST_LENGTH];
+    ItemPointerData shared;
+    bool            hit = false;
+
+    if ( pipe->digest != NULL ) {
+        SHA256_Final(digest, pipe->digest);
+        pfree(pipe->digest);
+        if ( pipe->length + pipe->stage_fill > 0 ) {
+            rel = RelationIdGetRelation(pipe->rel, DEFAULTDBOID);
+            hit = share_blob(rel, digest, &shared);
+        }
+    }
+
+    if ( pipe->stage != NULL ) {
+        if ( pipe->extent >= 0 ) {
+            close_extent(pipe);
+        } else if ( hit ) {
+    /*  the content is already stored, what is held back is not written  */
+            pipe->length += pipe->stage_fill;
+            pipe->stage_fill = 0;
+        } else if ( pipe->stage_fill > 0 ) {
+            store_staged_data(pipe);
+        }
+        pfree(pipe->stage);
+    }
     if ( VARSIZE(pipe->cache_data) > VARHDRSZ ) {
-        write_pipeline_segment_blob(pointer,NULL);  /*  null means flush the cache to write_pipeline  */
+        if ( hit ) {
+            pipe->length += VARSIZE(pipe->cache_data) - VARHDRSZ;
+        } else {
+            pipeline_segments(pipe,NULL);  /*  null means flush the cache to write_pipeline  */
+        }
     }
 
+    if ( hit ) {
+    /*  whatever was written already is given up  */
+        if ( ItemPointerIsValid(&pipe->head_pointer) ) {
+            delete_blob_segments(rel, &pipe->head_pointer);
+        }
+        link_blob(rel, digest, &shared, &pipe->head_pointer);
+    } else if ( rel != NULL ) {
+        publish_blob(rel, digest, pipe);
+    }
+    if ( rel != NULL ) RelationClose(rel);
+
     header->pointer_length = sizeof(blob_header);
     header->blob_length = pipe->length + VARHDRSZ;
     header->forward_pointer = pipe->head_pointer;
@@ -385,8 +1293,7 @@ read_pipeline_segment_blob(Datum pointer, char* target,int * length, int limit)
     if ( header->cache_data == NULL && !ItemPointerIsValid(&header->tail_pointer) ) return false;
     if ( header->length == header->read ) return false;
         
-    Relation rel = RelationIdGetRelation(header->rel,DEFAULTDBOID);
-    LockRelation(rel,AccessShareLock);
+    Relation rel = header->relation;
 
     while( (limit - count) > 0 ) {
         int pass_lim = limit - count;
@@ -406,6 +1313,20 @@ read_pipeline_segment_blob(Datum pointer, char* target,int * length, int limit)
                 pfree(header->cache_data);
                 header->cache_data = NULL;
            }
+        } else if ( header->extent >= 0 ) {
+/*  extent files are read straight into the target  */
+            int read = FileReadAt(header->extent, target + count, limit - count, header->read + count);
+            if ( read < 0 ) {
+                data_avail = false;
+                blob_log(rel,"read pipeline extent error");
+                ItemPointerSetInvalid(&header->tail_pointer);
+                break;
+            } else if ( read == 0 ) {
+                ItemPointerSetInvalid(&header->tail_pointer);
+                break;
+            }
+            data_avail = true;
+            count += read;
         } else {
 /*  go to disk  */
             if ( !ItemPointerIsValid(&header->tail_pointer) ) {
@@ -413,8 +1334,14 @@ read_pipeline_segment_blob(Datum pointer, char* target,int * length, int limit)
             } else {
                 data_avail = true;
             }
+            prefetch_segments(header);
             int read = get_segment(rel, &header->tail_pointer, header->read_only, (target + count), limit - count);
-            if ( read < 0 ) {
+            if ( read == EXTENT_LINK ) {
+                header->extent = open_extent(rel, &header->tail_pointer, header->read_only);
+                continue;
+            } else if ( read == SHARED_LINK ) {
+                continue;
+            } else if ( read < 0 ) {
                 data_avail = false;
                 blob_log(rel,"read pipeline error");
 		ItemPointerSetInvalid(&header->tail_pointer);
@@ -432,13 +1359,12 @@ read_pipeline_segment_blob(Datum pointer, char* target,int * length, int limit)
                 header->cache_length = read;
             }
             else count += read;
+            header->chain_read++;
         }
     }
     *length = count;
     header->read += count;
     
-    UnlockRelation(rel,AccessShareLock);
-    
     if ( header->read > header->length ) {
         blob_log(rel,"read_pipeline -- inconsistent blob detected read:%d length:%d",header->read,header->length);
         *length = count - (header->read - header->length);
@@ -449,20 +1375,33 @@ read_pipeline_segment_blob(Datum pointer, char* target,int * length, int limit)
         header->read = header->length;
         ItemPointerSetInvalid(&header->tail_pointer);
     }
-    RelationClose(rel);
 
     return data_avail;
 }
 
 bool
 write_pipeline_segment_blob(Datum pointer, bytea * data)
+{
+    write_pipeline * header = (write_pipeline*)DatumGetPointer(pointer);
+
+    if ( data != NULL && header->staging ) {
+        if ( header->digest != NULL ) {
+            SHA256_Update(header->digest, (uint8*)VARDATA(data), VARSIZE(data) - VARHDRSZ);
+        }
+        stage_pipeline_data(header, VARDATA(data), VARSIZE(data) - VARHDRSZ);
+        return true;
+    }
+
+    return pipeline_segments(header, data);
+}
+
+static bool
+pipeline_segments(write_pipeline* header, bytea * data)
 {
     HeapTupleData tp;
     segment_header*  seg;
     ItemPointerData start,end;
     bytea*  send = NULL;
-    
-    write_pipeline * header = (write_pipeline*)DatumGetPointer(pointer);
 
     ItemPointerCopy(&header->head_pointer,&start);
     ItemPointerCopy(&header->tail_pointer,&end);
@@ -571,16 +1510,20 @@ store_blob_segments(Relation rel, bytea * data, ItemPointer start, ItemPointer e
              *  vacuum scan
              */
                 map[counter].seg_blobhead = FALSE;
+                map[counter].seg_flags = 0;
 		map[counter].seg_data = raw + pos;
 		pos += size;
 		map[counter].seg_length = size;
-                limit = GetFreespace(rel,size + sizeof(HeapTupleHeader) + (SEGHDRSZ),limit);
+                compress_segment(&map[counter]);
+                limit = GetFreespace(rel,map[counter].seg_length + sizeof(HeapTupleHeader) + (SEGHDRSZ),limit);
                 storage[counter] = limit;
 	}
 
         map[counter].seg_blobhead = FALSE;
+        map[counter].seg_flags = 0;
 	map[counter].seg_data = raw + pos;
 	map[counter].seg_length = (copylen - pos);
+        compress_segment(&map[counter]);
         storage[counter] = GetFreespace(rel,map[counter].seg_length + sizeof(HeapTupleHeader) + (SEGHDRSZ),limit);
   /* if start is invalid the first segment is the head of the entire blob */      
         if ( !ItemPointerIsValid(start) ) {
@@ -594,6 +1537,7 @@ store_blob_segments(Relation rel, bytea * data, ItemPointer start, ItemPointer e
         for (; counter >= 0; counter--) {   
             ItemPointerCopy(&link, &map[counter].seg_next);     
             HeapTuple       tuple = store_segment(rel, &map[counter], storage[counter]);
+            if ( map[counter].seg_flags & SEGMENT_COMPRESSED ) pfree(map[counter].seg_data);
 /*  the first section saved is actually the tail of the blob */
             if ( !ItemPointerIsValid(end) ) ItemPointerCopy(&tuple->t_self, end);
 
@@ -634,6 +1578,14 @@ rebuild_indirect_blob(Datum item)
 
 	while (ItemPointerIsValid(&link)) {
             int read = get_segment(rel, &link, false, VARDATA(data) + pos, header.blob_length - pos - VARHDRSZ);
+            if ( read == SHARED_LINK ) {
+                continue;
+            } else if ( read == EXTENT_LINK ) {
+                File extent = open_extent(rel, &link, false);
+                read = FileReadAt(extent, VARDATA(data) + pos, header.blob_length - pos - VARHDRSZ, pos);
+                FileClose(extent);
+                ItemPointerSetInvalid(&link);
+            }
             if ( read < 0 ) {
                elog(ERROR,"error rebuilding blob");
             } else if ( read == 0 ) {
@@ -672,6 +1624,12 @@ Datum index_blob(Datum item) {
 	while ( ItemPointerIsValid(&link) ) {
             ItemPointerCopy(&link,&segs[pos].pointer);
             segs[pos++].length = get_segment(rel, &link,true,NULL,BLCKSZ);
+            if ( segs[pos - 1].length == SHARED_LINK ) {
+                pos--;
+                continue;
+            }
+        /*  an extent is a single entry, seek_blob reads it by offset  */
+            if ( segs[pos - 1].length == EXTENT_LINK ) ItemPointerSetInvalid(&link);
             if ( pos == size ) {
                 size *= 2;
                 ret = repalloc(ret,VARHDRSZ + (sizeof(BlobIndex) * size));
@@ -698,6 +1656,13 @@ Datum seek_blob(Relation rel, Datum blob, Datum index, uint32 seek) {
 
 	LockRelation(rel, AccessShareLock);
 
+        if ( pieces > 0 && segs[0].length == EXTENT_LINK ) {
+            ret = open_read_pipeline_blob(blob,true);
+            ((read_pipeline*)DatumGetPointer(ret))->read = seek;
+            UnlockRelation(rel,AccessShareLock);
+            return ret;
+        }
+
 	ItemPointerCopy(&segs[loc].pointer,&link);
 
 	while ( ItemPointerIsValid(&link) && pos + segs[loc].length < seek && loc < pieces) {
@@ -707,6 +1672,10 @@ Datum seek_blob(Relation rel, Datum blob, Datum index, uint32 seek) {
         if ( ItemPointerIsValid(&link) ) {
             ret = open_read_pipeline_blob(blob,true);
             read_pipeline* pipe = (read_pipeline*)DatumGetPointer(ret);
+            /*  the index has to outlive the pipe  */
+            pipe->chain = segs;
+            pipe->chain_length = pieces;
+            pipe->chain_read = loc + 1;
             ItemPointerCopy(&link,&pipe->head_pointer);
             pipe->cache_data = MemoryContextAlloc(pipe->cxt,BLCKSZ);
             pipe->length = get_segment(rel,&link,true,pipe->cache_data,BLCKSZ);
@@ -814,6 +1783,11 @@ vacuum_respan_tuple_blob(Relation rel, HeapTuple tuple, bool exclude_self)
                     RelationClose(storerel);
                     continue;
                 }
+  /*  extents are contiguous already and shared content stays shared  */
+                if ( storerel->rd_id == header.relid && blob_in_place(&header) ) {
+                    RelationClose(storerel);
+                    continue;
+                }
 
                 LockRelation(storerel,AccessShareLock);
 
@@ -990,7 +1964,13 @@ store_tuple_blob(Relation rel, HeapTuple tuple,int16 attnum)
                 ItemPointerSetInvalid(&start);
                 ItemPointerSetInvalid(&end);
                 
-                if ( store_blob_segments(storerel,data,&start,&end) ) {
+                if ( blob_dedup() ) {
+    /*  the write pipeline looks for the same content already stored  */
+                    Datum pipe = open_write_pipeline_blob(storerel);
+                    write_pipeline_segment_blob(pipe, data);
+                    replaces[list->attnum - 1] = 'r';
+                    values[list->attnum - 1] = close_write_pipeline_blob(pipe);
+                } else if ( store_blob_segments(storerel,data,&start,&end) ) {
                     if (storerel->rd_id == rel->rd_id && ItemPointerGetBlockNumber(&start) > limit) {
                         limit = ItemPointerGetBlockNumber(&start);
                         if ( storerel->rd_id != rel->rd_id ) limit = 0;
@@ -1139,6 +2119,276 @@ delete_tuple_blob(Relation rel, HeapTuple tuple, HeapTuple newtup)
     return count;
 }
 
+/*
+ *  give the extent files written by this transaction their real names
+ *  on commit, remove them on abort.  Read pipes the transaction left open
+ *  are released on abort, which runs before the relation cache, the
+ *  locks and the memory of the transaction are reset.  A pipe cannot
+ *  outlive its transaction's memory, so any left at commit are only
+ *  forgotten.
+ */
+void
+AtEOXact_Blobs(bool isCommit)
+{
+    TransactionId       xid;
+    pending_extent**    setter;
+    open_pipe**         pipes;
+    open_pipe*          left = NULL;
+
+    /*  only this thread adds entries for its transaction  */
+    if ( pending_extents == NULL && open_pipes == NULL ) return;
+
+    xid = GetCurrentTransactionId();
+    pthread_mutex_lock(&extent_guard);
+    pipes = &open_pipes;
+    while ( *pipes != NULL ) {
+        open_pipe* entry = *pipes;
+        if ( entry->xid == xid ) {
+            *pipes = entry->next;
+            entry->next = left;
+            left = entry;
+        } else {
+            pipes = &entry->next;
+        }
+    }
+    pthread_mutex_unlock(&extent_guard);
+
+    /*  relation locks are not taken holding extent_guard  */
+    while ( left != NULL ) {
+        open_pipe* entry = left;
+        left = entry->next;
+        if ( !isCommit ) release_read_pipe(entry->pipe);
+        pthread_mutex_lock(&extent_guard);
+        pfree(entry);
+        pthread_mutex_unlock(&extent_guard);
+    }
+
+    if ( pending_extents == NULL ) return;
+
+    pthread_mutex_lock(&extent_guard);
+    setter = &pending_extents;
+    while ( *setter != NULL ) {
+        pending_extent* entry = *setter;
+        if ( entry->xid == xid ) {
+            if ( isCommit ) {
+                if ( rename(entry->pending, entry->path) != 0 && errno != ENOENT ) {
+                    elog(NOTICE,"AtEOXact_Blobs -- could not rename %s: %m", entry->pending);
+                }
+            } else if ( unlink(entry->pending) != 0 && errno != ENOENT ) {
+                elog(NOTICE,"AtEOXact_Blobs -- could not remove %s: %m", entry->pending);
+            }
+            *setter = entry->next;
+            pfree(entry->pending);
+            pfree(entry->path);
+            pfree(entry);
+        } else {
+            setter = &entry->next;
+        }
+    }
+    pthread_mutex_unlock(&extent_guard);
+}
+
+/*
+ *  a pending extent file outlived its writer, keep it if the writer
+ *  committed and remove it if it did not
+ */
+static void
+settle_extent(char* pending, TransactionId xid)
+{
+    char*   path;
+    int     len;
+
+    if ( !TransactionIdDidCommit(xid) ) {
+        if ( TransactionIdIsInProgress(xid) ) return;
+        /*  the writer may have committed since the first look  */
+        if ( !TransactionIdDidCommit(xid) ) {
+            if ( unlink(pending) != 0 && errno != ENOENT ) {
+                elog(NOTICE,"blob extents -- could not remove %s: %m", pending);
+            }
+            return;
+        }
+    }
+    len = strlen(pending) - strlen(".tmp");
+    path = palloc(len + 1);
+    memmove(path, pending, len);
+    path[len] = '\0';
+    if ( rename(pending, path) != 0 && errno != ENOENT ) {
+        elog(NOTICE,"blob extents -- could not rename %s: %m", pending);
+    }
+    pfree(path);
+}
+
+/*
+ *  settle the pending extent files of the connected database, once per
+ *  database for the life of the process
+ */
+void
+SweepBlobExtents(void)
+{
+    Oid             dbid = GetDatabaseId();
+    char*           dbpath;
+    DIR*            dir;
+    struct dirent*  entry;
+    int             i;
+
+    pthread_mutex_lock(&extent_guard);
+    for (i = 0; i < swept_count; i++) {
+        if ( swept_databases[i] == dbid ) break;
+    }
+    if ( i < swept_count ) {
+        pthread_mutex_unlock(&extent_guard);
+        return;
+    }
+    if ( swept_count == swept_max ) {
+        swept_max = ( swept_max == 0 ) ? 16 : swept_max * 2;
+        swept_databases = ( swept_databases == NULL ) ?
+            MemoryContextAlloc(extent_cxt, swept_max * sizeof(Oid)) :
+            repalloc(swept_databases, swept_max * sizeof(Oid));
+    }
+    swept_databases[swept_count++] = dbid;
+    pthread_mutex_unlock(&extent_guard);
+
+    dbpath = GetDatabasePath();
+    dir = opendir(dbpath);
+    if ( dir == NULL ) return;
+    while ( (entry = readdir(dir)) != NULL ) {
+        Oid                 relid, extent;
+        unsigned long long  xid;
+        int                 end = 0;
+
+        if ( sscanf(entry->d_name, "%lu.%lu.%llu.extent.tmp%n", &relid, &extent, &xid, &end) == 3 &&
+                end > 0 && entry->d_name[end] == '\0' ) {
+            char*   pending = palloc(strlen(dbpath) + strlen(entry->d_name) + 2);
+
+            sprintf(pending, "%s%c%s", dbpath, SEP_CHAR, entry->d_name);
+            settle_extent(pending, (TransactionId)xid);
+            pfree(pending);
+        }
+    }
+    closedir(dir);
+}
+
+/*
+ *  the relation is being dropped, its extent files go with it
+ */
+void
+DropBlobExtents(Relation rel)
+{
+    Oid             relid = RelationGetRelid(rel);
+    char*           dbpath = GetDatabasePath();
+    DIR*            dir;
+    struct dirent*  entry;
+
+    dir = opendir(dbpath);
+    if ( dir == NULL ) return;
+    while ( (entry = readdir(dir)) != NULL ) {
+        Oid                 owner, extent;
+        unsigned long long  xid;
+        int                 end = 0;
+        int                 tmpend = 0;
+
+        if ( ( sscanf(entry->d_name, "%lu.%lu.extent%n", &owner, &extent, &end) == 2 && end > 0 && entry->d_name[end] == '\0' ) ||
+                ( sscanf(entry->d_name, "%lu.%lu.%llu.extent.tmp%n", &owner, &extent, &xid, &tmpend) == 3 && tmpend > 0 && entry->d_name[tmpend] == '\0' ) ) {
+            char*   path;
+
+            if ( owner != relid ) continue;
+            path = palloc(strlen(dbpath) + strlen(entry->d_name) + 2);
+            sprintf(path, "%s%c%s", dbpath, SEP_CHAR, entry->d_name);
+            if ( unlink(path) != 0 && errno != ENOENT ) {
+                blob_log(rel,"could not remove extent %s",path);
+            }
+            pfree(path);
+        }
+    }
+    closedir(dir);
+}
+
+/*
+ *  vacuum found a dead blob segment, an extent segment takes its file
+ *  with it.  A dead link is marked released and added to the list,
+ *  returns true when the page was changed.  The reference it held is
+ *  given back by vacuum_release_segment_blobs once the page is unlocked.
+ */
+bool
+vacuum_reap_segment_blob(Relation rel, HeapTuple tuple, List** released)
+{
+    segment_header*     seg = (segment_header*)GETSTRUCT(tuple);
+
+    if ( SEGEXTENT(seg) ) {
+        extent_descriptor   desc;
+        char*               path;
+
+        memmove(&desc, seg->data, sizeof(extent_descriptor));
+        path = extent_path(RelationGetRelid(rel), desc.extent);
+        if ( unlink(path) != 0 && errno != ENOENT ) {
+            blob_log(rel,"could not remove extent %s",path);
+        }
+        pfree(path);
+    /*  a crashed writer can leave the file under its pending name  */
+        path = extent_pending_path(RelationGetRelid(rel), desc.extent, tuple->t_data->t_xmin);
+        if ( unlink(path) != 0 && errno != ENOENT ) {
+            blob_log(rel,"could not remove extent %s",path);
+        }
+        pfree(path);
+    } else if ( SEGLINK(seg) && !SEGRELEASED(seg) ) {
+        shared_link*    link = palloc(sizeof(shared_link));
+
+        memmove(link, seg->data, sizeof(shared_link));
+        seg->length |= SEGMENT_RELEASED;
+        *released = lappend(*released, link);
+        return true;
+    }
+    return false;
+}
+
+/*
+ *  drop the references of released links, content nothing refers to
+ *  anymore is deleted and left for the next vacuum
+ */
+void
+vacuum_release_segment_blobs(Relation rel, List* released)
+{
+    List*   item;
+
+    foreach(item, released) {
+        shared_link*    link = lfirst(item);
+        HeapTupleData   tp;
+        Buffer          buffer;
+        segment_header* seg;
+        int32           refs = -1;
+
+        tp.t_self = link->shared;
+        tp.t_info = 0;
+        buffer = RelationGetHeapTuple(rel,&tp);
+        if ( BufferIsValid(buffer) ) {
+            LockHeapTuple(rel,buffer,&tp,TUPLE_LOCK_WRITE);
+            seg = (segment_header*)GETSTRUCT(&tp);
+            if ( SEGSHARED(seg) ) {
+                shared_head*    head = (shared_head*)seg->data;
+                if ( head->refs > 0 && memcmp(head->digest, link->digest, SHA256_DIGEST_LENGTH) == 0 ) {
+                    refs = --head->refs;
+                }
+            }
+            LockHeapTuple(rel,buffer,&tp,TUPLE_LOCK_UNLOCK);
+            if ( refs < 0 ) {
+                ReleaseBuffer(rel, buffer);
+            } else {
+                WriteBuffer(rel, buffer);
+            }
+        }
+
+        if ( refs < 0 ) {
+            blob_log(rel,"vacuum_release_segment_blobs -- bad shared pointer blk: %ld offset: %d",
+                ItemPointerGetBlockNumber(&link->shared),ItemPointerGetOffsetNumber(&link->shared));
+        } else if ( refs == 0 ) {
+            ItemPointerData pointer = link->shared;
+            dedup_forget(rel, link->digest, &pointer);
+            delete_blob_segments(rel, &pointer);
+        }
+        pfree(link);
+    }
+}
+
 int
 delete_blob_segments(Relation rel, ItemPointer first)
 {
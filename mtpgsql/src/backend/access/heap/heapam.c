@@ -83,6 +83,7 @@
 #include "access/heapam.h"
 #include "access/hio.h"
 #include "env/freespace.h"
+#include "env/visibilitymap.h"
 #include "catalog/catalog.h"
 #include "miscadmin.h"
 #include "storage/smgr.h"
@@ -95,6 +96,8 @@ static Buffer
 NextGenGetTup(Relation relation,
 		   HeapTuple tuple,
 		   Buffer buffer,
+		   BlockNumber startblock,
+		   BlockNumber endblock,
 		   Snapshot snapshot,
 		   int nkeys,
 		   ScanKey key);
@@ -148,6 +151,10 @@ initscan(HeapScanDesc scan,
 		scan->rs_cbuf = InvalidBuffer;
 	}							/* invalid too */
 
+	/* scan the whole relation unless told otherwise */
+	scan->rs_startblock = 0;
+	scan->rs_endblock = InvalidBlockNumber;
+
 	/* we don't have a marked position... */
 	ItemPointerSetInvalid(&(scan->rs_mctid));
 	ItemPointerSetInvalid(&(scan->rs_mcd));
@@ -427,6 +434,28 @@ heap_rescan(HeapScanDesc scan,
 	initscan(scan, scan->rs_rd, scan->rs_nkeys, key);
 }
 
+/* ----------------
+ *		heap_setscanlimits	- restrict a scan to a range of blocks
+ *
+ *		The scan is repositioned to the start of the range, so this can
+ *		be used to walk a relation in pieces with a single descriptor.
+ * ----------------
+ */
+void
+heap_setscanlimits(HeapScanDesc scan, BlockNumber startblock, BlockNumber numblocks)
+{
+	unpinscan(scan);
+
+	scan->rs_ctup.t_datamcxt = NULL;
+	scan->rs_ctup.t_datasrc = NULL;
+	scan->rs_ctup.t_info = 0;
+	scan->rs_ctup.t_data = NULL;
+	scan->rs_cbuf = InvalidBuffer;
+
+	scan->rs_startblock = startblock;
+	scan->rs_endblock = startblock + numblocks;
+}
+
 /* ----------------
  *		heap_endscan	- end relation scan
  *
@@ -545,6 +574,8 @@ heap_getnext(HeapScanDesc scandesc)
         scan->rs_cbuf = NextGenGetTup(scan->rs_rd,
                            &(scan->rs_ctup),
                            scan->rs_cbuf,
+                           scan->rs_startblock,
+                           scan->rs_endblock,
                            scan->rs_snapshot,
                            scan->rs_nkeys,
                            scan->rs_key);
@@ -758,6 +789,7 @@ heap_delete(Relation relation, ItemPointer tid, ItemPointer ctid, Snapshot snaps
 	}
 
 	xid = GetCurrentTransactionId();
+	VisibilityMapClear(relation, ItemPointerGetBlockNumber(&tp.t_self));
 
 	/* store transaction information of xact deleting the tuple */
 	if ( tp.t_data->t_infomask & HEAP_MOVED_IN ) {
@@ -823,6 +855,7 @@ heap_update(Relation relation, ItemPointer otid, HeapTuple newtup,
 	/* XXX order problems if not atomic assignment ??? */
 	newtup->t_data->t_oid = oldtup.t_data->t_oid;
 	xid = GetCurrentTransactionId();
+	VisibilityMapClear(relation, ItemPointerGetBlockNumber(&oldtup.t_self));
 
 	newtup->t_data->t_xmin = xid;
 	newtup->t_data->progress.cmd.t_cmin = GetCurrentCommandId();	
@@ -1020,6 +1053,8 @@ static Buffer
 NextGenGetTup(Relation relation,
 		   HeapTuple tuple,
 		   Buffer target,
+		   BlockNumber startblock,
+		   BlockNumber endblock,
 		   Snapshot snapshot,
 		   int nkeys,
 		   ScanKey key)
@@ -1049,9 +1084,12 @@ NextGenGetTup(Relation relation,
         
         Assert(total_pages != InvalidBlockNumber);
 
+        if (endblock < total_pages)
+                total_pages = endblock;
+
         if (!ItemPointerIsValid(tid))
         {
-                page = 0;			/* first page */
+                page = startblock;			/* first page */
                 lineoff = FirstOffsetNumber;		/* first offnum */
         }
         else
@@ -20,6 +20,7 @@
 #include "env/env.h"
 #include "storage/localbuf.h"
 #include "env/freespace.h"
+#include "env/visibilitymap.h"
 #include "access/heapam.h"
 #include "access/hio.h"
 #include "access/blobstorage.h"
@@ -78,6 +79,7 @@ RelationPutHeapTuple(Relation relation,
 	ItemPointerSet(&tuple->t_self, BufferGetBlockNumber(buffer), offnum);
 	ItemPointerSet(&tuple->t_data->t_ctid, BufferGetBlockNumber(buffer), offnum);
 
+	VisibilityMapClear(relation, BufferGetBlockNumber(buffer));
 }
 
 BlockNumber
@@ -171,6 +173,7 @@ manager may be old and incorrect.   MKS 12.31.2001
                     ItemPointerSet(&((HeapTupleHeader)item)->t_ctid, lastblock, offnum);
                     ItemPointerSet(&tuple->t_self, lastblock, offnum);	
                     ItemPointerSet(&tuple->t_data->t_ctid, lastblock, offnum);	
+                    VisibilityMapClear(relation, lastblock);
                 }
 
                 LockBuffer(relation, buffer, BUFFER_LOCK_UNLOCK);
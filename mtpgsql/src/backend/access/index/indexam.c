@@ -220,14 +220,14 @@ index_delete(Relation relation, ItemPointer indexItem)
 	fmgr(procedure, relation, indexItem);
 }
 
-TupleCount index_bulkdelete(Relation relation,int delcount, ItemPointerData* del_heappointers)
+TupleCount index_bulkdelete(Relation relation,int delcount, TidStore deadtids)
 {
 	RegProcedure procedure;
 
 	RELATION_CHECKS;
 	GET_REL_PROCEDURE(bulkdelete, ambulkdelete);
 
-	return (TupleCount)DatumGetLong(fmgr(procedure, relation, delcount, del_heappointers));
+	return (TupleCount)DatumGetLong(fmgr(procedure, relation, delcount, deadtids));
 }
 
 /* ----------------
@@ -79,6 +79,8 @@ static void _bt_pgaddtup(Relation rel, Page page,
 			 OffsetNumber itup_off, const char *where);
 static bool _bt_isequal(TupleDesc itupdesc, Page page, OffsetNumber offnum,
 			int keysz, ScanKey scankey);
+static bool _bt_dedup(Relation rel, Buffer buf);
+static bool _bt_heaptid_isdead(Relation heaprel, ItemPointer pointer);
 static int _bt_processqueue(Relation rel, void* spool);
 
 InsertIndexResult
@@ -493,6 +495,18 @@ _bt_insertonpg(Relation rel,
 			newitemoff = _bt_binsrch(rel, page, keysz, scankey);
 	}
 
+	/*
+	 * On a full leaf page of a non-unique index, first try to make room by
+	 * folding runs of equal keys into posting lists.  That moves items
+	 * around on the page, so find the insert position again.
+	 */
+	if (PageGetFreeSpace(page) < itemsz && P_ISLEAF(lpageop) && afteritem == 0 &&
+		!IndexPropIsUnique(IndexProperties(RelationGetRelid(rel))) &&
+		_bt_dedup(rel, buf))
+	{
+		newitemoff = _bt_binsrch(rel, page, keysz, scankey);
+	}
+
 	/*
 	 * Do we need to split the page to fit the item on it?
 	 *
@@ -690,6 +704,7 @@ _bt_split(Relation rel, Buffer buf, OffsetNumber firstright,
 	Size		itemsz;
 	ItemId		itemid;
 	BTItem		item;
+	BTItem		hikeycopy = NULL;
 	OffsetNumber leftoff,
 				rightoff;
 	OffsetNumber maxoff;
@@ -781,10 +796,20 @@ _bt_split(Relation rel, Buffer buf, OffsetNumber firstright,
 		item = (BTItem) PageGetItem(orig_leftpage, itemid);
 	}
 //	lhikey = item;
+
+	/* the high key only needs the key, not a posting list */
+	if (BTItemIsPosting(item))
+	{
+		hikeycopy = _bt_formitem(&(item->bti_itup));
+		item = hikeycopy;
+		itemsz = IndexTupleDSize(item->bti_itup);
+	}
                        
 	if (PageAddItem(leftpage, (Item) item, itemsz, leftoff,
 					LP_USED) == InvalidOffsetNumber)
         elog(FATAL, "btree: failed to add hikey to the left sibling");
+	if (hikeycopy != NULL)
+		pfree(hikeycopy);
 	leftoff = OffsetNumberNext(leftoff);
 
 	/*
@@ -1989,6 +2014,156 @@ _bt_isequal(TupleDesc itupdesc, Page page, OffsetNumber offnum,
 	return true;
 }
 
+/*
+ *	_bt_dedup() -- fold runs of equal keys on a leaf page into posting lists.
+ *
+ *		Called by _bt_insertonpg before it splits a full leaf page of a
+ *		non-unique index.  The page is rebuilt on a temp page and copied
+ *		back, like _bt_split does; we hold the write lock throughout.  The
+ *		heap TIDs of a run keep their page order inside the posting list,
+ *		and since items only ever move left a stopped scan can still find
+ *		its position again in _bt_restscan.
+ *
+ *		Returns true if anything was merged.
+ */
+static bool
+_bt_dedup(Relation rel, Buffer buf)
+{
+	Page		page = BufferGetPage(buf);
+	BTPageOpaque opaque = (BTPageOpaque) PageGetSpecialPointer(page);
+	Page		newpage;
+	OffsetNumber offnum,
+				maxoff,
+				newoff;
+	ItemId		itemid;
+	BTItem		item;
+	BTItem		base = NULL;
+	Size		basesz = 0;
+	ItemPointer tids;
+	int			ntids = 0;
+	int			nitems = 0;
+	int			total = 0;
+	bool		merged = false;
+
+	maxoff = PageGetMaxOffsetNumber(page);
+
+	for (offnum = P_FIRSTDATAKEY(opaque); offnum <= maxoff; offnum = OffsetNumberNext(offnum))
+	{
+		item = (BTItem) PageGetItem(page, PageGetItemId(page, offnum));
+		total += BTItemGetNTids(item);
+	}
+	if (total < 2)
+		return false;
+
+	tids = (ItemPointer) palloc(total * sizeof(ItemPointerData));
+	newpage = PageGetTempPage(page, sizeof(BTPageOpaqueData));
+	newoff = P_HIKEY;
+
+	if (!P_RIGHTMOST(opaque))
+	{
+		itemid = PageGetItemId(page, P_HIKEY);
+		item = (BTItem) PageGetItem(page, itemid);
+		_bt_pgaddtup(rel, newpage, ItemIdGetLength(itemid), item, newoff, "dedup page");
+		newoff = OffsetNumberNext(newoff);
+	}
+
+	for (offnum = P_FIRSTDATAKEY(opaque); offnum <= maxoff + 1; offnum = OffsetNumberNext(offnum))
+	{
+		int			n = 0;
+		int			i;
+
+		item = NULL;
+		if (offnum <= maxoff)
+		{
+			item = (BTItem) PageGetItem(page, PageGetItemId(page, offnum));
+			n = BTItemGetNTids(item);
+		}
+
+		/* extend the current run if the key matches and it still fits */
+		if (item != NULL && base != NULL && _bt_keysequal(base, item) &&
+			basesz + (ntids + n) * sizeof(ItemPointerData) <= BTMaxPostingSize)
+		{
+			for (i = 0; i < n; i++)
+				tids[ntids++] = *BTItemGetHeapTid(item, i);
+			nitems++;
+			continue;
+		}
+
+		/* close out the current run */
+		if (base != NULL)
+		{
+			if (nitems > 1)
+			{
+				BTItem		posting = _bt_formposting(base, tids, ntids);
+
+				_bt_pgaddtup(rel, newpage, IndexTupleDSize(posting->bti_itup),
+							 posting, newoff, "dedup page");
+				pfree(posting);
+				merged = true;
+			}
+			else
+			{
+				_bt_pgaddtup(rel, newpage, IndexTupleDSize(base->bti_itup),
+							 base, newoff, "dedup page");
+			}
+			newoff = OffsetNumberNext(newoff);
+		}
+
+		if (item == NULL)
+			break;
+
+		/* start a new run */
+		base = item;
+		basesz = MAXALIGN(_bt_keysize(item));
+		ntids = 0;
+		for (i = 0; i < n; i++)
+			tids[ntids++] = *BTItemGetHeapTid(item, i);
+		nitems = 1;
+	}
+
+	pfree(tids);
+
+	if (!merged)
+	{
+		pfree(newpage);
+		return false;
+	}
+
+	PageRestoreTempPage(newpage, page);
+	return true;
+}
+
+/*
+ * _bt_heaptid_isdead - true if a leaf TID no longer points at a used
+ * heap line pointer.
+ */
+static bool
+_bt_heaptid_isdead(Relation heaprel, ItemPointer pointer)
+{
+	bool		dead = false;
+	Buffer		heapbuffer = ReadBuffer(heaprel, ItemPointerGetBlockNumber(pointer));
+
+	if (!BufferIsValid(heapbuffer)) {
+		dead = true;
+	} else {
+		LockBuffer(heaprel, heapbuffer, BUFFER_LOCK_SHARE);
+		Page heapPage = BufferGetPage(heapbuffer);
+
+		if (ItemPointerGetOffsetNumber(pointer) <= PageGetMaxOffsetNumber(heapPage)) {
+			ItemId heapitem = PageGetItemId(heapPage, ItemPointerGetOffsetNumber(pointer));
+			if (!ItemIdIsUsed(heapitem)) {
+				dead = true;
+			}
+		} else {
+			dead = true;
+		}
+		LockBuffer(heaprel, heapbuffer, BUFFER_LOCK_UNLOCK);
+		ReleaseBuffer(heaprel, heapbuffer);
+	}
+
+	return dead;
+}
+
 bool
 _bt_validate_node(Relation rel, BlockNumber block) {
     bool changed,empty;
@@ -2074,25 +2249,12 @@ _bt_validate_leaf(Relation rel, BlockNumber block) {
             bool deleteit = false;
 
             BTItem item = (BTItem) PageGetItem(page, PageGetItemId(page, current));
-            ItemPointer pointer = &item->bti_itup.t_tid;
-            Buffer heapbuffer = ReadBuffer(heaprel, ItemPointerGetBlockNumber(pointer));
-
-            if (!BufferIsValid(heapbuffer)) {
-                deleteit = true;
-            } else {
-                LockBuffer(heaprel, heapbuffer, BUFFER_LOCK_SHARE);
-                Page heapPage = BufferGetPage(heapbuffer);
+            int post;
 
-                if (ItemPointerGetOffsetNumber(pointer) <= PageGetMaxOffsetNumber(heapPage)) {
-                    ItemId heapitem = PageGetItemId(heapPage, ItemPointerGetOffsetNumber(pointer));
-                    if (!ItemIdIsUsed(heapitem)) {
-                        deleteit = true;
-                    }
-                } else {
-                    deleteit = true;
-                }
-                LockBuffer(heaprel, heapbuffer, BUFFER_LOCK_UNLOCK);
-                ReleaseBuffer(heaprel, heapbuffer);
+            /*  a posting list goes only when none of its heap tuples are left  */
+            deleteit = true;
+            for (post = 0; post < BTItemGetNTids(item) && deleteit; post++) {
+                deleteit = _bt_heaptid_isdead(heaprel, BTItemGetHeapTid(item, post));
             }
 
             if (deleteit) {
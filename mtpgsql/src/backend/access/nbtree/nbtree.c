@@ -18,6 +18,7 @@
  *-------------------------------------------------------------------------
  */
 
+#include <pthread.h>
 
 #include "postgres.h"
 
@@ -34,6 +35,8 @@
 #include "env/poolsweep.h"
 #include "env/delegatedscan.h"
 #include "env/freespace.h"
+#include "env/dolhelper.h"
+#include "env/properties.h"
 #include "utils/syscache.h"
 
 /* Working state for btbuild and its callback */
@@ -45,17 +48,62 @@ typedef struct {
     BTSpool * spool;
     BTSpool * dead_spool;
     TupleCount indtuples;
+    Relation index;
+    int natts;
+    AttrNumber *attnum;
+    FuncIndexInfo *finfo;
+    Datum *attdata;
+    char *nulls;
+    TransactionId cxid;
+    MemoryContext spool_cxt;
 } BTBuildState;
 
+/*
+ * Parallel build.  The heap is handed out in chunks of
+ * BTBUILD_CHUNK_BLOCKS to the main thread and up to BTBUILD_MAX_WORKERS
+ * DOL helpers.  Each one spools and sorts what it scanned, the sorted
+ * runs of the helpers are merged by _bt_load in the main thread.
+ */
+#define BTBUILD_MAX_WORKERS     4
+#define BTBUILD_CHUNK_BLOCKS    64
+#define BTBUILD_MIN_BLOCKS      1024
+
+typedef struct BTBuildShared BTBuildShared;
+
+typedef struct {
+    BTBuildShared *shared;
+    BTExchange *xchg;
+    TupleCount reltuples;
+    TupleCount indtuples;
+} BTBuildWorker;
+
+struct BTBuildShared {
+    pthread_mutex_t guard;
+    Oid heapid;
+    Relation index;
+    int natts;
+    AttrNumber *attnum;
+    FuncIndexInfo *finfo;
+    bool isUnique;
+    TransactionId cxid;
+    BlockNumber nblocks;
+    BlockNumber nextblock; /* protected by guard */
+    int nworkers;
+    BTBuildWorker workers[BTBUILD_MAX_WORKERS];
+};
+
 
 #define BuildingBtree 	GetIndexGlobals()->BuildingBtree
 
 static BlockNumber
 _bt_check_pagelinks(Relation rel, BlockNumber target);
 
-static int
-cmp_itemptr(const void *left, const void *right);
 static void _bt_restscan(IndexScanDesc scan);
+static void _bt_buildtuple(BTBuildState *buildstate, HeapTuple htup);
+static bool _bt_buildclaim(BTBuildShared *shared, BlockNumber *start, BlockNumber *count);
+static TupleCount _bt_buildscanchunks(BTBuildState *buildstate, BTBuildShared *shared);
+static void *_bt_buildworker(void *arg);
+static BTBuildShared *_bt_buildlaunch(Relation heap, BTBuildState *buildstate);
 static void btbuildCallback(Relation index,
         HeapTuple htup,
         Datum *attdata,
@@ -77,13 +125,313 @@ AtEOXact_nbtree(void) {
     BuildingBtree = false;
 }
 
+/*
+ * _bt_buildtuple() -- index one heap tuple of a build.
+ *
+ *		Forms the index tuple and either spools it or, when the fast
+ *		build is off, inserts it into the tree.  Called in a per tuple
+ *		context, spooled memory is allocated in buildstate->spool_cxt.
+ */
+static void
+_bt_buildtuple(BTBuildState *buildstate, HeapTuple htup) {
+    TupleDesc htupdesc = RelationGetDescr(buildstate->heapRel);
+    TupleDesc itupdesc = RelationGetDescr(buildstate->index);
+    IndexTuple itup;
+    BTItem btitem;
+    InsertIndexResult res = NULL;
+    MemoryContext old;
+    int i;
+
+    /*
+     * For the current heap tuple, extract all the attributes we use
+     * in this index, and note which are null.
+     */
+
+    for (i = 1; i <= buildstate->natts; i++) {
+        int attoff;
+        bool attnull;
+
+        /*
+         * Offsets are from the start of the tuple, and are
+         * zero-based; indices are one-based.  The next call returns i
+         * - 1.  That's data hiding for you.
+         */
+
+        attoff = AttrNumberGetAttrOffset(i);
+        buildstate->attdata[attoff] = GetIndexValue(htup,
+                htupdesc,
+                attoff,
+                buildstate->attnum,
+                buildstate->finfo,
+                &attnull);
+        buildstate->nulls[attoff] = (attnull ? 'n' : ' ');
+    }
+
+    /* form an index tuple and point it at the heap tuple */
+    itup = index_formtuple(itupdesc, buildstate->attdata, buildstate->nulls);
+    /*
+     * If the single index key is null, we don't insert it into the
+     * index.  Btrees support scans on <, <=, =, >=, and >. Relational
+     * algebra says that A op B (where op is one of the operators
+     * above) returns null if either A or B is null.  This means that
+     * no qualification used in an index scan could ever return true
+     * on a null attribute.  It also means that indices can't be used
+     * by ISNULL or NOTNULL scans, but that's an artifact of the
+     * strategy map architecture chosen in 1986, not of the way nulls
+     * are handled here.
+     */
+
+    /*
+     * New comments: NULLs handling. While we can't do NULL
+     * comparison, we can follow simple rule for ordering items on
+     * btree pages - NULLs greater NOT_NULLs and NULL = NULL is TRUE.
+     * Sure, it's just rule for placing/finding items and no more -
+     * keytest'll return FALSE for a = 5 for items having 'a' isNULL.
+     * Look at _bt_skeycmp, _bt_compare and _bt_itemcmp for how it
+     * works.				 - vadim 03/23/97
+     *
+     * if (itup->t_info & INDEX_NULL_MASK) { pfree(itup); continue; }
+     */
+
+    itup->t_tid = htup->t_self;
+    btitem = _bt_formitem(itup);
+
+    /*
+     * if we are doing bottom-up btree build, we insert the index into
+     * a spool file for subsequent processing.	otherwise, we insert
+     * into the btree.
+     */
+    /* switch back to build context 
+            so that any memory created during 
+            spooling is persistent until 
+            build is done.
+     */
+    old = MemoryContextSwitchTo(buildstate->spool_cxt);
+    if (buildstate->usefast) {
+        if (buildstate->isUnique) {
+            HTSV_Result isAlive = HeapTupleSatisfiesVacuum(htup->t_data, buildstate->cxid);
+            switch (isAlive) {
+                case HEAPTUPLE_STILLBORN:
+                case HEAPTUPLE_RECENTLY_DEAD:
+                case HEAPTUPLE_DEAD:
+                    _bt_spool(btitem, buildstate->dead_spool);
+                    buildstate->hasDead = true;
+                    break;
+                case HEAPTUPLE_LIVE:
+                    _bt_spool(btitem, buildstate->spool);
+                    break;
+                case HEAPTUPLE_INSERT_IN_PROGRESS:
+                    _bt_spool(btitem, buildstate->dead_spool);
+                    buildstate->hasDead = true;
+                    break;
+                case HEAPTUPLE_DELETE_IN_PROGRESS:
+                    _bt_spool(btitem, buildstate->spool);
+                    break;
+                default:
+                    elog(ERROR, "heap is in inconsistent state %d", isAlive);
+                    break;
+            }
+        } else {
+            _bt_spool(btitem, buildstate->spool);
+        }
+    } else {
+        res = _bt_doinsert(buildstate->index, btitem, buildstate->isUnique, buildstate->heapRel);
+    }
+    MemoryContextSwitchTo(old);
+
+    pfree(btitem);
+    pfree(itup);
+    if (res)
+        pfree(res);
+}
+
+/*
+ * _bt_buildclaim() -- hand out the next chunk of heap blocks to scan.
+ *
+ *		The last chunk runs to the end of the relation so pages added
+ *		after the block count was taken are not missed.
+ */
+static bool
+_bt_buildclaim(BTBuildShared *shared, BlockNumber *start, BlockNumber *count) {
+    bool claimed = false;
+
+    pthread_mutex_lock(&shared->guard);
+    if (shared->nextblock < shared->nblocks) {
+        *start = shared->nextblock;
+        if (shared->nblocks - shared->nextblock > BTBUILD_CHUNK_BLOCKS) {
+            *count = BTBUILD_CHUNK_BLOCKS;
+        } else {
+            *count = InvalidBlockNumber - *start;
+        }
+        shared->nextblock += BTBUILD_CHUNK_BLOCKS;
+        claimed = true;
+    }
+    pthread_mutex_unlock(&shared->guard);
+
+    return claimed;
+}
+
+/*
+ * _bt_buildscanchunks() -- spool heap chunks until none are left.
+ *
+ *		Runs in the main thread and in every build worker.  Returns the
+ *		number of heap tuples seen.
+ */
+static TupleCount
+_bt_buildscanchunks(BTBuildState *buildstate, BTBuildShared *shared) {
+    HeapScanDesc hscan;
+    HeapTuple htup;
+    BlockNumber start;
+    BlockNumber count;
+    TupleCount reltuples = 0;
+    MemoryContext scan_cxt = SubSetContextCreate(buildstate->spool_cxt, "BuildScanContext");
+
+    hscan = heap_beginscan(buildstate->heapRel, SnapshotAny, 0, (ScanKey) NULL);
+
+    while (_bt_buildclaim(shared, &start, &count)) {
+        heap_setscanlimits(hscan, start, count);
+        while (HeapTupleIsValid(htup = heap_getnext(hscan))) {
+            reltuples++;
+
+            if (CheckForCancel()) {
+                elog(ERROR, "Query Cancelled");
+            }
+
+            MemoryContextResetAndDeleteChildren(scan_cxt);
+            MemoryContextSwitchTo(scan_cxt);
+
+            buildstate->indtuples++;
+
+            _bt_buildtuple(buildstate, htup);
+        }
+    }
+
+    heap_endscan(hscan);
+    MemoryContextSwitchTo(buildstate->spool_cxt);
+
+    return reltuples;
+}
+
+/*
+ * _bt_buildworker() -- body of a build worker run by a DOL helper.
+ *
+ *		The heap is opened again by the helper, the index relation of the
+ *		main thread is only read.  The sorted spools are handed to the
+ *		main thread through the worker's exchange, the helper stays here
+ *		until the main thread has merged all of them.
+ */
+static void *
+_bt_buildworker(void *arg) {
+    BTBuildWorker *worker = (BTBuildWorker *) arg;
+    BTBuildShared *shared = worker->shared;
+    BTBuildState buildstate;
+    Relation heap = heap_open(shared->heapid, AccessShareLock);
+
+    buildstate.usefast = true;
+    buildstate.isUnique = shared->isUnique;
+    buildstate.hasDead = false;
+    buildstate.heapRel = heap;
+    buildstate.indtuples = 0;
+    buildstate.index = shared->index;
+    buildstate.natts = shared->natts;
+    buildstate.attnum = shared->attnum;
+    buildstate.finfo = shared->finfo;
+    buildstate.attdata = (Datum *) palloc(shared->natts * sizeof (Datum));
+    buildstate.nulls = (char *) palloc(shared->natts * sizeof (char));
+    buildstate.cxid = shared->cxid;
+    buildstate.spool_cxt = MemoryContextGetCurrentContext();
+
+    /* uniqueness is checked when the main thread merges the runs */
+    buildstate.spool = _bt_spoolinit(shared->index, false);
+    buildstate.dead_spool = (shared->isUnique) ? _bt_spoolinit(shared->index, false) : NULL;
+
+    worker->reltuples = _bt_buildscanchunks(&buildstate, shared);
+    worker->indtuples = buildstate.indtuples;
+
+    heap_close(heap, AccessShareLock);
+
+    _bt_spoolexport(worker->xchg, buildstate.spool,
+            (buildstate.hasDead) ? buildstate.dead_spool : NULL);
+
+    _bt_spooldestroy(buildstate.spool);
+    if (buildstate.dead_spool)
+        _bt_spooldestroy(buildstate.dead_spool);
+
+    return NULL;
+}
+
+/*
+ * _bt_buildlaunch() -- start build workers for a large heap.
+ *
+ *		Returns NULL when the heap is too small or no DOL helper is
+ *		free, the caller then does a serial build.  The number of
+ *		workers is taken from the indexbuildworkers property.
+ */
+static BTBuildShared *
+_bt_buildlaunch(Relation heap, BTBuildState *buildstate) {
+    BTBuildShared *shared;
+    BlockNumber nblocks = RelationGetNumberOfBlocks(heap);
+    int nworkers = BTBUILD_MAX_WORKERS;
+    int i;
+
+    if (nblocks < BTBUILD_MIN_BLOCKS)
+        return NULL;
+
+    if (PropertyIsValid("indexbuildworkers")) {
+        nworkers = GetIntProperty("indexbuildworkers");
+        if (nworkers > BTBUILD_MAX_WORKERS)
+            nworkers = BTBUILD_MAX_WORKERS;
+    }
+    if (nworkers <= 0)
+        return NULL;
+
+    shared = (BTBuildShared *) palloc(sizeof (BTBuildShared));
+    MemSet(shared, 0, sizeof (BTBuildShared));
+    pthread_mutex_init(&shared->guard, NULL);
+    shared->heapid = RelationGetRelid(heap);
+    shared->index = buildstate->index;
+    shared->natts = buildstate->natts;
+    shared->attnum = buildstate->attnum;
+    shared->finfo = buildstate->finfo;
+    shared->isUnique = buildstate->isUnique;
+    shared->cxid = buildstate->cxid;
+    shared->nblocks = nblocks;
+    shared->nextblock = 0;
+    shared->nworkers = 0;
+
+    for (i = 0; i < nworkers; i++) {
+        DolConnection conn = GetDolConnection();
+        BTBuildWorker *worker;
+
+        if (conn == NULL)
+            break;
+
+        worker = &shared->workers[shared->nworkers++];
+        worker->shared = shared;
+        worker->xchg = _bt_exchangeinit(conn);
+        worker->reltuples = 0;
+        worker->indtuples = 0;
+
+        ProcessDolCommand(conn, _bt_buildworker, worker);
+    }
+
+    if (shared->nworkers == 0) {
+        pthread_mutex_destroy(&shared->guard);
+        pfree(shared);
+        return NULL;
+    }
+
+    return shared;
+}
+
 /*
  *	btbuild() -- build a new btree index.
  *
  *		We use a global variable to record the fact that we're creating
  *		a new index.  This is used to avoid high-concurrency locking,
  *		since the index won't be visible until this transaction commits
- *		and since building is guaranteed to be single-threaded.
+ *		and since only the building thread writes to the tree.  Build
+ *		workers started by _bt_buildlaunch only scan the heap and sort.
  */
 Datum
 btbuild(Relation heap, Relation index, int natts,
@@ -92,20 +440,10 @@ btbuild(Relation heap, Relation index, int natts,
     HeapScanDesc hscan;
     HeapTuple htup;
 
-    IndexTuple itup;
-    TupleDesc htupdesc,
-            itupdesc;
     Datum * attdata = NULL;
     char * nulls = NULL;
-    InsertIndexResult res = 0;
-    int i;
-    BTItem btitem;
     TupleCount reltuples = 0;
 
-    HTSV_Result isAlive = HEAPTUPLE_LIVE;
-    TransactionId cxid = InvalidTransactionId;
-
-
     MemoryContext parent = MemoryContextGetCurrentContext();
     MemoryContext build_context = AllocSetContextCreate(parent,
             "NbtBuildContext",
@@ -116,8 +454,6 @@ btbuild(Relation heap, Relation index, int natts,
 
     MemoryContextSwitchTo(build_context);
 
-    cxid = GetCurrentTransactionId();
-
 #ifndef OMIT_PARTIAL_INDEX
     ExprContext * econtext = (ExprContext *) NULL;
     TupleTableSlot * slot = (TupleTableSlot *) NULL;
@@ -127,14 +463,11 @@ btbuild(Relation heap, Relation index, int natts,
             *oldPred = predInfo->oldPred;
 
     BTBuildState buildstate;
+    BTBuildShared *shared = NULL;
 
     /* set flag to disable locking */
     BuildingBtree = true;
 
-    /* get tuple descriptors for heap and index relations */
-    htupdesc = RelationGetDescr(heap);
-    itupdesc = RelationGetDescr(index);
-
     /* get space for data items that'll appear in the index tuple */
     attdata = (Datum *) palloc(natts * sizeof (Datum));
     nulls = (char *) palloc(natts * sizeof (char));
@@ -151,6 +484,14 @@ btbuild(Relation heap, Relation index, int natts,
     buildstate.spool = NULL;
     buildstate.dead_spool = NULL;
     buildstate.indtuples = 0;
+    buildstate.index = index;
+    buildstate.natts = natts;
+    buildstate.attnum = attnum;
+    buildstate.finfo = finfo;
+    buildstate.attdata = attdata;
+    buildstate.nulls = nulls;
+    buildstate.cxid = GetCurrentTransactionId();
+    buildstate.spool_cxt = build_context;
 
 #ifdef BTREE_BUILD_STATS
     if (log_btree_build_stats)
@@ -173,149 +514,80 @@ btbuild(Relation heap, Relation index, int natts,
         if (buildstate.isUnique) buildstate.dead_spool = _bt_spoolinit(index, false);
     }
 
+    /*
+     * Large heaps without a predicate are scanned and sorted by several
+     * threads at once, see _bt_buildlaunch.
+     */
+    if (buildstate.usefast && pred == NULL && oldPred == NULL &&
+            GetIndexGlobals()->DelegatedIndexBuild) {
+        shared = _bt_buildlaunch(heap, &buildstate);
+    }
 
-    hscan = heap_beginscan(heap, SnapshotAny, 0, (ScanKey) NULL);
-
-    while (HeapTupleIsValid(htup = heap_getnext(hscan))) {
-        reltuples++;
+    if (shared != NULL) {
+        int i;
 
-        CheckForCancel();
+        reltuples = _bt_buildscanchunks(&buildstate, shared);
 
-        MemoryContextResetAndDeleteChildren(scan_cxt);
-        MemoryContextSwitchTo(scan_cxt);
-        /*
-         * If oldPred != NULL, this is an EXTEND INDEX command, so skip
-         * this tuple if it was already in the existing partial index
-         */
-        if (oldPred != NULL) {
-#ifndef OMIT_PARTIAL_INDEX
-            ExecStoreTuple(htup, slot, false);
-            if (ExecQual((List *) oldPred, econtext, false)) {
-                buildstate.indtuples++;
-                continue;
-            }
-#endif	 /* OMIT_PARTIAL_INDEX */
+        /* the workers' counts are valid once their runs are attached */
+        for (i = 0; i < shared->nworkers; i++) {
+            _bt_spoolattachexchange(buildstate.spool, shared->workers[i].xchg);
+            reltuples += shared->workers[i].reltuples;
+            buildstate.indtuples += shared->workers[i].indtuples;
         }
-
-        /*
-         * Skip this tuple if it doesn't satisfy the partial-index
-         * predicate
-         */
-        if (pred != NULL) {
-#ifndef OMIT_PARTIAL_INDEX
-            /* SetSlotContents(slot, htup); */
-            ExecStoreTuple(htup, slot, false);
-            if (!ExecQual((List *) pred, econtext, false))
-                continue;
-#endif	 /* OMIT_PARTIAL_INDEX */
+        if (buildstate.dead_spool) {
+            if (buildstate.hasDead)
+                _bt_spoolattach(buildstate.spool, buildstate.dead_spool);
+            else
+                _bt_spooldestroy(buildstate.dead_spool);
+            buildstate.dead_spool = NULL;
         }
+        pthread_mutex_destroy(&shared->guard);
+    } else {
+        hscan = heap_beginscan(heap, SnapshotAny, 0, (ScanKey) NULL);
 
-        buildstate.indtuples++;
-
-        /*
-         * For the current heap tuple, extract all the attributes we use
-         * in this index, and note which are null.
-         */
+        while (HeapTupleIsValid(htup = heap_getnext(hscan))) {
+            reltuples++;
 
-        for (i = 1; i <= natts; i++) {
-            int attoff;
-            bool attnull;
+            CheckForCancel();
 
+            MemoryContextResetAndDeleteChildren(scan_cxt);
+            MemoryContextSwitchTo(scan_cxt);
             /*
-             * Offsets are from the start of the tuple, and are
-             * zero-based; indices are one-based.  The next call returns i
-             * - 1.  That's data hiding for you.
+             * If oldPred != NULL, this is an EXTEND INDEX command, so skip
+             * this tuple if it was already in the existing partial index
              */
+            if (oldPred != NULL) {
+#ifndef OMIT_PARTIAL_INDEX
+                ExecStoreTuple(htup, slot, false);
+                if (ExecQual((List *) oldPred, econtext, false)) {
+                    buildstate.indtuples++;
+                    continue;
+                }
+#endif	 /* OMIT_PARTIAL_INDEX */
+            }
 
-            attoff = AttrNumberGetAttrOffset(i);
-            attdata[attoff] = GetIndexValue(htup,
-                    htupdesc,
-                    attoff,
-                    attnum,
-                    finfo,
-                    &attnull);
-            nulls[attoff] = (attnull ? 'n' : ' ');
-        }
-
-        /* form an index tuple and point it at the heap tuple */
-        itup = index_formtuple(itupdesc, attdata, nulls);
-        /*
-         * If the single index key is null, we don't insert it into the
-         * index.  Btrees support scans on <, <=, =, >=, and >. Relational
-         * algebra says that A op B (where op is one of the operators
-         * above) returns null if either A or B is null.  This means that
-         * no qualification used in an index scan could ever return true
-         * on a null attribute.  It also means that indices can't be used
-         * by ISNULL or NOTNULL scans, but that's an artifact of the
-         * strategy map architecture chosen in 1986, not of the way nulls
-         * are handled here.
-         */
-
-        /*
-         * New comments: NULLs handling. While we can't do NULL
-         * comparison, we can follow simple rule for ordering items on
-         * btree pages - NULLs greater NOT_NULLs and NULL = NULL is TRUE.
-         * Sure, it's just rule for placing/finding items and no more -
-         * keytest'll return FALSE for a = 5 for items having 'a' isNULL.
-         * Look at _bt_skeycmp, _bt_compare and _bt_itemcmp for how it
-         * works.				 - vadim 03/23/97
-         *
-         * if (itup->t_info & INDEX_NULL_MASK) { pfree(itup); continue; }
-         */
+            /*
+             * Skip this tuple if it doesn't satisfy the partial-index
+             * predicate
+             */
+            if (pred != NULL) {
+#ifndef OMIT_PARTIAL_INDEX
+                /* SetSlotContents(slot, htup); */
+                ExecStoreTuple(htup, slot, false);
+                if (!ExecQual((List *) pred, econtext, false))
+                    continue;
+#endif	 /* OMIT_PARTIAL_INDEX */
+            }
 
-        itup->t_tid = htup->t_self;
-        btitem = _bt_formitem(itup);
+            buildstate.indtuples++;
 
-        /*
-         * if we are doing bottom-up btree build, we insert the index into
-         * a spool file for subsequent processing.	otherwise, we insert
-         * into the btree.
-         */
-        /* switch back to build context 
-                so that any memory created during 
-                spooling is persistent until 
-                build is done.
-         */
-        MemoryContextSwitchTo(build_context);
-        if (buildstate.usefast) {
-            if (buildstate.isUnique) {
-                switch (HeapTupleSatisfiesVacuum(htup->t_data, cxid)) {
-                    case HEAPTUPLE_STILLBORN:
-                    case HEAPTUPLE_RECENTLY_DEAD:
-                    case HEAPTUPLE_DEAD:
-                        _bt_spool(btitem, buildstate.dead_spool);
-                        buildstate.hasDead = true;
-                        break;
-                    case HEAPTUPLE_LIVE:
-                        _bt_spool(btitem, buildstate.spool);
-                        break;
-                    case HEAPTUPLE_INSERT_IN_PROGRESS:
-                        _bt_spool(btitem, buildstate.dead_spool);
-                        buildstate.hasDead = true;
-                        break;
-                    case HEAPTUPLE_DELETE_IN_PROGRESS:
-                        _bt_spool(btitem, buildstate.spool);
-                        break;
-                    default:
-                        elog(ERROR, "heap is in inconsistent state %d", isAlive);
-                        break;
-                }
-            } else {
-                _bt_spool(btitem, buildstate.spool);
-            }
-        } else {
-            res = _bt_doinsert(index, btitem, buildstate.isUnique, heap);
+            _bt_buildtuple(&buildstate, htup);
         }
+        /* okay, all heap tuples are indexed */
 
-        pfree(btitem);
-        pfree(itup);
-        if (res)
-            pfree(res);
-
+        heap_endscan(hscan);
     }
-    /* okay, all heap tuples are indexed */
-
-    heap_endscan(hscan);
+    MemoryContextSwitchTo(build_context);
 
     /*
      * if we are doing bottom-up btree build, finish the build by (1)
@@ -335,7 +607,7 @@ btbuild(Relation heap, Relation index, int natts,
                 buildstate.dead_spool = NULL;
             }
         }
-        _bt_leafbuild(builders);
+        _bt_leafbuild(builders, buildstate.isUnique);
         _bt_spooldestroy(builders);
     }
 
@@ -525,6 +797,7 @@ btrescan(IndexScanDesc scan, bool fromEnd, ScanKey scankey) {
     if (so == NULL) /* if called from btbeginscan */ {
         so = (BTScanOpaque) palloc(sizeof (BTScanOpaqueData));
         so->btso_curbuf = so->btso_mrkbuf = InvalidBuffer;
+        so->btso_curpost = -1;
         ItemPointerSetInvalid(&(so->curHeapIptr));
         ItemPointerSetInvalid(&(so->mrkHeapIptr));
         if (scan->numberOfKeys > 0)
@@ -538,6 +811,7 @@ btrescan(IndexScanDesc scan, bool fromEnd, ScanKey scankey) {
     if (ItemPointerIsValid(iptr = &(scan->currentItemData))) {
         ReleaseBuffer(scan->relation, so->btso_curbuf);
         so->btso_curbuf = InvalidBuffer;
+        so->btso_curpost = -1;
         ItemPointerSetInvalid(&(so->curHeapIptr));
         ItemPointerSetInvalid(iptr);
     }
@@ -576,6 +850,7 @@ btmovescan(IndexScanDesc scan, Datum v) {
     if (ItemPointerIsValid(iptr = &(scan->currentItemData))) {
         ReleaseBuffer(scan->relation, so->btso_curbuf);
         so->btso_curbuf = InvalidBuffer;
+        so->btso_curpost = -1;
         ItemPointerSetInvalid(iptr);
     }
 
@@ -733,13 +1008,13 @@ btrecoverpage(Relation rel, BlockNumber block) {
 
 /*
  * Bulk deletion of all index entries pointing to a set of heap tuples.
- * The set of target tuples is specified via a callback routine that tells
- * whether any given heap tuple (identified by ItemPointer) is being deleted.
+ * The set of target tuples is given by the vacuum's dead tuple store,
+ * which is only read here so several indexes may be processed at once.
  *
  * Result: a palloc'd struct containing statistical info for VACUUM displays.
  */
 Datum
-btbulkdelete(Relation rel, int delcount, ItemPointerData* tuple_deletes) {
+btbulkdelete(Relation rel, int delcount, TidStore deadtids) {
     long tuples_removed;
 //    long num_index_tuples;
     IndexScanDesc scan;
@@ -751,10 +1026,6 @@ btbulkdelete(Relation rel, int delcount, ItemPointerData* tuple_deletes) {
     tuples_removed = 0;
 //    num_index_tuples = 0;
 
-    /*  array is seq scan so ItemPointers are in order */
-    /* maybe just make sure  */
-    qsort(tuple_deletes, delcount, sizeof (ItemPointerData), cmp_itemptr);
-
     /*
      * We use a standard IndexScanDesc scan object, but to speed up the
      * loop, we skip most of the wrapper layers of index_getnext and
@@ -799,6 +1070,7 @@ btbulkdelete(Relation rel, int delcount, ItemPointerData* tuple_deletes) {
             IndexTuple itup;
             ItemPointer htup;
             ItemId itemid;
+            bool deleteit = false;
 
             /*
              * Make sure we have a super-exclusive write lock on this page.
@@ -838,8 +1110,43 @@ btbulkdelete(Relation rel, int delcount, ItemPointerData* tuple_deletes) {
             btitem = (BTItem) PageGetItem(page, itemid);
             itup = &btitem->bti_itup;
             htup = &(itup->t_tid);
-            /*  if the heap tuple item pointer is found in the list, delete it  */
-            if (bsearch(htup, tuple_deletes, delcount, sizeof (ItemPointerData), cmp_itemptr) != NULL) {
+            if (BTItemIsPosting(btitem)) {
+                /*
+                 * Filter the posting list.  The item goes away only when
+                 * every heap TID in it is dead, otherwise it is replaced
+                 * in place by a smaller one holding the survivors.
+                 */
+                int ntids = BTItemGetNPosting(btitem);
+                ItemPointerData* keep = palloc(ntids * sizeof (ItemPointerData));
+                int nkeep = 0;
+                int i;
+
+                for (i = 0; i < ntids; i++) {
+                    if (!TidStoreIsMember(deadtids, BTItemGetPosting(btitem, i)))
+                        keep[nkeep++] = *BTItemGetPosting(btitem, i);
+                }
+
+                if (nkeep == 0) {
+                    tuples_removed += ntids - 1;
+                    deleteit = true;
+                } else if (nkeep < ntids) {
+                    BTItem newitem = _bt_formposting(btitem, keep, nkeep);
+                    Size itemsz = IndexTupleDSize(newitem->bti_itup) + (sizeof (BTItemData) - sizeof (IndexTupleData));
+
+                    _bt_itemdel(rel, buf, current);
+                    if (PageAddItem(page, (Item) newitem, MAXALIGN(itemsz), offnum, LP_USED) == InvalidOffsetNumber)
+                        elog(FATAL, "btree: failed to replace posting list in index %s", RelationGetRelationName(rel));
+                    pfree(newitem);
+                    dirtied = true;
+                    tuples_removed += ntids - nkeep;
+                }
+                pfree(keep);
+            } else {
+                /*  if the heap tuple item pointer is found in the list, delete it  */
+                deleteit = TidStoreIsMember(deadtids, htup);
+            }
+
+            if (deleteit) {
                 /* Okay to delete the item from the page */
                 _bt_itemdel(rel, buf, current);
                 dirtied = true;
@@ -950,10 +1257,39 @@ _bt_restscan(IndexScanDesc scan) {
      * (_bt_step will move it right)...  XXX still needed?
      */
     if (!ItemPointerIsValid(&target)) {
+        so->btso_curpost = -1;
         ItemPointerSet(current, ItemPointerGetBlockNumber(current), OffsetNumberPrev(P_FIRSTDATAKEY(opaque)));
         return;
     }
 
+    /*
+     * Usually nothing moved, check the saved offset first.
+     */
+    if (offnum >= P_FIRSTDATAKEY(opaque) && offnum <= maxoff) {
+        int ntids;
+        int i;
+
+        item = (BTItem) PageGetItem(page, PageGetItemId(page, offnum));
+        ntids = BTItemGetNTids(item);
+        i = (so->btso_curpost >= 0 && so->btso_curpost < ntids) ? so->btso_curpost : 0;
+        for (; i < ntids; i++) {
+            ItemPointer htid = BTItemGetHeapTid(item, i);
+
+            if ((ItemPointerGetBlockNumber(htid) == ItemPointerGetBlockNumber(&target)) &&
+                    (ItemPointerGetOffsetNumber(htid) == ItemPointerGetOffsetNumber(&target))) {
+                so->btso_curpost = i;
+                return;
+            }
+        }
+    }
+
+    /*
+     * A dedup pass may have folded our item into a posting list further
+     * left on this page, so search from the first data item rather than
+     * the saved offset.
+     */
+    offnum = P_FIRSTDATAKEY(opaque);
+
     /*
      * The item we were on may have moved right due to insertions. Find it
      * again.  We use the heap TID to identify the item uniquely.
@@ -963,12 +1299,21 @@ _bt_restscan(IndexScanDesc scan) {
         for (;
                 offnum <= maxoff;
                 offnum = OffsetNumberNext(offnum)) {
+            int ntids;
+            int i;
+
             item = (BTItem) PageGetItem(page, PageGetItemId(page, offnum));
-            if ((ItemPointerGetBlockNumber(&item->bti_itup.t_tid) == ItemPointerGetBlockNumber(&target)) &&
-                    (ItemPointerGetOffsetNumber(&item->bti_itup.t_tid) == ItemPointerGetOffsetNumber(&target))) {
-                /* Found it */
-                ItemPointerSet(current, ItemPointerGetBlockNumber(current), offnum);
-                return;
+            ntids = BTItemGetNTids(item);
+            for (i = 0; i < ntids; i++) {
+                ItemPointer htid = BTItemGetHeapTid(item, i);
+
+                if ((ItemPointerGetBlockNumber(htid) == ItemPointerGetBlockNumber(&target)) &&
+                        (ItemPointerGetOffsetNumber(htid) == ItemPointerGetOffsetNumber(&target))) {
+                    /* Found it */
+                    so->btso_curpost = i;
+                    ItemPointerSet(current, ItemPointerGetBlockNumber(current), offnum);
+                    return;
+                }
             }
         }
 
@@ -996,29 +1341,3 @@ _bt_restscan(IndexScanDesc scan) {
     }
 }
 
-static int
-cmp_itemptr(const void *left, const void *right) {
-    BlockNumber lblk,
-            rblk;
-    OffsetNumber loff,
-            roff;
-
-    lblk = ItemPointerGetBlockNumber((ItemPointer) left);
-    rblk = ItemPointerGetBlockNumber((ItemPointer) right);
-
-    if (lblk < rblk)
-        return -1;
-    if (lblk > rblk)
-        return 1;
-
-    loff = ItemPointerGetOffsetNumber((ItemPointer) left);
-    roff = ItemPointerGetOffsetNumber((ItemPointer) right);
-
-    if (loff < roff)
-        return -1;
-    if (loff > roff)
-        return 1;
-
-    return 0;
-}
-
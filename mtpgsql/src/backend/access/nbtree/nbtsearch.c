@@ -23,6 +23,7 @@
 
 
 static bool _bt_endpoint(IndexScanDesc scan, ScanDirection dir);
+static inline int32 _bt_fastcmp(int16 cmptype, Datum key, Datum item);
 
 
 /*
@@ -348,6 +349,10 @@ _bt_compare(Relation rel,
 		{
 			result = -1;		/* NOT_NULL "<" NULL */
 		}
+		else if (entry->sk_cmptype != BTCMP_FMGR)
+		{
+			result = _bt_fastcmp(entry->sk_cmptype, entry->sk_argument, datum);
+		}
 		else
 		{
 			result = DatumGetInt32((*fmgr_faddr_2(&entry->sk_func))(entry->sk_argument,datum));
@@ -362,6 +367,60 @@ _bt_compare(Relation rel,
 	return 0;
 }
 
+/*
+ *	_bt_fastcmp() -- inline equivalents of the builtin order procs in
+ *		nbtcompare.c for the scan key types tagged by _bt_setcmptype().
+ *		The results must agree in sign with the fmgr versions.
+ */
+static inline int32
+_bt_fastcmp(int16 cmptype, Datum key, Datum item)
+{
+	switch (cmptype)
+	{
+		case BTCMP_INT2:
+			return (int32) (DatumGetInt16(key) - DatumGetInt16(item));
+		case BTCMP_INT4:
+			{
+				int32		a = DatumGetInt32(key);
+				int32		b = DatumGetInt32(item);
+
+				return (a > b) ? 1 : ((a == b) ? 0 : -1);
+			}
+		case BTCMP_INT8:
+			{
+				int64		a = *(int64 *) DatumGetPointer(key);
+				int64		b = *(int64 *) DatumGetPointer(item);
+
+				return (a > b) ? 1 : ((a == b) ? 0 : -1);
+			}
+		case BTCMP_OID:
+			{
+				Oid			a = DatumGetObjectId(key);
+				Oid			b = DatumGetObjectId(item);
+
+				return (a > b) ? 1 : ((a == b) ? 0 : -1);
+			}
+		case BTCMP_FLOAT8:
+			{
+				float8		a = *(float8 *) DatumGetPointer(key);
+				float8		b = *(float8 *) DatumGetPointer(item);
+
+				return (a > b) ? 1 : ((a == b) ? 0 : -1);
+			}
+		case BTCMP_NAME:
+			return strncmp(NameStr(*(NameData *) DatumGetPointer(key)),
+						   NameStr(*(NameData *) DatumGetPointer(item)),
+						   NAMEDATALEN);
+		case BTCMP_CHAR:
+			return (int32) ((uint8) DatumGetChar(key) - (uint8) DatumGetChar(item));
+		case BTCMP_BOOL:
+			return (int32) ((uint8) DatumGetChar(key) - (uint8) DatumGetChar(item));
+		default:
+			elog(ERROR, "_bt_fastcmp: unknown compare type %d", cmptype);
+	}
+	return 0;
+}
+
 /*
  *	_bt_next() -- Get the next item in a scan.
  *
@@ -392,6 +451,34 @@ _bt_next(IndexScanDesc scan, ScanDirection dir)
 	buf = so->btso_curbuf;
 	Assert(BufferIsValid(buf));
 
+	/*
+	 * If the last TID came out of a posting list, hand back the rest of
+	 * the list before moving on.  They share the key, so the scan keys
+	 * need not be checked again.
+	 */
+	if (so->btso_curpost >= 0)
+	{
+		BTPageOpaque opaque;
+
+		offnum = ItemPointerGetOffsetUnchecked(current);
+		page = BufferGetPage(buf);
+		opaque = (BTPageOpaque) PageGetSpecialPointer(page);
+		if (offnum >= P_FIRSTDATAKEY(opaque) && offnum <= PageGetMaxOffsetNumber(page))
+		{
+			int			next = ScanDirectionIsForward(dir) ?
+				so->btso_curpost + 1 : so->btso_curpost - 1;
+
+			btitem = (BTItem) PageGetItem(page, PageGetItemId(page, offnum));
+			if (next >= 0 && next < BTItemGetNTids(btitem))
+			{
+				so->btso_curpost = next;
+				scan->xs_ctup.t_self = *BTItemGetHeapTid(btitem, next);
+				return true;
+			}
+		}
+	}
+	so->btso_curpost = -1;
+
 	do
 	{
 		/* step one tuple in the appropriate direction */
@@ -414,7 +501,8 @@ _bt_next(IndexScanDesc scan, ScanDirection dir)
 
 
                         if ( changed ) WriteNoReleaseBuffer(scan->relation, buf);
-                        scan->xs_ctup.t_self = itup->t_tid;
+                        so->btso_curpost = ScanDirectionIsForward(dir) ? 0 : BTItemGetNTids(btitem) - 1;
+                        scan->xs_ctup.t_self = *BTItemGetHeapTid(btitem, so->btso_curpost);
                         return true;
 		}
 
@@ -464,6 +552,8 @@ _bt_first(IndexScanDesc scan, ScanDirection dir)
 				j;
 	StrategyNumber strat_total;
 
+	so->btso_curpost = -1;
+
 	/*
 	 * Order the scan keys in our canonical fashion and eliminate any
 	 * redundant keys.
@@ -566,6 +656,7 @@ _bt_first(IndexScanDesc scan, ScanDirection dir)
                 proc = index_getprocid(rel, i + 1, BTORDER_PROC);
                 ScanKeyEntryInitialize(scankeys + i, so->keyData[j].sk_flags,
 							   i + 1, proc, so->keyData[j].sk_argument);
+                _bt_setcmptype(scankeys + i);
 	}
 	if (nKeyIs)
 		pfree(nKeyIs);
@@ -792,7 +883,8 @@ _bt_first(IndexScanDesc scan, ScanDirection dir)
 				page associated with it does not before crash  MKS  12.2.2003
 			*/
 
-			scan->xs_ctup.t_self = itup->t_tid;
+			so->btso_curpost = ScanDirectionIsForward(dir) ? 0 : BTItemGetNTids(btitem) - 1;
+			scan->xs_ctup.t_self = *BTItemGetHeapTid(btitem, so->btso_curpost);
 			res = true;
 
 	}
@@ -1085,7 +1177,8 @@ _bt_endpoint(IndexScanDesc scan, ScanDirection dir)
 				page associated with it does not before crash  MKS  12.2.2003
 			*/
 
-			scan->xs_ctup.t_self = itup->t_tid;
+			so->btso_curpost = ScanDirectionIsForward(dir) ? 0 : BTItemGetNTids(btitem) - 1;
+			scan->xs_ctup.t_self = *BTItemGetHeapTid(btitem, so->btso_curpost);
 			res = true;
 	}
 	else if (continuescan)
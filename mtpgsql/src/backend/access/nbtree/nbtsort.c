@@ -30,6 +30,12 @@
  * (there aren't many upper pages if the keys are reasonable-size) without
  * incurring a lot of cascading splits during early insertions.
  *
+ * A parallel build has worker threads scan and sort their own share of
+ * the heap.  Their sorted runs are attached to the spool of the thread
+ * doing the load, and _bt_load merges them on the fly.  A worker keeps
+ * its tuplesort open until the loader has drained it, passing tuples over
+ * in batches through a BTExchange.
+ *
  *
  * Portions Copyright (c) 2000-2024, Myron Scott  <myron@weaverdb.org>
  * Portions Copyright (c) 1996-2002, PostgreSQL Global Development Group
@@ -41,6 +47,9 @@
  *-------------------------------------------------------------------------
  */
 
+#include <pthread.h>
+#include <errno.h>
+#include <time.h>
 
 #include "postgres.h"
 #include "env/env.h"
@@ -48,6 +57,59 @@
 #include "access/nbtree.h"
 #include "utils/tuplesort.h"
 #include "access/heapam.h"
+#include "env/dolhelper.h"
+
+/*
+ * Tuples go from a build worker to the loader in batches of this size.
+ */
+#define BTEXCHANGE_BATCHSZ	(64 * 1024)
+#define BTEXCHANGE_MAXRUNS	2
+
+typedef enum BTSlotState {
+	BTSLOT_EMPTY,		/* worker may fill the batch */
+	BTSLOT_FULL,		/* batch is ready for the loader */
+	BTSLOT_LAST,		/* last batch of the run is ready for the loader */
+	BTSLOT_DONE			/* run has been drained */
+} BTSlotState;
+
+typedef struct BTExchangeSlot {
+	BTSlotState     state;
+	char           *batch;	/* MAXALIGN'ed index tuples */
+	Size            len;
+} BTExchangeSlot;
+
+/*
+ * Hand-over point between one build worker and the loading thread.  The
+ * batch buffers are allocated by the loader, so the worker may go away as
+ * soon as it has written its last batch.
+ */
+struct BTExchange {
+	pthread_mutex_t guard;
+	pthread_cond_t  gate;
+	DolConnection   worker;
+	bool            scanned;	/* worker has sorted its runs */
+	bool            finished;	/* worker no longer touches the exchange */
+	int             nslots;
+	BTExchangeSlot  slots[BTEXCHANGE_MAXRUNS];
+};
+
+/*
+ * One sorted input of the merge in _bt_load: either a local spool or one
+ * run of a worker.
+ */
+typedef struct BTRunData {
+	BTSpool        *spool;	/* local run, else NULL */
+	BTExchange     *xchg;	/* worker run, else NULL */
+	int             slot;
+	bool            checkunique;	/* run holds live tuples of a unique
+					 * index */
+	char           *batch;	/* loader's copy of the current batch */
+	Size            len;
+	Size            pos;
+	bool            last;
+	IndexTuple      head;	/* next tuple of the run, NULL at end */
+	bool            head_free;
+} BTRunData;
 
 /*
  * Status record for spooling.
@@ -56,6 +118,12 @@ struct BTSpool {
 	Tuplesortstate *sortstate;	/* state data for tuplesort.c */
 	Relation        index;
 	bool            isunique;
+	int             nruns;	/* merge inputs, 0 if just sortstate */
+	int             maxruns;
+	BTRunData      *runs;	/* runs[0] is this spool's own sortstate */
+	int             lastrun;	/* run of the last tuple handed out */
+	ScanKey         mergekey;
+	IndexTuple      lastunique;	/* copy of the last live tuple merged */
 };
 
 /*
@@ -98,7 +166,19 @@ _bt_sortaddtup(Page page, Size itemsize,
 	       BTItem btitem, OffsetNumber itup_off);
 static void     _bt_buildadd(Relation index, BTPageState * state, BTItem bti);
 static void     _bt_uppershutdown(Relation index, BTPageState * state);
-static void     _bt_load(Relation index, BTSpool * btspool);
+static void     _bt_loadflush(Relation index, BTPageState * state, BTItem base,
+			      ItemPointer tids, int ntids);
+static void     _bt_load(Relation index, BTSpool * btspool, bool isunique);
+static BTRunData *_bt_spooladdrun(BTSpool * btspool);
+static IndexTuple _bt_spoolnext(BTSpool * btspool, bool * should_free);
+static void     _bt_runadvance(BTRunData * run);
+static int32    _bt_mergecompare(BTSpool * btspool, IndexTuple a, IndexTuple b,
+				 bool * hasnull);
+static void     _bt_exchangewait(BTExchange * xchg, bool loader);
+static void     _bt_exchangetake(BTRunData * run);
+static bool     _bt_exchangefill(BTSpool * spool, BTExchangeSlot * slot,
+				 IndexTuple * pending, bool * pending_free);
+static void     _bt_exchangeend(BTExchange * xchg);
 
 
 /*
@@ -116,6 +196,12 @@ _bt_spoolinit(Relation index, bool isunique)
 
 	btspool->index = index;
 	btspool->isunique = isunique;
+	btspool->nruns = 0;
+	btspool->maxruns = 0;
+	btspool->runs = NULL;
+	btspool->lastrun = -1;
+	btspool->mergekey = NULL;
+	btspool->lastunique = NULL;
 
 	btspool->sortstate = tuplesort_begin_index(index, isunique, false);
 
@@ -135,6 +221,24 @@ _bt_spoolinit(Relation index, bool isunique)
 void
 _bt_spooldestroy(BTSpool * btspool)
 {
+	int             i;
+
+	for (i = 1; i < btspool->nruns; i++) {
+		BTRunData      *run = &btspool->runs[i];
+
+		if (run->spool != NULL)
+			_bt_spooldestroy(run->spool);
+		else {
+			if (run->slot == 0)
+				_bt_exchangeend(run->xchg);
+			pfree(run->batch);
+		}
+	}
+	if (btspool->runs != NULL)
+		pfree(btspool->runs);
+	if (btspool->lastunique != NULL)
+		pfree(btspool->lastunique);
+
 	tuplesort_end(btspool->sortstate);
 	pfree((void *) btspool);
 }
@@ -151,11 +255,14 @@ _bt_spool(BTItem btitem, BTSpool * btspool)
 
 /*
  * given a spool loaded by successive calls to _bt_spool, create an entire
- * btree.
+ * btree.  isunique is whether the index is unique, which the spool may not
+ * say.
  */
 void
-_bt_leafbuild(BTSpool * btspool)
+_bt_leafbuild(BTSpool * btspool, bool isunique)
 {
+	int             i;
+
 #ifdef BTREE_BUILD_STATS
 	if (log_btree_build_stats) {
 		ShowUsage("BTREE BUILD (Spool) STATISTICS");
@@ -163,8 +270,12 @@ _bt_leafbuild(BTSpool * btspool)
 	}
 #endif				/* BTREE_BUILD_STATS */
 	tuplesort_performsort(btspool->sortstate);
+	for (i = 1; i < btspool->nruns; i++) {
+		if (btspool->runs[i].spool != NULL)
+			tuplesort_performsort(btspool->runs[i].spool->sortstate);
+	}
 
-	_bt_load(btspool->index, btspool);
+	_bt_load(btspool->index, btspool, isunique);
 }
 
 void
@@ -188,12 +299,383 @@ _bt_spoolmerge(BTSpool * dest, BTSpool * src)
 	}
 }
 
+/*
+ * merge the sorted contents of src into dest when dest is loaded.  dest
+ * takes ownership of src.
+ */
+void
+_bt_spoolattach(BTSpool * dest, BTSpool * src)
+{
+	BTRunData      *run = _bt_spooladdrun(dest);
+
+	run->spool = src;
+	run->checkunique = src->isunique;
+}
+
+/*
+ * set up the hand-over point for a build worker running on the given
+ * helper connection.  Called by the loading thread.
+ */
+BTExchange     *
+_bt_exchangeinit(DolConnection worker)
+{
+	BTExchange     *xchg = (BTExchange *) palloc(sizeof(BTExchange));
+	int             i;
+
+	MemSet(xchg, 0, sizeof(BTExchange));
+	pthread_mutex_init(&xchg->guard, NULL);
+	pthread_cond_init(&xchg->gate, NULL);
+	xchg->worker = worker;
+	for (i = 0; i < BTEXCHANGE_MAXRUNS; i++) {
+		xchg->slots[i].state = BTSLOT_EMPTY;
+		xchg->slots[i].batch = (char *) palloc(BTEXCHANGE_BATCHSZ);
+	}
+
+	return xchg;
+}
+
+/*
+ * sort the worker's spools and feed them to the loader until it has
+ * drained them.  Called by the worker; live holds the live tuples and is
+ * checked for uniqueness by the loader, dead may be NULL.
+ */
+void
+_bt_spoolexport(BTExchange * xchg, BTSpool * live, BTSpool * dead)
+{
+	BTSpool        *spools[BTEXCHANGE_MAXRUNS];
+	IndexTuple      pending[BTEXCHANGE_MAXRUNS];
+	bool            pending_free[BTEXCHANGE_MAXRUNS];
+	int             nspools = 0;
+	int             left;
+	int             i;
+
+	spools[nspools++] = live;
+	if (dead != NULL)
+		spools[nspools++] = dead;
+
+	for (i = 0; i < nspools; i++) {
+		tuplesort_performsort(spools[i]->sortstate);
+		pending[i] = NULL;
+		pending_free[i] = false;
+	}
+
+	pthread_mutex_lock(&xchg->guard);
+	xchg->nslots = nspools;
+	xchg->scanned = true;
+	pthread_cond_broadcast(&xchg->gate);
+
+	left = nspools;
+	while (left > 0) {
+		bool            eof;
+
+		for (i = 0; i < nspools; i++) {
+			if (xchg->slots[i].state == BTSLOT_EMPTY)
+				break;
+		}
+		if (i == nspools) {
+			_bt_exchangewait(xchg, false);
+			continue;
+		}
+
+		/* the loader leaves an empty slot alone, so fill it unlocked */
+		pthread_mutex_unlock(&xchg->guard);
+		eof = _bt_exchangefill(spools[i], &xchg->slots[i], &pending[i], &pending_free[i]);
+		pthread_mutex_lock(&xchg->guard);
+
+		xchg->slots[i].state = (eof) ? BTSLOT_LAST : BTSLOT_FULL;
+		if (eof)
+			left--;
+		pthread_cond_broadcast(&xchg->gate);
+	}
+
+	xchg->finished = true;
+	pthread_cond_broadcast(&xchg->gate);
+	pthread_mutex_unlock(&xchg->guard);
+}
+
+/*
+ * merge the runs of a build worker into dest when dest is loaded.  Waits
+ * for the worker to finish scanning and sorting.
+ */
+void
+_bt_spoolattachexchange(BTSpool * dest, BTExchange * xchg)
+{
+	int             i;
+
+	pthread_mutex_lock(&xchg->guard);
+	while (!xchg->scanned)
+		_bt_exchangewait(xchg, true);
+	pthread_mutex_unlock(&xchg->guard);
+
+	for (i = 0; i < xchg->nslots; i++) {
+		BTRunData      *run = _bt_spooladdrun(dest);
+
+		run->xchg = xchg;
+		run->slot = i;
+		run->checkunique = (i == 0 && dest->isunique);
+		run->batch = (char *) palloc(BTEXCHANGE_BATCHSZ);
+		run->last = false;
+	}
+}
+
 
 /*
  * Internal routines.
  */
 
 
+/*
+ * add an empty merge input to a spool, turning its own sortstate into
+ * the first input if this is the first one.
+ */
+static BTRunData *
+_bt_spooladdrun(BTSpool * btspool)
+{
+	BTRunData      *run;
+
+	if (btspool->nruns == 0) {
+		btspool->maxruns = 1 + 2 * BTEXCHANGE_MAXRUNS;
+		btspool->runs = (BTRunData *) palloc(btspool->maxruns * sizeof(BTRunData));
+		btspool->mergekey = _bt_mkscankey_nodata(btspool->index);
+
+		run = &btspool->runs[btspool->nruns++];
+		MemSet(run, 0, sizeof(BTRunData));
+		run->spool = btspool;
+		run->checkunique = btspool->isunique;
+	} else if (btspool->nruns == btspool->maxruns) {
+		btspool->maxruns *= 2;
+		btspool->runs = (BTRunData *) repalloc(btspool->runs, btspool->maxruns * sizeof(BTRunData));
+	}
+
+	run = &btspool->runs[btspool->nruns++];
+	MemSet(run, 0, sizeof(BTRunData));
+	return run;
+}
+
+/*
+ * next tuple of a spool in sort order, merging in any attached runs.
+ * With runs attached, uniqueness across them is checked here since each
+ * run's tuplesort only saw its own tuples.
+ */
+static IndexTuple
+_bt_spoolnext(BTSpool * btspool, bool * should_free)
+{
+	BTRunData      *best = NULL;
+	bool            hasnull;
+	int             i;
+
+	if (btspool->nruns == 0)
+		return (IndexTuple) tuplesort_getindextuple(btspool->sortstate, true, should_free);
+
+	/* fill every run on the first call, afterwards only the one we used */
+	if (btspool->lastrun < 0) {
+		for (i = 0; i < btspool->nruns; i++)
+			_bt_runadvance(&btspool->runs[i]);
+	} else
+		_bt_runadvance(&btspool->runs[btspool->lastrun]);
+
+	for (i = 0; i < btspool->nruns; i++) {
+		BTRunData      *run = &btspool->runs[i];
+
+		if (run->head == NULL)
+			continue;
+		if (best == NULL || _bt_mergecompare(btspool, run->head, best->head, &hasnull) < 0)
+			best = run;
+	}
+
+	if (best == NULL)
+		return NULL;
+
+	if (best->checkunique) {
+		Size            itemsz = IndexTupleSize(best->head);
+
+		if (btspool->lastunique != NULL) {
+			if (_bt_mergecompare(btspool, best->head, btspool->lastunique, &hasnull) == 0 && !hasnull)
+				elog(ERROR, "Cannot create unique index %s. Table contains non-unique values",
+				     RelationGetRelationName(btspool->index));
+			pfree(btspool->lastunique);
+		}
+		btspool->lastunique = (IndexTuple) palloc(itemsz);
+		memcpy(btspool->lastunique, best->head, itemsz);
+	}
+
+	btspool->lastrun = best - btspool->runs;
+	*should_free = best->head_free;
+	return best->head;
+}
+
+/*
+ * step a merge input to its next tuple.  The previous head has already
+ * been handed to the caller of _bt_spoolnext, who frees it if need be.
+ */
+static void
+_bt_runadvance(BTRunData * run)
+{
+	if (run->spool != NULL) {
+		run->head = (IndexTuple) tuplesort_getindextuple(run->spool->sortstate, true, &run->head_free);
+		return;
+	}
+
+	run->head_free = false;
+	while (run->pos >= run->len) {
+		if (run->last) {
+			run->head = NULL;
+			return;
+		}
+		_bt_exchangetake(run);
+	}
+	run->head = (IndexTuple) (run->batch + run->pos);
+	run->pos += MAXALIGN(IndexTupleSize(run->head));
+}
+
+/*
+ * compare two index tuples the way tuplesort orders them, NULLs last.
+ * hasnull is set if they compared equal on a NULL column.
+ */
+static int32
+_bt_mergecompare(BTSpool * btspool, IndexTuple a, IndexTuple b, bool * hasnull)
+{
+	TupleDesc       tupdes = RelationGetDescr(btspool->index);
+	int             keysz = RelationGetNumberOfAttributes(btspool->index);
+	int             i;
+
+	*hasnull = false;
+	for (i = 1; i <= keysz; i++) {
+		ScanKey         entry = &btspool->mergekey[i - 1];
+		Datum           datum1,
+		                datum2;
+		bool            null1,
+		                null2;
+		int32           result;
+
+		datum1 = index_getattr(a, i, tupdes, &null1);
+		datum2 = index_getattr(b, i, tupdes, &null2);
+
+		if (null1) {
+			if (null2) {
+				result = 0;
+				*hasnull = true;
+			} else
+				result = 1;
+		} else if (null2)
+			result = -1;
+		else
+			result = DatumGetInt32(FMGR_PTR2(&entry->sk_func, datum1, datum2));
+
+		if (result != 0)
+			return result;
+	}
+
+	return 0;
+}
+
+/*
+ * wait on an exchange, with its guard held.  The loader bails out if the
+ * worker has died; either side bails out if the query was cancelled.
+ */
+static void
+_bt_exchangewait(BTExchange * xchg, bool loader)
+{
+	struct timespec waittime;
+
+	ptimeout(&waittime, 1000);
+	if (pthread_cond_timedwait(&xchg->gate, &xchg->guard, &waittime) != ETIMEDOUT)
+		return;
+
+	if (CheckForCancel()) {
+		pthread_mutex_unlock(&xchg->guard);
+		elog(ERROR, "Query Cancelled");
+	}
+	if (loader && !xchg->finished && !IsDolConnectionRunning(xchg->worker)) {
+		pthread_mutex_unlock(&xchg->guard);
+		elog(ERROR, "btree build worker stopped before finishing its sort");
+	}
+}
+
+/*
+ * copy the next batch of a worker run into the loader's buffer and hand
+ * the slot back to the worker.
+ */
+static void
+_bt_exchangetake(BTRunData * run)
+{
+	BTExchange     *xchg = run->xchg;
+	BTExchangeSlot *slot = &xchg->slots[run->slot];
+
+	pthread_mutex_lock(&xchg->guard);
+	while (slot->state != BTSLOT_FULL && slot->state != BTSLOT_LAST)
+		_bt_exchangewait(xchg, true);
+
+	memcpy(run->batch, slot->batch, slot->len);
+	run->len = slot->len;
+	run->pos = 0;
+	run->last = (slot->state == BTSLOT_LAST);
+	slot->state = (run->last) ? BTSLOT_DONE : BTSLOT_EMPTY;
+
+	pthread_cond_broadcast(&xchg->gate);
+	pthread_mutex_unlock(&xchg->guard);
+}
+
+/*
+ * worker side: pack sorted tuples into an empty slot.  A tuple that does
+ * not fit is kept in pending for the next batch.  Returns true once the
+ * spool is exhausted.
+ */
+static bool
+_bt_exchangefill(BTSpool * spool, BTExchangeSlot * slot,
+		 IndexTuple * pending, bool * pending_free)
+{
+	Size            len = 0;
+	bool            eof = false;
+
+	for (;;) {
+		Size            itemsz;
+
+		if (*pending == NULL) {
+			*pending = (IndexTuple) tuplesort_getindextuple(spool->sortstate, true, pending_free);
+			if (*pending == NULL) {
+				eof = true;
+				break;
+			}
+		}
+
+		itemsz = IndexTupleSize(*pending);
+		if (len + MAXALIGN(itemsz) > BTEXCHANGE_BATCHSZ)
+			break;
+
+		memcpy(slot->batch + len, *pending, itemsz);
+		len += MAXALIGN(itemsz);
+
+		if (*pending_free)
+			pfree(*pending);
+		*pending = NULL;
+	}
+
+	slot->len = len;
+	return eof;
+}
+
+/*
+ * wait for the worker to let go of an exchange and release it.
+ */
+static void
+_bt_exchangeend(BTExchange * xchg)
+{
+	int             i;
+
+	pthread_mutex_lock(&xchg->guard);
+	while (!xchg->finished)
+		_bt_exchangewait(xchg, true);
+	pthread_mutex_unlock(&xchg->guard);
+
+	pthread_mutex_destroy(&xchg->guard);
+	pthread_cond_destroy(&xchg->gate);
+	for (i = 0; i < BTEXCHANGE_MAXRUNS; i++)
+		pfree(xchg->slots[i].batch);
+	pfree(xchg);
+}
+
+
 /*
  * allocate a new, clean btree page, not linked to any siblings.
  */
@@ -404,6 +886,18 @@ _bt_buildadd(Relation index, BTPageState * state, BTItem bti)
 		ii->lp_flags &= ~LP_USED;
 		((PageHeader) opage)->pd_lower -= sizeof(ItemIdData);
 
+		/*
+		 * The high key only needs the key, not a posting list.  The
+		 * plain item is smaller, so it is cut back where it lies.
+		 */
+		if (BTItemIsPosting(obti)) {
+			BTItem          hikey = _bt_formitem(&(obti->bti_itup));
+
+			memcpy(obti, hikey, BTITEMSZ(hikey));
+			hii->lp_len = BTITEMSZ(hikey);
+			pfree(hikey);
+		}
+
 		/*
 		 * Link the old buffer into its parent, using its minimum
 		 * key. If we don't have a parent, we have to create one;
@@ -535,28 +1029,90 @@ _bt_uppershutdown(Relation index, BTPageState * state)
 }
 
 /*
- * Read tuples in correct sort order from tuplesort, and load them into btree
- * leaves.
+ * Flush the pending run of equal keys collected by _bt_load as one leaf
+ * item, a posting list if the run holds more than one heap TID.
  */
 static void
-_bt_load(Relation index, BTSpool * btspool)
+_bt_loadflush(Relation index, BTPageState * state, BTItem base,
+	      ItemPointer tids, int ntids)
+{
+	BTItem          bti;
+
+	if (base == NULL)
+		return;
+
+	bti = _bt_formposting(base, tids, ntids);
+	_bt_buildadd(index, state, bti);
+	pfree(bti);
+}
+
+/*
+ * Read tuples in correct sort order from tuplesort, merging any attached
+ * runs, and load them into btree leaves.
+ *
+ * For a non-unique index, runs of equal keys are merged into posting list
+ * items as they come off the sort, up to BTMaxPostingSize per item.  The
+ * index decides, not the spool: the dead tuple spool of a unique index is
+ * sorted without the uniqueness check but must still load plain items,
+ * _bt_check_unique reads every leaf t_tid as a heap tid.
+ */
+static void
+_bt_load(Relation index, BTSpool * btspool, bool isunique)
 {
 	BTPageState    *state = NULL;
 	IndexTuple      it = NULL;
 	BTItem          bti = NULL;
 	bool            should_free;
+	bool            dedup = !isunique;
+	BTItem          base = NULL;
+	ItemPointer     tids = NULL;
+	int             ntids = 0;
+	int             maxtids = 0;
 
-	while (it = (IndexTuple) tuplesort_getindextuple(btspool->sortstate, true, &should_free), it != (IndexTuple) NULL) {
+	while (it = _bt_spoolnext(btspool, &should_free), it != (IndexTuple) NULL) {
 		/* When we see first tuple, create first index page */
 		if (state == NULL)
 			state = _bt_pagestate(index, BTP_LEAF, 0);
 
 		bti = _bt_formitem(it);
-		_bt_buildadd(index, state, bti);
 		if (should_free)
 			pfree((void *) it);
-		pfree(bti);
+
+		if (!dedup) {
+			_bt_buildadd(index, state, bti);
+			pfree(bti);
+			continue;
+		}
+
+		if (base != NULL && ntids < maxtids && _bt_keysequal(base, bti)) {
+			tids[ntids++] = bti->bti_itup.t_tid;
+			pfree(bti);
+			continue;
+		}
+
+		_bt_loadflush(index, state, base, tids, ntids);
+		if (base != NULL)
+			pfree(base);
+
+		/* start a new run keyed by this item */
+		base = bti;
+		maxtids = (BTMaxPostingSize - MAXALIGN(_bt_keysize(base))) / sizeof(ItemPointerData);
+		if (maxtids < 1)
+			maxtids = 1;
+		if (tids == NULL)
+			tids = (ItemPointer) palloc(maxtids * sizeof(ItemPointerData));
+		else
+			tids = (ItemPointer) repalloc(tids, maxtids * sizeof(ItemPointerData));
+		tids[0] = base->bti_itup.t_tid;
+		ntids = 1;
+	}
+
+	if (base != NULL) {
+		_bt_loadflush(index, state, base, tids, ntids);
+		pfree(base);
 	}
+	if (tids != NULL)
+		pfree(tids);
 
 	/* Close down final pages, if we had any data at all */
 	if (state != NULL)
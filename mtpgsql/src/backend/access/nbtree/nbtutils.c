@@ -63,6 +63,7 @@ _bt_mkscankey(Relation rel, IndexTuple itup)
 									   (AttrNumber) (i + 1),
 									   proc,
 									   arg);
+		_bt_setcmptype(&skey[i]);
         }
 
 	return skey;
@@ -97,11 +98,55 @@ _bt_mkscankey_nodata(Relation rel)
 									   (AttrNumber) (i + 1),
 									   proc,
 									   (Datum) 0);
+		_bt_setcmptype(&skey[i]);
 	}
 
 	return skey;
 }
 
+/*
+ * _bt_setcmptype
+ *		Select an inline comparison for a scan key built on one of the
+ *		builtin fixed-width order procs.  This is done once when the
+ *		scan key is made so that _bt_compare() does not have to go
+ *		through the fmgr function pointer for every probe.  Keys on
+ *		any other type keep BTCMP_FMGR.
+ */
+void
+_bt_setcmptype(ScanKey entry)
+{
+	switch (entry->sk_procedure)
+	{
+		case F_BTINT2CMP:
+			entry->sk_cmptype = BTCMP_INT2;
+			break;
+		case F_BTINT4CMP:
+			entry->sk_cmptype = BTCMP_INT4;
+			break;
+		case F_BTINT8CMP:
+			entry->sk_cmptype = BTCMP_INT8;
+			break;
+		case F_BTOIDCMP:
+			entry->sk_cmptype = BTCMP_OID;
+			break;
+		case F_BTFLOAT8CMP:
+			entry->sk_cmptype = BTCMP_FLOAT8;
+			break;
+		case F_BTNAMECMP:
+			entry->sk_cmptype = BTCMP_NAME;
+			break;
+		case F_BTCHARCMP:
+			entry->sk_cmptype = BTCMP_CHAR;
+			break;
+		case F_BTBOOLCMP:
+			entry->sk_cmptype = BTCMP_BOOL;
+			break;
+		default:
+			entry->sk_cmptype = BTCMP_FMGR;
+			break;
+	}
+}
+
 /*
  * free a scan key made by either _bt_mkscankey or _bt_mkscankey_nodata.
  */
@@ -144,11 +189,98 @@ _bt_formitem(IndexTuple itup)
 
 	/* make a copy of the index tuple with room for extra stuff */
 	tuplen = IndexTupleSize(itup);
+	if (itup->t_info & INDEX_POSTING_MASK)
+		tuplen = _bt_keysize((BTItem) itup);
 	nbytes_btitem = tuplen + (sizeof(BTItemData) - sizeof(IndexTupleData));
 
 	btitem = (BTItem) palloc(nbytes_btitem);
 	memcpy((char *) &(btitem->bti_itup), (char *) itup, tuplen);
 
+	/*
+	 * A posting list item is cut back to its key and first heap TID.
+	 * Every caller wants either a pivot key or a fresh leaf item.
+	 */
+	if (itup->t_info & INDEX_POSTING_MASK)
+	{
+		btitem->bti_itup.t_tid = *BTItemGetPosting((BTItem) itup, 0);
+		btitem->bti_itup.t_info &= ~(INDEX_POSTING_MASK | INDEX_SIZE_MASK);
+		btitem->bti_itup.t_info |= tuplen;
+	}
+
+	return btitem;
+}
+
+/*
+ * _bt_keysize
+ *		Size of the header and key data of a btree item, not counting
+ *		the heap TIDs of a posting list.
+ */
+Size
+_bt_keysize(BTItem btitem)
+{
+	if (BTItemIsPosting(btitem))
+		return BTItemGetPostingOffset(btitem);
+	return IndexTupleDSize(btitem->bti_itup);
+}
+
+/*
+ * _bt_keysequal
+ *		True if two leaf items carry byte-identical keys.  This is stricter
+ *		than the opclass notion of equality, which is fine for deciding
+ *		whether two items may share a posting list.
+ */
+bool
+_bt_keysequal(BTItem a, BTItem b)
+{
+	Size		asz = _bt_keysize(a);
+	Size		bsz = _bt_keysize(b);
+
+	if (asz != bsz)
+		return false;
+	if ((a->bti_itup.t_info & (INDEX_NULL_MASK | INDEX_VAR_MASK)) !=
+		(b->bti_itup.t_info & (INDEX_NULL_MASK | INDEX_VAR_MASK)))
+		return false;
+
+	return (memcmp((char *) &a->bti_itup + sizeof(IndexTupleData),
+				   (char *) &b->bti_itup + sizeof(IndexTupleData),
+				   asz - sizeof(IndexTupleData)) == 0);
+}
+
+/*
+ * _bt_formposting
+ *		Build a leaf item with the key of base and the given heap TIDs.
+ *		A single TID gives back a plain item.  The caller is responsible
+ *		for keeping the result within BTMaxPostingSize.
+ */
+BTItem
+_bt_formposting(BTItem base, ItemPointer tids, int ntids)
+{
+	Size		keysz = _bt_keysize(base);
+	Size		postoff = MAXALIGN(keysz);
+	Size		itemsz;
+	BTItem		btitem;
+
+	Assert(ntids > 0);
+
+	if (ntids == 1)
+	{
+		btitem = _bt_formitem(&base->bti_itup);
+		btitem->bti_itup.t_tid = tids[0];
+		return btitem;
+	}
+
+	itemsz = postoff + ntids * sizeof(ItemPointerData);
+	if (itemsz & ~INDEX_SIZE_MASK)
+		elog(ERROR, "btree: posting list of %d items is too big", ntids);
+
+	btitem = (BTItem) palloc(itemsz);
+	MemSet(btitem, 0, itemsz);
+	memcpy((char *) &(btitem->bti_itup), (char *) &(base->bti_itup), keysz);
+	btitem->bti_itup.t_info &= ~INDEX_SIZE_MASK;
+	btitem->bti_itup.t_info |= (INDEX_POSTING_MASK | itemsz);
+	ItemPointerSetUnchecked(&btitem->bti_itup.t_tid, postoff, ntids);
+	memcpy(BTItemGetPosting(btitem, 0), tids, ntids * sizeof(ItemPointerData));
+
 	return btitem;
 }
 
@@ -168,6 +168,8 @@
 #include "utils/memutils.h"
 #include "access/genam.h"
 #include "env/dolhelper.h"
+#include "access/blobstorage.h"
+#include "env/visibilitymap.h"
 
 /*
 * Moved to env MKS  7/30/2000
@@ -912,6 +914,7 @@ CommitTransaction()
 	CloseSequences();
 	DropNoNameRels();
         RelationCacheCommit();
+	AtEOXact_VisibilityMap(true);
 	
         ThreadTransactionEnd();
         
@@ -931,6 +934,7 @@ CommitTransaction()
 	AtCommit_Locks();
 	AtCommit_Memory();
 	AtEOXact_Files();
+	AtEOXact_Blobs(true);
 
 #ifdef  USE_ASSERT_CHECKING  
         if ( BufferPoolCheckLeak() ) {
@@ -1012,10 +1016,13 @@ AbortTransaction()
 	DropNoNameRels();
 	invalidate_temp_relations();
 
+	/* releases the blob read pipes still open, before the cache and locks go */
+	AtEOXact_Blobs(false);
 	AtAbort_Cache();
 	AtAbort_Locks();
 	AtAbort_Memory();
 	AtEOXact_Files();
+	AtEOXact_VisibilityMap(false);
 
         ResetLocalBufferPool();
 
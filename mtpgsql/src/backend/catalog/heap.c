@@ -32,9 +32,11 @@
 #include "env/env.h"
 
 #include "env/freespace.h"
+#include "env/visibilitymap.h"
 #include "env/dbwriter.h"
 
 #include "access/heapam.h"
+#include "access/blobstorage.h"
 #include "access/genam.h"
 #include "access/xact.h"
 #include "catalog/catalog.h"
@@ -1322,6 +1324,7 @@ heap_truncate(char *relname)
         DropVacuumRequests(rid,GetDatabaseId());   
         InvalidateRelationBuffers(rel);
         ForgetFreespace(rel,false);
+        VisibilityMapForget(rel);
 	/* Now truncate the actual data and set blocks to zero */
 	
         smgrtruncate(rel->rd_smgr, 0);
@@ -1615,6 +1618,7 @@ heap_drop_with_catalog(const char *relname)
 		smgrunlink(rel->rd_smgr);
                 rel->rd_smgr = NULL;
         }
+        DropBlobExtents(rel);
         
 	rel->rd_unlinked = TRUE;
 
@@ -1630,6 +1634,7 @@ heap_drop_with_catalog(const char *relname)
 
         DropVacuumRequests(rid,GetDatabaseId());
         ForgetFreespace(rel,true);
+        VisibilityMapForget(rel);
         ImmediateSharedRelationCacheInvalidate(rel);
 	RelationForgetRelation(rid,GetDatabaseId());
 
@@ -1654,11 +1659,13 @@ heap_drop(Relation rel)
 		smgrunlink(rel->rd_smgr);
                 rel->rd_smgr = NULL;
         }
+        DropBlobExtents(rel);
 	rel->rd_unlinked = TRUE;
 	heap_close(rel, NoLock);
 	RemoveFromNoNameRelList(rel);
         DropVacuumRequests(rid,GetDatabaseId());        
         ForgetFreespace(rel,true);
+        VisibilityMapForget(rel);
         ImmediateSharedRelationCacheInvalidate(rel);
 	RelationForgetRelation(rid,GetDatabaseId());
 }
@@ -185,7 +185,10 @@ explain_outNode(StringInfo str, Plan *plan, int indent, ExplainState *es)
 			pname = "Merge Join";
 			break;
 		case T_HashJoin:
-			pname = "Hash Join";
+			if (((HashJoin *) plan)->parallel > 0)
+				pname = "Parallel Hash Join";
+			else
+				pname = "Hash Join";
 			break;
 		case T_SeqScan:
 			pname = "Seq Scan";
@@ -214,6 +217,9 @@ explain_outNode(StringInfo str, Plan *plan, int indent, ExplainState *es)
 		case T_Agg:
 			pname = "Aggregate";
 			break;
+		case T_HashAgg:
+			pname = "HashAggregate";
+			break;
 		case T_Unique:
 			pname = "Unique";
 			break;
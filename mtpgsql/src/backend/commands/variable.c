@@ -40,6 +40,7 @@
 #include "env/poolsweep.h"
 #include "access/genam.h"
 #include "env/freespace.h"
+#include "storage/bufmgr.h"
 #include "catalog/catname.h"
 #include "catalog/pg_database.h"
 
@@ -131,6 +132,12 @@ static bool parse_enable_mergejoin(char *);
 static bool reset_enable_hashjoin(void);
 static bool show_enable_hashjoin(void);
 static bool parse_enable_hashjoin(char *);
+static bool reset_enable_hashagg(void);
+static bool show_enable_hashagg(void);
+static bool parse_enable_hashagg(char *);
+static bool reset_enable_parallelhashjoin(void);
+static bool show_enable_parallelhashjoin(void);
+static bool parse_enable_parallelhashjoin(char *);
 static bool reset_geqo(void);
 static bool show_geqo(void);
 static bool parse_geqo(char *);
@@ -194,6 +201,9 @@ static bool reset_snapshot(void);
 static bool parse_debug_memory(char *);
 static bool show_debug_memory(void);
 static bool reset_debug_memory(void);
+static bool parse_buffers(char *);
+static bool show_buffers(void);
+static bool reset_buffers(void);
 /*
  * get_token
  *		Obtain the next item in a comma-separated list of items,
@@ -552,6 +562,56 @@ reset_enable_hashjoin()
 	return TRUE;
 }
 
+/*
+ * ENABLE_HASHAGG
+ */
+static bool
+parse_enable_hashagg(char *value)
+{
+	return parse_boolean_var(value, &GetCostInfo()->enable_hashagg,
+							 "ENABLE_HASHAGG", true);
+}
+
+static bool
+show_enable_hashagg()
+{
+	elog(NOTICE, "ENABLE_HASHAGG is %s",
+		 GetCostInfo()->enable_hashagg ? "ON" : "OFF");
+	return TRUE;
+}
+
+static bool
+reset_enable_hashagg()
+{
+	GetCostInfo()->enable_hashagg = true;
+	return TRUE;
+}
+
+/*
+ * ENABLE_PARALLELHASHJOIN
+ */
+static bool
+parse_enable_parallelhashjoin(char *value)
+{
+	return parse_boolean_var(value, &GetCostInfo()->enable_parallelhashjoin,
+							 "ENABLE_PARALLELHASHJOIN", true);
+}
+
+static bool
+show_enable_parallelhashjoin()
+{
+	elog(NOTICE, "ENABLE_PARALLELHASHJOIN is %s",
+		 GetCostInfo()->enable_parallelhashjoin ? "ON" : "OFF");
+	return TRUE;
+}
+
+static bool
+reset_enable_parallelhashjoin()
+{
+	GetCostInfo()->enable_parallelhashjoin = true;
+	return TRUE;
+}
+
 /*
  *
  * GEQO
@@ -1575,6 +1635,14 @@ static struct VariableParsers
 		"enable_hashjoin", parse_enable_hashjoin,
 		show_enable_hashjoin, reset_enable_hashjoin
 	},
+	{
+		"enable_hashagg", parse_enable_hashagg,
+		show_enable_hashagg, reset_enable_hashagg
+	},
+	{
+		"enable_parallelhashjoin", parse_enable_parallelhashjoin,
+		show_enable_parallelhashjoin, reset_enable_parallelhashjoin
+	},
 	{
 		"geqo", parse_geqo, show_geqo, reset_geqo
 	},
@@ -1650,6 +1718,9 @@ static struct VariableParsers
  	{
 		"debug_memory", parse_debug_memory, show_debug_memory, reset_debug_memory
 	},
+ 	{
+		"buffers", parse_buffers, show_buffers, reset_buffers
+	},
         {
 		NULL, NULL, NULL, NULL
 	}
@@ -1750,6 +1821,8 @@ InitializeCostInfo(void) {
     info->enable_nestloop = true;
     info->enable_mergejoin = true;
     info->enable_hashjoin = true;
+    info->enable_hashagg = true;
+    info->enable_parallelhashjoin = thread_helpers;
     info->enable_delegatedindexscan = thread_helpers;
 
     cost_info = info;
@@ -2183,3 +2256,36 @@ reset_debug_memory()
     GetEnv()->print_memory = FALSE;
 	return TRUE;
 }
+
+/*
+ * resize the shared buffer pool while running, growing is bounded by the
+ * maximum the pool was created with.
+ */
+static bool
+parse_buffers(char *value)
+{
+	int			buffers = atoi(value);
+
+	if (!superuser())
+		elog(ERROR, "Only users with superuser privilege can set buffers");
+	if (buffers <= 0)
+		elog(ERROR, "Bad value for buffers (%s)", value);
+	elog(NOTICE, "BUFFERS is %d", ResizeBufferPool(buffers));
+	return TRUE;
+}
+
+static bool
+show_buffers()
+{
+	elog(NOTICE, "BUFFERS is %d", ActiveBuffers());
+	return TRUE;
+}
+
+static bool
+reset_buffers()
+{
+	if (!superuser())
+		elog(ERROR, "Only users with superuser privilege can set buffers");
+	elog(NOTICE, "BUFFERS is %d", RestoreBufferPool());
+	return TRUE;
+}
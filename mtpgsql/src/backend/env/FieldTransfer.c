@@ -264,3 +264,330 @@ TransferToRegistered(InputOutput* output, Form_pg_attribute desc, Datum value, b
     return result >= 0;
 }
 
+
+/*
+ *  columnar output segments, see WeaverInterface.h
+ */
+#define SEGMENT_ALIGN(len)  (((len) + 7) & ~((int64_t) 7))
+
+static int
+SegmentWidth(int type) {
+    switch (type) {
+        case BOOLOID:
+            return 1;
+        case INT2OID:
+            return 2;
+        case INT4OID:
+        case FLOAT4OID:
+            return 4;
+        case INT8OID:
+        case FLOAT8OID:
+        case TIMESTAMPOID:
+            return 8;
+        case CHAROID:
+        case TEXTOID:
+        case VARCHAROID:
+        case BPCHAROID:
+        case BYTEAOID:
+        case BLOBOID:
+        case JAVAOID:
+            return sizeof(OutputSegmentVar);
+        default:
+            return 0;
+    }
+}
+
+/*
+ *  a char output is one byte from a char and text from anything else,
+ *  so it is variable length in a segment
+ */
+static bool
+IsSegmentVarType(Oid type) {
+    switch (type) {
+        case CHAROID:
+        case TEXTOID:
+        case VARCHAROID:
+        case BPCHAROID:
+        case BYTEAOID:
+        case BLOBOID:
+        case JAVAOID:
+            return true;
+        default:
+            return false;
+    }
+}
+
+void
+LayoutOutputSegment(OutputSegment* segment, long size) {
+    int64_t     pos;
+    int64_t     rowbytes = 0;
+    int64_t     left;
+    int64_t     maxrows;
+    bool        hasvar = false;
+    int         i;
+
+    if (segment->ncols <= 0 || segment->ncols > MAX_ARGS) {
+        coded_elog(ERROR, 101, "bad value - segment columns must be greater than 0 and less than %d", MAX_ARGS);
+    }
+
+    pos = SEGMENT_ALIGN(offsetof(OutputSegment, columns) + segment->ncols * sizeof(OutputSegmentColumn));
+    if (size <= pos) {
+        coded_elog(ERROR, 101, "bad value - output segment of %ld bytes is too small", size);
+    }
+
+    for (i = 0; i < segment->ncols; i++) {
+        OutputSegmentColumn* col = &segment->columns[i];
+
+        if (col->index <= 0 || col->index > MAX_ARGS) {
+            coded_elog(ERROR, 101, "bad value - index must be greater than 0 and less than %d", MAX_ARGS);
+        }
+        col->width = SegmentWidth(col->type);
+        if (col->width == 0) {
+            coded_elog(ERROR, 106, "type %d cannot be fetched into an output segment", col->type);
+        }
+        if (IsSegmentVarType(col->type)) {
+            hasvar = true;
+        }
+        rowbytes += col->width;
+        col->name[0] = '\0';
+    }
+
+    /*  half goes to variable length data when there is any, each column
+     *  loses at most 16 bytes to aligning its two arrays  */
+    left = size - pos;
+    if (hasvar) {
+        left /= 2;
+    }
+    maxrows = ((left - segment->ncols * 16) * 8) / (rowbytes * 8 + segment->ncols);
+    if (segment->maxrows > 0 && segment->maxrows < maxrows) {
+        maxrows = segment->maxrows;
+    }
+    if (maxrows > 0x7fffffff) {
+        maxrows = 0x7fffffff;
+    }
+    if (maxrows < 1) {
+        coded_elog(ERROR, 101, "bad value - output segment of %ld bytes is too small", size);
+    }
+
+    for (i = 0; i < segment->ncols; i++) {
+        OutputSegmentColumn* col = &segment->columns[i];
+
+        col->values = pos;
+        pos = SEGMENT_ALIGN(pos + maxrows * col->width);
+        col->nulls = pos;
+        pos = SEGMENT_ALIGN(pos + (maxrows + 7) / 8);
+    }
+
+    segment->maxrows = (int32_t) maxrows;
+    segment->nrows = 0;
+    segment->size = size;
+    segment->vardata = pos;
+    /*  var entries hold 32 bit offsets  */
+    segment->varsize = (size - pos > 0x7fffffff) ? 0x7fffffff : size - pos;
+    segment->varused = 0;
+}
+
+/*
+ *  append bytes to the variable area of the segment and point the
+ *  entry at them.  false when they do not fit.
+ */
+static bool
+SegmentVarCopy(OutputSegment* segment, char* entry, const char* data, int64_t length) {
+    OutputSegmentVar var;
+
+    if (segment->varused + length > segment->varsize) {
+        return false;
+    }
+    memcpy((char*) segment + segment->vardata + segment->varused, data, length);
+    var.offset = (int32_t) segment->varused;
+    var.length = (int32_t) length;
+    memcpy(entry, &var, sizeof(OutputSegmentVar));
+    segment->varused += length;
+    return true;
+}
+
+static bool
+SegmentVarValue(OutputSegment* segment, char* entry, Datum value) {
+    if ( ISINDIRECT(value) ) {
+        int64_t     length = sizeof_indirect_blob(value);
+        char*       dest = (char*) segment + segment->vardata + segment->varused;
+        int         read = 0;
+        Datum       pipe;
+        OutputSegmentVar var;
+
+        if (segment->varused + length > segment->varsize) {
+            return false;
+        }
+        pipe = open_read_pipeline_blob(value, false);
+        while (read_pipeline_segment_blob(pipe, dest, &read, sizeof_max_tuple_blob())) {
+            dest += read;
+        }
+        close_read_pipeline_blob(pipe);
+        var.offset = (int32_t) segment->varused;
+        var.length = (int32_t) length;
+        memcpy(entry, &var, sizeof(OutputSegmentVar));
+        segment->varused += length;
+        return true;
+    } else {
+        return SegmentVarCopy(segment, entry, VARDATA(DatumGetPointer(value)), VARSIZE(DatumGetPointer(value)) - VARHDRSZ);
+    }
+}
+
+/*
+ *  the bytes BinaryCopyOutValue transfers
+ */
+static bool
+SegmentBinaryValue(OutputSegment* segment, char* entry, Form_pg_attribute desc, Datum value) {
+    if (desc->attlen > 0) {
+        if (desc->attbyval) {
+            return SegmentVarCopy(segment, entry, (char*) &value, desc->attlen);
+        } else {
+            return SegmentVarCopy(segment, entry, DatumGetPointer(value), desc->attlen);
+        }
+    } else {
+        return SegmentVarValue(segment, entry, value);
+    }
+}
+
+/*
+ *  write one value of a row into the segment.  The conversions are the
+ *  ones TransferToRegistered makes, anything else is a mismatch.
+ */
+int
+TransferToSegment(OutputSegment* segment, int col, int row, Form_pg_attribute desc, Datum value, bool isnull) {
+    OutputSegmentColumn* column = &segment->columns[col];
+    char*       entry = (char*) segment + column->values + (int64_t) row * column->width;
+    uint8_t*    nulls = (uint8_t*) segment + column->nulls;
+
+    if (isnull) {
+        nulls[row >> 3] |= (1 << (row & 0x07));
+        memset(entry, 0x00, column->width);
+        return SEGMENT_TRANSFERRED;
+    }
+    nulls[row >> 3] &= ~(1 << (row & 0x07));
+
+    if (desc->atttypid == column->type) {
+        switch (column->type) {
+            case BOOLOID:
+                *entry = DatumGetChar(value);
+                break;
+            case CHAROID:
+                {
+                    char val = DatumGetChar(value);
+                    if (!SegmentVarCopy(segment, entry, &val, 1)) {
+                        return SEGMENT_FULL;
+                    }
+                    break;
+                }
+            case INT2OID:
+                {
+                    int16 val = DatumGetInt16(value);
+                    memcpy(entry, &val, 2);
+                    break;
+                }
+            case INT4OID:
+                {
+                    int32 val = DatumGetInt32(value);
+                    memcpy(entry, &val, 4);
+                    break;
+                }
+            case FLOAT4OID:
+            case INT8OID:
+            case FLOAT8OID:
+            case TIMESTAMPOID:
+                if (desc->attbyval) {
+                    memcpy(entry, &value, column->width);
+                } else {
+                    memcpy(entry, DatumGetPointer(value), column->width);
+                }
+                break;
+            default:
+                if (!SegmentVarValue(segment, entry, value)) {
+                    return SEGMENT_FULL;
+                }
+                break;
+        }
+        return SEGMENT_TRANSFERRED;
+    }
+
+    switch (column->type) {
+        case CHAROID:
+        case VARCHAROID:
+            {
+                Oid     foutoid,
+                        typelem;
+                char*   texto;
+
+                if (!getTypeOutAndElem(desc->atttypid, &foutoid, &typelem)) {
+                    coded_elog(ERROR, 108, "type conversion error");
+                }
+                texto = (char *) (fmgr(foutoid, value, typelem, desc->atttypmod));
+                if (!SegmentVarCopy(segment, entry, texto, strlen(texto))) {
+                    return SEGMENT_FULL;
+                }
+                break;
+            }
+        case TEXTOID:
+        case BPCHAROID:
+        case BYTEAOID:
+        case BLOBOID:
+            if (!SegmentBinaryValue(segment, entry, desc, value)) {
+                return SEGMENT_FULL;
+            }
+            break;
+        case INT4OID:
+            {
+                int32 val;
+
+                if (desc->atttypid == CONNECTOROID) {
+                    val = DatumGetInt32(value);
+                } else if (desc->atttypid == BOOLOID) {
+                    val = (value) ? 1 : 0;
+                } else if (desc->atttypid == INT8OID) {
+                    int64 var = desc->attbyval ? DatumGetLong(value) : *(int64*) DatumGetPointer(value);
+                    if (var > 0x7fffffffL) {
+                        return SEGMENT_TYPE_MISMATCH;
+                    }
+                    val = (int32) var;
+                } else {
+                    return SEGMENT_TYPE_MISMATCH;
+                }
+                memcpy(entry, &val, 4);
+                break;
+            }
+        case BOOLOID:
+            if (desc->atttypid != INT4OID) {
+                return SEGMENT_TYPE_MISMATCH;
+            }
+            *entry = (value == 0) ? FALSE : TRUE;
+            break;
+        case INT8OID:
+            {
+                int64 val;
+
+                if (desc->atttypid == INT2OID) {
+                    val = DatumGetInt16(value);
+                } else if (desc->atttypid == INT4OID) {
+                    val = DatumGetInt32(value);
+                } else {
+                    val = desc->attbyval ? (int64) value : *(int64*) DatumGetPointer(value);
+                }
+                memcpy(entry, &val, 8);
+                break;
+            }
+        case FLOAT8OID:
+            {
+                double val;
+
+                if (desc->atttypid != FLOAT4OID) {
+                    return SEGMENT_TYPE_MISMATCH;
+                }
+                val = (double) *DatumGetFloat32(value);
+                memcpy(entry, &val, 8);
+                break;
+            }
+        default:
+            return SEGMENT_TYPE_MISMATCH;
+    }
+    return SEGMENT_TRANSFERRED;
+}
@@ -75,6 +75,8 @@ static void* AllocMemory(WConn connection, mem_type type, size_t size);
 static int ExpandSlots(PreparedPlan* connection,TransferType type);
 static short CheckThreadContext(WConn);
 static PreparedPlan* ClearPlan(PreparedPlan* plan);
+static void FillOutputSegment(PreparedPlan* plan);
+static bool TransferTupleToSegment(PreparedPlan* plan, HeapTuple tuple, TupleDesc tdesc, int row);
 
 static SectionId   connection_section_id = SECTIONID("CONN");
 
@@ -226,6 +228,7 @@ WCreateConnection(const char *tName, const char *pass, const char *conn) {
 
         SetPgUserName(connection->name);
         SetUserId();
+        SweepBlobExtents();
         pthread_mutex_init(&connection->child_lock, NULL);
         connection->parent = NULL;
     } else {
@@ -440,6 +443,10 @@ WPrepareStatement(OpaqueWConn conn, const char *smt) {
     plan->node_cxt = NULL;
     plan->exec_cxt = NULL;
     plan->stage = STMT_NEW;
+
+    plan->segment = NULL;
+    plan->segment_held = NULL;
+    plan->segment_desc = NULL;
     
     plan->next = connection->plan;
     connection->plan = plan;
@@ -517,6 +524,43 @@ WOutputTransfer(OpaquePreparedStatement plan, short pos, int type, void* userenv
     return err;
 }
 
+/*
+ *  register a columnar segment the rows of the statement are fetched
+ *  into by WFetchSegment.  The caller fills in the column count, the
+ *  index and type of each column and optionally a row limit, the rest
+ *  of the layout is done here.  A NULL segment drops the registration.
+ */
+long
+WOutputSegment(OpaquePreparedStatement plan, void* segment, long size) {
+    WConn connection = SETUP(plan->owner);
+    long err;
+
+    if (CheckThreadContext(connection)) {
+        return GETERROR(connection);
+    }
+
+    READY(connection, err, false);
+
+    if (CheckForCancel()) {
+        elog(ERROR, "Query Cancelled");
+    }
+
+    if (plan->segment_held != NULL) {
+        elog(ERROR, "cannot change the output segment while rows are pending");
+    }
+
+    if (segment != NULL) {
+        LayoutOutputSegment((OutputSegment*) segment, size);
+    }
+    plan->segment = (OutputSegment*) segment;
+    plan->segment_held = NULL;
+    plan->segment_desc = NULL;
+
+    RELEASE(connection, false);
+
+    return err;
+}
+
 long
 WExec(OpaquePreparedStatement plan) {
     WConn connection = SETUP(plan->owner);
@@ -762,6 +806,45 @@ WFetch(OpaquePreparedStatement plan) {
     return err;
 }
 
+/*
+ *  fill the registered segment with as many rows as fit.  Returns 0 with
+ *  the row count in the segment header, 4 once there are no more rows.
+ *  A row whose variable length data does not fit in what is left is held
+ *  over to start the next segment.
+ */
+long
+WFetchSegment(OpaquePreparedStatement plan) {
+    WConn connection = SETUP(plan->owner);
+    OutputSegment* segment = plan->segment;
+    long err;
+
+    if (CheckThreadContext(connection)) {
+        return GETERROR(connection);
+    }
+    READY(connection, err, false);
+
+    if (segment == NULL) {
+        elog(ERROR, "no output segment registered");
+    }
+
+    if (plan->stage == STMT_EOD) {
+        /*  the last rows went out with the previous segment  */
+        segment->nrows = 0;
+        err = 4;
+    } else {
+        FillOutputSegment(plan);
+        if (plan->stage == STMT_EOD) {
+            Assert(connection->inselect == NULL);
+            if (segment->nrows == 0) {
+                err = 4; /*  EOT ( End of Transmission ascii code */
+            }
+        }
+    }
+
+    RELEASE(connection, false);
+    return err;
+}
+
 long
 WFetchIsComplete(OpaquePreparedStatement stmt) {
     if (stmt->stage == STMT_EOD) return TRUE;
@@ -1406,12 +1489,154 @@ WResetExecutor(PreparedPlan * plan) {
     MemoryContextSwitchTo(plan->exec_cxt);        
 
     plan->fetch_cxt = NULL;
+    plan->segment_held = NULL;
+    plan->segment_desc = NULL;
 
     plan->tupdesc = NULL;
     plan->state = NULL;
     plan->qdesc = NULL;
 }
 
+/*
+ *  the row loop of WFetchSegment
+ */
+static void
+FillOutputSegment(PreparedPlan* plan) {
+    WConn connection = plan->owner;
+    OutputSegment* segment = plan->segment;
+
+    if (plan->stage != STMT_FETCH) {
+        elog(ERROR, "statement must be executed first executed");
+    }
+    if (connection->inselect == NULL) {
+        elog(ERROR, "no statement executed");
+    }
+    if (connection->inselect != plan) {
+        elog(ERROR, "cannot mix multiple select statements on the same connection");
+    }
+    if (CheckForCancel()) {
+        elog(ERROR, "Query Cancelled");
+    }
+
+    if (plan->fetch_cxt == NULL) {
+        plan->fetch_cxt = AllocSetContextCreate(plan->exec_cxt,
+            "FetchCxt",
+            ALLOCSET_DEFAULT_MINSIZE,
+            ALLOCSET_DEFAULT_INITSIZE,
+            ALLOCSET_DEFAULT_MAXSIZE);
+    }
+
+    MemoryContext old = MemoryContextSwitchTo(plan->fetch_cxt);
+    bool done = false;
+
+    segment->nrows = 0;
+    segment->varused = 0;
+
+    if (plan->segment_held != NULL) {
+        if (!TransferTupleToSegment(plan, plan->segment_held, plan->segment_desc, 0)) {
+            coded_elog(ERROR, 107, "row does not fit in the output segment");
+        }
+        heap_freetuple(plan->segment_held);
+        plan->segment_held = NULL;
+        plan->segment_desc = NULL;
+        segment->nrows++;
+        plan->state->es_processed++;
+        plan->processed++;
+    }
+
+    while (segment->nrows < segment->maxrows) {
+        MemoryContextResetAndDeleteChildren(plan->fetch_cxt);
+
+        TupleTableSlot *slot = ExecProcNode(plan->qdesc->plantree);
+
+        if (TupIsNull(slot)) {
+            done = true;
+            break;
+        }
+        if (!TransferTupleToSegment(plan, slot->val, slot->ttc_tupleDescriptor, segment->nrows)) {
+            if (segment->nrows == 0) {
+                coded_elog(ERROR, 107, "row does not fit in the output segment");
+            }
+            MemoryContextSwitchTo(plan->exec_cxt);
+            plan->segment_held = heap_copytuple(slot->val);
+            plan->segment_desc = slot->ttc_tupleDescriptor;
+            MemoryContextSwitchTo(plan->fetch_cxt);
+            ExecClearTuple(slot);
+            break;
+        }
+        ExecClearTuple(slot);
+        segment->nrows++;
+        plan->state->es_processed++;
+        plan->processed++;
+    }
+
+    MemoryContextSwitchTo(old);
+
+    if (done) {
+        WResetExecutor(plan);
+        Assert(plan == connection->inselect);
+        connection->inselect = NULL;
+        plan->stage = STMT_EOD;
+    }
+}
+
+/*
+ *  write one row into the segment, false when its variable length data
+ *  does not fit.  The variable area is rolled back to where the row
+ *  started so the row can be retried in the next segment.
+ */
+static bool
+TransferTupleToSegment(PreparedPlan* plan, HeapTuple tuple, TupleDesc tdesc, int row) {
+    OutputSegment* segment = plan->segment;
+    int64_t varstart = segment->varused;
+    int col;
+
+    for (col = 0; col < segment->ncols; col++) {
+        OutputSegmentColumn* column = &segment->columns[col];
+        Form_pg_attribute attr;
+        Datum val;
+        char isnull = 0;
+        int result;
+
+        if (column->index > tdesc->natts) {
+            coded_elog(ERROR, 104, "unassigned attribute");
+        }
+        attr = tdesc->attrs[column->index - 1];
+
+        if (plan->processed == 0 && row == 0) {
+            strncpy(column->name, NameStr(attr->attname), sizeof(column->name) - 1);
+            column->name[sizeof(column->name) - 1] = '\0';
+        }
+
+        if (tuple->t_data->t_natts < column->index) {
+            val = PointerGetDatum(NULL);
+            isnull = 1;
+        } else {
+            val = HeapGetAttr(tuple, column->index, tdesc, &isnull);
+        }
+
+        result = TransferToSegment(segment, col, row, attr, val, isnull);
+        if (result == SEGMENT_FULL) {
+            segment->varused = varstart;
+            return false;
+        } else if (result == SEGMENT_TYPE_MISMATCH) {
+            Oid oType[1];
+            Oid iType[1];
+
+            oType[0] = column->type;
+            iType[0] = attr->atttypid;
+            if (can_coerce_type(1, iType, oType)) {
+                coded_elog(ERROR, 105, "Types are compatible but conversion not implemented link type: %d result type: %d",
+                        column->type, attr->atttypid);
+            } else {
+                coded_elog(ERROR, 106, "Types do not match, no type conversion . position: %d type: %d result type: %d",
+                        column->index, column->type, attr->atttypid);
+            }
+        }
+    }
+    return true;
+}
+
 static int
 TransferExecArgs(PreparedPlan* plan) {
     int k = 0;
@@ -35,6 +35,8 @@
 #include "utils/builtins.h"
 
 #include "env/freespace.h"
+#include "env/visibilitymap.h"
+#include "access/blobstorage.h"
 #include "env/poolsweep.h"
 #include "storage/multithread.h"
 #include "utils/tqual.h"
@@ -306,6 +308,12 @@ LIB_EXTERN bool initweaverbackend(const char* vars)
 	DBCreateWriterThread(LOG_MODE);
         InitializeTransactionSystem();		/* pg_log,etc init/crash recovery here */
 	InitFreespace();
+	InitVisibilityMap();
+	InitBlobStorage();
+
+	if ( PropertyIsValid("checksumbenchmark") ) {
+		PageChecksumBenchmark(GetIntProperty("checksumbenchmark"));
+	}
         LockDisable(false);
 
 	InitThread(DAEMON_THREAD);  
@@ -537,6 +545,8 @@ wrapupweaverbackend()
 	SetEnv(env);
         
 	ShutdownDBWriter();
+	ShutdownVisibilityMap();
+	ShutdownFreespace();
 
 	RelationCacheShutdown();  
         smgrshutdown();
@@ -632,6 +642,8 @@ void
 singleusershutdown(int code) {
         
         ShutdownDBWriter();
+        ShutdownVisibilityMap();
+        ShutdownFreespace();
         smgrshutdown();
         ShutdownVirtualFileSystem();
         DestroyEnv(GetEnv());
@@ -123,6 +123,7 @@ struct writegroups {
     
     char*                               snapshot;
     long                                generation;
+    int                                 dirty;  /* buffers registered, for the trickle writer */
     
     WriteGroup				next;
 };
@@ -157,6 +158,7 @@ static int UnlockWriteGroup(WriteGroup  cart);
 static WriteGroup GetNextTarget(WriteGroup last);
 static void* DBWriter(void* arg);
 static void* SyncWriter(void *jones);
+static void* TrickleWriter(void *jones);
 
 static WriteGroup GetSyncGroup(void);
 static void ActivateSyncGroup(void);
@@ -207,6 +209,14 @@ static int      wait_timeout = 400;
 static int      sync_timeout = 5000;
 static int      max_logcount = (512);
 static long   flush_time = 3000;
+/*
+ * trickle writer -- every trickle_interval ms the current write group is
+ * flushed if it holds trickle_threshold of the buffer pool or a thread
+ * is waiting on the freelist, so dirty buffers are unpinned before the
+ * pool runs out instead of after a buffer_wait timeout
+ */
+static int      trickle_interval = 250;
+static double   trickle_threshold = 0.25;
 /*
  * heap garbage collection threshold -- asks for a vacuum every time the
  * number of syncs on a heap/number of relation blocks is accessed
@@ -256,6 +266,12 @@ void DBWriterInit() {
      if ( PropertyIsValid("gcupdatefactor") ) {
         hgc_update = GetFloatProperty("gcupdatefactor");
     }
+    if ( PropertyIsValid("trickle_interval") ) {
+        trickle_interval = GetIntProperty("trickle_interval");
+    }
+    if ( PropertyIsValid("trickle_threshold") ) {
+        trickle_threshold = GetFloatProperty("trickle_threshold");
+    }
     
     elog(DEBUG, "[DBWriter]waiting time %d", wait_timeout);
     elog(DEBUG, "[DBWriter]sync timeout %d", sync_timeout);
@@ -406,6 +422,12 @@ void DBCreateWriterThread(DBMode mode) {
                     elog(FATAL, "[DBWriter]could not create sync writer\n");
                 }  
             }
+            if ( trickle_interval > 0 ) {
+                writerid = os_realloc(writerid, sizeof(pthread_t) * (writercount + 1));
+                if (pthread_create(&writerid[writercount++], &writerprops, TrickleWriter, NULL) != 0) {
+                    elog(FATAL, "[DBWriter]could not create trickle writer\n");
+                }  
+            }
             /*  fall through so that both threads are created */
         case SYNC_MODE: 
             writerid = os_realloc(writerid, sizeof(pthread_t) * (writercount + 1));
@@ -451,6 +473,39 @@ void* SyncWriter(void *jones) {
     return NULL;
 }
 
+void* TrickleWriter(void *jones) {
+    Env            *env = CreateEnv(NULL);
+    struct timespec nap;
+    
+    SetEnv(env);
+    SetProcessingMode(InitProcessing);
+        
+    MemoryContextInit();
+    MemoryContextSwitchTo(MemoryContextGetTopContext());
+
+    nap.tv_sec = trickle_interval / 1000;
+    nap.tv_nsec = (trickle_interval % 1000) * 1000000;
+    
+    while (!stopped) {
+        int     dirty;
+
+        nanosleep(&nap, NULL);
+        if ( stopped ) break;
+   /*  a dirty read is fine, this only decides whether to ask for a flush  */
+        dirty = log_group->dirty;
+        if ( dirty > 0 && 
+                ( dirty >= ActiveBuffers() * trickle_threshold || IsFreeListWaiting() ) ) {
+            DTRACE_PROBE2(mtpg, dbwriter__trickle, dirty, ActiveBuffers());
+            FlushAllDirtyBuffers(false);
+        }
+    }
+    
+    SetEnv(NULL);
+    DestroyEnv(env);    
+    
+    return NULL;
+}
+
 WriteGroup GetSyncGroup() {
     pthread_mutex_lock(&sync_group->checkpoint);
     while ( sync_group->currstate == FLUSHING || sync_group->currstate == COMPLETED ) {
@@ -811,6 +866,7 @@ void ResetWriteGroup(WriteGroup cart) {
     memset(cart->wait_for_sync, 0, sizeof(bool) * maxtrans);
     
     cart->numberOfTrans = 0;
+    cart->dirty = 0;
     cart->dotransaction = true;
 
     cart->isTransFriendly = true;
@@ -837,6 +893,7 @@ int MergeWriteGroups(WriteGroup target, WriteGroup src) {
         if ( !target->buffers[i] ) {
             memmove(&target->descriptions[i], &src->descriptions[i], sizeof(BufferTag));
             target->buffers[i] = true;
+            target->dirty++;
         }
         
         if ( target->descriptions[i].relId.dbId != src->descriptions[i].relId.dbId ||
@@ -858,6 +915,7 @@ int MergeWriteGroups(WriteGroup target, WriteGroup src) {
             src->buffers[i] = false;
         }
     }
+    src->dirty = 0;
     pthread_mutex_unlock(&target->checkpoint);
     
     return moved;
@@ -934,6 +992,7 @@ long RegisterBufferWrite(BufferDesc * bufHdr, bool release) {
          */
         if ( ManualPin(bufHdr, false) ) {
             cart->buffers[bufHdr->buf_id] = true;
+            cart->dirty++;
             cart->release[bufHdr->buf_id]++;
             memcpy(&cart->descriptions[bufHdr->buf_id], &bufHdr->tag, sizeof(BufferTag));
         } else {
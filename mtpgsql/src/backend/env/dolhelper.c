@@ -519,6 +519,21 @@ IsDolConnectionAvailable(void) {
 }
 
 
+/*
+ * True while a command handed to conn by ProcessDolCommand has not
+ * finished.  A helper that errors out drops back to waiting, so callers
+ * blocked on a helper's output use this to notice that it died.
+ */
+PG_EXTERN bool
+IsDolConnectionRunning(DolConnection conn) {
+    DolState state;
+
+    pthread_mutex_lock(&conn->guard);
+    state = conn->state;
+    pthread_mutex_unlock(&conn->guard);
+
+    return (state == DOL_PRIMED || state == DOL_RUNNING || state == DOL_MAINWAITING);
+}
 
 DolHelperInfo*
 GetDolHelperInfo(void)
@@ -7,6 +7,29 @@
  *
  * IDENTIFICATION
  *
+ * NOTES
+ *     The free bytes of each block are the leaves of a max-tree, every
+ *     inner node holds the larger of its two children, so finding the
+ *     first block at or past a limit with room for a request walks one
+ *     path up and one path down the tree.  Vacuum rebuilds the leaves,
+ *     inserts lower them as they hand out space.
+ *
+ *     Concurrent inserters are spread over lanes, picked by a hash of the
+ *     thread.  Each lane remembers the block it is filling and keeps
+ *     going there while it has room, and a lane looking for a new block
+ *     starts from its own share of the relation and passes over blocks
+ *     another lane is filling, so inserters rarely fight over one
+ *     buffer.
+ *
+ *     The leaves of a heap are written beside the relation
+ *     ("<relation>.fsm") at the end of each vacuum and at shutdown and
+ *     read back when the relation is first used, so a restart does not
+ *     need a freespace scan.  The file is only a hint, hio checks the
+ *     real space on the page and corrects the map when it is wrong.
+ *     Files are read and written without holding freespace_access or
+ *     the accessor of the entry, a write works from a copy of the
+ *     leaves and a load holds off inserters as an extender would.
+ *
  *-------------------------------------------------------------------------
  */
 
@@ -15,6 +38,8 @@
 #include <time.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
 
 
 
@@ -39,6 +64,7 @@
 #include "utils/memutils.h"
 #include "storage/smgr.h"
 #include "storage/buffile.h"
+#include "storage/fd.h"
 
 
 static HTAB*  			freetable;
@@ -50,7 +76,9 @@ static bool			print_freespace_memory = false;
 static MemoryContext            free_cxt;
 
 #define DEFAULT_MINLIVE  (BLCKSZ / 10)  /*  default if the available space is only 10% don't bother checking anymore */
-#define INDEX_SIZE          8
+#define FREEMAP_MAGIC       0x46534d30   /* "FSM0" */
+#define FREEMAP_MIN_LEAVES  64
+#define FREESPACE_LANES     16
 
 
 typedef struct freekey {
@@ -58,22 +86,27 @@ typedef struct freekey {
 	Oid		 dbid;
 } FreeKey;
 
-typedef struct freerun {
-    BlockNumber         tryblock;
-    Size                avail;
-    int                 misses;
-    int                 unused_pointers;
-    bool                live;
-} FreeRun;
+typedef struct freemapheader {
+    uint32              magic;
+    uint32              blcksz;
+    BlockNumber         nblocks;
+    double              live_tuples;
+    double              dead_tuples;
+    Size                min_tuple_size;
+    Size                max_tuple_size;
+    Size                ave_tuple_size;
+} FreeMapHeader;
 
 typedef struct freespace {
     FreeKey				key;
-    long 				size;
-    long 				pointer;
-    BlockNumber                         index[INDEX_SIZE];
-    Size                                index_size[INDEX_SIZE];
-    
-    int                                 skip;
+    uint16*                             tree;       /* node 1 is the root, leaf
+                                                     * for block b is capacity + b */
+    long                                capacity;   /* leaves, a power of two */
+    bool                                changed;    /* differs from the file */
+    char*                               path;       /* heaps only */
+    BlockNumber                         lanes[FREESPACE_LANES];  /* block each
+                                                     * lane is filling */
+
     int                                 min_request;
     int                                 max_request;
     int                                 extent;
@@ -91,9 +124,9 @@ typedef struct freespace {
     Size				ave_tuple_size;
     Size				total_available;
 
-    FreeRun*                            blocks;
     pthread_cond_t                      creator;
     pthread_mutex_t                     accessor;
+    pthread_mutex_t                     writer;     /* one file write at a time */
     pthread_t                           extender;
     MemoryContext                       context;
 } FreeSpace;
@@ -112,7 +145,17 @@ static void RemoveExtentForRelation(Relation rel);
 #ifdef UNUSED
 static void  freespace_log(FreeSpace*, char*, ...);
 #endif
-static int cmp_freeruns(const void *left, const void *right);
+static uint16 FreeTreeClamp(Size avail);
+static void FreeTreeGrow(FreeSpace* entry, BlockNumber nblocks);
+static void FreeTreeRebuild(FreeSpace* entry);
+static void FreeTreeSet(FreeSpace* entry, BlockNumber blk, Size avail);
+static Size FreeTreeGet(FreeSpace* entry, BlockNumber blk);
+static long FreeTreeSearch(FreeSpace* entry, BlockNumber limit, Size space);
+static int FreespaceLane(void);
+static long FreespaceLaneSearch(FreeSpace* entry, int lane, BlockNumber limit, Size space);
+static int FreespaceLanesActive(FreeSpace* entry);
+static bool LoadFreeMap(FreeSpace* entry);
+static void WriteFreeMap(FreeSpace* entry);
 
 static void* FreespaceAlloc(Size size,void* cxt)
 {
@@ -159,6 +202,44 @@ InitFreespace()
 	inited = true;
 }
 
+/*
+ * write the map of every heap changed since its last vacuum.  Called once
+ * the writers are stopped, so no entry goes away while the files are
+ * written outside of freespace_access.
+ */
+void
+ShutdownFreespace()
+{
+    HASH_SEQ_STATUS   seq;
+    FreeSpace*        entry;
+    FreeSpace**       list;
+    long              count = 0;
+    long              pos;
+
+    if ( !inited ) return;
+
+    pthread_mutex_lock(&freespace_access);
+    hash_seq_init(&seq,freetable);
+    while ( (entry = (FreeSpace*)hash_seq_search(&seq)) != NULL ) {
+        count++;
+    }
+    list = MemoryContextAlloc(free_cxt,(count + 1) * sizeof(FreeSpace*));
+    count = 0;
+    hash_seq_init(&seq,freetable);
+    while ( (entry = (FreeSpace*)hash_seq_search(&seq)) != NULL ) {
+        list[count++] = entry;
+    }
+    pthread_mutex_unlock(&freespace_access);
+
+    for (pos = 0; pos < count; pos++) {
+        WriteFreeMap(list[pos]);
+    }
+
+    pthread_mutex_lock(&freespace_access);
+    pfree(list);
+    pthread_mutex_unlock(&freespace_access);
+}
+
 double 
 GetUpdateFactor(Oid relid, Oid dbid, char* relname, char* dbname, double last_value, bool * trackable)
 {
@@ -240,18 +321,7 @@ RegisterFreespace(Relation rel, int space,BlockNumber* index,
             return -1;
         }
         
-        MemoryContextResetAndDeleteChildren(entry->context);
-
-	entry->size = space;
-        entry->active = active;
-        
-	entry->pointer = 0;
-        entry->index[0] = 0;
-        entry->index_size[0] = sizeof_max_tuple_blob();
-        for (c=1;c<INDEX_SIZE;c++) {
-            entry->index[c] = 0;
-            entry->index_size[c] = 0;
-        }
+	entry->active = active;
         entry->min_request = MaxTupleSize;
         entry->max_request = MinTupleSize;
         entry->min_tuple_size = min;
@@ -259,33 +329,27 @@ RegisterFreespace(Relation rel, int space,BlockNumber* index,
 	entry->ave_tuple_size = ave;
         entry->last_live_tuple_count = live_count;
         entry->last_dead_tuple_count = dead_count;
-    
-	if ( space != 0 ) {
-            FreeRun*    run;
-            MemoryContext old = MemoryContextSwitchTo(entry->context);
-            
-            entry->total_available = 0;
-            
-            run = palloc(sizeof(FreeRun) * space);
-            for (c=0;c<space;c++) {
-                run[c].live = true;
-                run[c].tryblock = index[c];
-                if ( sa ) run[c].avail = sa[c];
-                if ( unused_pointers) run[c].unused_pointers = unused_pointers[c];
-                run[c].misses = 0;
- 
-                entry->total_available += run[c].avail;         
-            }
-            
-            qsort(run,space,sizeof(FreeRun),cmp_freeruns);
-            
-            entry->blocks = run;
-            MemoryContextSwitchTo(old);
-        } else {
-            entry->blocks = NULL;
+
+        /*  rebuild the leaves from the list and the inner nodes in one pass  */
+        if ( entry->tree != NULL ) MemSet(entry->tree, 0, 2 * entry->capacity * sizeof(uint16));
+        entry->total_available = 0;
+        for (c=0;c<space;c++) {
+            Size avail = ( sa ) ? sa[c] : (BLCKSZ - sizeof(PageHeaderData));
+            FreeTreeGrow(entry, index[c] + 1);
+            entry->tree[entry->capacity + index[c]] = FreeTreeClamp(avail);
+            entry->total_available += FreeTreeClamp(avail);
+        }
+        if ( entry->tree != NULL ) FreeTreeRebuild(entry);
+        entry->changed = true;
+        /*  lanes pick new targets, and only lanes still inserting count again  */
+        for (c=0;c<FREESPACE_LANES;c++) {
+            entry->lanes[c] = InvalidBlockNumber;
         }
+
 /*  new statistics available */
 	pthread_mutex_unlock(&entry->accessor);
+
+        WriteFreeMap(entry);
     return 0;
 }
 
@@ -386,98 +450,54 @@ GetFreespace(Relation rel,int request,BlockNumber limit)
     
     entry = FindFreespace(rel,NULL,true);	
     if ( entry ) {
-        int p = 0;
-        int run = 0;
-        int idx = 0;
-        FreeRun*    alloc = NULL;
+        long    found = -1;
+        int     lane = FreespaceLane();
+        BlockNumber target;
 
         pthread_mutex_lock(&entry->accessor);
 
         while ( entry->extender != 0 ) {
             pthread_cond_wait(&entry->creator,&entry->accessor);
         }
-/*  
-    this runs the length of a blob so that the full amount is covered by 
-    the block allocation  
-*/
+
         if ( space > MaxTupleSize ) {
             pthread_mutex_unlock(&entry->accessor);
             elog(ERROR,"requesting freespace greater than page size");
-        } else {
-           int start = 0;
-
-            for (idx=0;idx < INDEX_SIZE;idx++) {
-                if (request <= entry->index_size[idx]) break;
-                if (entry->index[idx] == 0) break;
-            }
-           if ( idx == INDEX_SIZE ) idx -= 1;
-            start = entry->index[idx];
-            if ( start == 0 ) start = entry->pointer;
-            alloc = entry->blocks;
-
-            for (p = start; p < entry->size; p++) {
-                run++;
-                if ( !alloc[p].live ) {
-                    if ( entry->pointer == p ) entry->pointer++;
-                    continue;
-                }
+        }
 
-                if ( alloc[p].tryblock >= limit ) {
-                    if ( alloc[p].avail > space ) {
-                        check = alloc[p].tryblock;
-                        break;
-                    } else if ( alloc[p].misses++ > (128) ) {
-                        alloc[p].live = false;
-                    }
-                }
-                    
-                if ( alloc[p].avail < entry->min_request ) {
-                    alloc[p].live = false;
-                }
-            }
+        target = entry->lanes[lane];
+        if ( BlockNumberIsValid(target) && target >= limit && FreeTreeGet(entry, target) > space ) {
+            found = target;
+        } else {
+            found = FreespaceLaneSearch(entry, lane, limit, space);
         }
 
-//        if ( entry->size - p < RecommendAllocation(rel,entry) ) scan = true;
         if ( entry->min_request > request ) entry->min_request = request;
         if ( entry->max_request < request ) entry->max_request = request;
             
-        if ( !BlockNumberIsValid(check) ) {
+        if ( found < 0 ) {
             entry->extender = pthread_self();
             recommend = RecommendAllocation(rel,entry);
             check = entry->relsize;
             allocate = true;
         } else {
-            DTRACE_PROBE4(mtpg, freespace__reservation,RelationGetRelationName(rel),alloc[p].avail,run,alloc[p].misses);
-            Size remove_space = space;
-            if ( alloc[p].unused_pointers == 0 ) {
-                remove_space += sizeof(ItemIdData);
+            Size avail = 0;
+            Size remove_space = space + sizeof(ItemIdData);
+
+            check = (BlockNumber)found;
+            entry->lanes[lane] = check;
+            avail = FreeTreeGet(entry, check);
+            DTRACE_PROBE4(mtpg, freespace__reservation,RelationGetRelationName(rel),avail,check,0);
+            if ( remove_space > avail ) remove_space = avail;
+/*  
+    a blob segment runs the rest of the page so nothing is left to hand out 
+*/
+            if ( space >= sizeof_max_tuple_blob() ) {
+                avail = 0;
             } else {
-                alloc[p].unused_pointers -= 1;
-            }
-            if ( remove_space > alloc[p].avail ) remove_space = alloc[p].avail;
-            alloc[p].misses = 0;
-            alloc[p].avail -= remove_space;
-
-            if ( space >= sizeof_max_tuple_blob() || ( alloc[p].misses > 10 && alloc[p].avail < entry->min_request ) ) {
-                alloc[p].live = false;
-            }
-                        
-            entry->total_available -= remove_space;
-            
-            if ( limit <= entry->index[idx] ) {
-                if ( entry->index_size[idx] > request && entry->index[INDEX_SIZE-1] == 0 ) {
-                    memmove(entry->index + (idx+1),entry->index + (idx),(INDEX_SIZE - idx - 1) * sizeof(BlockNumber));
-                    memmove(entry->index_size + (idx+1),entry->index_size + (idx),(INDEX_SIZE - idx - 1) * sizeof(Size));
-                    entry->index[idx] = p;
-                    entry->index_size[idx] = request;
-                } else if ( (MaxTupleSize / (INDEX_SIZE - idx)) > alloc[p].avail &&
-			alloc[p].avail > (MaxTupleSize / (INDEX_SIZE)) * idx ) {
-                    entry->index[idx] = p;
-                    entry->index_size[idx] = alloc[p].avail;
-                } else {
-                    entry->index[idx] = p;
-                }
+                avail -= remove_space;
             }
+            FreeTreeSet(entry, check, avail);
         }
      
         pthread_mutex_unlock(&entry->accessor);
@@ -514,34 +534,8 @@ DeactivateFreespace(Relation rel, BlockNumber blk,Size realspace)
  	entry = FindFreespace(rel,NULL,false);
 
 	if ( entry ) {
-		int p , lo, hi;
-                
 		pthread_mutex_lock(&entry->accessor);
-                lo = entry->pointer;
-                hi = entry->size-1;
-		for (p = entry->index[0];p<entry->size;) {
-                    FreeRun*  free = &entry->blocks[p];
-                    if ( free->tryblock == blk ) {
-                        if ( realspace < entry->min_request ) {
-                            free->live = false;
-                        }
-                        entry->total_available -= free->avail;
-                        free->avail = realspace;
-                        entry->total_available += realspace;
-                        break;
-                    } else {
-                        if ( blk > free->tryblock ) {
-                            lo = p;
-                            if ( hi - lo < 8 ) p++;
-                            else p += (hi - p)/2;
-                        } else {
-                            hi = p;
-                            if ( hi - lo < 8 ) p--;
-                            else p -= (p - lo)/2;
-                        }
-                    }
-                    if ( lo < 0 || hi >= entry->size ) break;
-		}
+                FreeTreeSet(entry, blk, ( realspace < entry->min_request ) ? 0 : realspace);
 		pthread_mutex_unlock(&entry->accessor);
 	}
 }
@@ -558,12 +552,14 @@ void PrintFreespaceMemory( )
 }
 
 /*  rely on locking at the relation level to protect from 
-    removing a referenced freespace
+    removing a referenced freespace.  The relation is either
+    gone or emptied so the map file goes too.
 */
 int ForgetFreespace(Relation rel, bool gone) {
 	FreeKey tag;
 	bool found;
         FreeSpace* entry;
+        char*   path = NULL;
 
         if ( !inited ) return 0;
 
@@ -582,11 +578,25 @@ int ForgetFreespace(Relation rel, bool gone) {
         } else {
 		pthread_cond_destroy(&entry->creator);
 		pthread_mutex_destroy(&entry->accessor);
+		pthread_mutex_destroy(&entry->writer);
+                if ( entry->path != NULL ) unlink(entry->path);
                 MemoryContextDelete(entry->context);
         }
 
 	pthread_mutex_unlock(&freespace_access);
 
+        if ( !found && rel->rd_rel->relkind == RELKIND_RELATION && !rel->rd_myxactonly ) {
+            path = relpath(RelationGetPhysicalRelationName(rel));
+        }
+
+        if ( path != NULL ) {
+            char*   fsmpath = palloc(strlen(path) + 5);
+            sprintf(fsmpath,"%s.fsm",path);
+            unlink(fsmpath);
+            pfree(fsmpath);
+            pfree(path);
+        }
+
         if ( gone ) RemoveExtentForRelation(rel);
 
         return 0;
@@ -616,12 +626,14 @@ FreeSpace* FindFreespace(Relation rel,char* dbname,bool create) {
 		pthread_mutex_unlock(&freespace_access);
 		return entry;
  	} else if ( create ) {          
-            int c=0;
+                int c=0;
+                bool    loaded = false;
                 char*		db = ( dbname == NULL ) ? GetDatabaseName() : dbname;
 		char mem_name[128];
 		sprintf(mem_name,"FreespaceInstance-rel:%s-dbname:%s",RelationGetRelationName(rel),db);
 		pthread_cond_init(&entry->creator,&process_cond_attr);
 		pthread_mutex_init(&entry->accessor,&process_mutex_attr);
+		pthread_mutex_init(&entry->writer,&process_mutex_attr);
                 entry->context = AllocSetContextCreate(freetable->hcxt,
 						mem_name,
 						1024,
@@ -632,14 +644,13 @@ FreeSpace* FindFreespace(Relation rel,char* dbname,bool create) {
     here
 */
 		entry->relkind = rel->rd_rel->relkind;
-                entry->size = 0;
-                entry->pointer = 0;
-                entry->index[0] = 0;
-                entry->index_size[0] = sizeof_max_tuple_blob();
-                for (c=1;c<INDEX_SIZE;c++) {
-                    entry->index[c] = 0;
-                    entry->index_size[c] = 0;
-                }                
+                entry->tree = NULL;
+                entry->capacity = 0;
+                entry->changed = false;
+                entry->path = NULL;
+                for (c=0;c<FREESPACE_LANES;c++) {
+                    entry->lanes[c] = InvalidBlockNumber;
+                }
 		entry->relsize = smgrnblocks(rel->rd_smgr);
 		entry->extender = 0;
 		entry->active = false;
@@ -649,15 +660,27 @@ FreeSpace* FindFreespace(Relation rel,char* dbname,bool create) {
 		entry->ave_tuple_size = 0;
                 entry->extent = 0;
                 entry->extent_percentage = false;
-                entry->blocks = NULL;
                 entry->min_request = MaxTupleSize;
                 entry->max_request = MinTupleSize;
                 entry->last_dead_tuple_count = 0;
                 entry->last_live_tuple_count = 0;
+                entry->total_available = 0;
+
+                if ( entry->relkind == RELKIND_RELATION && !rel->rd_myxactonly ) {
+                    char* path = relpath(RelationGetPhysicalRelationName(rel));
+                    entry->path = MemoryContextAlloc(entry->context,strlen(path) + 5);
+                    sprintf(entry->path,"%s.fsm",path);
+                    pfree(path);
+                    /*  inserters wait for the load as for an extension  */
+                    entry->extender = pthread_self();
+                }
                 
 		pthread_mutex_unlock(&freespace_access);
-                        
-                if ( !rel->rd_myxactonly ) {
+
+                /*  the map from the last vacuum makes a scan unnecessary  */
+                if ( entry->path != NULL ) loaded = LoadFreeMap(entry);
+
+                if ( !rel->rd_myxactonly && !loaded ) {
                     AddFreespaceScanRequest(RelationGetRelationName(rel),GetDatabaseName(),rel->rd_id,GetDatabaseId());
                 }
                 
@@ -673,6 +696,7 @@ AllocateMoreSpace(Relation rel, char* sdata, int ssize) {
     
     FreeSpace*  freespace = FindFreespace(rel,NULL,!rel->rd_myxactonly);
     int recommend = 0;
+    long found = -1;
     BlockNumber nb = InvalidBlockNumber;
 
     if ( freespace == NULL ) {
@@ -685,11 +709,10 @@ AllocateMoreSpace(Relation rel, char* sdata, int ssize) {
         pthread_cond_wait(&freespace->creator,&freespace->accessor);
     }
     
-    if ( freespace->pointer < freespace->size ) {
-        FreeRun* next = &freespace->blocks[freespace->pointer++];
-        Assert(next->live);
-        nb = next->tryblock;
-        next->live = false;
+    found = FreeTreeSearch(freespace, 0, 0);
+    if ( found >= 0 ) {
+        nb = (BlockNumber)found;
+        FreeTreeSet(freespace, nb, 0);
     } else {
         recommend = RecommendAllocation(rel,freespace);
         freespace->extender = pthread_self();
@@ -699,6 +722,10 @@ AllocateMoreSpace(Relation rel, char* sdata, int ssize) {
     pthread_mutex_unlock(&freespace->accessor);
     if ( recommend > 0 ) {
         nb = PerformAllocation(rel, freespace, sdata, ssize, recommend);
+        /*  the first new block is handed out whole, don't offer it again  */
+        pthread_mutex_lock(&freespace->accessor);
+        FreeTreeSet(freespace, nb, 0);
+        pthread_mutex_unlock(&freespace->accessor);
     } 
     
     return nb;
@@ -708,7 +735,7 @@ AllocateMoreSpace(Relation rel, char* sdata, int ssize) {
 BlockNumber
 TruncateHeapRelation(Relation rel, BlockNumber new_rel_pages) {
     FreeSpace*  entry = FindFreespace(rel,NULL,TRUE);
-    int count = 0;
+    BlockNumber count = 0;
 
     pthread_mutex_lock(&entry->accessor);
 
@@ -726,11 +753,8 @@ TruncateHeapRelation(Relation rel, BlockNumber new_rel_pages) {
     
     entry->extender = 0;
     entry->relsize = new_rel_pages;
-    for ( count =0;count < entry->size; count++) {
-        if ( entry->blocks[count].tryblock >= new_rel_pages ) {
-            entry->blocks[count].live = false;
-            entry->blocks[count].avail = 0;
-        }
+    for ( count = new_rel_pages; count < entry->capacity; count++) {
+        FreeTreeSet(entry, count, 0);
     }
         
     pthread_cond_broadcast(&entry->creator);
@@ -769,32 +793,10 @@ BlockNumber PerformAllocation(Relation rel, FreeSpace* freespace, char* sdata, i
         if ( freespace->relkind == RELKIND_RELATION || freespace->relkind == RELKIND_INDEX ) {
             Size                total = (BLCKSZ - sizeof(PageHeaderData));
             int                 counter = 0;
-            MemoryContext       old;
-
-            old = MemoryContextSwitchTo(freespace->context);
 
-            freespace->size = (found+allocated);
-	
-            freespace->pointer = 0;
-            freespace->index[0] = 0;
-            freespace->index_size[0] = sizeof_max_tuple_blob();
-            for (counter=1;counter<INDEX_SIZE;counter++) {
-                freespace->index[counter] = 0;
-                freespace->index_size[counter] = 0;
-            }
-        
-            if ( freespace->blocks != NULL ) pfree(freespace->blocks);
-            freespace->blocks = palloc(sizeof(FreeRun) * freespace->size);
             for (counter=0;counter<(found+allocated);counter++) {
-                freespace->blocks[counter].live = true;
-                freespace->blocks[counter].tryblock = freespace->relsize++;
-                freespace->blocks[counter].avail = total;
-                freespace->blocks[counter].misses = 0;
-                freespace->blocks[counter].unused_pointers = 0;
+                FreeTreeSet(freespace, freespace->relsize++, total);
             }        
-            freespace->total_available = (total*(found+allocated));         
-
-            MemoryContextSwitchTo(old);
 
             freespace->active = true;
         } else {
@@ -906,6 +908,8 @@ RecommendAllocation(Relation rel,FreeSpace* freespace) {
         create = freespace->extent;
     }
     
+/*  give every lane that is inserting a block of its own  */
+    if ( create < FreespaceLanesActive(freespace) ) create = FreespaceLanesActive(freespace);
 /*  introduce some sanity  */
     if ( create < 3 ) create = 3;
     if ( create > (NBuffers) ) create = (NBuffers) ;
@@ -1119,16 +1123,318 @@ RemoveExtentForRelation(Relation rel) {
     }
 }
 
-int cmp_freeruns(const void *left, const void *right) {
-	FreeRun*      lrun = (FreeRun*)left;
-	FreeRun*       rrun = (FreeRun*)right;
+static uint16
+FreeTreeClamp(Size avail)
+{
+    return ( avail > 0xffff ) ? 0xffff : (uint16)avail;
+}
 
-	if (lrun->tryblock < rrun->tryblock)
-		return -1;
-	if (lrun->tryblock > rrun->tryblock)
-		return 1;
+/*
+ * make room for nblocks leaves, doubling the tree as needed and keeping
+ * the leaves already set.  Holding the accessor.
+ */
+static void
+FreeTreeGrow(FreeSpace* entry, BlockNumber nblocks)
+{
+    long        capacity = ( entry->capacity == 0 ) ? FREEMAP_MIN_LEAVES : entry->capacity;
+    uint16*     tree;
 
-	return 0;
+    if ( nblocks <= entry->capacity ) return;
+
+    while ( capacity < nblocks ) capacity *= 2;
+    tree = MemoryContextAlloc(entry->context, 2 * capacity * sizeof(uint16));
+    MemSet(tree, 0, 2 * capacity * sizeof(uint16));
+    if ( entry->tree != NULL ) {
+        memmove(tree + capacity, entry->tree + entry->capacity, entry->capacity * sizeof(uint16));
+        pfree(entry->tree);
+    }
+    entry->tree = tree;
+    entry->capacity = capacity;
+    FreeTreeRebuild(entry);
+}
+
+static void
+FreeTreeRebuild(FreeSpace* entry)
+{
+    long    node;
+
+    for (node = entry->capacity - 1; node > 0; node--) {
+        uint16  left = entry->tree[2 * node];
+        uint16  right = entry->tree[2 * node + 1];
+        entry->tree[node] = ( left > right ) ? left : right;
+    }
+}
+
+/*
+ * set the free bytes of one block and carry the change up the tree as
+ * far as it alters a maximum.  Holding the accessor.
+ */
+static void
+FreeTreeSet(FreeSpace* entry, BlockNumber blk, Size avail)
+{
+    long    node;
+    uint16  value = FreeTreeClamp(avail);
+
+    if ( blk >= entry->capacity ) {
+        if ( value == 0 ) return;
+        FreeTreeGrow(entry, blk + 1);
+    }
+
+    node = entry->capacity + blk;
+    entry->total_available -= entry->tree[node];
+    entry->total_available += value;
+    entry->tree[node] = value;
+    entry->changed = true;
+
+    for (node >>= 1; node > 0; node >>= 1) {
+        uint16  left = entry->tree[2 * node];
+        uint16  right = entry->tree[2 * node + 1];
+        uint16  max = ( left > right ) ? left : right;
+
+        if ( entry->tree[node] == max ) break;
+        entry->tree[node] = max;
+    }
+}
+
+static Size
+FreeTreeGet(FreeSpace* entry, BlockNumber blk)
+{
+    return ( blk < entry->capacity ) ? entry->tree[entry->capacity + blk] : 0;
+}
+
+/*
+ * the first block at or after limit with more than space bytes free, -1
+ * if there is none.  Climb from the leaf for limit until a right sibling
+ * has room, then follow the leftmost child with room down to a leaf.
+ */
+static long
+FreeTreeSearch(FreeSpace* entry, BlockNumber limit, Size space)
+{
+    long    node;
+
+    if ( entry->tree == NULL || limit >= entry->capacity || entry->tree[1] <= space ) {
+        return -1;
+    }
+
+    node = entry->capacity + limit;
+    if ( entry->tree[node] > space ) return limit;
+
+    while ( node > 1 ) {
+        if ( (node & 0x01) == 0 && entry->tree[node + 1] > space ) {
+            node += 1;
+            break;
+        }
+        node >>= 1;
+    }
+    if ( node == 1 ) return -1;
+
+    while ( node < entry->capacity ) {
+        node <<= 1;
+        if ( entry->tree[node] <= space ) node += 1;
+    }
+
+    return node - entry->capacity;
+}
+
+static int
+FreespaceLane(void)
+{
+    pthread_t   self = pthread_self();
+
+    return (int)((unsigned long)tag_hash(&self, sizeof(self)) % FREESPACE_LANES);
+}
+
+/*
+ * a block past limit with room for space for lane.  Start at the lane's
+ * share of the relation, wrap back to limit, and pass over up to a
+ * lane's worth of blocks other lanes are filling.  A shared block is
+ * still better than extending.  Holding the accessor.
+ */
+static long
+FreespaceLaneSearch(FreeSpace* entry, int lane, BlockNumber limit, Size space)
+{
+    BlockNumber start = limit;
+    long        found = -1;
+    long        shared = -1;
+    int         tries = 0;
+
+    if ( entry->relsize > limit ) {
+        start = limit + ((entry->relsize - limit) / FREESPACE_LANES) * lane;
+    }
+
+    found = FreeTreeSearch(entry, start, space);
+    if ( found < 0 && start > limit ) found = FreeTreeSearch(entry, limit, space);
+
+    while ( found >= 0 && tries++ < FREESPACE_LANES ) {
+        int     other;
+        bool    taken = false;
+
+        for (other = 0; other < FREESPACE_LANES; other++) {
+            if ( other != lane && entry->lanes[other] == (BlockNumber)found ) {
+                taken = true;
+                break;
+            }
+        }
+        if ( !taken ) return found;
+        if ( shared < 0 ) shared = found;
+        found = FreeTreeSearch(entry, found + 1, space);
+    }
+
+    return ( shared >= 0 ) ? shared : found;
+}
+
+static int
+FreespaceLanesActive(FreeSpace* entry)
+{
+    int     lane;
+    int     active = 0;
+
+    for (lane = 0; lane < FREESPACE_LANES; lane++) {
+        if ( BlockNumberIsValid(entry->lanes[lane]) ) active++;
+    }
+    return active;
+}
+
+/*
+ * read the leaves and statistics written by the last vacuum or shutdown.
+ * Blocks past the current end of the relation are dropped.  Called by the
+ * creator of the entry, marked as its extender, without any lock held.
+ * The file is read into a copy and installed under the accessor, which
+ * also releases the waiting inserters.
+ */
+static bool
+LoadFreeMap(FreeSpace* entry)
+{
+    FreeMapHeader   header;
+    BlockNumber     nblocks = 0;
+    long            leaf;
+    int             fd;
+    uint16*         leaves = NULL;
+    Size            len = 0;
+    bool            loaded = false;
+
+#ifndef __CYGWIN__
+    fd = open(entry->path, O_RDONLY);
+#else
+    fd = open(entry->path, O_RDONLY | O_BINARY);
+#endif
+    if ( fd >= 0 ) {
+        if ( read(fd, &header, sizeof(header)) != sizeof(header) ||
+                header.magic != FREEMAP_MAGIC ||
+                header.blcksz != BLCKSZ ) {
+            elog(DEBUG,"free space map %s is not usable, ignoring",entry->path);
+        } else {
+            nblocks = ( header.nblocks > entry->relsize ) ? entry->relsize : header.nblocks;
+            len = nblocks * sizeof(uint16);
+            if ( len > 0 ) leaves = palloc(len);
+            if ( len > 0 && read(fd, leaves, len) != len ) {
+                elog(DEBUG,"free space map %s is short, ignoring",entry->path);
+            } else {
+                loaded = true;
+            }
+        }
+        close(fd);
+    }
+
+    pthread_mutex_lock(&entry->accessor);
+    if ( loaded ) {
+        if ( nblocks > 0 ) {
+            FreeTreeGrow(entry, nblocks);
+            memcpy(entry->tree + entry->capacity, leaves, len);
+            FreeTreeRebuild(entry);
+        }
+        entry->total_available = 0;
+        for (leaf = 0; leaf < nblocks; leaf++) {
+            entry->total_available += entry->tree[entry->capacity + leaf];
+        }
+        entry->last_live_tuple_count = header.live_tuples;
+        entry->last_dead_tuple_count = header.dead_tuples;
+        entry->min_tuple_size = header.min_tuple_size;
+        entry->max_tuple_size = header.max_tuple_size;
+        entry->ave_tuple_size = header.ave_tuple_size;
+        entry->active = true;
+    }
+    entry->extender = 0;
+    pthread_cond_broadcast(&entry->creator);
+    pthread_mutex_unlock(&entry->accessor);
+
+    if ( leaves != NULL ) pfree(leaves);
+
+    return loaded;
+}
+
+/*
+ * write the leaves to a temporary file and rename it into place so a
+ * crash leaves either the old map or the new one.  The leaves are copied
+ * under the accessor and written with it released, writer keeps an older
+ * copy from being renamed over a newer one.
+ */
+static void
+WriteFreeMap(FreeSpace* entry)
+{
+    FreeMapHeader   header;
+    char            tmppath[MAXPGPATH];
+    int             fd;
+    Size            len;
+    uint16*         leaves = NULL;
+    bool            written = false;
+
+    if ( entry->path == NULL ) return;
+
+    pthread_mutex_lock(&entry->writer);
+    pthread_mutex_lock(&entry->accessor);
+    if ( !entry->changed ) {
+        pthread_mutex_unlock(&entry->accessor);
+        pthread_mutex_unlock(&entry->writer);
+        return;
+    }
+    MemSet(&header, 0, sizeof(header));
+    header.magic = FREEMAP_MAGIC;
+    header.blcksz = BLCKSZ;
+    header.nblocks = ( entry->relsize < entry->capacity ) ? entry->relsize : entry->capacity;
+    header.live_tuples = entry->last_live_tuple_count;
+    header.dead_tuples = entry->last_dead_tuple_count;
+    header.min_tuple_size = entry->min_tuple_size;
+    header.max_tuple_size = entry->max_tuple_size;
+    header.ave_tuple_size = entry->ave_tuple_size;
+    len = header.nblocks * sizeof(uint16);
+    if ( len > 0 ) {
+        leaves = MemoryContextAlloc(entry->context, len);
+        memcpy(leaves, entry->tree + entry->capacity, len);
+    }
+    /*  a change made while the copy is written marks it again  */
+    entry->changed = false;
+    pthread_mutex_unlock(&entry->accessor);
+
+    snprintf(tmppath, MAXPGPATH, "%s.tmp", entry->path);
+#ifndef __CYGWIN__
+    fd = open(tmppath, O_RDWR | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
+#else
+    fd = open(tmppath, O_RDWR | O_CREAT | O_TRUNC | O_BINARY, S_IRUSR | S_IWUSR);
+#endif
+    if ( fd < 0 ) {
+        elog(NOTICE,"unable to create free space map %s errno: %d",tmppath,errno);
+    } else if ( write(fd, &header, sizeof(header)) != sizeof(header) ||
+            (len > 0 && write(fd, leaves, len) != len) ||
+            pg_fsync(fd) != 0 ) {
+        close(fd);
+        unlink(tmppath);
+        elog(NOTICE,"unable to write free space map %s errno: %d",tmppath,errno);
+    } else {
+        close(fd);
+        if ( rename(tmppath, entry->path) != 0 ) {
+            unlink(tmppath);
+            elog(NOTICE,"unable to rename free space map %s errno: %d",entry->path,errno);
+        } else {
+            written = true;
+        }
+    }
+
+    pthread_mutex_lock(&entry->accessor);
+    if ( !written ) entry->changed = true;
+    if ( leaves != NULL ) pfree(leaves);
+    pthread_mutex_unlock(&entry->accessor);
+    pthread_mutex_unlock(&entry->writer);
 }
 
 #ifdef UNUSED
@@ -23,10 +23,24 @@
  *
  *-------------------------------------------------------------------------
  */
+#include <pthread.h>
+
 #include "postgres.h"
 
 #include "env/pg_crc.h"
 
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#include <nmmintrin.h>
+#define CRC32C_SSE42
+#elif defined(__aarch64__) && (defined(__GNUC__) || defined(__clang__))
+#include <arm_acle.h>
+#ifdef __linux__
+#include <sys/auxv.h>
+#include <asm/hwcap.h>
+#endif
+#define CRC32C_ARMV8
+#endif
+
 /*
  * This table is based on the polynomial
  *	x^32+x^26+x^23+x^22+x^16+x^12+x^11+x^10+x^8+x^7+x^5+x^4+x^2+x+1.
@@ -543,3 +557,261 @@ eq_crc64(crc64 c1,crc64 c2)
     s2.crc0 = c2;
     return EQ_CRC64(s1,s2);
 }
+
+
+/*
+ * CRC32C (Castagnoli) in the reflected form the hardware instructions
+ * compute.  Pages are checksummed whole with it, see bufpage.c.  The
+ * instruction is picked the first time a block is checksummed, with a
+ * slice-by-8 table version for processors that have none.
+ *
+ * The instruction takes three cycles to produce a result but can start
+ * one every cycle, so long blocks are run in rounds of three interleaved
+ * streams put back together with a table that advances a CRC over the
+ * length of one stream.
+ */
+#define CRC32C_POLY		0x82F63B78
+#define CRC32C_STREAM	512
+
+typedef uint32 (*crc32c_func) (uint32 crc, const unsigned char *data, int len);
+
+static uint32 crc32c_choose(uint32 crc, const unsigned char *data, int len);
+static uint32 crc32c_sb8(uint32 crc, const unsigned char *data, int len);
+static uint32 crc32c_shift(uint32 crc);
+static void crc32c_init(void);
+static void crc32c_build_shift(int len);
+
+static crc32c_func crc32c_impl = crc32c_choose;
+static const char *crc32c_name = "unknown";
+
+static pthread_once_t crc32c_once = PTHREAD_ONCE_INIT;
+static uint32 crc32c_table[8][256];
+static uint32 crc32c_shift_table[4][256];
+
+static void
+crc32c_init(void)
+{
+	int			i,
+				j;
+
+	for (i = 0; i < 256; i++)
+	{
+		uint32		crc = i;
+
+		for (j = 0; j < 8; j++)
+			crc = (crc & 1) ? (crc >> 1) ^ CRC32C_POLY : (crc >> 1);
+		crc32c_table[0][i] = crc;
+	}
+	for (i = 0; i < 256; i++)
+	{
+		for (j = 1; j < 8; j++)
+			crc32c_table[j][i] = (crc32c_table[j - 1][i] >> 8) ^
+				crc32c_table[0][crc32c_table[j - 1][i] & 0xFF];
+	}
+	crc32c_build_shift(CRC32C_STREAM);
+}
+
+static uint32
+crc32c_sb8(uint32 crc, const unsigned char *data, int len)
+{
+	while (len > 0 && ((unsigned long) data & 7) != 0)
+	{
+		crc = crc32c_table[0][(crc ^ *data++) & 0xFF] ^ (crc >> 8);
+		len--;
+	}
+	while (len >= 8)
+	{
+		uint32		a = *(const uint32 *) data ^ crc;
+		uint32		b = *(const uint32 *) (data + 4);
+
+#ifdef WORDS_BIGENDIAN
+		a = ((a >> 24) | ((a >> 8) & 0xFF00) | ((a << 8) & 0xFF0000) | (a << 24));
+		b = ((b >> 24) | ((b >> 8) & 0xFF00) | ((b << 8) & 0xFF0000) | (b << 24));
+		a ^= crc ^ ((crc >> 24) | ((crc >> 8) & 0xFF00) | ((crc << 8) & 0xFF0000) | (crc << 24));
+#endif
+		crc = crc32c_table[7][a & 0xFF] ^ crc32c_table[6][(a >> 8) & 0xFF] ^
+			crc32c_table[5][(a >> 16) & 0xFF] ^ crc32c_table[4][a >> 24] ^
+			crc32c_table[3][b & 0xFF] ^ crc32c_table[2][(b >> 8) & 0xFF] ^
+			crc32c_table[1][(b >> 16) & 0xFF] ^ crc32c_table[0][b >> 24];
+		data += 8;
+		len -= 8;
+	}
+	while (len-- > 0)
+		crc = crc32c_table[0][(crc ^ *data++) & 0xFF] ^ (crc >> 8);
+
+	return crc;
+}
+
+/*
+ * advance crc over CRC32C_STREAM zero bytes.  The CRC is linear so
+ * this is the xor of the advanced bits, four table lookups.
+ */
+static uint32
+crc32c_shift(uint32 crc)
+{
+	return crc32c_shift_table[0][crc & 0xFF] ^
+		crc32c_shift_table[1][(crc >> 8) & 0xFF] ^
+		crc32c_shift_table[2][(crc >> 16) & 0xFF] ^
+		crc32c_shift_table[3][crc >> 24];
+}
+
+/*
+ * build the shift table for streams of len bytes from the advance of
+ * each single bit.
+ */
+static void
+crc32c_build_shift(int len)
+{
+	uint32		bits[32];
+	unsigned char zeros[256];
+	int			i,
+				b;
+
+	MemSet(zeros, 0, sizeof(zeros));
+	for (i = 0; i < 32; i++)
+	{
+		int			left = len;
+
+		bits[i] = ((uint32) 1) << i;
+		while (left > 0)
+		{
+			int			step = (left > sizeof(zeros)) ? sizeof(zeros) : left;
+
+			bits[i] = crc32c_sb8(bits[i], zeros, step);
+			left -= step;
+		}
+	}
+	for (i = 0; i < 4; i++)
+	{
+		for (b = 0; b < 256; b++)
+		{
+			uint32		crc = 0;
+			int			j;
+
+			for (j = 0; j < 8; j++)
+			{
+				if (b & (1 << j))
+					crc ^= bits[(i * 8) + j];
+			}
+			crc32c_shift_table[i][b] = crc;
+		}
+	}
+}
+
+#ifdef CRC32C_SSE42
+__attribute__((target("sse4.2")))
+static uint32
+crc32c_sse42(uint32 crc, const unsigned char *data, int len)
+{
+	while (len >= CRC32C_STREAM * 3)
+	{
+		const unsigned char *d1 = data + CRC32C_STREAM;
+		const unsigned char *d2 = d1 + CRC32C_STREAM;
+		uint64		c0 = crc,
+					c1 = 0,
+					c2 = 0;
+		int			i;
+
+		for (i = 0; i < CRC32C_STREAM; i += 8)
+		{
+			c0 = _mm_crc32_u64(c0, *(const uint64 *) (data + i));
+			c1 = _mm_crc32_u64(c1, *(const uint64 *) (d1 + i));
+			c2 = _mm_crc32_u64(c2, *(const uint64 *) (d2 + i));
+		}
+		crc = crc32c_shift(crc32c_shift((uint32) c0) ^ (uint32) c1) ^ (uint32) c2;
+		data += CRC32C_STREAM * 3;
+		len -= CRC32C_STREAM * 3;
+	}
+	while (len >= 8)
+	{
+		crc = (uint32) _mm_crc32_u64(crc, *(const uint64 *) data);
+		data += 8;
+		len -= 8;
+	}
+	while (len-- > 0)
+		crc = _mm_crc32_u8(crc, *data++);
+
+	return crc;
+}
+#endif
+
+#ifdef CRC32C_ARMV8
+__attribute__((target("+crc")))
+static uint32
+crc32c_armv8(uint32 crc, const unsigned char *data, int len)
+{
+	while (len >= CRC32C_STREAM * 3)
+	{
+		const unsigned char *d1 = data + CRC32C_STREAM;
+		const unsigned char *d2 = d1 + CRC32C_STREAM;
+		uint32		c0 = crc,
+					c1 = 0,
+					c2 = 0;
+		int			i;
+
+		for (i = 0; i < CRC32C_STREAM; i += 8)
+		{
+			c0 = __crc32cd(c0, *(const uint64 *) (data + i));
+			c1 = __crc32cd(c1, *(const uint64 *) (d1 + i));
+			c2 = __crc32cd(c2, *(const uint64 *) (d2 + i));
+		}
+		crc = crc32c_shift(crc32c_shift(c0) ^ c1) ^ c2;
+		data += CRC32C_STREAM * 3;
+		len -= CRC32C_STREAM * 3;
+	}
+	while (len >= 8)
+	{
+		crc = __crc32cd(crc, *(const uint64 *) data);
+		data += 8;
+		len -= 8;
+	}
+	while (len-- > 0)
+		crc = __crc32cb(crc, *data++);
+
+	return crc;
+}
+#endif
+
+static uint32
+crc32c_choose(uint32 crc, const unsigned char *data, int len)
+{
+	pthread_once(&crc32c_once, crc32c_init);
+
+	crc32c_name = "slice-by-8";
+	crc32c_impl = crc32c_sb8;
+#ifdef CRC32C_SSE42
+	if (__builtin_cpu_supports("sse4.2"))
+	{
+		crc32c_name = "sse4.2";
+		crc32c_impl = crc32c_sse42;
+	}
+#endif
+#ifdef CRC32C_ARMV8
+#if defined(__linux__)
+	if (getauxval(AT_HWCAP) & HWCAP_CRC32)
+#endif
+	{
+		crc32c_name = "armv8";
+		crc32c_impl = crc32c_armv8;
+	}
+#endif
+
+	return crc32c_impl(crc, data, len);
+}
+
+uint32
+crc32c_block(unsigned char *block, int len)
+{
+	return crc32c_impl(0xFFFFFFFF, block, len) ^ 0xFFFFFFFF;
+}
+
+/*
+ * which implementation crc32c_block uses, for reporting
+ */
+const char *
+crc32c_implementation(void)
+{
+	if (crc32c_impl == crc32c_choose)
+		crc32c_block((unsigned char *) "", 0);
+	return crc32c_name;
+}
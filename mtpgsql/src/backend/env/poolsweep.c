@@ -2,6 +2,14 @@
  *
  * poolsweep.c
  *     auto vacuum relations upon signal of the db writer
+ *
+ * Requests go on one queue ordered by job priority, first in first out
+ * within a priority.  Each database gets a pool of up to "sweeps" worker
+ * threads that take the most urgent job whose relation is not already
+ * being worked on by another worker, so a long reindex no longer holds
+ * up vacuums of other relations.  A request for a job already waiting on
+ * the queue for the same relation is dropped.  Workers can be held to
+ * "sweepiobudget" pages a second through PoolsweepDelayPoint.
  *     
  * Copyright (c) 2000-2024, Myron Scott  <myron@weaverdb.org>
  *
@@ -15,6 +23,7 @@
 #include <signal.h>
 #include <time.h>
 #include <errno.h>
+#include <sys/time.h>
 
 
 
@@ -29,6 +38,7 @@
 #include "env/poolsweep.h"
 #include "env/properties.h"
 #include "env/freespace.h"
+#include "env/dolhelper.h"
 #include "commands/vacuum.h"
 #include "storage/smgr.h"
 #include "storage/multithread.h"
@@ -64,14 +74,41 @@ typedef enum jobtype {
     RECOVER_JOB
 }               JobType;
 
+/*
+ *  higher runs first, indexed by JobType.  Vacuums keep hot relations
+ *  from bloating so they go ahead of the long maintenance jobs.  Wait
+ *  and recover requests are barriers, see JobIsRunnable.
+ */
+static const int job_priority[] = {
+    7,      /* VACUUM_JOB */
+    3,      /* REINDEX_JOB */
+    5,      /* SCAN_JOB */
+    6,      /* FREESPACE_JOB */
+    1,      /* DEFRAG_JOB */
+    4,      /* ANALYZE_JOB */
+    2,      /* VACUUMDB_JOB */
+    6,      /* TRIM_JOB */
+    1,      /* RESPAN_JOB */
+    1,      /* RELINK_JOB */
+    1,      /* MOVE_JOB */
+    1,      /* COMPACT_JOB */
+    6,      /* ALLOCATE_JOB */
+    9,      /* WAIT_JOB */
+    9       /* RECOVER_JOB */
+};
+
 typedef struct joblist {
     char            relname[256];
     char            dbname[256];
     Oid             relid;
     Oid             dbid;
     JobType             jobtype;
+    int             priority;
+    long            sequence;
     bool            activejob;
+    bool            ownarg;
     void*           arg;
+    struct timeval  queued;
     struct joblist*        next;
 } JobList;
 
@@ -89,14 +126,12 @@ typedef struct fragargs {
 typedef struct sweeps {
     Oid             dbid;
     char            dbname[255];
-    JobList        *requests;
+    JobList        *current;    /* job this worker is running */
     pthread_t       thread;
-    pthread_cond_t  gate;
     struct sweeps           *next;
     bool            activesweep;
     int             idle_count;
     Env*            env;
-    MemoryContext   context;
 } Sweeps;
 
 typedef struct waiter {
@@ -105,22 +140,37 @@ typedef struct waiter {
     bool                done;
 } Waiter;
 
+typedef struct sweepbudget {
+    long            charged;    /* pages in the current window */
+    struct timeval  window;
+} SweepBudget;
+
 
 static pthread_mutex_t list_guard;
+static pthread_cond_t work_gate;
 
 static pthread_attr_t sweeperprops;
 static bool     paused = true;
 static bool     inited = false;
-static int     concurrent = 1;
+static int     concurrent = 2;
+static int     io_budget = 0;
+static long    job_sequence = 0;
 
 static Sweeps  *sweeplist;
+static JobList *requests;
 static MemoryContext sweep_cxt = NULL;
 
+static SectionId sweep_id = SECTIONID("SWEP");
+
 static Sweeps  *StartupPoolsweep(char *dbname, Oid dbid);
-static Sweeps  *ShutdownPoolsweep(Sweeps * job);
+static void     ShutdownPoolsweep(Sweeps ** position);
 static int      AddJobRequest(JobType type, char *relname, char *dbname, Oid relid, Oid dbid, PoolArgs* extra);
-static int      CheckSweepForJob(Sweeps* sweep, JobType type, Oid relid);
-static int      AddJobToSweep(Sweeps* sweep, JobType type, char *relname, char *dbname, Oid relid, Oid dbid, PoolArgs* extra);
+static bool     CheckQueueForJob(JobType type, Oid relid, Oid dbid);
+static int      AddJobToQueue(JobType type, char *relname, char *dbname, Oid relid, Oid dbid, PoolArgs* extra);
+static bool     JobIsRunnable(JobList* job);
+static JobList *NextJob(Sweeps* sweep);
+static void     FreeJob(JobList* job);
+static long     ElapsedMillis(struct timeval* from, struct timeval* to);
 static void  poolsweep_log(Oid rel, char* pattern, ...);
 
 static void* Poolsweep(void* arg);
@@ -138,6 +188,11 @@ PoolsweepInit(int priority) {
     
     if ( cc != NULL ) {
         concurrent = atoi(cc);
+        if ( concurrent < 1 ) concurrent = 1;
+    }
+
+    if ( PropertyIsValid("sweepiobudget") ) {
+        io_budget = GetIntProperty("sweepiobudget");
     }
 #ifndef MACOSX
 /*
@@ -153,6 +208,7 @@ PoolsweepInit(int priority) {
  */
 #endif
     pthread_mutex_init(&list_guard, NULL);
+    pthread_cond_init(&work_gate, NULL);
 
     sweep_cxt = AllocSetContextCreate((MemoryContext) NULL,
             "SweepMemoryContext",
@@ -168,16 +224,27 @@ PoolsweepInit(int priority) {
 void
 StopPoolsweepsForDB(Oid dbid) {
     Sweeps         **position = NULL;
+    JobList        **setter = NULL;
         
     if (!inited)
         return;
     
     pthread_mutex_lock(&list_guard);
+    setter = &requests;
+    while (*setter != NULL) {
+        JobList* job = *setter;
+        if ( job->dbid == dbid ) {
+            *setter = job->next;
+            FreeJob(job);
+        } else {
+            setter = &job->next;
+        }
+    }
+
     position = &sweeplist;
     while (*position != NULL) {
         if ( (*position)->dbid == dbid ) {
-            *position = ShutdownPoolsweep(*position);
-            break;
+            ShutdownPoolsweep(position);
         } else {
             position = &(*position)->next;
         }
@@ -187,18 +254,19 @@ StopPoolsweepsForDB(Oid dbid) {
 
 void
 PoolsweepDestroy() {
-    Sweeps         *next = NULL;
-        
     if (!inited)
         return;
     
     pthread_mutex_lock(&list_guard);
-    next = sweeplist;
+    while (requests != NULL) {
+        JobList* job = requests;
+        requests = job->next;
+        FreeJob(job);
+    }
 
-    while (next != NULL) {
-        next = ShutdownPoolsweep(next);
+    while (sweeplist != NULL) {
+        ShutdownPoolsweep(&sweeplist);
     }
-    sweeplist = NULL;
 
     if (sweep_cxt != NULL) {
         MemoryContextDelete(sweep_cxt);
@@ -214,10 +282,7 @@ StartupPoolsweep(char *dbname, Oid dbid) {
     Sweeps         **setter = &sweeplist;
     Sweeps         *inst = NULL;
 
-    char            name[256];
     /*  already holding listguard  */
-    snprintf(name,256,"SweepInstanceCxt -- dbid: %ld",dbid);
-    
     if ( sweep_cxt == NULL ) {
         return NULL;
     } 
@@ -226,14 +291,10 @@ StartupPoolsweep(char *dbname, Oid dbid) {
     inst->dbid = dbid;
     strncpy(inst->dbname, dbname, 255);
     inst->next = NULL;
-    inst->requests = NULL;
+    inst->current = NULL;
     inst->activesweep = true;
-    inst->context = AllocSetContextCreate(sweep_cxt,
-        name,
-        512,
-        512,
-        1024 * 1024);
-    pthread_cond_init(&inst->gate, NULL);
+    inst->idle_count = 0;
+    inst->env = NULL;
     
     if (pthread_create(&inst->thread, &sweeperprops, Poolsweep, inst) != 0) {
         elog(FATAL, "could not create pool sweep thread\n");
@@ -245,23 +306,25 @@ StartupPoolsweep(char *dbname, Oid dbid) {
     return inst;
 }
 
-Sweeps*
-ShutdownPoolsweep(Sweeps * job) {
+/*
+ *  take the worker at *position off the list and wait for it to exit.
+ *  The worker is unlinked before list_guard is let go so nobody else can
+ *  find it while it is being joined.
+ */
+void
+ShutdownPoolsweep(Sweeps ** position) {
     void           *ret = NULL;
-    Sweeps*         next = job->next;
+    Sweeps*         job = *position;
     
+    *position = job->next;
     job->activesweep = false;
-    pthread_cond_broadcast(&job->gate);
+    pthread_cond_broadcast(&work_gate);
     pthread_mutex_unlock(&list_guard);
     
     pthread_join(job->thread, &ret);
     
     pthread_mutex_lock(&list_guard);
-    next = job->next;
-    MemoryContextDelete(job->context);
     pfree(job);
-    
-    return next;
 }
 
 void           *
@@ -270,6 +333,7 @@ Poolsweep(void *args) {
     Sweeps         *tool = (Sweeps *) args;
     bool            activated = true;
     Env*            env;
+    SweepBudget*    budget;
 
     env = CreateEnv(NULL);
     tool->env = env;
@@ -288,6 +352,9 @@ Poolsweep(void *args) {
         DestroyThread();
         SetEnv(NULL);
         DestroyEnv(env);
+        pthread_mutex_lock(&list_guard);
+        tool->activesweep = false;
+        pthread_mutex_unlock(&list_guard);
         return NULL;
     }
     
@@ -295,6 +362,7 @@ Poolsweep(void *args) {
 
     InitCatalogCache();
     
+    budget = AllocateEnvSpace(sweep_id, sizeof(SweepBudget));
     
     SetProcessingMode(NormalProcessing);
     
@@ -303,16 +371,19 @@ Poolsweep(void *args) {
         
         if (setjmp(env->errorContext)) {
             pthread_mutex_lock(&list_guard);
-            if (item->activejob && tool->requests == item) {
-                tool->requests = item->next;
-            }
+            item = tool->current;
+            tool->current = NULL;
+            if ( item != NULL ) FreeJob(item);
+            pthread_cond_broadcast(&work_gate);
             pthread_mutex_unlock(&list_guard);
-            if ( item != NULL ) pfree(item);
             item = NULL;
             if (CurrentXactInProgress()) {
                 AbortTransaction();
             }
         } else {
+            struct timeval  started;
+            struct timeval  finished;
+
             pthread_mutex_lock(&list_guard);
             
             if ( !tool->activesweep ) {
@@ -323,7 +394,9 @@ Poolsweep(void *args) {
             
             MemoryContextSwitchTo(MemoryContextGetEnv()->QueryContext);
             
-            if (tool->requests == NULL) {
+            item = ( paused ) ? NULL : NextJob(tool);
+
+            if (item == NULL) {
                 struct timespec tv;
                 int             result = 0;
                 tv.tv_sec = time(NULL) + 60;
@@ -336,7 +409,7 @@ Poolsweep(void *args) {
                  * if ( invalidate ) { InvalidateAllCaches();
                  * invalidate = false; }
                  */
-                result = pthread_cond_timedwait(&tool->gate, &list_guard, &tv);
+                result = pthread_cond_timedwait(&work_gate, &list_guard, &tv);
                 if (result == ETIMEDOUT) {
                     if ( tool->idle_count++== 5 ) {
                         tool->activesweep = false;
@@ -348,99 +421,95 @@ Poolsweep(void *args) {
                     tool->idle_count = 0;
                 }
                 pthread_mutex_unlock(&list_guard);
+                continue;
+            }
+
+            tool->idle_count = 0;
+            pthread_mutex_unlock(&list_guard);
+
+            gettimeofday(&started, NULL);
+            budget->charged = 0;
+            budget->window = started;
+            DTRACE_PROBE4(mtpg, poolsweep__start, item->jobtype, item->relid, item->dbid, ElapsedMillis(&item->queued, &started));
+
+            SetTransactionCommitType(TRANSACTION_CAREFUL_COMMIT);
+
+            StartTransaction();
+
+            SetQuerySnapshot();
+
+            if (item->jobtype == VACUUM_JOB) {
+                poolsweep_log(item->relid, "starting vacuum job");
+                lazy_open_vacuum_rel(item->relid, false, false);
+            } else if (item->jobtype == REINDEX_JOB) {
+                poolsweep_log(item->relid, "starting reindex job");
+                reindex_index(item->relid, true);
+            } else if (item->jobtype == SCAN_JOB) {
+                poolsweep_log(item->relid, "starting scan job");
+                lazy_open_vacuum_rel(item->relid, false, true);
+            } else if (item->jobtype == FREESPACE_JOB) {
+                poolsweep_log(item->relid, "starting freespace scan job");
+                lazy_freespace_scan_rel(item->relid);
+            } else if (item->jobtype == DEFRAG_JOB) {
+                FragArgs* args = item->arg;
+                poolsweep_log(item->relid, "starting defrag job");
+                lazy_fragmentation_scan_rel(item->relid, false,(args->useblobs) ? BLOB_MOVE : NORMAL, args->max);
+            } else if (item->jobtype == ANALYZE_JOB) {
+                poolsweep_log(item->relid, "starting analyze job");
+                analyze_rel(item->relid);
+            } else if (item->jobtype == TRIM_JOB) {
+                poolsweep_log(item->relid, "starting trim job");
+                lazy_open_vacuum_rel(item->relid, true, false);
+            } else if (item->jobtype == RESPAN_JOB) {
+                poolsweep_log(item->relid, "starting respan job");
+                lazy_respan_blobs_rel(item->relid, true, false); /* don't exclude self moves */
+            } else if (item->jobtype == RELINK_JOB) {
+/*
+                poolsweep_log(item->relid, "starting relink job");
+                lazy_fragmentation_scan_rel(item->relid, true, RELINKING, 1024 * 1024);
+*/
+            } else if (item->jobtype == MOVE_JOB) {
+                poolsweep_log(item->relid, "starting move job");
+                lazy_respan_blobs_rel(item->relid, true, true);/* exclude self moves */
+            } else if (item->jobtype == VACUUMDB_JOB) {
+                poolsweep_log(item->relid, "starting vacuumdb job");
+                lazy_vacuum_database(false);
+            } else if (item->jobtype == COMPACT_JOB) {
+                FragArgs* args = item->arg;
+                poolsweep_log(item->relid, "starting compact job");
+                lazy_fragmentation_scan_rel(item->relid, true,(args->useblobs) ? BLOB_MOVE : NORMAL, args->max);
+             } else if ( item->jobtype == ALLOCATE_JOB ) {
+                Relation rel = RelationIdGetRelation(item->relid, DEFAULTDBOID);
+                poolsweep_log(item->relid, "starting space allocation job");
+/*
+                AllocateMoreSpace(rel, NULL);
+*/
+                RelationClose(rel);
+            } else if ( item->jobtype == WAIT_JOB ) {
+                /*  the waiter is released when the job is freed  */
+                poolsweep_log(item->relid, "starting wait notification");
+            } else  if ( item->jobtype == RECOVER_JOB ) {
+                List* pages = smgrgetrecoveredlist(GetDatabaseId());
+                index_recoverpages(pages);
             } else {
-                item = tool->requests;
-                if (item != NULL) {
-                    Assert(!item->activejob);
-                    item->activejob = true;
-                }
-                pthread_mutex_unlock(&list_guard);
+                poolsweep_log(item->relid, "unknown job type %d", item->jobtype);
+            }
 
-                if (paused || item == NULL) {
-                    continue;
-                }
+            MemoryContextResetAndDeleteChildren(MemoryContextGetEnv()->QueryContext);
+            CommitTransaction();
 
-                SetTransactionCommitType(TRANSACTION_CAREFUL_COMMIT);
-
-                StartTransaction();
-
-                SetQuerySnapshot();
-
-                if (item->jobtype == VACUUM_JOB) {
-                    poolsweep_log(item->relid, "starting vacuum job");
-                    lazy_open_vacuum_rel(item->relid, false, false);
-                } else if (item->jobtype == REINDEX_JOB) {
-                    poolsweep_log(item->relid, "starting reindex job");
-                    reindex_index(item->relid, true);
-                } else if (item->jobtype == SCAN_JOB) {
-                    poolsweep_log(item->relid, "starting scan job");
-                    lazy_open_vacuum_rel(item->relid, false, true);
-                } else if (item->jobtype == FREESPACE_JOB) {
-                    poolsweep_log(item->relid, "starting freespace scan job");
-                    lazy_freespace_scan_rel(item->relid);                
-                } else if (item->jobtype == DEFRAG_JOB) {
-                    FragArgs* args = item->arg;
-                    poolsweep_log(item->relid, "starting defrag job");
-                    lazy_fragmentation_scan_rel(item->relid, false,(args->useblobs) ? BLOB_MOVE : NORMAL, args->max);
-                    pfree(args);
-                } else if (item->jobtype == ANALYZE_JOB) {
-                    poolsweep_log(item->relid, "starting analyze job");
-                    analyze_rel(item->relid);
-                } else if (item->jobtype == TRIM_JOB) {
-                    poolsweep_log(item->relid, "starting trim job");
-                    lazy_open_vacuum_rel(item->relid, true, false);
-                } else if (item->jobtype == RESPAN_JOB) {
-                    poolsweep_log(item->relid, "starting respan job");
-                    lazy_respan_blobs_rel(item->relid, true, false); /* don't exclude self moves */
-                } else if (item->jobtype == RELINK_JOB) {
-    /*
-                    poolsweep_log(item->relid, "starting relink job");
-                    lazy_fragmentation_scan_rel(item->relid, true, RELINKING, 1024 * 1024);
-    */
-                } else if (item->jobtype == MOVE_JOB) {
-                    poolsweep_log(item->relid, "starting move job");
-                    lazy_respan_blobs_rel(item->relid, true, true);/* exclude self moves */
-                } else if (item->jobtype == VACUUMDB_JOB) {
-                    poolsweep_log(item->relid, "starting vacuumdb job");
-                    lazy_vacuum_database(false);
-                } else if (item->jobtype == COMPACT_JOB) {
-                    FragArgs* args = item->arg;
-                    poolsweep_log(item->relid, "starting compact job");
-                    lazy_fragmentation_scan_rel(item->relid, true,(args->useblobs) ? BLOB_MOVE : NORMAL, args->max);
-                    pfree(args);
-                 } else if ( item->jobtype == ALLOCATE_JOB ) {
-                    Relation rel = RelationIdGetRelation(item->relid, DEFAULTDBOID);
-                    poolsweep_log(item->relid, "starting space allocation job");
-    /*
-                    AllocateMoreSpace(rel, NULL);
-    */
-                    RelationClose(rel);
-                } else if ( item->jobtype == WAIT_JOB ) {
-                    poolsweep_log(item->relid, "starting wait notification");
-                    Waiter*     w = item->arg;
-                    pthread_mutex_lock(&w->guard);
-                    w->done = true;
-                    pthread_cond_broadcast(&w->gate);
-                    pthread_mutex_unlock(&w->guard);
-                } else  if ( item->jobtype == RECOVER_JOB ) {
-                    List* pages = smgrgetrecoveredlist(GetDatabaseId());
-                    index_recoverpages(pages);
-                } else {
-                    poolsweep_log(item->relid, "unknown job type %d", item->jobtype);
-                }
+            gettimeofday(&finished, NULL);
+            DTRACE_PROBE4(mtpg, poolsweep__done, item->jobtype, item->relid, item->dbid, ElapsedMillis(&started, &finished));
 
-                MemoryContextResetAndDeleteChildren(MemoryContextGetEnv()->QueryContext);
-                CommitTransaction();
-                if (item != NULL) {
-                    pthread_mutex_lock(&list_guard);
-                    Assert(tool->requests == item);
-                    Assert(item->activejob);
-                    tool->requests = item->next;
-                    pthread_mutex_unlock(&list_guard);
-                    pfree(item);
-                    item = NULL;
-                }
-            }
+            pthread_mutex_lock(&list_guard);
+            Assert(tool->current == item);
+            Assert(item->activejob);
+            tool->current = NULL;
+            FreeJob(item);
+            item = NULL;
+            /*  jobs held back behind this one may be runnable now  */
+            pthread_cond_broadcast(&work_gate);
+            pthread_mutex_unlock(&list_guard);
         }
     }
     
@@ -452,6 +521,9 @@ Poolsweep(void *args) {
         }
 #endif
     
+    /*  reindex jobs may have started btree build workers  */
+    if (setjmp(env->errorContext) == 0)
+        ShutdownDolHelpers();
     
     RelationCacheShutdown();
     
@@ -467,32 +539,104 @@ Poolsweep(void *args) {
     return NULL;
 }
 
-static int
-CheckSweepForJob(Sweeps* sweep, JobType type, Oid relid) {
+/*
+ *  a wait or a recover is a barrier, it runs once every job queued for
+ *  its database ahead of it is done.  Any other job runs as long as no
+ *  other worker is busy with its relation.  Holding list_guard.
+ */
+static bool
+JobIsRunnable(JobList* job) {
+    Sweeps*     sweep;
+    JobList*    search;
+
+    if ( job->jobtype == WAIT_JOB || job->jobtype == RECOVER_JOB ) {
+        for (search = requests; search != NULL; search = search->next) {
+            if ( search->dbid == job->dbid && search->sequence < job->sequence ) return false;
+        }
+        for (sweep = sweeplist; sweep != NULL; sweep = sweep->next) {
+            if ( sweep->current != NULL && sweep->current->dbid == job->dbid &&
+                    sweep->current->sequence < job->sequence ) return false;
+        }
+        return true;
+    }
+
+    if ( job->relid == InvalidOid ) return true;
+
+    for (sweep = sweeplist; sweep != NULL; sweep = sweep->next) {
+        if ( sweep->current != NULL && sweep->current->dbid == job->dbid &&
+                sweep->current->relid == job->relid ) return false;
+    }
+    return true;
+}
+
+/*
+ *  take the first runnable job for the worker's database off the queue,
+ *  the queue is already in priority order.  Holding list_guard.
+ */
+static JobList*
+NextJob(Sweeps* sweep) {
+    JobList**   setter = &requests;
+
+    while (*setter != NULL) {
+        JobList* job = *setter;
+        if ( job->dbid == sweep->dbid && JobIsRunnable(job) ) {
+            *setter = job->next;
+            job->next = NULL;
+            job->activejob = true;
+            sweep->current = job;
+            return job;
+        }
+        setter = &job->next;
+    }
+    return NULL;
+}
+
+/*
+ *  holding list_guard, a waiter is released whether its job ran or not
+ */
+static void
+FreeJob(JobList* job) {
+    if ( job->jobtype == WAIT_JOB && job->arg != NULL ) {
+        Waiter*     w = job->arg;
+        pthread_mutex_lock(&w->guard);
+        w->done = true;
+        pthread_cond_broadcast(&w->gate);
+        pthread_mutex_unlock(&w->guard);
+    } else if ( job->ownarg ) {
+        pfree(job->arg);
+    }
+    pfree(job);
+}
+
+/*
+ *  true if the same job for the relation is still waiting to run.  A
+ *  job that is already running does not count, it may have passed the
+ *  changes that prompted the new request.
+ */
+static bool
+CheckQueueForJob(JobType type, Oid relid, Oid dbid) {
     JobList         *search;
-    int pos = 1;
-    bool relid_is_valid = false;
-    search = sweep->requests;
-
-    /* make sure the request isn't already in queue  */
-    while (search != NULL) {
-        pos++;
-        if ( relid == search->relid) {
-            if ( type == search->jobtype ) return -1;
-            relid_is_valid = true;
+
+    /*  every wait has a caller blocked on it  */
+    if ( type == WAIT_JOB ) return false;
+
+    for (search = requests; search != NULL; search = search->next) {
+        if ( search->dbid == dbid && search->relid == relid && search->jobtype == type ) {
+            return true;
         }
-        search = search->next;
     }
-    if ( relid_is_valid && type != FREESPACE_JOB ) return 0;
-  /*  this relid is not hosted on this list  */
-    return pos;
+    return false;
 }
 
+/*
+ *  queue behind every job of the same or higher priority and return
+ *  the number of jobs waiting for the database.
+ */
 static int
-AddJobToSweep(Sweeps* sweep, JobType type, char *relname, char *dbname, Oid relid, Oid dbid, PoolArgs* extra) {
+AddJobToQueue(JobType type, char *relname, char *dbname, Oid relid, Oid dbid, PoolArgs* extra) {
     JobList** setter = NULL;
-    MemoryContext old = MemoryContextSwitchTo(sweep->context);
-    JobList* item = palloc(sizeof(JobList));
+    JobList* item = MemoryContextAlloc(sweep_cxt, sizeof(JobList));
+    JobList* search = NULL;
     int depth = 0;
 
     strncpy(item->relname, relname, 255);
@@ -501,40 +645,41 @@ AddJobToSweep(Sweeps* sweep, JobType type, char *relname, char *dbname, Oid reli
     strncpy(item->dbname, dbname, 255);
     item->activejob = false;
     item->jobtype = type;
+    item->priority = job_priority[type];
+    item->sequence = job_sequence++;
+    item->ownarg = false;
     item->arg = NULL;
+    gettimeofday(&item->queued, NULL);
     if ( extra != NULL ) {
         if ( extra->copy ) {
-            item->arg = palloc(extra->length);
+            item->arg = MemoryContextAlloc(sweep_cxt, extra->length);
             memmove(item->arg,extra->args,extra->length);
+            item->ownarg = true;
         } else {
             item->arg = extra->args;
         }
     } 
     
-    setter = &sweep->requests;
-
-    while (*setter != NULL) {
-        if (item->jobtype == REINDEX_JOB && (*setter)->jobtype != REINDEX_JOB && !(*setter)->activejob) {
-        // reindex jobs go first
-            break;
-        }
+    setter = &requests;
+    while (*setter != NULL && (*setter)->priority >= item->priority) {
         setter = &(*setter)->next;
-        depth++;
     }
     
     item->next = *setter;
     *setter = item;
     
-    MemoryContextSwitchTo(old);
+    for (search = requests; search != NULL; search = search->next) {
+        if ( search->dbid == dbid ) depth++;
+    }
+
     return depth;
 }
 
 static int
 AddJobRequest(JobType type, char *relname, char *dbname, Oid relid, Oid dbid, PoolArgs* extra) {
-    Sweeps         *sweep = NULL;
-    int             sweepcount = 0;
-    Sweeps         *add = NULL;
-    Sweeps	   *save = NULL;
+    Sweeps         **position = NULL;
+    int             workers = 0;
+    int             idle = 0;
     int             depth = 0;
     
     if (!inited)
@@ -547,66 +692,48 @@ AddJobRequest(JobType type, char *relname, char *dbname, Oid relid, Oid dbid, Po
     if ( IsShutdownProcessingMode() ) return -1;
 
     pthread_mutex_lock(&list_guard);
-    sweep = sweeplist;
     if ( sweep_cxt == NULL ) {
             pthread_mutex_unlock(&list_guard);
             return -1;
     }
-    /* first member is now active or null, proceed with the
-    rest of the list */
-    while (sweep != NULL) {        
+
+    /*  reap workers that went idle and count the ones left for the database  */
+    position = &sweeplist;
+    while (*position != NULL) {
 	if ( IsShutdownProcessingMode() ) {
             pthread_mutex_unlock(&list_guard);
             return -1;
         }
         
-        if ( !sweep->activesweep ) {
-            sweep = ShutdownPoolsweep(sweep);
-            if ( save == NULL ) sweeplist = sweep;
-	    else save->next = sweep;
-   /* have a new sweep, skip getting a new one below  */
+        if ( !(*position)->activesweep ) {
+            ShutdownPoolsweep(position);
             continue;
         } 
         
-        if ( sweep->dbid == dbid ) {
-            int space = CheckSweepForJob(sweep, type, relid);
-        
-            sweepcount++;
-
-            if ( space < 0 ) {
-                pthread_mutex_unlock(&list_guard);
-                return -1; /*  already in a list, just return  */
-            } else if ( space == 0 ) {
-                add = sweep; 
-		break;
-            } else if ( add == NULL ) {
-                depth = space;
-                add = sweep;
-            } else if( space < depth ) {
-                depth = space;
-                add = sweep;
-            }
+        if ( (*position)->dbid == dbid ) {
+            workers++;
+            if ( (*position)->current == NULL ) idle++;
         }
         
-        save = sweep;
-        sweep = sweep->next;
+        position = &(*position)->next;
     }
     
-    if ( sweep == NULL && sweepcount < concurrent ) {
-/*  this means that the relid was not found in the sweeps and 
- *  there is room for another concurrent thread
- */
-        add = StartupPoolsweep(dbname, dbid);
-    } else if ( add == NULL ) {
-        Assert(sweepcount == 0);
-        add = StartupPoolsweep(dbname, dbid);
+    if ( CheckQueueForJob(type, relid, dbid) ) {
+        pthread_mutex_unlock(&list_guard);
+        return -1; /*  already queued, just return  */
     }
     
-    if ( add != NULL ) sweepcount = AddJobToSweep(add, type, relname, dbname, relid, dbid, extra);
+    depth = AddJobToQueue(type, relname, dbname, relid, dbid, extra);
+    DTRACE_PROBE4(mtpg, poolsweep__enqueue, type, relid, dbid, depth);
+
+    if ( workers == 0 || (idle < depth && workers < concurrent) ) {
+        StartupPoolsweep(dbname, dbid);
+    }
+    pthread_cond_broadcast(&work_gate);
     
     pthread_mutex_unlock(&list_guard);
     
-    return ( sweepcount >= 0 ) ? 0 : 1;
+    return 0;
 }
 
 void
@@ -787,30 +914,28 @@ IsPoolsweep() {
 void
 DropVacuumRequests(Oid relid, Oid dbid) {
     Sweeps         *job = NULL;
+    JobList**       setter = NULL;
     
     pthread_mutex_lock(&list_guard);
     
+    setter = &requests;
+    while (*setter != NULL) {
+        JobList* search = *setter;
+        if ( search->dbid == dbid && (relid == search->relid || relid == InvalidOid) ) {
+            // erase from the list and free
+            *setter = search->next;
+            FreeJob(search);
+        } else {
+            // advance the setter
+            setter = &search->next;
+        }
+    }
+
     job = sweeplist;
     while (job != NULL ) {
-        if ( job->dbid == dbid && job->activesweep ) {
-            JobList** setter = &job->requests;
-            JobList* search = job->requests;
-            
-            while (search != NULL) {
-                if (relid == search->relid || relid == InvalidOid) {
-                    if (search->activejob) {
-                        job->env->cancelled = true;
-                        setter = &search->next;
-                    } else {
-                        // erase from the list and free
-                        (*setter) = search->next;
-                        pfree(search);
-                    }
-                } else {
-                    // advance the setter
-                    setter = &search->next;
-                }
-                search = *setter;
+        if ( job->dbid == dbid && job->activesweep && job->current != NULL ) {
+            if (relid == job->current->relid || relid == InvalidOid) {
+                job->env->cancelled = true;
             }
         }
         job = job->next;
@@ -834,8 +959,52 @@ IsPoolsweepPaused() {
 void
 ResumePoolsweep() {
     paused = false;
+    if ( inited ) {
+        pthread_mutex_lock(&list_guard);
+        pthread_cond_broadcast(&work_gate);
+        pthread_mutex_unlock(&list_guard);
+    }
+}
+
+/*
+ *  charge pages of work to the running job and sleep out the rest of
+ *  the second once the worker has used up its budget.  Call only where
+ *  no buffer locks are held.
+ */
+void
+PoolsweepDelayPoint(int pages) {
+    SweepBudget*    budget;
+    struct timeval  now;
+    long            elapsed;
+
+    if ( io_budget <= 0 || !IsPoolsweep() ) return;
+
+    budget = GetEnvSpace(sweep_id);
+    if ( budget == NULL ) return;
+
+    budget->charged += pages;
+    if ( budget->charged < io_budget ) return;
+
+    gettimeofday(&now, NULL);
+    elapsed = ElapsedMillis(&budget->window, &now);
+    if ( elapsed >= 0 && elapsed < 1000 ) {
+        struct timespec nap;
+        nap.tv_sec = 0;
+        nap.tv_nsec = (1000 - elapsed) * 1000000;
+        DTRACE_PROBE2(mtpg, poolsweep__throttle, budget->charged, 1000 - elapsed);
+        nanosleep(&nap, NULL);
+        gettimeofday(&now, NULL);
+    }
+    budget->charged = 0;
+    budget->window = now;
 }
 
+static long
+ElapsedMillis(struct timeval* from, struct timeval* to) {
+    return ((to->tv_sec - from->tv_sec) * 1000) + ((to->tv_usec - from->tv_usec) / 1000);
+}
+
+
 void PrintPoolsweepMemory( ) 
 {
 	pthread_mutex_lock(&list_guard);
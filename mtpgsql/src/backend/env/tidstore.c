@@ -0,0 +1,328 @@
+/*-------------------------------------------------------------------------
+ *
+ * tidstore.c
+ *	  compact set of heap tuple ids keyed by block
+ *
+ * The store is a two level directory on block number.  The top array
+ * holds one pointer per TIDSTORE_LEAF_BLOCKS blocks, a leaf holds one
+ * entry pointer per block.  An entry is a uint16 header followed by
+ * either a sorted list of offsets or a bitmap with bit (offset - 1) set
+ * for each dead tuple, whichever is smaller for that page.  The high bit
+ * of the header marks a bitmap, the rest is the number of offsets or the
+ * number of bitmap bytes.
+ *
+ * Entries are carved out of large chunks, nothing is freed until the
+ * store is reset, and the memory used is counted against the limit the
+ * store was created with.
+ *
+ * Portions Copyright (c) 2000-2024, Myron Scott  <myron@weaverdb.org>
+ *
+ * IDENTIFICATION
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+
+#include "env/tidstore.h"
+#include "utils/memutils.h"
+
+
+#define TIDSTORE_LEAF_SHIFT		6
+#define TIDSTORE_LEAF_BLOCKS	(1 << TIDSTORE_LEAF_SHIFT)
+#define TIDSTORE_LEAF_MASK		(TIDSTORE_LEAF_BLOCKS - 1)
+#define TIDSTORE_CHUNK_SIZE		(32 * 1024)
+
+#define TIDSTORE_BITMAP			0x8000
+#define TIDSTORE_LENMASK		0x7fff
+
+/* largest entry one page can need, the bitmap for MaxOffsetNumber */
+#define TIDSTORE_MAX_ENTRY		(sizeof(uint16) + (MaxOffsetNumber + 7) / 8)
+
+typedef struct TidStoreLeaf {
+	uint16	   *entries[TIDSTORE_LEAF_BLOCKS];
+} TidStoreLeaf;
+
+typedef struct TidStoreData {
+	MemoryContext cxt;			/* directory and entries, the struct is
+								 * in the creator's context */
+	Size		maxbytes;
+	Size		usedbytes;
+	TidStoreLeaf **leaves;
+	long		nleaves;
+	char	   *chunk;			/* current arena chunk */
+	Size		chunkfree;
+} TidStoreData;
+
+static uint16 *TidStoreAlloc(TidStore store, Size size);
+static TidStoreLeaf *TidStoreGetLeaf(TidStore store, BlockNumber blkno);
+static Size TidStoreLeafSpace(TidStore store, BlockNumber blkno);
+static int	TidStoreDecode(uint16 *entry, OffsetNumber *offsets);
+
+/*
+ * create an empty store that reports itself full once it holds about
+ * maxbytes of entries and directory.
+ */
+TidStore
+TidStoreCreate(Size maxbytes)
+{
+	TidStore	store = (TidStore) palloc(sizeof(TidStoreData));
+
+	MemSet(store, 0, sizeof(TidStoreData));
+	store->cxt = AllocSetContextCreate(MemoryContextGetCurrentContext(),
+									   "TidStoreContext",
+									   ALLOCSET_DEFAULT_MINSIZE,
+									   ALLOCSET_DEFAULT_INITSIZE,
+									   ALLOCSET_DEFAULT_MAXSIZE);
+	store->maxbytes = maxbytes;
+
+	return store;
+}
+
+/*
+ * free the store along with everything in it.
+ */
+void
+TidStoreDestroy(TidStore store)
+{
+	MemoryContextDelete(store->cxt);
+	pfree(store);
+}
+
+/*
+ * forget every tuple id and give the memory back.
+ */
+void
+TidStoreReset(TidStore store)
+{
+	MemoryContextResetAndDeleteChildren(store->cxt);
+	store->usedbytes = 0;
+	store->leaves = NULL;
+	store->nleaves = 0;
+	store->chunk = NULL;
+	store->chunkfree = 0;
+}
+
+/*
+ * add the dead offsets of one page.  offsets must be ascending and the
+ * page must not be in the store yet.  Returns false without adding
+ * anything when the page does not fit.
+ */
+bool
+TidStoreAddPage(TidStore store, BlockNumber blkno, OffsetNumber *offsets, int noffsets)
+{
+	TidStoreLeaf *leaf;
+	uint16	   *entry;
+	Size		listsz,
+				mapsz,
+				entrysz;
+	int			i;
+
+	if (noffsets <= 0)
+		return true;
+
+	listsz = noffsets * sizeof(uint16);
+	mapsz = (offsets[noffsets - 1] + 7) / 8;
+	entrysz = (sizeof(uint16) + Min(listsz, mapsz) + 1) & ~((Size) 1);
+
+	if (store->usedbytes + entrysz + TidStoreLeafSpace(store, blkno) > store->maxbytes)
+		return false;
+
+	leaf = TidStoreGetLeaf(store, blkno);
+	if (leaf->entries[blkno & TIDSTORE_LEAF_MASK] != NULL)
+		elog(ERROR, "TidStoreAddPage: block %lu added twice", (unsigned long) blkno);
+
+	if (listsz < mapsz) {
+		entry = TidStoreAlloc(store, sizeof(uint16) + listsz);
+		entry[0] = (uint16) noffsets;
+		for (i = 0; i < noffsets; i++)
+			entry[i + 1] = offsets[i];
+	} else {
+		uint8	   *map;
+
+		entry = TidStoreAlloc(store, sizeof(uint16) + mapsz);
+		entry[0] = (uint16) (TIDSTORE_BITMAP | mapsz);
+		map = (uint8 *) (entry + 1);
+		MemSet(map, 0, mapsz);
+		for (i = 0; i < noffsets; i++)
+			map[(offsets[i] - 1) >> 3] |= (1 << ((offsets[i] - 1) & 0x07));
+	}
+
+	leaf->entries[blkno & TIDSTORE_LEAF_MASK] = entry;
+
+	return true;
+}
+
+bool
+TidStoreIsMember(TidStore store, ItemPointer tid)
+{
+	BlockNumber blkno = ItemPointerGetBlockNumber(tid);
+	OffsetNumber off = ItemPointerGetOffsetNumber(tid);
+	long		top = blkno >> TIDSTORE_LEAF_SHIFT;
+	TidStoreLeaf *leaf;
+	uint16	   *entry;
+	int			len;
+
+	if (top >= store->nleaves || (leaf = store->leaves[top]) == NULL)
+		return false;
+	if ((entry = leaf->entries[blkno & TIDSTORE_LEAF_MASK]) == NULL)
+		return false;
+
+	len = entry[0] & TIDSTORE_LENMASK;
+	if (entry[0] & TIDSTORE_BITMAP) {
+		uint8	   *map = (uint8 *) (entry + 1);
+
+		if (off == 0 || ((off - 1) >> 3) >= len)
+			return false;
+		return (map[(off - 1) >> 3] & (1 << ((off - 1) & 0x07))) != 0;
+	} else {
+		/* lists are only used while shorter than the bitmap, scan it */
+		int			i;
+
+		for (i = 1; i <= len && entry[i] <= off; i++) {
+			if (entry[i] == off)
+				return true;
+		}
+		return false;
+	}
+}
+
+/*
+ * true once there is no room left for page blkno full of dead tuples.
+ */
+bool
+TidStoreIsFull(TidStore store, BlockNumber blkno)
+{
+	return (store->usedbytes + TIDSTORE_MAX_ENTRY + TidStoreLeafSpace(store, blkno) > store->maxbytes);
+}
+
+/*
+ * find the first page at or after *blkno holding dead tuples.  Its
+ * offsets go to offsets, which must have room for MaxOffsetNumber, in
+ * ascending order and *blkno is set to the page.  Returns the number of
+ * offsets, zero when there are no more pages.
+ */
+int
+TidStoreNextPage(TidStore store, BlockNumber *blkno, OffsetNumber *offsets)
+{
+	long		top = *blkno >> TIDSTORE_LEAF_SHIFT;
+	int			slot = *blkno & TIDSTORE_LEAF_MASK;
+
+	for (; top < store->nleaves; top++, slot = 0) {
+		TidStoreLeaf *leaf = store->leaves[top];
+
+		if (leaf == NULL)
+			continue;
+		for (; slot < TIDSTORE_LEAF_BLOCKS; slot++) {
+			if (leaf->entries[slot] != NULL) {
+				*blkno = (BlockNumber) ((top << TIDSTORE_LEAF_SHIFT) | slot);
+				return TidStoreDecode(leaf->entries[slot], offsets);
+			}
+		}
+	}
+
+	return 0;
+}
+
+static int
+TidStoreDecode(uint16 *entry, OffsetNumber *offsets)
+{
+	int			len = entry[0] & TIDSTORE_LENMASK;
+	int			n = 0;
+	int			i;
+
+	if (entry[0] & TIDSTORE_BITMAP) {
+		uint8	   *map = (uint8 *) (entry + 1);
+
+		for (i = 0; i < len; i++) {
+			uint8		bits = map[i];
+			int			b;
+
+			for (b = 0; bits != 0; b++, bits >>= 1) {
+				if (bits & 0x01)
+					offsets[n++] = (OffsetNumber) ((i << 3) + b + 1);
+			}
+		}
+	} else {
+		for (i = 1; i <= len; i++)
+			offsets[n++] = entry[i];
+	}
+
+	return n;
+}
+
+/*
+ * the leaf covering blkno, the top array and the leaf are created as
+ * needed.
+ */
+static TidStoreLeaf *
+TidStoreGetLeaf(TidStore store, BlockNumber blkno)
+{
+	long		top = blkno >> TIDSTORE_LEAF_SHIFT;
+
+	if (top >= store->nleaves) {
+		long		nleaves = (store->nleaves == 0) ? 64 : store->nleaves;
+
+		while (nleaves <= top)
+			nleaves *= 2;
+		if (store->leaves == NULL)
+			store->leaves = (TidStoreLeaf **) MemoryContextAlloc(store->cxt, nleaves * sizeof(TidStoreLeaf *));
+		else
+			store->leaves = (TidStoreLeaf **) repalloc(store->leaves, nleaves * sizeof(TidStoreLeaf *));
+		MemSet(store->leaves + store->nleaves, 0, (nleaves - store->nleaves) * sizeof(TidStoreLeaf *));
+		store->usedbytes += (nleaves - store->nleaves) * sizeof(TidStoreLeaf *);
+		store->nleaves = nleaves;
+	}
+
+	if (store->leaves[top] == NULL) {
+		store->leaves[top] = (TidStoreLeaf *) MemoryContextAlloc(store->cxt, sizeof(TidStoreLeaf));
+		MemSet(store->leaves[top], 0, sizeof(TidStoreLeaf));
+		store->usedbytes += sizeof(TidStoreLeaf);
+	}
+
+	return store->leaves[top];
+}
+
+/*
+ * bytes TidStoreGetLeaf would allocate for blkno, the growth of the top
+ * array and the leaf itself.
+ */
+static Size
+TidStoreLeafSpace(TidStore store, BlockNumber blkno)
+{
+	long		top = blkno >> TIDSTORE_LEAF_SHIFT;
+	Size		space = 0;
+
+	if (top >= store->nleaves) {
+		long		nleaves = (store->nleaves == 0) ? 64 : store->nleaves;
+
+		while (nleaves <= top)
+			nleaves *= 2;
+		space += (nleaves - store->nleaves) * sizeof(TidStoreLeaf *);
+	} else if (store->leaves[top] != NULL)
+		return 0;
+
+	return space + sizeof(TidStoreLeaf);
+}
+
+/*
+ * carve an entry out of the current chunk.  Entries are kept on uint16
+ * boundaries.
+ */
+static uint16 *
+TidStoreAlloc(TidStore store, Size size)
+{
+	uint16	   *entry;
+
+	size = (size + 1) & ~((Size) 1);
+	if (size > store->chunkfree) {
+		store->chunk = (char *) MemoryContextAlloc(store->cxt, TIDSTORE_CHUNK_SIZE);
+		store->chunkfree = TIDSTORE_CHUNK_SIZE;
+	}
+	entry = (uint16 *) store->chunk;
+	store->chunk += size;
+	store->chunkfree -= size;
+	store->usedbytes += size;
+
+	return entry;
+}
@@ -39,6 +39,8 @@
 
 #include <sys/time.h>
 #include <sys/resource.h>
+#include <pthread.h>
+#include <errno.h>
 
 
 
@@ -46,8 +48,11 @@
 #include "env/env.h"
 
 #include "env/freespace.h"
+#include "env/visibilitymap.h"
+#include "env/tidstore.h"
 #include "env/poolsweep.h"
 #include "env/dbwriter.h"
+#include "env/dolhelper.h"
 #include "env/properties.h"
 
 #include "access/genam.h"
@@ -135,13 +140,12 @@ typedef struct LVRelStats {
 	TupleCount      rel_live_segment_tuples;
 	TupleCount      rel_dead_segment_tuples;
 	BlockNumber     nonempty_pages;	/* actually, last nonempty page + 1 */
-	/* List of TIDs of tuples we intend to delete */
-	/* NB: this list is ordered by TID address */
+	/* Set of TIDs of tuples we intend to delete, kept by block */
 	TupleCount      num_dead_tuples;	/* current # of entries */
 	TupleCount      num_aborted_tuples;	/* current # of entries */
 	TupleCount      num_recently_dead_tuples;	/* current # of entries */
 	TupleCount      max_dead_tuples;	/* # slots allocated in array */
-	ItemPointer     dead_tuples;	/* array of ItemPointerData */
+	TidStore        dead_tuples;	/* dead tuple ids by block */
 	ItemPointer     recently_dead_tuples;	/* array of ItemPointerData */
 /*      ItemPointer     forward_pointers;  */	/* array of ItemPointerData */
 	/* Array or heap of per-page info about free space */
@@ -160,6 +164,7 @@ typedef struct LVRelStats {
 					 * page  */
         long            empty_pages;
         long            changed_pages;
+        long            skipped_pages;	/* all-visible pages not read */
 	long            total_free;
         long            total_bytes;
         long            total_seg_bytes;
@@ -168,8 +173,39 @@ typedef struct LVRelStats {
 	bool            force_trim;
 	bool		freespace_scan;
 	Snapshot        index_confirm;
+	List           *released_links;	/* shared blob links reaped on the
+					 * current page */
 }               LVRelStats;
 
+/*
+ * Index passes are spread over DOL helpers.  The main thread and up to
+ * LAZY_INDEX_MAX_WORKERS helpers each take the next unprocessed index
+ * until none are left.  vacrelstats and its dead tuple array are only
+ * read while the workers run.
+ */
+#define LAZY_INDEX_MAX_WORKERS  3
+
+struct LVIndexShared;
+
+typedef struct LVIndexWorker {
+	struct LVIndexShared *shared;
+	DolConnection   conn;
+	bool            done;
+}               LVIndexWorker;
+
+typedef struct LVIndexShared {
+	LVRelStats     *vacrelstats;	/* NULL for a scan-only pass */
+	int             nindexes;
+	Oid            *indexids;
+	TupleCount     *results;
+	int             next;
+	int             finished;
+	int             nworkers;
+	LVIndexWorker   workers[LAZY_INDEX_MAX_WORKERS];
+	pthread_mutex_t guard;
+	pthread_cond_t  gate;
+}               LVIndexShared;
+
 
 /* non-export function prototypes */
 static TupleCount 
@@ -178,17 +214,20 @@ lazy_scan_heap(Relation onerel, LVRelStats * vacrelstats,
 static void     lazy_vacuum_heap(Relation onerel, LVRelStats * vacrelstats);
 static TupleCount lazy_scan_index(Relation indrel);
 static TupleCount lazy_vacuum_index(Relation indrel, LVRelStats * vacrelstats);
-static int 
+static void     lazy_vacuum_indexes(Relation * Irel, int nindexes, LVRelStats * vacrelstats, TupleCount * results);
+static void     lazy_index_work(LVIndexShared * shared, Relation * Irel);
+static void    *lazy_index_worker(void *arg);
+static void 
 lazy_vacuum_page(Relation onerel, BlockNumber blkno, Buffer buffer,
-		 int tupindex, LVRelStats * vacrelstats);
+		 OffsetNumber * offsets, int noffsets);
 static void     lazy_truncate_heap(Relation onerel, LVRelStats * vacrelstats);
 static BlockNumber 
 count_nondeletable_pages(Relation onerel,
 			 LVRelStats * vacrelstats);
 static void     lazy_space_alloc(LVRelStats * vacrelstats, BlockNumber relblocks);
 static void 
-lazy_record_dead_tuple(LVRelStats * vacrelstats,
-		       ItemPointer itemptr);
+lazy_record_dead_page(LVRelStats * vacrelstats, BlockNumber blkno,
+		       OffsetNumber * offsets, int noffsets);
 static void 
 lazy_record_free_space(LVRelStats * vacrelstats,
 		       BlockNumber page, Size avail, int unused_pointers);
@@ -438,6 +477,7 @@ lazy_freespace_scan_rel(Oid relid)
                       vacrelstats->rel_live_tuples,
                       vacrelstats->rel_dead_tuples + vacrelstats->rel_kept_tuples, false);
                       
+                if (vacrelstats->dead_tuples != NULL) TidStoreDestroy(vacrelstats->dead_tuples);
                 pfree(vacrelstats);
         } else if (rel->rd_rel->relkind == RELKIND_INDEX) {
                 LockRelation(rel, AccessShareLock);
@@ -568,6 +608,8 @@ lazy_vacuum_rel(Relation onerel, bool scanonly, bool force_trim)
                       vacrelstats->rel_live_tuples,
                       vacrelstats->rel_dead_tuples + vacrelstats->rel_kept_tuples, true);
 
+	VisibilityMapFlush(onerel);
+
 	if (!scanonly) {
             ratio = ((double) vacrelstats->total_free) / ((double) (vacrelstats->rel_pages * MaxTupleSize));
             random = prandom();
@@ -580,12 +622,14 @@ lazy_vacuum_rel(Relation onerel, bool scanonly, bool force_trim)
         }
 /*  don't do this for now, not optimized properly */
 
+	if (vacrelstats->dead_tuples != NULL)
+		TidStoreDestroy(vacrelstats->dead_tuples);
 	pfree(vacrelstats);
 
 }
 
 static bool
-lazy_scan_heap_page(Relation onerel, Buffer buf, LVRelStats * vacrelstats) {
+lazy_scan_heap_page(Relation onerel, Buffer buf, LVRelStats * vacrelstats, bool * allvisible) {
         Page            page = BufferGetPage(buf);
         OffsetNumber    offnum;
         bool            pgchanged, hastup;
@@ -599,6 +643,8 @@ lazy_scan_heap_page(Relation onerel, Buffer buf, LVRelStats * vacrelstats) {
 	Size            max, min;
 	Size		freespace;
 	int		num_dead = vacrelstats->num_dead_tuples;
+	OffsetNumber    deadoffsets[MaxOffsetNumber];
+	int             ndead = 0;
 
         OffsetNumber maxoff = PageGetMaxOffsetNumber(page);
         	
@@ -606,6 +652,7 @@ lazy_scan_heap_page(Relation onerel, Buffer buf, LVRelStats * vacrelstats) {
 	min = ~0;
         pgchanged = false;
         hastup = false;
+        *allvisible = true;
 
         for (offnum = FirstOffsetNumber;
              offnum <= maxoff;
@@ -614,6 +661,7 @@ lazy_scan_heap_page(Relation onerel, Buffer buf, LVRelStats * vacrelstats) {
                 uint16              sv_infomask;
                 HeapTupleData       tuple;
                 bool                tupgone = false;
+                bool                tuplive = false;
 
                 itemid = PageGetItemId(page, offnum);
 
@@ -645,6 +693,7 @@ lazy_scan_heap_page(Relation onerel, Buffer buf, LVRelStats * vacrelstats) {
                         break;
                     case HEAPTUPLE_LIVE:
                         tups_live++;
+                        tuplive = true;
                         break;
                     case HEAPTUPLE_RECENTLY_DEAD:
                         /*
@@ -672,7 +721,18 @@ lazy_scan_heap_page(Relation onerel, Buffer buf, LVRelStats * vacrelstats) {
                         break;
                 }
 
+                /*
+                 * the page is all-visible only if every tuple is live, its
+                 * commit is hinted and no open transaction predates it
+                 */
+                if (!tuplive || !(tuple.t_data->t_infomask & HEAP_XMIN_COMMITTED) ||
+                        tuple.t_data->t_xmin >= vacrelstats->reapid)
+                        *allvisible = false;
+
                 if (sv_infomask & HEAP_BLOB_SEGMENT) {
+                    if (tupgone && !vacrelstats->scanonly &&
+                            vacuum_reap_segment_blob(onerel, &tuple, &vacrelstats->released_links))
+                            pgchanged = true;
                     if (tupgone)
                             vacrelstats->rel_dead_segment_tuples += 1;
                     else
@@ -699,13 +759,15 @@ lazy_scan_heap_page(Relation onerel, Buffer buf, LVRelStats * vacrelstats) {
                 num_tuples += 1;
                 if (tupgone) {
                     if (!vacrelstats->scanonly) {
-                        lazy_record_dead_tuple(vacrelstats, &(tuple.t_self));
+                        deadoffsets[ndead++] = offnum;
                     }
                     tups_dead += 1;
                 } else {
                     hastup = true;
                 }
         }		/* scan along page */
+
+        lazy_record_dead_page(vacrelstats, blkno, deadoffsets, ndead);
         /*
          * Remember the location of the last page with nonremovable
          * tuples
@@ -713,6 +775,7 @@ lazy_scan_heap_page(Relation onerel, Buffer buf, LVRelStats * vacrelstats) {
         if (hastup) {
                 vacrelstats->nonempty_pages = blkno + 1;
         } else {
+            *allvisible = false;
           /*  this is a fix for previous mis-deeds when 
            *  PageRepairFragmentation didn't clear space if there 
            *  were not tuples in it, nothing should be accessing,
@@ -757,6 +820,7 @@ lazy_scan_heap(Relation onerel, LVRelStats * vacrelstats,
 	BlockNumber     nblocks, blkno;
 	char           *relname;
 	TupleCount      tups_vacuumed, tups_aborted, tups_live_segment, tups_dead_segment;
+	TupleCount     *i_results = NULL;
 	int             i;
 
 	VacRUsage       ru0;
@@ -777,11 +841,15 @@ lazy_scan_heap(Relation onerel, LVRelStats * vacrelstats,
 	vacrelstats->num_dead_tuples = 0;
 
 	lazy_space_alloc(vacrelstats, nblocks);
+	if (nindexes > 0)
+		i_results = (TupleCount *) palloc(nindexes * sizeof(TupleCount));
 
 	for (blkno = 0; blkno < nblocks; blkno++) {
 		Buffer          buf;
 		Page            page;
                 bool            changed = false;
+                bool            allvisible = false;
+                uint32          vmsequence = 0;
 
                 if (IsShutdownProcessingMode()) {
                         elog(ERROR, "shutting down");
@@ -799,12 +867,10 @@ lazy_scan_heap(Relation onerel, LVRelStats * vacrelstats,
 		 * dead-tuple TIDs, pause and do a cycle of vacuuming before
 		 * we tackle this page.
 		 */
-		if ((vacrelstats->max_dead_tuples - vacrelstats->num_dead_tuples) < MAX_TUPLES_PER_PAGE &&
+		if (TidStoreIsFull(vacrelstats->dead_tuples, blkno) &&
 		    vacrelstats->num_dead_tuples > 0) {
 			/* Remove index entries */
-			for (i = 0; i < nindexes; i++) {
-                            TupleCount i_tup = lazy_vacuum_index(Irel[i], vacrelstats);
-			}
+			lazy_vacuum_indexes(Irel, nindexes, vacrelstats, i_results);
 			/*
 			 * flush the dirty buffers to make sure that the
 			 * index entries are gone before the heap entries
@@ -818,12 +884,28 @@ lazy_scan_heap(Relation onerel, LVRelStats * vacrelstats,
 			tups_vacuumed += vacrelstats->num_dead_tuples;
 			tups_aborted += vacrelstats->num_aborted_tuples;
 			vacrelstats->num_dead_tuples = 0;
+			TidStoreReset(vacrelstats->dead_tuples);
 			vacrelstats->num_aborted_tuples = 0;
 			tups_live_segment += vacrelstats->rel_live_segment_tuples;
 			tups_dead_segment += vacrelstats->rel_dead_segment_tuples;
 			vacrelstats->rel_live_segment_tuples = 0;
 			vacrelstats->rel_dead_segment_tuples = 0;
 		}
+                /*
+                 * Nothing has touched an all-visible page since the last
+                 * pass, it has no dead tuples and too little space to
+                 * bother recording, so don't read it.
+                 */
+                if ( !vacrelstats->freespace_scan && !vacrelstats->force_trim ) {
+                    if ( VisibilityMapTest(onerel, blkno) ) {
+                        vacrelstats->skipped_pages++;
+                        vacrelstats->nonempty_pages = blkno + 1;
+                        continue;
+                    }
+                    vmsequence = VisibilityMapGetSequence(onerel, blkno);
+                }
+
+                PoolsweepDelayPoint(1);
                 buf = ReadBuffer(onerel, blkno);
 		if (!BufferIsValid(buf))
 			elog(ERROR, "bad buffer read in garbage collection");
@@ -861,7 +943,11 @@ lazy_scan_heap(Relation onerel, LVRelStats * vacrelstats,
 		}
 
                 if ( !vacrelstats->freespace_scan ) {
-                    changed = lazy_scan_heap_page(onerel,buf,vacrelstats);
+                    changed = lazy_scan_heap_page(onerel,buf,vacrelstats,&allvisible);
+                    if ( allvisible && !vacrelstats->force_trim && 
+                            PageGetFreeSpace(page) < BLCKSZ / 32 ) {
+                        VisibilityMapSet(onerel, blkno, vmsequence);
+                    }
                 } else {
                      TupleCount unused = 0;
                      OffsetNumber offnum,maxoff;
@@ -902,6 +988,12 @@ lazy_scan_heap(Relation onerel, LVRelStats * vacrelstats,
                 } else {
                     ReleaseBuffer(onerel, buf);
                 }
+                /*  shared blob content is released once the page is let go  */
+                if ( vacrelstats->released_links != NIL ) {
+                    vacuum_release_segment_blobs(onerel, vacrelstats->released_links);
+                    freeList(vacrelstats->released_links);
+                    vacrelstats->released_links = NIL;
+                }
 
 		if ( vacrelstats->freespace_scan && vacrelstats->num_free_pages >= vacrelstats->rel_pages * 0.10 ) {
                     break;
@@ -913,10 +1005,10 @@ lazy_scan_heap(Relation onerel, LVRelStats * vacrelstats,
 	/* XXX put a threshold on min number of tuples here? */
 	if ( vacrelstats->num_dead_tuples > 0 ) {
             /* Remove index entries */
+            lazy_vacuum_indexes(Irel, nindexes, vacrelstats, i_results);
             for (i = 0; i < nindexes; i++) {
-                    TupleCount      i_tup = lazy_vacuum_index(Irel[i], vacrelstats);
-                    if (i_tup == vacrelstats->num_dead_tuples) {
-                            lazy_update_index_stats(Irel[i], i_tup);
+                    if (i_results[i] == vacrelstats->num_dead_tuples) {
+                            lazy_update_index_stats(Irel[i], i_results[i]);
                     }
             }
 
@@ -931,12 +1023,13 @@ lazy_scan_heap(Relation onerel, LVRelStats * vacrelstats,
             /*( vacuum stats  */
             tups_vacuumed += vacrelstats->num_dead_tuples;
             vacrelstats->num_dead_tuples = 0;
+            TidStoreReset(vacrelstats->dead_tuples);
 	} else {
             /* Scan indexes just to update pg_class statistics about them */
             if ( !vacrelstats->freespace_scan ) {
+                lazy_vacuum_indexes(Irel, nindexes, NULL, i_results);
                 for (i = 0; i < nindexes; i++) {
-                        TupleCount      i_tups = lazy_scan_index(Irel[i]);
-                        lazy_update_index_stats(Irel[i], i_tups);
+                        lazy_update_index_stats(Irel[i], i_results[i]);
                 }
             }
 	}
@@ -951,6 +1044,15 @@ lazy_scan_heap(Relation onerel, LVRelStats * vacrelstats,
 	vacrelstats->rel_live_segment_tuples = tups_live_segment;
 	vacrelstats->rel_dead_segment_tuples = tups_dead_segment;
 
+	/*
+	 * Skipped pages were not counted, estimate their live tuples from
+	 * the density the last pass left in pg_class.
+	 */
+	if (vacrelstats->skipped_pages > 0 && onerel->rd_rel->relpages > 0) {
+		double          density = ((double) onerel->rd_rel->reltuples) / ((double) onerel->rd_rel->relpages);
+
+		vacrelstats->rel_live_tuples += (TupleCount) (density * vacrelstats->skipped_pages);
+	}
 	if (vacrelstats->max_size < vacrelstats->min_size)
 		vacrelstats->min_size = vacrelstats->max_size;
 	if (onerel->rd_rel->relkind == RELKIND_RELATION && vacrelstats->total_bytes > 0) {
@@ -959,8 +1061,8 @@ lazy_scan_heap(Relation onerel, LVRelStats * vacrelstats,
                         / 
                     (vacrelstats->rel_tuples - vacrelstats->rel_live_segment_tuples - vacrelstats->rel_dead_segment_tuples));
 	}
-	vacuum_log(onerel,"Pages %ld: Changed %ld, Empty %ld; Tup %ld: Live %ld, Dead %ld, Abort %ld, Vac %ld, Keep %ld, UnUsed %ld, Segments: Live %ld, Dead %ld.",
-	     nblocks, vacrelstats->changed_pages, vacrelstats->empty_pages,
+	vacuum_log(onerel,"Pages %ld: Changed %ld, Empty %ld, Skipped %ld; Tup %ld: Live %ld, Dead %ld, Abort %ld, Vac %ld, Keep %ld, UnUsed %ld, Segments: Live %ld, Dead %ld.",
+	     nblocks, vacrelstats->changed_pages, vacrelstats->empty_pages, vacrelstats->skipped_pages,
 	     vacrelstats->rel_tuples, vacrelstats->rel_live_tuples,
 	     vacrelstats->rel_dead_tuples, tups_aborted, tups_vacuumed, vacrelstats->rel_kept_tuples, 
                 vacrelstats->rel_unused, tups_live_segment, tups_dead_segment);
@@ -968,6 +1070,8 @@ lazy_scan_heap(Relation onerel, LVRelStats * vacrelstats,
 	vacuum_log(onerel,"Total Space Usage %ld free / %ld total",
 	     vacrelstats->total_free, nblocks * MaxTupleSize);
 	vacuum_log(onerel,"%s", vac_show_rusage(&ru0, rubuf));
+	if (i_results != NULL)
+		pfree(i_results);
 	return (tups_vacuumed);
 }
 
@@ -990,13 +1094,16 @@ lazy_vacuum_heap(Relation onerel, LVRelStats * vacrelstats)
 	long            npages;
 	char            rubuf[255];
 	VacRUsage       ru0;
+	BlockNumber     tblk;
+	OffsetNumber    offsets[MaxOffsetNumber];
+	int             noffsets;
 
 	vac_init_rusage(&ru0);
 	npages = 0;
 	tupindex = 0;
+	tblk = 0;
 
-	while (tupindex < vacrelstats->num_dead_tuples) {
-		BlockNumber     tblk;
+	while ((noffsets = TidStoreNextPage(vacrelstats->dead_tuples, &tblk, offsets)) > 0) {
 		Buffer          buf;
 		Page            page;
 		long            unused_p, newmax;
@@ -1011,14 +1118,15 @@ lazy_vacuum_heap(Relation onerel, LVRelStats * vacrelstats)
                     }
                 }
 
-		tblk = ItemPointerGetBlockNumber(&vacrelstats->dead_tuples[tupindex]);
+                PoolsweepDelayPoint(1);
 		buf = ReadBuffer(onerel, tblk);
 
 		if (!BufferIsValid(buf))
 			elog(ERROR, "bad buffer read in garbage collection");
 
 		LockBuffer((onerel), buf, BUFFER_LOCK_REF_EXCLUSIVE);
-		tupindex = lazy_vacuum_page(onerel, tblk, buf, tupindex, vacrelstats);
+		lazy_vacuum_page(onerel, tblk, buf, offsets, noffsets);
+		tupindex += noffsets;
 		/*
 		 * Now that we've compacted the page, record its available
 		 * space
@@ -1053,6 +1161,7 @@ lazy_vacuum_heap(Relation onerel, LVRelStats * vacrelstats)
                 }
 
 		npages++;
+		tblk++;
 	}
         
 	/*
@@ -1069,34 +1178,20 @@ lazy_vacuum_heap(Relation onerel, LVRelStats * vacrelstats)
  * 
  * Caller is expected to handle reading, locking, and writing the buffer.
  * 
- * tupindex is the index in vacrelstats->dead_tuples of the first dead tuple for
- * this page.  We assume the rest follow sequentially. The return value is
- * the first tupindex after the tuples of this page.
+ * offsets are the dead tuples of this page taken from vacrelstats->dead_tuples.
  */
-static int
+static void
 lazy_vacuum_page(Relation onerel, BlockNumber blkno, Buffer buffer,
-		 int tupindex, LVRelStats * vacrelstats)
+		 OffsetNumber * offsets, int noffsets)
 {
-	OffsetNumber    unbuf[BLCKSZ / sizeof(OffsetNumber)];
-	OffsetNumber   *unused = unbuf;
-	long            uncnt;
 	Page            page = BufferGetPage(buffer);
 	ItemId          itemid;
+	int             i;
 
-	for (; tupindex < vacrelstats->num_dead_tuples; tupindex++) {
-		BlockNumber     tblk;
-		OffsetNumber    toff;
-		ItemPointer     target = &vacrelstats->dead_tuples[tupindex];
-
-		tblk = ItemPointerGetBlockNumber(target);
-		if (tblk != blkno)
-			break;	/* past end of tuples for this block */
-		toff = ItemPointerGetOffsetNumber(target);
-		itemid = PageGetItemId(page, toff);
+	for (i = 0; i < noffsets; i++) {
+		itemid = PageGetItemId(page, offsets[i]);
 		itemid->lp_flags &= ~LP_USED;
 	}
-
-	return tupindex;
 }
 
 /*
@@ -1178,8 +1273,6 @@ lazy_vacuum_index(Relation indrel, LVRelStats * vacrelstats)
 
 	vac_init_rusage(&ru0);
         
-        LockRelation(indrel,RowExclusiveLock);
-        
 	nitupsremoved = (TupleCount) index_bulkdelete(indrel, vacrelstats->num_dead_tuples, vacrelstats->dead_tuples);
 
 	/* if deleted tuples do not equal it is time to reindex  */
@@ -1200,6 +1293,145 @@ lazy_vacuum_index(Relation indrel, LVRelStats * vacrelstats)
 	return nitupsremoved;
 }
 
+/*
+ * lazy_vacuum_indexes() -- vacuum or scan all the indexes of a relation.
+ * 
+ * With vacrelstats the dead tuples are deleted from every index, without
+ * it the indexes are only scanned for statistics.  The count for Irel[i]
+ * is returned in results[i].  When there is more than one index the work
+ * is shared with DOL helpers, the number is taken from the
+ * vacuumindexworkers property.  Statistics are left to the caller since
+ * pg_class is updated by the main thread.
+ */
+static void
+lazy_vacuum_indexes(Relation * Irel, int nindexes, LVRelStats * vacrelstats, TupleCount * results)
+{
+	LVIndexShared   shared;
+	int             nworkers = LAZY_INDEX_MAX_WORKERS;
+	int             i;
+
+	/* take the locks here so they belong to the vacuum transaction */
+	if (vacrelstats != NULL) {
+		for (i = 0; i < nindexes; i++)
+			LockRelation(Irel[i], RowExclusiveLock);
+	}
+
+	MemSet(&shared, 0, sizeof(LVIndexShared));
+	shared.vacrelstats = vacrelstats;
+	shared.nindexes = nindexes;
+	shared.results = results;
+	shared.indexids = (Oid *) palloc(nindexes * sizeof(Oid));
+	for (i = 0; i < nindexes; i++)
+		shared.indexids[i] = RelationGetRelid(Irel[i]);
+	pthread_mutex_init(&shared.guard, NULL);
+	pthread_cond_init(&shared.gate, NULL);
+
+	if (PropertyIsValid("vacuumindexworkers")) {
+		nworkers = GetIntProperty("vacuumindexworkers");
+		if (nworkers > LAZY_INDEX_MAX_WORKERS)
+			nworkers = LAZY_INDEX_MAX_WORKERS;
+	}
+	if (nworkers > nindexes - 1)
+		nworkers = nindexes - 1;
+
+	for (i = 0; i < nworkers; i++) {
+		DolConnection   conn = GetDolConnection();
+		LVIndexWorker  *worker;
+
+		if (conn == NULL)
+			break;
+
+		worker = &shared.workers[shared.nworkers++];
+		worker->shared = &shared;
+		worker->conn = conn;
+		worker->done = false;
+
+		ProcessDolCommand(conn, lazy_index_worker, worker);
+	}
+
+	lazy_index_work(&shared, Irel);
+
+	/*
+	 * wait for the helpers, they reference shared until they are done.
+	 * A helper that errors out goes back to waiting without finishing.
+	 */
+	pthread_mutex_lock(&shared.guard);
+	for (i = 0; i < shared.nworkers; i++) {
+		LVIndexWorker  *worker = &shared.workers[i];
+
+		while (!worker->done) {
+			struct timespec waittime;
+
+			ptimeout(&waittime, 1000);
+			if (pthread_cond_timedwait(&shared.gate, &shared.guard, &waittime) == ETIMEDOUT &&
+			    !worker->done && !IsDolConnectionRunning(worker->conn)) {
+				pthread_mutex_unlock(&shared.guard);
+				elog(ERROR, "index vacuum worker stopped before finishing");
+			}
+		}
+	}
+	pthread_mutex_unlock(&shared.guard);
+
+	pthread_cond_destroy(&shared.gate);
+	pthread_mutex_destroy(&shared.guard);
+	pfree(shared.indexids);
+
+	if (shared.finished != nindexes)
+		elog(ERROR, "index vacuum finished %d of %d indexes", shared.finished, nindexes);
+}
+
+/*
+ * take indexes until there are none left.  The main thread passes its own
+ * relations, helpers open the indexes again in their own relcache.
+ */
+static void
+lazy_index_work(LVIndexShared * shared, Relation * Irel)
+{
+	for (;;) {
+		Relation        indrel;
+		TupleCount      result;
+		int             i;
+
+		pthread_mutex_lock(&shared->guard);
+		i = shared->next++;
+		pthread_mutex_unlock(&shared->guard);
+
+		if (i >= shared->nindexes)
+			break;
+
+		indrel = (Irel != NULL) ? Irel[i] : index_open(shared->indexids[i]);
+
+		if (shared->vacrelstats != NULL)
+			result = lazy_vacuum_index(indrel, shared->vacrelstats);
+		else
+			result = lazy_scan_index(indrel);
+
+		if (Irel == NULL)
+			index_close(indrel);
+
+		pthread_mutex_lock(&shared->guard);
+		shared->results[i] = result;
+		shared->finished++;
+		pthread_mutex_unlock(&shared->guard);
+	}
+}
+
+static void *
+lazy_index_worker(void *arg)
+{
+	LVIndexWorker  *worker = (LVIndexWorker *) arg;
+	LVIndexShared  *shared = worker->shared;
+
+	lazy_index_work(shared, NULL);
+
+	pthread_mutex_lock(&shared->guard);
+	worker->done = true;
+	pthread_cond_broadcast(&shared->gate);
+	pthread_mutex_unlock(&shared->guard);
+
+	return NULL;
+}
+
 static bool
 repair_insert_index_for_entry(Relation onerel, HeapTuple newtup, FragRepairInfo* repair_info) {
 	InsertIndexResult   iresult;
@@ -1424,6 +1656,7 @@ lazy_respan_blobs(Relation onerel, bool exclude_self, FragRepairInfo* repair_inf
                                 break;
 			}
 		}               
+                PoolsweepDelayPoint(1);
                 buf = ReadBuffer(onerel, marker);
                 if ( !BufferIsValid(buf) ) {
                     elog(ERROR,"bad read under respanning");
@@ -1484,8 +1717,12 @@ lazy_respan_blobs(Relation onerel, bool exclude_self, FragRepairInfo* repair_inf
                        }
                 }        
                 LockBuffer((onerel), buf, BUFFER_LOCK_UNLOCK);
-		if ( page_altered ) WriteBuffer(onerel,buf);
-                else ReleaseBuffer(onerel, buf);
+		if ( page_altered ) {
+                    VisibilityMapClear(onerel, marker);
+                    WriteBuffer(onerel,buf);
+                } else {
+                    ReleaseBuffer(onerel, buf);
+                }
 
                 MemoryContextResetAndDeleteChildren(page_cxt);
                 
@@ -1562,6 +1799,7 @@ lazy_repair_fragmentation(Relation onerel, FragRepairInfo* repair_info) {
 			}
 		}
                 
+                PoolsweepDelayPoint(1);
 		buf = ReadBuffer(onerel, blkno);
                 if ( !BufferIsValid(buf) ) {
                     elog(ERROR,"bad buffer read under repair fragmentation");
@@ -1570,10 +1808,12 @@ lazy_repair_fragmentation(Relation onerel, FragRepairInfo* repair_info) {
                 page_altered = repair_page_fragmentation(onerel, buf, repair_info);
                 LockBuffer((onerel), buf, BUFFER_LOCK_UNLOCK);
 				
-                if (page_altered)
+                if (page_altered) {
+                        VisibilityMapClear(onerel, blkno);
 			WriteBuffer(onerel,buf);
-		else
+		} else {
 			ReleaseBuffer(onerel, buf);
+		}
                 
                 MemoryContextResetAndDeleteChildren(page_cxt);
                 
@@ -1664,6 +1904,7 @@ lazy_truncate_heap(Relation onerel, LVRelStats * vacrelstats)
         FlushAllDirtyBuffers(true);
 	InvalidateRelationBuffers(onerel);
 	TruncateHeapRelation(onerel, new_rel_pages);
+	VisibilityMapTruncate(onerel, new_rel_pages);
 	onerel->rd_nblocks = new_rel_pages;
 	vacrelstats->rel_pages = onerel->rd_nblocks;	/* save new number of blocks */
 	/*
@@ -1791,8 +2032,8 @@ lazy_space_alloc(LVRelStats * vacrelstats, BlockNumber relblocks)
 	vacrelstats->num_dead_tuples = 0;
 	vacrelstats->num_recently_dead_tuples = 0;
 	vacrelstats->max_dead_tuples = maxtuples;
-	vacrelstats->dead_tuples = (ItemPointer)
-		palloc(maxtuples * sizeof(ItemPointerData));
+	/* same budget the flat array of ItemPointers used to get */
+	vacrelstats->dead_tuples = TidStoreCreate(maxtuples * sizeof(ItemPointerData));
 	vacrelstats->recently_dead_tuples = (ItemPointer)
 		palloc(maxtuples * sizeof(ItemPointerData));
         
@@ -1814,20 +2055,20 @@ lazy_space_alloc(LVRelStats * vacrelstats, BlockNumber relblocks)
 }
 
 /*
- * lazy_record_dead_tuple - remember one deletable tuple
+ * lazy_record_dead_page - remember the deletable tuples of one page
  */
 static void
-lazy_record_dead_tuple(LVRelStats * vacrelstats,
-		       ItemPointer itemptr)
+lazy_record_dead_page(LVRelStats * vacrelstats, BlockNumber blkno,
+		       OffsetNumber * offsets, int noffsets)
 {
 	/*
-	 * The array shouldn't overflow under normal behavior, but perhaps it
-	 * could if we are given a really small VacuumMem. In that case, just
-	 * forget the last few tuples.
+	 * The store shouldn't overflow under normal behavior, lazy_scan_heap
+	 * empties it before it gets close, but perhaps it could if we are
+	 * given a really small freetuples.  In that case, just forget the
+	 * page's tuples.
 	 */
-	if (vacrelstats->num_dead_tuples < vacrelstats->max_dead_tuples) {
-		vacrelstats->dead_tuples[vacrelstats->num_dead_tuples] = *itemptr;
-		vacrelstats->num_dead_tuples++;
+	if (TidStoreAddPage(vacrelstats->dead_tuples, blkno, offsets, noffsets)) {
+		vacrelstats->num_dead_tuples += noffsets;
 	}
 }
 
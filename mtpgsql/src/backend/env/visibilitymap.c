@@ -0,0 +1,657 @@
+/*-------------------------------------------------------------------------
+ *
+ * visibilitymap.c
+ *     tracking of heap pages whose tuples are all visible to every
+ *     transaction
+ *
+ * Copyright (c) 2000-2024, Myron Scott  <myron@weaverdb.org>
+ *
+ * IDENTIFICATION
+ *
+ * NOTES
+ *     One bit per heap block.  Lazy vacuum sets the bit when every tuple
+ *     on the page is committed, undeleted and older than the reap id, and
+ *     heap_insert/heap_update/heap_delete clear it again.  Vacuum skips
+ *     pages with the bit set.
+ *
+ *     The map lives in memory and is written to a file beside the
+ *     relation ("<relation>.vm") at the end of each vacuum and at
+ *     shutdown.  A clear of a bit while the file claims to be current
+ *     only notes the map for the clearing transaction, which marks the
+ *     file dirty on disk before it records its commit
+ *     (AtEOXact_VisibilityMap), so no file I/O is done under the heap
+ *     buffer lock.  A dirty file is thrown away when it is loaded, so a
+ *     crash only costs one full vacuum pass.
+ *
+ *     accessor guards the bits, writer serializes the file I/O of a map
+ *     and is never held by the heap paths.
+ *
+ *     Vacuum and the modifying threads do not share a lock while the page
+ *     is examined, so each clear bumps a sequence counter for its slot of
+ *     blocks.  Vacuum reads the counter before it looks at the page and
+ *     the bit is only set if the counter has not moved.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include <pthread.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#include "c.h"
+#include "postgres.h"
+
+#include "env/env.h"
+#include "env/visibilitymap.h"
+#include "access/xact.h"
+#include "catalog/catalog.h"
+
+#include "config.h"
+#include "miscadmin.h"
+#include "utils/rel.h"
+#include "utils/relcache.h"
+#include "utils/memutils.h"
+#include "storage/fd.h"
+
+
+static HTAB*  			vistable;
+static pthread_mutex_t          vismap_access;
+static bool			inited = false;
+static MemoryContext            vis_cxt;
+
+/*  maps whose file must be marked dirty before a transaction commits  */
+typedef struct vispending {
+    Oid                 relid;
+    Oid                 dbid;
+    TransactionId       xid;
+    struct vispending*  next;
+} VisPending;
+
+static VisPending*              pending_maps;
+static pthread_mutex_t          pending_access;
+static MemoryContext            pending_cxt;
+
+#define VM_MAGIC            0x56495330   /* "VIS0" */
+#define VM_STATE_CLEAN      1
+#define VM_STATE_DIRTY      2
+#define VM_SEQUENCE_SLOTS   64
+#define VM_MIN_SIZE         64           /* bytes, covers 512 blocks */
+
+typedef struct viskey {
+	Oid		 relid;
+	Oid		 dbid;
+} VisKey;
+
+typedef struct vismapheader {
+    uint32              magic;
+    uint32              state;
+    uint32              nblocks;
+} VisMapHeader;
+
+typedef struct vismap {
+    VisKey				key;
+    char*                               path;
+    uint8*                              bits;
+    Size                                size;       /* bytes allocated for bits */
+    BlockNumber                         nblocks;    /* one past the highest block ever set */
+    bool                                disk_clean; /* file on disk claims to be current */
+    bool                                changed;    /* memory differs from the file */
+    uint32                              version;    /* bumped by every change */
+    uint32                              sequence[VM_SEQUENCE_SLOTS];
+    pthread_mutex_t                     accessor;
+    pthread_mutex_t                     writer;
+    MemoryContext                       context;
+} VisMap;
+
+
+static void* VisMapAlloc(Size size,void* cxt);
+static void VisMapFree(void* pointer,void* cxt);
+static VisMap* FindVisibilityMap(Relation rel);
+static void LoadVisibilityMap(VisMap* map);
+static void WriteVisibilityMap(VisMap* map);
+static void MarkVisibilityMapDirty(VisMap* map);
+static void NoteVisibilityMapDirty(VisMap* map);
+static void GrowVisibilityMap(VisMap* map, BlockNumber blk);
+
+#define VM_BYTE(blk)        ((blk) >> 3)
+#define VM_BIT(blk)         (1 << ((blk) & 0x07))
+#define VM_SLOT(blk)        ((blk) % VM_SEQUENCE_SLOTS)
+
+static void* VisMapAlloc(Size size,void* cxt)
+{
+    return MemoryContextAlloc(cxt,size);
+}
+
+static void VisMapFree(void* pointer,void* cxt)
+{
+	pfree(pointer);
+}
+
+void
+InitVisibilityMap()
+{
+	HASHCTL ctl;
+    MemoryContext  hash_cxt,old;
+
+    vis_cxt = AllocSetContextCreate((MemoryContext) NULL,
+                                                 "VisibilityMapMemoryContext",
+                                                ALLOCSET_DEFAULT_MINSIZE,
+                                                ALLOCSET_DEFAULT_INITSIZE,
+                                                ALLOCSET_DEFAULT_MAXSIZE);
+
+    hash_cxt = AllocSetContextCreate((MemoryContext)vis_cxt,
+                                                 "VisibilityMapHashCxt",
+                                                ALLOCSET_DEFAULT_MINSIZE,
+                                                ALLOCSET_DEFAULT_INITSIZE,
+                                                ALLOCSET_DEFAULT_MAXSIZE);
+
+    old = MemoryContextSwitchTo(vis_cxt);
+
+	memset(&ctl,0,sizeof(HASHCTL));
+	ctl.keysize = sizeof(VisKey);
+	ctl.entrysize = sizeof(VisMap);
+	ctl.hash = tag_hash;
+	ctl.alloc = VisMapAlloc;
+	ctl.free = VisMapFree;
+	ctl.hcxt = hash_cxt;
+
+	vistable = hash_create("visibility map hash",100,&ctl,HASH_ELEM | HASH_ALLOC | HASH_FUNCTION | HASH_CONTEXT);
+
+    pending_cxt = AllocSetContextCreate((MemoryContext)vis_cxt,
+                                                 "VisibilityMapPendingCxt",
+                                                ALLOCSET_DEFAULT_MINSIZE,
+                                                ALLOCSET_DEFAULT_INITSIZE,
+                                                ALLOCSET_DEFAULT_MAXSIZE);
+    pending_maps = NULL;
+
+	MemoryContextSwitchTo(old);
+	pthread_mutex_init(&vismap_access,&process_mutex_attr);
+	pthread_mutex_init(&pending_access,&process_mutex_attr);
+	inited = true;
+}
+
+/*
+ * write every map that has changed since it was last written.  Called once
+ * the writers are stopped so the maps are quiet.
+ */
+void
+ShutdownVisibilityMap()
+{
+    HASH_SEQ_STATUS   seq;
+    VisMap*          entry;
+
+    if ( !inited ) return;
+
+    pthread_mutex_lock(&vismap_access);
+    hash_seq_init(&seq,vistable);
+    while ( (entry = (VisMap*)hash_seq_search(&seq)) != NULL ) {
+        WriteVisibilityMap(entry);
+    }
+    pthread_mutex_unlock(&vismap_access);
+}
+
+bool
+VisibilityMapTest(Relation rel, BlockNumber blk)
+{
+    VisMap*  map = FindVisibilityMap(rel);
+    bool     visible = false;
+
+    if ( map == NULL ) return false;
+
+    pthread_mutex_lock(&map->accessor);
+    if ( blk < map->nblocks ) {
+        visible = ((map->bits[VM_BYTE(blk)] & VM_BIT(blk)) != 0);
+    }
+    pthread_mutex_unlock(&map->accessor);
+
+    return visible;
+}
+
+/*
+ * the value passed back to VisibilityMapSet.  Must be read before the page
+ * is examined.
+ */
+uint32
+VisibilityMapGetSequence(Relation rel, BlockNumber blk)
+{
+    VisMap*  map = FindVisibilityMap(rel);
+    uint32   sequence = 0;
+
+    if ( map == NULL ) return 0;
+
+    pthread_mutex_lock(&map->accessor);
+    sequence = map->sequence[VM_SLOT(blk)];
+    pthread_mutex_unlock(&map->accessor);
+
+    return sequence;
+}
+
+bool
+VisibilityMapSet(Relation rel, BlockNumber blk, uint32 sequence)
+{
+    VisMap*  map = FindVisibilityMap(rel);
+    bool     set = false;
+
+    if ( map == NULL ) return false;
+
+    pthread_mutex_lock(&map->accessor);
+    if ( map->sequence[VM_SLOT(blk)] == sequence ) {
+        GrowVisibilityMap(map, blk);
+        if ( !(map->bits[VM_BYTE(blk)] & VM_BIT(blk)) ) {
+            map->bits[VM_BYTE(blk)] |= VM_BIT(blk);
+            map->changed = true;
+            map->version += 1;
+        }
+        set = true;
+    }
+    pthread_mutex_unlock(&map->accessor);
+
+    return set;
+}
+
+void
+VisibilityMapClear(Relation rel, BlockNumber blk)
+{
+    VisMap*  map = FindVisibilityMap(rel);
+    bool     note = false;
+
+    if ( map == NULL ) return;
+
+    pthread_mutex_lock(&map->accessor);
+    map->sequence[VM_SLOT(blk)] += 1;
+    if ( blk < map->nblocks && (map->bits[VM_BYTE(blk)] & VM_BIT(blk)) ) {
+        map->bits[VM_BYTE(blk)] &= ~VM_BIT(blk);
+        map->changed = true;
+        map->version += 1;
+        note = map->disk_clean;
+    }
+    pthread_mutex_unlock(&map->accessor);
+
+    if ( note ) NoteVisibilityMapDirty(map);
+}
+
+void
+VisibilityMapTruncate(Relation rel, BlockNumber nblocks)
+{
+    VisMap*  map = FindVisibilityMap(rel);
+    BlockNumber blk;
+
+    if ( map == NULL ) return;
+
+    bool     note = false;
+
+    pthread_mutex_lock(&map->accessor);
+    for (blk = nblocks; blk < map->nblocks; blk++) {
+        map->sequence[VM_SLOT(blk)] += 1;
+        map->bits[VM_BYTE(blk)] &= ~VM_BIT(blk);
+    }
+    if ( nblocks < map->nblocks ) {
+        map->nblocks = nblocks;
+        map->changed = true;
+        map->version += 1;
+        note = map->disk_clean;
+    }
+    pthread_mutex_unlock(&map->accessor);
+
+    if ( note ) NoteVisibilityMapDirty(map);
+}
+
+void
+VisibilityMapFlush(Relation rel)
+{
+    VisMap*  map = FindVisibilityMap(rel);
+
+    if ( map == NULL ) return;
+
+    WriteVisibilityMap(map);
+}
+
+/*
+ * mark the files of the maps this transaction cleared bits in dirty before
+ * the commit is recorded.  On abort the notes are dropped, the bits stay
+ * clear in memory and the next write brings the file up to date.
+ */
+void
+AtEOXact_VisibilityMap(bool isCommit)
+{
+    TransactionId   xid;
+    VisPending**    setter;
+    VisPending*     mine = NULL;
+
+    /*  only this thread adds notes for its transaction  */
+    if ( !inited || pending_maps == NULL ) return;
+
+    xid = GetCurrentTransactionId();
+    pthread_mutex_lock(&pending_access);
+    setter = &pending_maps;
+    while ( *setter != NULL ) {
+        VisPending* entry = *setter;
+        if ( entry->xid == xid ) {
+            *setter = entry->next;
+            entry->next = mine;
+            mine = entry;
+        } else {
+            setter = &entry->next;
+        }
+    }
+    pthread_mutex_unlock(&pending_access);
+
+    while ( mine != NULL ) {
+        VisPending* entry = mine;
+        mine = entry->next;
+
+        if ( isCommit ) {
+            VisKey      tag;
+            bool        found;
+            VisMap*     map;
+
+            memset(&tag,0,sizeof(tag));
+            tag.relid = entry->relid;
+            tag.dbid = entry->dbid;
+
+            pthread_mutex_lock(&vismap_access);
+            map = (VisMap*)hash_search(vistable,(char*)&tag,HASH_FIND,&found);
+            if ( map != NULL && found ) pthread_mutex_lock(&map->writer);
+            pthread_mutex_unlock(&vismap_access);
+
+            if ( map != NULL && found ) {
+                bool    clean;
+
+                pthread_mutex_lock(&map->accessor);
+                clean = map->disk_clean;
+                pthread_mutex_unlock(&map->accessor);
+                if ( clean ) MarkVisibilityMapDirty(map);
+                pthread_mutex_unlock(&map->writer);
+            }
+        }
+        pthread_mutex_lock(&pending_access);
+        pfree(entry);
+        pthread_mutex_unlock(&pending_access);
+    }
+}
+
+/*
+ * drop the map along with its file.  Used when the relation is dropped or
+ * emptied, either way no page is all-visible any longer.
+ */
+void
+VisibilityMapForget(Relation rel)
+{
+	VisKey tag;
+	bool found;
+        VisMap* entry;
+        char*   path = NULL;
+
+        if ( !inited ) return;
+
+	memset(&tag,0,sizeof(tag));
+	tag.relid = rel->rd_lockInfo.lockRelId.relId;
+	tag.dbid = rel->rd_lockInfo.lockRelId.dbId;
+
+	pthread_mutex_lock(&vismap_access);
+
+	entry = hash_search(vistable,(char*)&tag,HASH_REMOVE,&found);
+
+        if ( found ) {
+		pthread_mutex_destroy(&entry->accessor);
+		pthread_mutex_destroy(&entry->writer);
+                unlink(entry->path);
+                MemoryContextDelete(entry->context);
+        } else if ( !rel->rd_myxactonly ) {
+                path = relpath(RelationGetPhysicalRelationName(rel));
+        }
+
+	pthread_mutex_unlock(&vismap_access);
+
+        if ( path != NULL ) {
+            char*   vmpath = palloc(strlen(path) + 4);
+            sprintf(vmpath,"%s.vm",path);
+            unlink(vmpath);
+            pfree(vmpath);
+            pfree(path);
+        }
+}
+
+static VisMap*
+FindVisibilityMap(Relation rel) {
+
+	VisKey tag;
+	bool	found;
+	VisMap* entry;
+
+    if (!inited || rel->rd_myxactonly) {
+        return NULL;
+    }
+
+	memset(&tag,0,sizeof(tag));
+	tag.relid = rel->rd_lockInfo.lockRelId.relId;
+	tag.dbid = rel->rd_lockInfo.lockRelId.dbId;
+
+	pthread_mutex_lock(&vismap_access);
+
+	entry = (VisMap*)hash_search(vistable,(char*)&tag,HASH_ENTER,&found);
+
+	if ( !found ) {
+		char mem_name[128];
+                char* path;
+		snprintf(mem_name,sizeof(mem_name),"VisibilityMapInstance-rel:%s-dbname:%s",RelationGetRelationName(rel),GetDatabaseName());
+		pthread_mutex_init(&entry->accessor,&process_mutex_attr);
+		pthread_mutex_init(&entry->writer,&process_mutex_attr);
+                entry->context = AllocSetContextCreate(vistable->hcxt,
+						mem_name,
+						1024,
+                                                1024,
+                                                1024 * 1024);
+                path = relpath(RelationGetPhysicalRelationName(rel));
+                entry->path = MemoryContextAlloc(entry->context,strlen(path) + 4);
+                sprintf(entry->path,"%s.vm",path);
+                pfree(path);
+                entry->bits = NULL;
+                entry->size = 0;
+                entry->nblocks = 0;
+                entry->disk_clean = false;
+                entry->changed = false;
+                entry->version = 0;
+                memset(entry->sequence,0,sizeof(entry->sequence));
+                LoadVisibilityMap(entry);
+	}
+
+	pthread_mutex_unlock(&vismap_access);
+
+	return entry;
+}
+
+static void
+GrowVisibilityMap(VisMap* map, BlockNumber blk)
+{
+    Size  need = VM_BYTE(blk) + 1;
+
+    if ( need > map->size ) {
+        Size  size = ( map->size < VM_MIN_SIZE ) ? VM_MIN_SIZE : map->size;
+        while ( size < need ) size *= 2;
+        if ( map->bits == NULL ) {
+            map->bits = MemoryContextAlloc(map->context,size);
+        } else {
+            map->bits = repalloc(map->bits,size);
+        }
+        MemSet(map->bits + map->size, 0, size - map->size);
+        map->size = size;
+    }
+    if ( blk >= map->nblocks ) map->nblocks = blk + 1;
+}
+
+/*
+ * read the file written by the last vacuum.  Anything other than a clean
+ * file is ignored, the next vacuum rebuilds the map from a full scan.
+ */
+static void
+LoadVisibilityMap(VisMap* map)
+{
+    VisMapHeader    header;
+    int             fd;
+    Size            len;
+
+#ifndef __CYGWIN__
+    fd = open(map->path, O_RDONLY);
+#else
+    fd = open(map->path, O_RDONLY | O_BINARY);
+#endif
+    if ( fd < 0 ) return;
+
+    if ( read(fd, &header, sizeof(header)) != sizeof(header) ||
+            header.magic != VM_MAGIC ||
+            header.state != VM_STATE_CLEAN ) {
+        close(fd);
+        elog(DEBUG,"visibility map %s is not current, ignoring",map->path);
+        return;
+    }
+
+    if ( header.nblocks > 0 ) {
+        GrowVisibilityMap(map, header.nblocks - 1);
+        len = VM_BYTE(header.nblocks - 1) + 1;
+        if ( read(fd, map->bits, len) != len ) {
+            MemSet(map->bits, 0, map->size);
+            map->nblocks = 0;
+            close(fd);
+            elog(DEBUG,"visibility map %s is short, ignoring",map->path);
+            return;
+        }
+    }
+    close(fd);
+    map->disk_clean = true;
+}
+
+/*
+ * write the whole map to a temporary file and rename it into place so a
+ * crash leaves either the old file or the new one.  The file is written
+ * from a copy taken under accessor, and only renamed into place if no bit
+ * changed while it was written.
+ */
+static void
+WriteVisibilityMap(VisMap* map)
+{
+    VisMapHeader    header;
+    char            tmppath[MAXPGPATH];
+    int             fd;
+    Size            len;
+    uint8*          copy = NULL;
+    uint32          version;
+
+    pthread_mutex_lock(&map->writer);
+    pthread_mutex_lock(&map->accessor);
+    if ( !map->changed ) {
+        pthread_mutex_unlock(&map->accessor);
+        pthread_mutex_unlock(&map->writer);
+        return;
+    }
+    len = ( map->nblocks > 0 ) ? VM_BYTE(map->nblocks - 1) + 1 : 0;
+    header.magic = VM_MAGIC;
+    header.state = VM_STATE_CLEAN;
+    header.nblocks = map->nblocks;
+    version = map->version;
+    if ( len > 0 ) {
+        copy = MemoryContextAlloc(map->context,len);
+        memcpy(copy, map->bits, len);
+    }
+    pthread_mutex_unlock(&map->accessor);
+
+    snprintf(tmppath, MAXPGPATH, "%s.tmp", map->path);
+#ifndef __CYGWIN__
+    fd = open(tmppath, O_RDWR | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
+#else
+    fd = open(tmppath, O_RDWR | O_CREAT | O_TRUNC | O_BINARY, S_IRUSR | S_IWUSR);
+#endif
+    if ( fd < 0 ) {
+        elog(NOTICE,"unable to create visibility map %s errno: %d",tmppath,errno);
+    } else if ( write(fd, &header, sizeof(header)) != sizeof(header) ||
+            (len > 0 && write(fd, copy, len) != len) ||
+            pg_fsync(fd) != 0 ) {
+        close(fd);
+        unlink(tmppath);
+        elog(NOTICE,"unable to write visibility map %s errno: %d",tmppath,errno);
+    } else {
+        close(fd);
+        /*  a change since the copy would be lost, leave the old file  */
+        pthread_mutex_lock(&map->accessor);
+        if ( map->version != version ) {
+            unlink(tmppath);
+        } else if ( rename(tmppath, map->path) != 0 ) {
+            unlink(tmppath);
+            elog(NOTICE,"unable to rename visibility map %s errno: %d",map->path,errno);
+        } else {
+            map->disk_clean = true;
+            map->changed = false;
+        }
+        pthread_mutex_unlock(&map->accessor);
+    }
+
+    if ( copy != NULL ) pfree(copy);
+    pthread_mutex_unlock(&map->writer);
+}
+
+/*
+ * remember that the current transaction cleared a bit the file on disk
+ * still has set
+ */
+static void
+NoteVisibilityMapDirty(VisMap* map)
+{
+    TransactionId   xid = GetCurrentTransactionId();
+    VisPending*     entry;
+
+    pthread_mutex_lock(&pending_access);
+    for (entry = pending_maps; entry != NULL; entry = entry->next) {
+        if ( entry->xid == xid && entry->relid == map->key.relid && entry->dbid == map->key.dbid ) break;
+    }
+    if ( entry == NULL ) {
+        entry = MemoryContextAlloc(pending_cxt,sizeof(VisPending));
+        entry->relid = map->key.relid;
+        entry->dbid = map->key.dbid;
+        entry->xid = xid;
+        entry->next = pending_maps;
+        pending_maps = entry;
+    }
+    pthread_mutex_unlock(&pending_access);
+}
+
+/*
+ * the file no longer matches memory.  Flip the header before the change
+ * commits so a crash can never leave a set bit on disk for a page with a
+ * committed change.  Called holding writer only.
+ */
+static void
+MarkVisibilityMapDirty(VisMap* map)
+{
+    VisMapHeader    header;
+    int             fd;
+
+#ifndef __CYGWIN__
+    fd = open(map->path, O_RDWR);
+#else
+    fd = open(map->path, O_RDWR | O_BINARY);
+#endif
+    if ( fd >= 0 ) {
+        header.magic = VM_MAGIC;
+        header.state = VM_STATE_DIRTY;
+        header.nblocks = 0;
+
+        if ( write(fd, &header, sizeof(header)) == sizeof(header) && pg_fsync(fd) == 0 ) {
+            close(fd);
+            pthread_mutex_lock(&map->accessor);
+            map->disk_clean = false;
+            pthread_mutex_unlock(&map->accessor);
+            return;
+        }
+        close(fd);
+    }
+/*  could not rewrite the header, getting rid of the file does just as well  */
+    if ( unlink(map->path) != 0 && errno != ENOENT ) {
+        pthread_mutex_unlock(&map->writer);
+        elog(FATAL,"unable to invalidate visibility map %s errno: %d",map->path,errno);
+    }
+    pthread_mutex_lock(&map->accessor);
+    map->disk_clean = false;
+    pthread_mutex_unlock(&map->accessor);
+}
@@ -39,6 +39,7 @@
 #include "executor/nodeGroup.h"
 #include "executor/nodeGroup.h"
 #include "executor/nodeHash.h"
+#include "executor/nodeHashAgg.h"
 #include "executor/nodeHashjoin.h"
 #include "executor/nodeIndexscan.h"
 #include "executor/nodeDelegatedIndexscan.h"
@@ -228,6 +229,10 @@ ExecCloseR(Plan *node)
 			state = &(((Agg *) node)->aggstate->csstate);
 			break;
 
+		case T_HashAgg:
+			state = &(((HashAgg *) node)->hashaggstate->csstate);
+			break;
+
 		case T_TidScan:
 			state = ((TidScan *) node)->scan.scanstate;
 			break;
@@ -366,6 +371,10 @@ ExecReScan(Plan *node, ExprContext *exprCtxt)
 			ExecReScanAgg((Agg *) node, exprCtxt);
 			break;
 
+		case T_HashAgg:
+			ExecReScanHashAgg((HashAgg *) node, exprCtxt);
+			break;
+
 		case T_Group:
 			ExecReScanGroup((Group *) node, exprCtxt);
 			break;
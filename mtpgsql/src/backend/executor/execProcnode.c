@@ -82,6 +82,7 @@
 #include "executor/nodeAppend.h"
 #include "executor/nodeGroup.h"
 #include "executor/nodeHash.h"
+#include "executor/nodeHashAgg.h"
 #include "executor/nodeHashjoin.h"
 #include "executor/nodeIndexscan.h"
 #include "executor/nodeDelegatedIndexscan.h"
@@ -201,6 +202,10 @@ ExecInitNode(Plan *node, EState *estate)
 			result = ExecInitAgg((Agg *) node, estate);
 			break;
 
+		case T_HashAgg:
+			result = ExecInitHashAgg((HashAgg *) node, estate);
+			break;
+
 		case T_Hash:
 			result = ExecInitHash((Hash *) node, estate);
 			break;
@@ -328,6 +333,10 @@ ExecProcNode(Plan *node)
 			result = ExecAgg((Agg *) node);
 			break;
 
+		case T_HashAgg:
+			result = ExecHashAgg((HashAgg *) node);
+			break;
+
 		case T_Hash:
 			result = ExecHash((Hash *) node);
 			break;
@@ -410,6 +419,9 @@ ExecCountSlotsNode(Plan *node)
 		case T_Agg:
 			return ExecCountSlotsAgg((Agg *) node);
 
+		case T_HashAgg:
+			return ExecCountSlotsHashAgg((HashAgg *) node);
+
 		case T_Hash:
 			return ExecCountSlotsHash((Hash *) node);
 
@@ -530,6 +542,10 @@ ExecEndNode(Plan *node)
 			ExecEndAgg((Agg *) node);
 			break;
 
+		case T_HashAgg:
+			ExecEndHashAgg((HashAgg *) node);
+			break;
+
 			/* ----------------
 			 *		XXX add hooks to these
 			 * ----------------
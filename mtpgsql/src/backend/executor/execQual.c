@@ -619,6 +619,17 @@ ExecMakeFunctionResult(Node * node,
 		elog(ERROR, "ExecMakeFunctionResult: unknown operation");
 		return PointerGetDatum(NULL);
 	}
+	/*
+	 * a batched java call of the scan below already produced the result
+	 * for this tuple, see execScan.c
+	 */
+	if (fcache->javaBatched) {
+		fcache->javaBatched = false;
+		if (isDone)
+			*isDone = true;
+		*isNull = fcache->javaIsNull;
+		return fcache->javaValue;
+	}
 	/*
 	 * arguments is a list of expressions to evaluate before passing to
 	 * the function manager. We collect the results of evaluating the
@@ -24,6 +24,63 @@
 
 #include "executor/executor.h"
 #include "access/blobstorage.h"
+#include "access/heapam.h"
+#include "catalog/pg_language.h"
+#include "catalog/pg_proc.h"
+#include "env/properties.h"
+#include "utils/fcache.h"
+#include "utils/fcache2.h"
+#include "utils/java.h"
+#include "utils/memutils.h"
+#include "utils/syscache.h"
+
+/*
+ * Java function batching
+ *
+ * A sequential scan whose targetlist calls java functions reads up to
+ * javabatchsize qualifying tuples ahead, evaluates the arguments of those
+ * calls for all of them and makes one fmgr_cached_javaA_batch call per
+ * function, so java is entered once per batch instead of once per row.
+ * As each tuple is handed out its results are parked in the function
+ * caches where ExecMakeFunctionResult picks them up.  Only top level
+ * targetlist calls whose arguments are Vars or Consts are batched, and
+ * only of functions declared iscachable: rows read ahead may never be
+ * fetched by a LIMIT or a cursor, so the calls must have no side effects.
+ */
+#define JAVA_BATCH_DEFAULT		64
+#define JAVA_BATCH_MAX			1024
+
+typedef struct JavaBatchCall
+{
+	FunctionCachePtr fcache;
+	List	   *args;
+	int			nargs;
+	Datum	   *argcols[FUNC_MAX_ARGS];
+	bool	   *nullcols[FUNC_MAX_ARGS];
+	Datum	   *results;
+	bool	   *isNull;
+} JavaBatchCall;
+
+typedef struct JavaBatchData
+{
+	MemoryContext cxt;			/* tuples, arguments and results of the
+								 * current batch */
+	int			size;
+	int			count;
+	int			pos;
+	bool		done;			/* access method returned the last tuple */
+	HeapTuple  *tuples;
+	int			ncalls;			/* zero when the scan does not batch */
+	JavaBatchCall *calls;
+} JavaBatchData;
+
+static JavaBatchData *ExecScanJavaBatchInit(Scan *node, CommonScanState *scanstate,
+					  ExprContext *econtext);
+static bool ExecScanJavaBatchArgs(List *args);
+static bool ExecScanJavaBatchCachable(Oid funcid);
+static void ExecScanJavaBatchFill(Scan *node, JavaBatchData *batch,
+					  TupleTableSlot *(*accessMtd) (Scan*), List *qual,
+					  ExprContext *econtext);
 
 /* ----------------------------------------------------------------
  *		ExecScan
@@ -95,6 +152,55 @@ ExecScan(Scan *node,
 			return resultSlot;
 	}
 
+	if (scanstate->css_JavaBatch == NULL)
+		scanstate->css_JavaBatch = ExecScanJavaBatchInit(node, scanstate, econtext);
+
+	if (scanstate->css_JavaBatch->ncalls > 0)
+	{
+		JavaBatchData *batch = scanstate->css_JavaBatch;
+		int			i;
+
+		if (!ScanDirectionIsForward(node->plan.state->es_direction))
+		{
+			if (batch->pos < batch->count)
+				elog(ERROR, "ExecScan: cannot change direction while reading ahead for java functions");
+		}
+		else
+		{
+			if (batch->pos >= batch->count)
+				ExecScanJavaBatchFill(node, batch, accessMtd, qual, econtext);
+
+			if (batch->count == 0)
+			{
+				scanstate->cstate.cs_TupFromTlist = false;
+				resultSlot = scanstate->cstate.cs_ProjInfo->pi_slot;
+				ExecClearTuple(resultSlot);
+				return ExecStoreTuple(NULL,resultSlot,false);
+			}
+
+			slot = scanstate->css_ScanTupleSlot;
+			ExecClearTuple(slot);
+			ExecStoreTuple(batch->tuples[batch->pos], slot, false);
+			econtext->ecxt_scantuple = slot;
+
+			for (i = 0; i < batch->ncalls; i++)
+			{
+				JavaBatchCall *call = &batch->calls[i];
+
+				call->fcache->javaBatched = true;
+				call->fcache->javaValue = call->results[batch->pos];
+				call->fcache->javaIsNull = call->isNull[batch->pos];
+			}
+			batch->pos++;
+
+			projInfo = scanstate->cstate.cs_ProjInfo;
+			resultSlot = ExecProject(projInfo, &isDone);
+			scanstate->cstate.cs_TupFromTlist = !isDone;
+
+			return resultSlot;
+		}
+	}
+
 	/*
 	 * get a tuple from the access method loop until we obtain a tuple
 	 * which passes the qualification.
@@ -155,3 +261,249 @@ ExecScan(Scan *node,
 
 	return resultSlot;
 }
+
+/*
+ * decide whether the scan batches java calls and set up the columns.
+ * The returned struct has ncalls zero when it does not.
+ */
+static JavaBatchData *
+ExecScanJavaBatchInit(Scan *node, CommonScanState *scanstate, ExprContext *econtext)
+{
+	JavaBatchData *batch;
+	List	   *tl;
+	List	   *funcs = NIL;
+	int			size = JAVA_BATCH_DEFAULT;
+	int			c,
+				a;
+
+	batch = (JavaBatchData *) palloc(sizeof(JavaBatchData));
+	MemSet(batch, 0, sizeof(JavaBatchData));
+
+	if (nodeTag(node) != T_SeqScan || outerPlan((Plan *) node) != NULL)
+		return batch;
+
+	if (PropertyIsValid("javabatchsize"))
+	{
+		size = GetIntProperty("javabatchsize");
+		if (size > JAVA_BATCH_MAX)
+			size = JAVA_BATCH_MAX;
+	}
+	if (size <= 1)
+		return batch;
+
+	foreach(tl, scanstate->cstate.cs_ProjInfo->pi_targetlist)
+	{
+		TargetEntry *tle = (TargetEntry *) lfirst(tl);
+		Expr	   *expr;
+		Func	   *func;
+		FunctionCachePtr fcache;
+
+		if (tle->expr == NULL || !IsA(tle->expr, Expr))
+			continue;
+		expr = (Expr *) tle->expr;
+		if (expr->opType != FUNC_EXPR || !IsA(expr->oper, Func))
+			continue;
+		if (!ExecScanJavaBatchArgs(expr->args))
+			continue;
+
+		func = (Func *) expr->oper;
+		if (func->func_fcache == NULL)
+			setFcache((Node *) func, func->funcid, expr->args, econtext);
+		fcache = func->func_fcache;
+		fcache->javaBatched = false;
+		if (fcache->language != JAVAlanguageId || fcache->hasSetArg ||
+			fcache->nargs != length(expr->args))
+			continue;
+		if (!ExecScanJavaBatchCachable(func->funcid))
+			continue;
+
+		funcs = lappend(funcs, expr);
+	}
+
+	if (funcs == NIL)
+		return batch;
+
+	batch->cxt = AllocSetContextCreate(MemoryContextGetCurrentContext(),
+									   "JavaBatchContext",
+									   ALLOCSET_DEFAULT_MINSIZE,
+									   ALLOCSET_DEFAULT_INITSIZE,
+									   ALLOCSET_DEFAULT_MAXSIZE);
+	batch->size = size;
+	batch->tuples = (HeapTuple *) palloc(size * sizeof(HeapTuple));
+	batch->ncalls = length(funcs);
+	batch->calls = (JavaBatchCall *) palloc(batch->ncalls * sizeof(JavaBatchCall));
+
+	c = 0;
+	foreach(tl, funcs)
+	{
+		Expr	   *expr = (Expr *) lfirst(tl);
+		JavaBatchCall *call = &batch->calls[c++];
+
+		call->fcache = ((Func *) expr->oper)->func_fcache;
+		call->args = expr->args;
+		call->nargs = call->fcache->nargs;
+		for (a = 0; a < call->nargs; a++)
+		{
+			call->argcols[a] = (Datum *) palloc(size * sizeof(Datum));
+			call->nullcols[a] = (bool *) palloc(size * sizeof(bool));
+		}
+		call->results = (Datum *) palloc(size * sizeof(Datum));
+		call->isNull = (bool *) palloc(size * sizeof(bool));
+	}
+	freeList(funcs);
+
+	return batch;
+}
+
+static bool
+ExecScanJavaBatchArgs(List *args)
+{
+	List	   *arg;
+
+	foreach(arg, args)
+	{
+		Node	   *node = (Node *) lfirst(arg);
+
+		if (!IsA(node, Var) && !IsA(node, Const))
+			return false;
+	}
+	return true;
+}
+
+/*
+ * only functions without side effects may be called for rows that are
+ * never returned
+ */
+static bool
+ExecScanJavaBatchCachable(Oid funcid)
+{
+	HeapTuple	func_tuple;
+
+	func_tuple = SearchSysCacheTuple(PROCOID,
+									 ObjectIdGetDatum(funcid),
+									 0, 0, 0);
+	if (!HeapTupleIsValid(func_tuple))
+		return false;
+	return ((Form_pg_proc) GETSTRUCT(func_tuple))->proiscachable;
+}
+
+/*
+ * read the next batch of qualifying tuples, copy them into the batch
+ * context and make the java calls for all of them.
+ */
+static void
+ExecScanJavaBatchFill(Scan *node, JavaBatchData *batch,
+					  TupleTableSlot *(*accessMtd) (Scan*), List *qual,
+					  ExprContext *econtext)
+{
+	MemoryContext old;
+	TupleTableSlot *slot;
+	int			c,
+				a;
+
+	MemoryContextResetAndDeleteChildren(batch->cxt);
+	batch->count = 0;
+	batch->pos = 0;
+
+	old = MemoryContextSwitchTo(batch->cxt);
+
+	while (!batch->done && batch->count < batch->size)
+	{
+		HeapTuple	tuple;
+
+		slot = (TupleTableSlot *) (*accessMtd) (node);
+		if (TupIsNull(slot))
+		{
+			batch->done = true;
+			break;
+		}
+
+		econtext->ecxt_scantuple = slot;
+		if (qual && !ExecQual(qual, econtext, false))
+			continue;
+
+		/* the access method reuses the slot, keep a copy */
+		tuple = heap_copytuple(slot->val);
+		ExecClearTuple(slot);
+		ExecStoreTuple(tuple, slot, false);
+		batch->tuples[batch->count] = tuple;
+
+		for (c = 0; c < batch->ncalls; c++)
+		{
+			JavaBatchCall *call = &batch->calls[c];
+			List	   *arg;
+			bool		isDone;
+
+			a = 0;
+			foreach(arg, call->args)
+			{
+				call->argcols[a][batch->count] = ExecEvalExpr((Node *) lfirst(arg), econtext, NULL,
+											&call->nullcols[a][batch->count], &isDone);
+				a++;
+			}
+		}
+		batch->count++;
+	}
+
+	if (batch->count > 0)
+	{
+		for (c = 0; c < batch->ncalls; c++)
+		{
+			JavaBatchCall *call = &batch->calls[c];
+
+			fmgr_cached_javaA_batch((JavaFunction) call->fcache->func.fn_data,
+									call->nargs, batch->count,
+									call->argcols, call->nullcols,
+									call->results, call->isNull);
+		}
+	}
+
+	MemoryContextSwitchTo(old);
+}
+
+/*
+ * true while tuples read ahead have not been returned yet.
+ */
+bool
+ExecScanJavaBatchPending(CommonScanState *scanstate)
+{
+	JavaBatchData *batch = scanstate->css_JavaBatch;
+
+	return (batch != NULL && batch->pos < batch->count);
+}
+
+/*
+ * drop the tuples read ahead, the scan is starting over.
+ */
+void
+ExecScanJavaBatchReset(CommonScanState *scanstate)
+{
+	JavaBatchData *batch = scanstate->css_JavaBatch;
+	int			c;
+
+	if (batch == NULL || batch->ncalls == 0)
+		return;
+
+	for (c = 0; c < batch->ncalls; c++)
+		batch->calls[c].fcache->javaBatched = false;
+	/* the scan slot may point at a tuple of the batch */
+	ExecClearTuple(scanstate->css_ScanTupleSlot);
+	MemoryContextResetAndDeleteChildren(batch->cxt);
+	batch->count = 0;
+	batch->pos = 0;
+	batch->done = false;
+}
+
+void
+ExecScanJavaBatchEnd(CommonScanState *scanstate)
+{
+	JavaBatchData *batch = scanstate->css_JavaBatch;
+
+	if (batch == NULL)
+		return;
+
+	ExecScanJavaBatchReset(scanstate);
+	if (batch->cxt != NULL)
+		MemoryContextDelete(batch->cxt);
+	scanstate->css_JavaBatch = NULL;
+}
@@ -598,6 +598,14 @@ NodeGetResultTupleSlot(Plan *node)
 			}
 			break;
 
+		case T_HashAgg:
+			{
+				HashAggState *hashaggstate = ((HashAgg *) node)->hashaggstate;
+
+				slot = hashaggstate->csstate.cstate.cs_ResultTupleSlot;
+			}
+			break;
+
 		case T_Group:
 			{
 				GroupState *grpstate = ((Group *) node)->grpstate;
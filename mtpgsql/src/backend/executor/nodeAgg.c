@@ -114,8 +114,10 @@ typedef struct AggStatePerAggData
 				transtype2ByVal;
 
 	/*
-	 * These values are working state that is initialized at the start of
-	 * an input tuple group and updated for each input tuple.
+	 * This is working state that is initialized at the start of an input
+	 * tuple group and updated for each input tuple.  The transition
+	 * values themselves are kept in an AggStatePerGroupData (see
+	 * nodeAgg.h) so that HashAgg can hold one set per hash table entry.
 	 *
 	 * For a simple (non DISTINCT) aggregate, we just feed the input values
 	 * straight to the transition functions.  If it's DISTINCT, we pass
@@ -125,27 +127,16 @@ typedef struct AggStatePerAggData
 	 */
 
 	Tuplesortstate *sortstate;	/* sort object, if a DISTINCT agg */
-
-	Datum		value1,			/* current transfer values 1 and 2 */
-				value2;
-	bool		value1IsNull,
-				value2IsNull;
-	bool		noInitValue;	/* true if value1 not set yet */
-
-	/*
-	 * Note: right now, noInitValue always has the same value as
-	 * value1IsNull. But we should keep them separate because once the
-	 * fmgr interface is fixed, we'll need to distinguish a null returned
-	 * by transfn1 from a null we haven't yet replaced with an input
-	 * value.
-	 */
 } AggStatePerAggData;
 
 
-static void initialize_aggregate(AggStatePerAgg peraggstate);
+static void initialize_aggregate(AggStatePerAgg peraggstate,
+					 AggStatePerGroup pergroupstate);
 static void advance_transition_functions(AggStatePerAgg peraggstate,
+							 AggStatePerGroup pergroupstate,
 							 Datum newVal, bool isNull);
 static void finalize_aggregate(AggStatePerAgg peraggstate,
+				   AggStatePerGroup pergroupstate,
 				   Datum *resultVal, bool *resultIsNull);
 static Datum copyDatum(Datum val, int typLen, bool typByVal);
 
@@ -154,7 +145,8 @@ static Datum copyDatum(Datum val, int typLen, bool typByVal);
  * Initialize one aggregate for a new set of input values.
  */
 static void
-initialize_aggregate(AggStatePerAgg peraggstate)
+initialize_aggregate(AggStatePerAgg peraggstate,
+					 AggStatePerGroup pergroupstate)
 {
 	Aggref	   *aggref = peraggstate->aggref;
 
@@ -182,21 +174,21 @@ initialize_aggregate(AggStatePerAgg peraggstate)
 	 */
 	if (OidIsValid(peraggstate->xfn1_oid) &&
 		!peraggstate->initValue1IsNull)
-		peraggstate->value1 = copyDatum(peraggstate->initValue1,
+		pergroupstate->value1 = copyDatum(peraggstate->initValue1,
 										peraggstate->transtype1Len,
 										peraggstate->transtype1ByVal);
 	else
-		peraggstate->value1 = (Datum) NULL;
-	peraggstate->value1IsNull = peraggstate->initValue1IsNull;
+		pergroupstate->value1 = (Datum) NULL;
+	pergroupstate->value1IsNull = peraggstate->initValue1IsNull;
 
 	if (OidIsValid(peraggstate->xfn2_oid) &&
 		!peraggstate->initValue2IsNull)
-		peraggstate->value2 = copyDatum(peraggstate->initValue2,
+		pergroupstate->value2 = copyDatum(peraggstate->initValue2,
 										peraggstate->transtype2Len,
 										peraggstate->transtype2ByVal);
 	else
-		peraggstate->value2 = (Datum) NULL;
-	peraggstate->value2IsNull = peraggstate->initValue2IsNull;
+		pergroupstate->value2 = (Datum) NULL;
+	pergroupstate->value2IsNull = peraggstate->initValue2IsNull;
 
 	/* ------------------------------------------
 	 * If the initial value for the first transition function
@@ -207,7 +199,7 @@ initialize_aggregate(AggStatePerAgg peraggstate)
 	 * still need to do this.
 	 * ------------------------------------------
 	 */
-	peraggstate->noInitValue = peraggstate->initValue1IsNull;
+	pergroupstate->noInitValue = peraggstate->initValue1IsNull;
 }
 
 /*
@@ -218,13 +210,14 @@ initialize_aggregate(AggStatePerAgg peraggstate)
  */
 static void
 advance_transition_functions(AggStatePerAgg peraggstate,
+							 AggStatePerGroup pergroupstate,
 							 Datum newVal, bool isNull)
 {
 	Datum		args[2];
 
 	if (OidIsValid(peraggstate->xfn1_oid) && !isNull)
 	{
-		if (peraggstate->noInitValue)
+		if (pergroupstate->noInitValue)
 		{
 
 			/*
@@ -237,37 +230,37 @@ advance_transition_functions(AggStatePerAgg peraggstate,
 			 * We have to copy the datum since the tuple from which it came
 			 * will be freed on the next iteration of the scan.
 			 */
-			peraggstate->value1 = copyDatum(newVal,
+			pergroupstate->value1 = copyDatum(newVal,
 											peraggstate->transtype1Len,
 											peraggstate->transtype1ByVal);
-			peraggstate->value1IsNull = false;
-			peraggstate->noInitValue = false;
+			pergroupstate->value1IsNull = false;
+			pergroupstate->noInitValue = false;
 		}
 		else
 		{
 			/* apply transition function 1 */
-			args[0] = peraggstate->value1;
+			args[0] = pergroupstate->value1;
 			args[1] = newVal;
 			newVal = (Datum) fmgr_c(&peraggstate->xfn1,
 									(FmgrValues *) args,
 									&isNull);
 			if (!peraggstate->transtype1ByVal)
-				pfree((void*)peraggstate->value1);
-			peraggstate->value1 = newVal;
+				pfree((void*)pergroupstate->value1);
+			pergroupstate->value1 = newVal;
 		}
 	}
 
 	if (OidIsValid(peraggstate->xfn2_oid))
 	{
 		/* apply transition function 2 */
-		args[0] = peraggstate->value2;
+		args[0] = pergroupstate->value2;
 		isNull = false;			/* value2 cannot be null, currently */
 		newVal = (Datum) fmgr_c(&peraggstate->xfn2,
 								(FmgrValues *) args,
 								&isNull);
 		if (!peraggstate->transtype2ByVal)
-			pfree((void*)peraggstate->value2);
-		peraggstate->value2 = newVal;
+			pfree((void*)pergroupstate->value2);
+		pergroupstate->value2 = newVal;
 	}
 }
 
@@ -276,6 +269,7 @@ advance_transition_functions(AggStatePerAgg peraggstate,
  */
 static void
 finalize_aggregate(AggStatePerAgg peraggstate,
+				   AggStatePerGroup pergroupstate,
 				   Datum *resultVal, bool *resultIsNull)
 {
 	Aggref	   *aggref = peraggstate->aggref;
@@ -314,7 +308,8 @@ finalize_aggregate(AggStatePerAgg peraggstate,
 					continue;
 				}
 			}
-			advance_transition_functions(peraggstate, newVal, false);
+			advance_transition_functions(peraggstate, pergroupstate,
+										 newVal, false);
 			if (haveOldVal && !peraggstate->inputtypeByVal)
 				pfree(DatumGetPointer(oldVal));
 			oldVal = newVal;
@@ -337,17 +332,17 @@ finalize_aggregate(AggStatePerAgg peraggstate,
 	 * finalfn returns for null input.
 	 */
 	if (OidIsValid(peraggstate->finalfn_oid) &&
-		!peraggstate->noInitValue)
+		!pergroupstate->noInitValue)
 	{
 		if (peraggstate->finalfn.fn_nargs > 1)
 		{
-			args[0] = (char *) peraggstate->value1;
-			args[1] = (char *) peraggstate->value2;
+			args[0] = (char *) pergroupstate->value1;
+			args[1] = (char *) pergroupstate->value2;
 		}
 		else if (OidIsValid(peraggstate->xfn1_oid))
-			args[0] = (char *) peraggstate->value1;
+			args[0] = (char *) pergroupstate->value1;
 		else if (OidIsValid(peraggstate->xfn2_oid))
-			args[0] = (char *) peraggstate->value2;
+			args[0] = (char *) pergroupstate->value2;
 		else
 			elog(ERROR, "ExecAgg: no valid transition functions??");
 		*resultIsNull = false;
@@ -358,18 +353,18 @@ finalize_aggregate(AggStatePerAgg peraggstate,
 	else if (OidIsValid(peraggstate->xfn1_oid))
 	{
 		/* Return value1 */
-		*resultVal = peraggstate->value1;
-		*resultIsNull = peraggstate->value1IsNull;
+		*resultVal = pergroupstate->value1;
+		*resultIsNull = pergroupstate->value1IsNull;
 		/* prevent pfree below */
-		peraggstate->value1IsNull = true;
+		pergroupstate->value1IsNull = true;
 	}
 	else if (OidIsValid(peraggstate->xfn2_oid))
 	{
 		/* Return value2 */
-		*resultVal = peraggstate->value2;
-		*resultIsNull = peraggstate->value2IsNull;
+		*resultVal = pergroupstate->value2;
+		*resultIsNull = pergroupstate->value2IsNull;
 		/* prevent pfree below */
-		peraggstate->value2IsNull = true;
+		pergroupstate->value2IsNull = true;
 	}
 	else
 		elog(ERROR, "ExecAgg: no valid transition functions??");
@@ -379,14 +374,116 @@ finalize_aggregate(AggStatePerAgg peraggstate,
 	 * as the result of the aggregate.
 	 */
 	if (OidIsValid(peraggstate->xfn1_oid) &&
-		!peraggstate->value1IsNull &&
+		!pergroupstate->value1IsNull &&
 		!peraggstate->transtype1ByVal)
-		pfree((void*)peraggstate->value1);
+		pfree((void*)pergroupstate->value1);
 
 	if (OidIsValid(peraggstate->xfn2_oid) &&
-		!peraggstate->value2IsNull &&
+		!pergroupstate->value2IsNull &&
 		!peraggstate->transtype2ByVal)
-		pfree((void*)peraggstate->value2);
+		pfree((void*)pergroupstate->value2);
+}
+
+/*
+ * The following routines let HashAgg drive the same per-aggregate
+ * machinery over the transition values of many groups at once.  They
+ * do not support DISTINCT aggregates, which the planner never hands to
+ * HashAgg.
+ */
+
+/*
+ * Initialize the transition values of all aggregates for a new group.
+ * Any by-reference initial values are copied into the current memory
+ * context.
+ */
+void
+ExecAggInitGroup(AggStatePerAgg peragg, AggStatePerGroup pergroup,
+				 int numaggs)
+{
+	int			aggno;
+
+	for (aggno = 0; aggno < numaggs; aggno++)
+		initialize_aggregate(&peragg[aggno], &pergroup[aggno]);
+}
+
+/*
+ * Evaluate the aggregate inputs for the tuple in econtext's scan slot
+ * and advance the transition values of one group.  The inputs are
+ * evaluated in the current memory context; if transcxt is given, new
+ * transition values are allocated there instead.
+ */
+void
+ExecAggAdvanceGroup(AggStatePerAgg peragg, AggStatePerGroup pergroup,
+					int numaggs, ExprContext *econtext,
+					MemoryContext transcxt)
+{
+	int			aggno;
+
+	for (aggno = 0; aggno < numaggs; aggno++)
+	{
+		AggStatePerAgg peraggstate = &peragg[aggno];
+		Aggref	   *aggref = peraggstate->aggref;
+		Datum		newVal;
+		bool		isNull;
+		bool		isDone;
+
+		newVal = ExecEvalExpr(aggref->target, econtext, NULL,
+							  &isNull, &isDone);
+
+		if (isNull && !aggref->usenulls)
+			continue;			/* ignore this tuple for this agg */
+
+		if (transcxt != NULL)
+		{
+			MemoryContext oldcxt = MemoryContextSwitchTo(transcxt);
+
+			advance_transition_functions(peraggstate, &pergroup[aggno],
+										 newVal, isNull);
+			MemoryContextSwitchTo(oldcxt);
+		}
+		else
+			advance_transition_functions(peraggstate, &pergroup[aggno],
+										 newVal, isNull);
+	}
+}
+
+/*
+ * Estimate the bytes of by-reference transition values one group holds,
+ * so that HashAgg can keep track of the size of its table.  Varlena
+ * values are assumed to stay small.
+ */
+Size
+ExecAggTransitionSpace(AggStatePerAgg peragg, int numaggs)
+{
+	Size		space = 0;
+	int			aggno;
+
+	for (aggno = 0; aggno < numaggs; aggno++)
+	{
+		AggStatePerAgg peraggstate = &peragg[aggno];
+
+		if (OidIsValid(peraggstate->xfn1_oid) && !peraggstate->transtype1ByVal)
+			space += (peraggstate->transtype1Len > 0) ?
+				MAXALIGN(peraggstate->transtype1Len) : MAXALIGN(32);
+		if (OidIsValid(peraggstate->xfn2_oid) && !peraggstate->transtype2ByVal)
+			space += (peraggstate->transtype2Len > 0) ?
+				MAXALIGN(peraggstate->transtype2Len) : MAXALIGN(32);
+	}
+	return space;
+}
+
+/*
+ * Compute the final aggregate values of one group.
+ */
+void
+ExecAggFinalizeGroup(AggStatePerAgg peragg, AggStatePerGroup pergroup,
+					 int numaggs, Datum *resultVals, bool *resultNulls)
+{
+	int			aggno;
+
+	for (aggno = 0; aggno < numaggs; aggno++)
+		finalize_aggregate(&peragg[aggno], &pergroup[aggno],
+						   &resultVals[aggno], &resultNulls[aggno]);
 }
 
 /* ---------------------------------------
@@ -418,6 +515,7 @@ ExecAgg(Agg *node)
 	Datum	   *aggvalues;
 	bool	   *aggnulls;
 	AggStatePerAgg peragg;
+	AggStatePerGroup pergroup;
 	TupleTableSlot *resultSlot;
 	HeapTuple	inputTuple;
 	int			aggno;
@@ -436,6 +534,7 @@ ExecAgg(Agg *node)
 	aggnulls = econtext->ecxt_aggnulls;
 	projInfo = aggstate->csstate.cstate.cs_ProjInfo;
 	peragg = aggstate->peragg;
+	pergroup = aggstate->pergroup;
 
 	/*
 	 * We loop retrieving groups until we find one matching
@@ -453,7 +552,7 @@ ExecAgg(Agg *node)
 		{
 			AggStatePerAgg peraggstate = &peragg[aggno];
 
-			initialize_aggregate(peraggstate);
+			initialize_aggregate(peraggstate, &pergroup[aggno]);
 		}
 
 		inputTuple = NULL;		/* no saved input tuple yet */
@@ -488,6 +587,7 @@ ExecAgg(Agg *node)
 									   newVal, isNull);
 				else
 					advance_transition_functions(peraggstate,
+												 &pergroup[aggno],
 												 newVal, isNull);
 			}
 
@@ -509,7 +609,7 @@ ExecAgg(Agg *node)
 		{
 			AggStatePerAgg peraggstate = &peragg[aggno];
 
-			finalize_aggregate(peraggstate,
+			finalize_aggregate(peraggstate, &pergroup[aggno],
 							   &aggvalues[aggno], &aggnulls[aggno]);
 		}
 
@@ -609,12 +709,9 @@ bool
 ExecInitAgg(Agg *node, EState *estate)
 {
 	AggState   *aggstate;
-	AggStatePerAgg peragg;
 	Plan	   *outerPlan;
 	ExprContext *econtext;
-	int			numaggs,
-				aggno;
-	List	   *alist;
+	int			numaggs;
 
 	/*
 	 * assign the node's execution state
@@ -678,9 +775,9 @@ ExecInitAgg(Agg *node, EState *estate)
 	econtext->ecxt_aggnulls = (bool *) palloc(sizeof(bool) * numaggs);
 	MemSet(econtext->ecxt_aggnulls, 0, sizeof(bool) * numaggs);
 
-	peragg = (AggStatePerAgg) palloc(sizeof(AggStatePerAggData) * numaggs);
-	MemSet(peragg, 0, sizeof(AggStatePerAggData) * numaggs);
-	aggstate->peragg = peragg;
+	aggstate->pergroup = (AggStatePerGroup)
+		palloc(sizeof(AggStatePerGroupData) * numaggs);
+	MemSet(aggstate->pergroup, 0, sizeof(AggStatePerGroupData) * numaggs);
 
 	/*
 	 * initialize child nodes
@@ -704,8 +801,30 @@ ExecInitAgg(Agg *node, EState *estate)
 	 * Perform lookups of aggregate function info, and initialize the
 	 * unchanging fields of the per-agg data
 	 */
+	aggstate->peragg = ExecInitAggregates(aggstate->aggs, numaggs);
+
+	return TRUE;
+}
+
+/*
+ * ExecInitAggregates
+ *
+ *	Look up the pg_aggregate entries of the given Aggref nodes and build
+ *	their per-agg working state.  Shared by Agg and HashAgg; numaggs must
+ *	be at least 1 even if the list is empty.
+ */
+AggStatePerAgg
+ExecInitAggregates(List *aggs, int numaggs)
+{
+	AggStatePerAgg peragg;
+	int			aggno;
+	List	   *alist;
+
+	peragg = (AggStatePerAgg) palloc(sizeof(AggStatePerAggData) * numaggs);
+	MemSet(peragg, 0, sizeof(AggStatePerAggData) * numaggs);
+
 	aggno = -1;
-	foreach(alist, aggstate->aggs)
+	foreach(alist, aggs)
 	{
 		Aggref	   *aggref = (Aggref *) lfirst(alist);
 		AggStatePerAgg peraggstate = &peragg[(++aggno)];
@@ -802,7 +921,7 @@ ExecInitAgg(Agg *node, EState *estate)
 		}
 	}
 
-	return TRUE;
+	return peragg;
 }
 
 int
@@ -33,14 +33,34 @@
 #include "utils/memutils.h"
 #include "utils/lsyscache.h"
 #include "parser/parse_expr.h"
+#include "access/hash.h"
+#include "catalog/pg_type.h"
+#include "optimizer/clauses.h"
+#include "utils/numeric.h"
 
 extern int	SortMem;
 static void ExecChooseHashTableSize(double ntuples, int tupwidth,
-						int *virtualbuckets,
+						int maxbatch,
 						int *physicalbuckets,
-						int *numbatches);
-
-static int	hashFunc(Datum key, int len, bool byVal);
+						int *numbatches,
+						long *spaceallowed);
+static void ExecHashIncreaseNumBatches(HashJoinTable hashtable);
+static void ExecHashBloomAdd(HashJoinTable hashtable, uint32 hashvalue);
+
+static uint32 hashkey_int(Datum key, int len);
+static uint32 hashkey_int8(Datum key, int len);
+static uint32 hashkey_float4(Datum key, int len);
+static uint32 hashkey_float8(Datum key, int len);
+static uint32 hashkey_name(Datum key, int len);
+static uint32 hashkey_bpchar(Datum key, int len);
+static uint32 hashkey_numeric(Datum key, int len);
+static uint32 hashkey_varlena(Datum key, int len);
+static uint32 hashkey_byval(Datum key, int len);
+static uint32 hashkey_byref(Datum key, int len);
+
+#define BLOOM_BITS_PER_TUPLE	8
+#define BLOOM_MIN_BITS			(1 << 12)
+#define BLOOM_MAX_BITS			(1 << 24)
 
 /* ----------------------------------------------------------------
  *		ExecHash
@@ -55,12 +75,10 @@ ExecHash(Hash *node)
 //	EState	   *estate;
 	HashState  *hashstate;
 	Plan	   *outerNode;
-	Var		   *hashkey;
 	HashJoinTable hashtable;
 	TupleTableSlot *slot;
 	ExprContext *econtext;
-	int			nbatch;
-	int			i;
+	uint32		hashvalue;
 
 	/* ----------------
 	 *	get state info from node
@@ -75,28 +93,16 @@ ExecHash(Hash *node)
 	if (hashtable == NULL)
 		elog(ERROR, "ExecHash: hash table is NULL.");
 
-	nbatch = hashtable->nbatch;
-
-	if (nbatch > 0)
-	{
-		/* ----------------
-		 * Open temp files for inner batches, if needed.
-		 * Note that file buffers are palloc'd in regular executor context.
-		 * ----------------
-		 */
-		for (i = 0; i < nbatch; i++)
-			hashtable->innerBatchFile[i] = BufFileCreateTemp();
-	}
-
 	/* ----------------
 	 *	set expression context
 	 * ----------------
 	 */
-	hashkey = node->hashkey;
 	econtext = hashstate->cstate.cs_ExprContext;
 
 	/* ----------------
-	 *	get all inner tuples and insert into the hash table (or temp files)
+	 *	get all inner tuples and insert into the hash table (or temp files).
+	 *	A tuple with a null key can never satisfy the hash clauses, so it
+	 *	is not kept at all.
 	 * ----------------
 	 */
 	for (;;)
@@ -105,10 +111,20 @@ ExecHash(Hash *node)
 		if (TupIsNull(slot))
 			break;
 		econtext->ecxt_innertuple = slot;
-		ExecHashTableInsert(hashtable, econtext, hashkey);
+		if (ExecHashGetHashValue(hashtable, econtext,
+								 hashtable->innerkeys, &hashvalue))
+		{
+			ExecHashBloomAdd(hashtable, hashvalue);
+			ExecHashTableInsert(hashtable, slot->val, hashvalue);
+		}
 		ExecClearTuple(slot);
 	}
 
+#ifdef HJDEBUG
+	printf("ExecHash: nbatch = %d, spaceUsed = %ld\n",
+		   hashtable->nbatch, hashtable->spaceUsed);
+#endif
+
 	/* ---------------------
 	 *	Return the slot so that we have the tuple descriptor
 	 *	when we need to save/restore them.	-Jeff 11 July 1991
@@ -233,16 +249,28 @@ ExecEndHash(Hash *node)
 #define FUDGE_FAC				2.0
 
 HashJoinTable
-ExecHashTableCreate(Hash *node)
+ExecHashTableCreate(Hash *node, List *hashclauses)
 {
 	HashJoinTable hashtable;
 	Plan	   *outerNode;
-	int			totalbuckets;
 	int			nbuckets;
 	int			nbatch;
+	int			maxbatch;
+	long		spaceAllowed;
+	long		nbloom;
 	int			i;
+	List	   *hc;
 	MemoryContext oldcxt;
 
+	/*
+	 * Batch files are created as needed and closed as soon as their
+	 * batch is done, but every batch may have an inner and an outer file
+	 * open at once.
+	 */
+	maxbatch = 1;
+	while (maxbatch * 2 <= MAX_PRIVATE_FILES / 3)
+		maxbatch *= 2;
+
 	/*
 	 * Get information about the size of the relation to be hashed (it's
 	 * the "outer" subtree of this node, but the inner relation of the
@@ -251,11 +279,10 @@ ExecHashTableCreate(Hash *node)
 	outerNode = outerPlan(node);
 
 	ExecChooseHashTableSize(outerNode->plan_rows, outerNode->plan_width,
-							&totalbuckets, &nbuckets, &nbatch);
+							maxbatch, &nbuckets, &nbatch, &spaceAllowed);
 
 #ifdef HJDEBUG
-	printf("nbatch = %d, totalbuckets = %d, nbuckets = %d\n",
-		   nbatch, totalbuckets, nbuckets);
+	printf("nbatch = %d, nbuckets = %d\n", nbatch, nbuckets);
 #endif
 
 	/*
@@ -265,21 +292,14 @@ ExecHashTableCreate(Hash *node)
 	 * per-query memory context.
 	 */
 	hashtable = (HashJoinTable) MemoryContextAlloc(MemoryContextGetEnv()->QueryContext,sizeof(HashTableData));
+	MemSet(hashtable, 0, sizeof(HashTableData));
 	hashtable->nbuckets = nbuckets;
-	hashtable->totalbuckets = totalbuckets;
-	hashtable->buckets = NULL;
 	hashtable->nbatch = nbatch;
+	hashtable->nbatch_original = nbatch;
+	hashtable->nbatch_outstart = nbatch;
+	hashtable->maxbatch = maxbatch;
 	hashtable->curbatch = 0;
-	hashtable->innerBatchFile = NULL;
-	hashtable->outerBatchFile = NULL;
-	hashtable->innerBatchSize = NULL;
-	hashtable->outerBatchSize = NULL;
-
-	/*
-	 * Get info about the datatype of the hash key.
-	 */
-     hashtable->typLen = get_typlen(exprType((Node*)node->hashkey));
-     hashtable->typByVal = get_typbyval(exprType((Node*)node->hashkey));
+	hashtable->spaceAllowed = spaceAllowed;
 
 	/*
 	 * Create temporary memory contexts in which to keep the hashtable
@@ -301,29 +321,59 @@ ExecHashTableCreate(Hash *node)
 
 	oldcxt = MemoryContextSwitchTo(hashtable->hashCxt);
 
-	if (nbatch > 0)
+	/*
+	 * Split the hash clauses into the keys of each side, the outer Var
+	 * is on the left (cf. create_hashjoin_node()), and pick the hash
+	 * function for every key.
+	 */
+	hashtable->nkeys = length(hashclauses);
+	hashtable->hashfuncs = (HashKeyFunc *)
+		palloc(hashtable->nkeys * sizeof(HashKeyFunc));
+	i = 0;
+	foreach(hc, hashclauses)
 	{
-		/*
-		 * allocate and initialize the file arrays in hashCxt
-		 */
-		hashtable->innerBatchFile = (BufFile **)
-			palloc(nbatch * sizeof(BufFile *));
-		hashtable->outerBatchFile = (BufFile **)
-			palloc(nbatch * sizeof(BufFile *));
-		hashtable->innerBatchSize = (long *)
-			palloc(nbatch * sizeof(long));
-		hashtable->outerBatchSize = (long *)
-			palloc(nbatch * sizeof(long));
-		for (i = 0; i < nbatch; i++)
-		{
-			hashtable->innerBatchFile[i] = NULL;
-			hashtable->outerBatchFile[i] = NULL;
-			hashtable->innerBatchSize[i] = 0;
-			hashtable->outerBatchSize[i] = 0;
-		}
-		/* The files will not be opened until later... */
+		Expr	   *clause = (Expr *) lfirst(hc);
+		Var		   *innerkey = get_rightop(clause);
+
+		hashtable->outerkeys = lappend(hashtable->outerkeys, get_leftop(clause));
+		hashtable->innerkeys = lappend(hashtable->innerkeys, innerkey);
+		hashtable->hashfuncs[i++] = ExecHashKeyFunc(exprType((Node *) innerkey));
 	}
 
+	/*
+	 * allocate and initialize the file arrays in hashCxt
+	 */
+	hashtable->innerBatchFile = (BufFile **)
+		palloc(nbatch * sizeof(BufFile *));
+	hashtable->outerBatchFile = (BufFile **)
+		palloc(nbatch * sizeof(BufFile *));
+	hashtable->innerBatchSize = (long *)
+		palloc(nbatch * sizeof(long));
+	hashtable->outerBatchSize = (long *)
+		palloc(nbatch * sizeof(long));
+	for (i = 0; i < nbatch; i++)
+	{
+		hashtable->innerBatchFile[i] = NULL;
+		hashtable->outerBatchFile[i] = NULL;
+		hashtable->innerBatchSize[i] = 0;
+		hashtable->outerBatchSize[i] = 0;
+	}
+	/* The files will not be opened until later... */
+
+	/*
+	 * The bloom filter gets BLOOM_BITS_PER_TUPLE bits per estimated inner
+	 * tuple, which keeps false positives near 5% with two probes, but no
+	 * more than an eighth of the memory allowed for the hash table.
+	 */
+	nbloom = BLOOM_MIN_BITS;
+	while (nbloom < BLOOM_MAX_BITS &&
+		   nbloom < outerNode->plan_rows * BLOOM_BITS_PER_TUPLE &&
+		   (nbloom * 2) / 8 <= hashtable->spaceAllowed / 8)
+		nbloom *= 2;
+	hashtable->bloom = (uint32 *) palloc(nbloom / 8);
+	MemSet(hashtable->bloom, 0, nbloom / 8);
+	hashtable->bloomMask = (uint32) (nbloom - 1);
+
 	/*
 	 * Prepare context for the first-scan space allocations; allocate the
 	 * hashbucket array therein, and set each bucket "empty".
@@ -380,18 +430,19 @@ ExecHashTableDestroy(HashJoinTable hashtable)
  */
 void
 ExecHashTableInsert(HashJoinTable hashtable,
-					ExprContext *econtext,
-					Var *hashkey)
+					HeapTuple heapTuple,
+					uint32 hashvalue)
 {
-	int			bucketno = ExecHashGetBucket(hashtable, econtext, hashkey);
-	TupleTableSlot *slot = econtext->ecxt_innertuple;
-	HeapTuple	heapTuple = slot->val;
+	int			bucketno;
+	int			batchno;
+
+	ExecHashGetBucketAndBatch(hashtable, hashvalue, &bucketno, &batchno);
 
 	/* ----------------
 	 *	decide whether to put the tuple in the hash table or a tmp file
 	 * ----------------
 	 */
-	if (bucketno < hashtable->nbuckets)
+	if (batchno == hashtable->curbatch)
 	{
 		/* ---------------
 		 *	put the tuple in hash table
@@ -405,6 +456,7 @@ ExecHashTableInsert(HashJoinTable hashtable,
 													   hashTupleSize);
 		if (hashTuple == NULL)
 			elog(ERROR, "Insufficient memory for hash table.");
+		hashTuple->hashvalue = hashvalue;
 		memcpy((char *) &hashTuple->htup,
 			   (char *) heapTuple,
 			   sizeof(hashTuple->htup));
@@ -418,73 +470,212 @@ ExecHashTableInsert(HashJoinTable hashtable,
 			   heapTuple->t_len);
 		hashTuple->next = hashtable->buckets[bucketno];
 		hashtable->buckets[bucketno] = hashTuple;
+
+		hashtable->spaceUsed += hashTupleSize;
+		if (hashtable->spaceUsed > hashtable->spaceAllowed)
+			ExecHashIncreaseNumBatches(hashtable);
 	}
 	else
 	{
 		/* -----------------
-		 * put the tuple into a tmp file for other batches
+		 * put the tuple into a tmp file for a later batch
 		 * -----------------
 		 */
-		int			batchno = (hashtable->nbatch * (bucketno - hashtable->nbuckets)) /
-		(hashtable->totalbuckets - hashtable->nbuckets);
-
+		Assert(batchno > hashtable->curbatch);
 		hashtable->innerBatchSize[batchno]++;
-		ExecHashJoinSaveTuple(heapTuple,hashtable->innerBatchFile[batchno]);
+		ExecHashJoinSaveTuple(heapTuple, hashvalue,
+							  &hashtable->innerBatchFile[batchno]);
 	}
 }
 
 /* ----------------------------------------------------------------
- *		ExecHashGetBucket
+ *		ExecHashIncreaseNumBatches
  *
- *		Get the hash value for a tuple
+ *		the current batch has outgrown SortMem, double the number of
+ *		batches and write the tuples that now belong to a later batch
+ *		out to its file.
  * ----------------------------------------------------------------
  */
-int
-ExecHashGetBucket(HashJoinTable hashtable,
-				  ExprContext *econtext,
-				  Var *hashkey)
+static void
+ExecHashIncreaseNumBatches(HashJoinTable hashtable)
 {
-	int			bucketno;
-	Datum		keyval;
-	bool		isNull;
-        bool            byval;
-        int             length;
-        /* ----------------
-	 *	Get the join attribute value of the tuple
-	 *
-	 * ...It's quick hack - use ExecEvalExpr instead of ExecEvalVar:
-	 * hashkey may be T_ArrayRef, not just T_Var.		- vadim 04/22/97
-	 * ----------------
-	 */
+	int			oldnbatch = hashtable->nbatch;
+	int			nbatch;
+	long		ninmemory;
+	long		nfreed;
+	int			i;
 
-        keyval = ExecEvalVar(hashkey, econtext, &isNull, &byval, &length);
+	if (oldnbatch >= hashtable->maxbatch)
+		return;
+
+	nbatch = oldnbatch * 2;
+
+	hashtable->innerBatchFile = (BufFile **)
+		repalloc(hashtable->innerBatchFile, nbatch * sizeof(BufFile *));
+	hashtable->outerBatchFile = (BufFile **)
+		repalloc(hashtable->outerBatchFile, nbatch * sizeof(BufFile *));
+	hashtable->innerBatchSize = (long *)
+		repalloc(hashtable->innerBatchSize, nbatch * sizeof(long));
+	hashtable->outerBatchSize = (long *)
+		repalloc(hashtable->outerBatchSize, nbatch * sizeof(long));
+	for (i = oldnbatch; i < nbatch; i++)
+	{
+		hashtable->innerBatchFile[i] = NULL;
+		hashtable->outerBatchFile[i] = NULL;
+		hashtable->innerBatchSize[i] = 0;
+		hashtable->outerBatchSize[i] = 0;
+	}
+	hashtable->nbatch = nbatch;
+
+	ninmemory = nfreed = 0;
+	for (i = 0; i < hashtable->nbuckets; i++)
+	{
+		HashJoinTuple *prev = &hashtable->buckets[i];
+		HashJoinTuple tuple;
+
+		while ((tuple = *prev) != NULL)
+		{
+			int			bucketno;
+			int			batchno;
+
+			ninmemory++;
+			ExecHashGetBucketAndBatch(hashtable, tuple->hashvalue,
+									  &bucketno, &batchno);
+			if (batchno == hashtable->curbatch)
+			{
+				prev = &tuple->next;
+				continue;
+			}
+
+			Assert(batchno > hashtable->curbatch);
+			*prev = tuple->next;
+			hashtable->innerBatchSize[batchno]++;
+			ExecHashJoinSaveTuple(&tuple->htup, tuple->hashvalue,
+								  &hashtable->innerBatchFile[batchno]);
+			hashtable->spaceUsed -= MAXALIGN(sizeof(*tuple)) + tuple->htup.t_len;
+			pfree(tuple);
+			nfreed++;
+		}
+	}
+
+	elog(DEBUG, "ExecHashIncreaseNumBatches: %d batches, moved %ld of %ld tuples",
+		 nbatch, nfreed, ninmemory);
 
 	/*
-	 * keyval could be null, so we better point it to something valid
-	 * before trying to run hashFunc on it. --djm 8/17/96
+	 * If the split moved nothing, or everything, the batch is a run of
+	 * equal keys that more batches will not break up.  Stop trying and
+	 * let the batch exceed SortMem.
 	 */
-	if (isNull)
+	if (nfreed == 0 || nfreed == ninmemory)
+		hashtable->maxbatch = nbatch;
+}
+
+/* ----------------------------------------------------------------
+ *		ExecHashGetHashValue
+ *
+ *		Compute the hash value of a tuple over the given join keys,
+ *		which must be the inner or the outer keys of the table.
+ *		Returns false, leaving *hashvalue alone, if any key is null;
+ *		such a tuple cannot satisfy the hash clauses.
+ * ----------------------------------------------------------------
+ */
+bool
+ExecHashGetHashValue(HashJoinTable hashtable,
+					 ExprContext *econtext,
+					 List *hashkeys,
+					 uint32 *hashvalue)
+{
+	uint32		hashkey = 0;
+	List	   *hk;
+	int			i = 0;
+
+	foreach(hk, hashkeys)
 	{
-		byval = 0;
-		length = 0;
-		keyval = (Datum) "";
+		Datum		keyval;
+		bool		isNull;
+		bool		byval;
+		int			length;
+
+		/* rotate so that equal values in different keys differ */
+		hashkey = (hashkey << 1) | (hashkey >> 31);
+
+		keyval = ExecEvalVar((Var *) lfirst(hk), econtext, &isNull, &byval, &length);
+		if (isNull)
+			return false;
+
+		hashkey ^= (*hashtable->hashfuncs[i++]) (keyval, length);
 	}
 
-	/* ------------------
-	 *	compute the hash function
-	 * ------------------
+	/*
+	 * Mix the bits so that both the bucket number and the batch number
+	 * depend on the whole key.
 	 */
+	hashkey ^= hashkey >> 16;
+	hashkey *= 0x85ebca6b;
+	hashkey ^= hashkey >> 13;
+	hashkey *= 0xc2b2ae35;
+	hashkey ^= hashkey >> 16;
+
+	*hashvalue = hashkey;
+	return true;
+}
 
-	bucketno = hashFunc(keyval, length, byval) % hashtable->totalbuckets;
+/* ----------------------------------------------------------------
+ *		ExecHashGetBucketAndBatch
+ *
+ *		Determine the bucket and the batch of a hash value
+ * ----------------------------------------------------------------
+ */
+void
+ExecHashGetBucketAndBatch(HashJoinTable hashtable,
+						  uint32 hashvalue,
+						  int *bucketno,
+						  int *batchno)
+{
+	uint32		nbuckets = (uint32) hashtable->nbuckets;
 
-#ifdef HJDEBUG
-	if (bucketno >= hashtable->nbuckets)
-		printf("hash(%d) = %d SAVED\n", keyval, bucketno);
+	*bucketno = (int) (hashvalue % nbuckets);
+	if (hashtable->nbatch > 1)
+		*batchno = (int) ((hashvalue / nbuckets) & (hashtable->nbatch - 1));
 	else
-		printf("hash(%d) = %d\n", keyval, bucketno);
+		*batchno = 0;
+
+#ifdef HJDEBUG
+	printf("hash(%u) = bucket %d batch %d\n", hashvalue, *bucketno, *batchno);
 #endif
+}
+
+/*
+ * The two probes of the bloom filter, the low bits of the hash value and
+ * the high bits rotated down.
+ */
+#define BLOOM_PROBE1(h, mask)	((h) & (mask))
+#define BLOOM_PROBE2(h, mask)	((((h) >> 16) | ((h) << 16)) * 0x9e3779b1 & (mask))
+#define BLOOM_SET(bloom, bit)	((bloom)[(bit) >> 5] |= ((uint32) 1 << ((bit) & 31)))
+#define BLOOM_ISSET(bloom, bit) (((bloom)[(bit) >> 5] & ((uint32) 1 << ((bit) & 31))) != 0)
+
+static void
+ExecHashBloomAdd(HashJoinTable hashtable, uint32 hashvalue)
+{
+	/* only the first pass sees the whole inner relation */
+	if (hashtable->curbatch != 0)
+		return;
 
-	return bucketno;
+	BLOOM_SET(hashtable->bloom, BLOOM_PROBE1(hashvalue, hashtable->bloomMask));
+	BLOOM_SET(hashtable->bloom, BLOOM_PROBE2(hashvalue, hashtable->bloomMask));
+}
+
+/* ----------------------------------------------------------------
+ *		ExecHashBloomTest
+ *
+ *		false if no inner tuple has this hash value, true if one may
+ * ----------------------------------------------------------------
+ */
+bool
+ExecHashBloomTest(HashJoinTable hashtable, uint32 hashvalue)
+{
+	return BLOOM_ISSET(hashtable->bloom, BLOOM_PROBE1(hashvalue, hashtable->bloomMask)) &&
+		BLOOM_ISSET(hashtable->bloom, BLOOM_PROBE2(hashvalue, hashtable->bloomMask));
 }
 
 /* ----------------------------------------------------------------
@@ -500,6 +691,7 @@ ExecScanHashBucket(HashJoinState *hjstate,
 {
 	HashJoinTable hashtable = hjstate->hj_HashTable;
 	HashJoinTuple hashTuple = hjstate->hj_CurTuple;
+	uint32		hashvalue = hjstate->hj_CurHashValue;
 
 	/*
 	 * hj_CurTuple is NULL to start scanning a new bucket, or the address
@@ -512,17 +704,21 @@ ExecScanHashBucket(HashJoinState *hjstate,
 
 	while (hashTuple != NULL)
 	{
-		HeapTuple	heapTuple = &hashTuple->htup;
-		TupleTableSlot *inntuple;
-
-		/* insert hashtable's tuple into exec slot so ExecQual sees it */
-		inntuple = ExecStoreTuple(heapTuple,hjstate->hj_HashTupleSlot,false);		/* do not pfree this tuple */
-		econtext->ecxt_innertuple = inntuple;
-
-		if (ExecQual(hjclauses, econtext, false))
+		/* tuples with a different hash value cannot match */
+		if (hashTuple->hashvalue == hashvalue)
 		{
-			hjstate->hj_CurTuple = hashTuple;
-			return heapTuple;
+			HeapTuple	heapTuple = &hashTuple->htup;
+			TupleTableSlot *inntuple;
+
+			/* insert hashtable's tuple into exec slot so ExecQual sees it */
+			inntuple = ExecStoreTuple(heapTuple,hjstate->hj_HashTupleSlot,false);		/* do not pfree this tuple */
+			econtext->ecxt_innertuple = inntuple;
+
+			if (ExecQual(hjclauses, econtext, false))
+			{
+				hjstate->hj_CurTuple = hashTuple;
+				return heapTuple;
+			}
 		}
 
 		hashTuple = hashTuple->next;
@@ -536,55 +732,182 @@ ExecScanHashBucket(HashJoinState *hjstate,
 }
 
 /* ----------------------------------------------------------------
- *		hashFunc
+ *		ExecHashKeyFunc
  *
- *		the hash function, copied from Margo
+ *		pick the hash function for a hash key of type typid.  Values
+ *		that the type's equality operator treats as equal must hash
+ *		alike, so types whose equality is not plain byte equality get
+ *		a function of their own.  Hashed aggregation uses this too.
  * ----------------------------------------------------------------
  */
-static int
-hashFunc(Datum key, int len, bool byVal)
+HashKeyFunc
+ExecHashKeyFunc(Oid typid)
 {
-	unsigned int h = 0;
-	unsigned char *k;
-
-	if (byVal)
+	switch (typid)
 	{
-
-		/*
-		 * If it's a by-value data type, use the 'len' least significant
-		 * bytes of the Datum value.  This should do the right thing on
-		 * either bigendian or littleendian hardware --- see the Datum
-		 * access macros in c.h.
-		 */
-		while (len-- > 0)
-		{
-			h = (h * PRIME1) ^ (key & 0xFF);
-			key >>= 8;
-		}
+		case BOOLOID:
+		case CHAROID:
+		case INT2OID:
+		case INT4OID:
+		case OIDOID:
+			return hashkey_int;
+		case INT8OID:
+			return hashkey_int8;
+		case FLOAT4OID:
+			return hashkey_float4;
+		case FLOAT8OID:
+			return hashkey_float8;
+		case NAMEOID:
+			return hashkey_name;
+		case BPCHAROID:
+			return hashkey_bpchar;
+		case NUMERICOID:
+			return hashkey_numeric;
+		case TEXTOID:
+		case VARCHAROID:
+		case BYTEAOID:
+			return hashkey_varlena;
+		default:
+			break;
 	}
-	else
+
+	if (get_typbyval(typid))
+		return hashkey_byval;
+	return hashkey_byref;
+}
+
+/* ----------------------------------------------------------------
+ *		ExecHashKeyIsTyped
+ *
+ *		true if ExecHashKeyFunc has a function of its own for typid,
+ *		false if values of the type are hashed by their raw bytes
+ * ----------------------------------------------------------------
+ */
+bool
+ExecHashKeyIsTyped(Oid typid)
+{
+	HashKeyFunc func = ExecHashKeyFunc(typid);
+
+	return func != hashkey_byval && func != hashkey_byref;
+}
+
+static uint32
+hashkey_int(Datum key, int len)
+{
+	switch (len)
 	{
+		case 1:
+			return hashint4((uint32) DatumGetChar(key));
+		case 2:
+			return hashint4((uint32) DatumGetInt16(key));
+		default:
+			return hashint4(DatumGetUInt32(key));
+	}
+}
 
-		/*
-		 * If this is a variable length type, then 'k' points to a "struct
-		 * varlena" and len == -1. NOTE: VARSIZE returns the "real" data
-		 * length plus the sizeof the "vl_len" attribute of varlena (the
-		 * length information). 'k' points to the beginning of the varlena
-		 * struct, so we have to use "VARDATA" to find the beginning of
-		 * the "real" data.
-		 */
-		if (len == -1)
-		{
-			len = VARSIZE(key) - VARHDRSZ;
-			k = (unsigned char *) VARDATA(key);
-		}
-		else
-			k = (unsigned char *) key;
-		while (len-- > 0)
-			h = (h * PRIME1) ^ (*k++);
+static uint32
+hashkey_int8(Datum key, int len)
+{
+	int64		val = *((int64 *) DatumGetPointer(key));
+
+	return hashint4((uint32) val ^ (uint32) (val >> 32));
+}
+
+static uint32
+hashkey_float4(Datum key, int len)
+{
+	float4		val = *DatumGetFloat32(key);
+
+	/* zero and minus zero are equal */
+	if (val == 0.0)
+		return 0;
+	return hash_any((unsigned char *) &val, sizeof(val));
+}
+
+static uint32
+hashkey_float8(Datum key, int len)
+{
+	float8		val = *DatumGetFloat64(key);
+
+	/* zero and minus zero are equal */
+	if (val == 0.0)
+		return 0;
+	return hash_any((unsigned char *) &val, sizeof(val));
+}
+
+static uint32
+hashkey_name(Datum key, int len)
+{
+	char	   *name = NameStr(*DatumGetName(key));
+
+	/* the bytes after the terminator are not compared */
+	return hash_any((unsigned char *) name, strlen(name));
+}
+
+static uint32
+hashkey_bpchar(Datum key, int len)
+{
+	struct varlena *val = (struct varlena *) DatumGetPointer(key);
+	char	   *data = VARDATA(val);
+	int			datalen = VARSIZE(val) - VARHDRSZ;
+
+	/* trailing blanks are not significant to bpchareq */
+	while (datalen > 0 && data[datalen - 1] == ' ')
+		datalen--;
+	return hash_any((unsigned char *) data, datalen);
+}
+
+static uint32
+hashkey_numeric(Datum key, int len)
+{
+	Numeric		num = (Numeric) DatumGetPointer(key);
+
+	/* numeric_eq treats all NaNs as equal */
+	if (NUMERIC_IS_NAN(num))
+		return 0;
+
+	/*
+	 * Stored digits carry no leading or trailing zeroes, so only the
+	 * scales differ between equal values; leave them out.
+	 */
+	return hashint4((uint32) num->n_weight ^ (uint32) NUMERIC_SIGN(num)) ^
+		hash_any(num->n_data, num->varlen - NUMERIC_HDRSZ);
+}
+
+static uint32
+hashkey_varlena(Datum key, int len)
+{
+	struct varlena *val = (struct varlena *) DatumGetPointer(key);
+
+	return hash_any((unsigned char *) VARDATA(val), VARSIZE(val) - VARHDRSZ);
+}
+
+/*
+ * types without a function of their own are hashed on the bytes of the
+ * value, the 'len' least significant bytes of a by-value Datum.
+ */
+static uint32
+hashkey_byval(Datum key, int len)
+{
+	unsigned char bytes[sizeof(Datum)];
+	int			i;
+
+	if (len <= 0 || len > sizeof(Datum))
+		len = sizeof(Datum);
+	for (i = 0; i < len; i++)
+	{
+		bytes[i] = (unsigned char) (key & 0xFF);
+		key >>= 8;
 	}
+	return hash_any(bytes, len);
+}
 
-	return h % PRIME2;
+static uint32
+hashkey_byref(Datum key, int len)
+{
+	if (len == -1)
+		return hashkey_varlena(key, len);
+	return hash_any((unsigned char *) DatumGetPointer(key), len);
 }
 
 /* ----------------------------------------------------------------
@@ -612,15 +935,11 @@ ExecHashTableReset(HashJoinTable hashtable, long ntuples)
 
 	/*
 	 * We still use the same number of physical buckets as in the first
-	 * pass. (It could be different; but we already decided how many
-	 * buckets would be appropriate for the allowed memory, so stick with
-	 * that number.) We MUST set totalbuckets to equal nbuckets, because
-	 * from now on no tuples will go out to temp files; there are no more
-	 * virtual buckets, only real buckets.	(This implies that tuples will
-	 * go into different bucket numbers than they did on the first pass,
-	 * but that's OK.)
+	 * pass.  We MUST, since the batch of a tuple is computed from the
+	 * number of buckets and tuples already in batch files would land in
+	 * the wrong batch otherwise.
 	 */
-	hashtable->totalbuckets = nbuckets;
+	hashtable->spaceUsed = 0;
 
 	/* Reallocate and reinitialize the hash bucket headers. */
 	hashtable->buckets = (HashJoinTuple *)
@@ -647,18 +966,18 @@ ExecReScanHash(Hash *node, ExprContext *exprCtxt)
 		ExecReScan(((Plan *) node)->lefttree, exprCtxt);
 }
 
-void
+static void
 ExecChooseHashTableSize(double ntuples, int tupwidth,
-						int *virtualbuckets,
+						int maxbatch,
 						int *physicalbuckets,
-						int *numbatches)
+						int *numbatches,
+						long *spaceallowed)
 {
 	int			tupsize;
 	double		inner_rel_bytes;
 	double		hash_table_bytes;
 	int			nbatch;
 	int			nbuckets;
-	int			totalbuckets;
 	int			bucketsize;
 
 	/* Force a plausible relation size if no info */
@@ -681,67 +1000,30 @@ ExecChooseHashTableSize(double ntuples, int tupwidth,
 	if (hash_table_bytes < (SortMem * 1024L))
 		hash_table_bytes = SortMem * 1024L;
 
-	/*
-	 * Count the number of hash buckets we want for the whole relation,
-	 * for an average bucket load of NTUP_PER_BUCKET (per virtual
-	 * bucket!).
-	 */
-	totalbuckets = (int) ceil(ntuples * FUDGE_FAC / NTUP_PER_BUCKET);
-
 	/*
 	 * Count the number of buckets we think will actually fit in the
 	 * target memory size, at a loading of NTUP_PER_BUCKET (physical
 	 * buckets). NOTE: FUDGE_FAC here determines the fraction of the
 	 * hashtable space reserved to allow for nonuniform distribution of
-	 * hash values. Perhaps this should be a different number from the
-	 * other uses of FUDGE_FAC, but since we have no real good way to pick
-	 * either one...
+	 * hash values.  The number of buckets is fixed for the whole join,
+	 * if the estimate is too low the batches are doubled instead.
 	 */
 	bucketsize = NTUP_PER_BUCKET * tupsize;
 	nbuckets = (int) (hash_table_bytes / (bucketsize * FUDGE_FAC));
 	if (nbuckets <= 0)
 		nbuckets = 1;
 
-	if (totalbuckets <= nbuckets)
-	{
-		/*
-		 * We have enough space, so no batching.  In theory we could even
-		 * reduce nbuckets, but since that could lead to poor behavior if
-		 * estimated ntuples is much less than reality, it seems better to
-		 * make more buckets instead of fewer.
-		 */
-		totalbuckets = nbuckets;
-		nbatch = 0;
-	}
-	else
-	{
-		/*
-		 * Need to batch; compute how many batches we want to use. Note
-		 * that nbatch doesn't have to have anything to do with the ratio
-		 * totalbuckets/nbuckets; in fact, it is the number of groups we
-		 * will use for the part of the data that doesn't fall into the
-		 * first nbuckets hash buckets.
-		 */
-		nbatch = (int) ceil((inner_rel_bytes - hash_table_bytes) /
-							hash_table_bytes);
-		if (nbatch <= 0)
-			nbatch = 1;
-                if ( nbatch > MAX_PRIVATE_FILES / 3) {
-                    nbatch = MAX_PRIVATE_FILES / 3;
-                }
-	}
-
 	/*
-	 * Now, totalbuckets is the number of (virtual) hashbuckets for the
-	 * whole relation, and nbuckets is the number of physical hashbuckets
-	 * we will use in the first pass.  Data falling into the first
-	 * nbuckets virtual hashbuckets gets handled in the first pass;
-	 * everything else gets divided into nbatch batches to be processed in
-	 * additional passes.
-	 */
-	*virtualbuckets = totalbuckets;
+	 * Use as many batches as it takes for each of them to fit the target
+	 * memory size, rounded up to a power of two.  One batch means no
+	 * batching at all.
+	 */
+	nbatch = 1;
+	while (nbatch < maxbatch && nbatch * hash_table_bytes < inner_rel_bytes)
+		nbatch *= 2;
+
 	*physicalbuckets = nbuckets;
 	*numbatches = nbatch;
+	*spaceallowed = (long) hash_table_bytes;
 }
 
-
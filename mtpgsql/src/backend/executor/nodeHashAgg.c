@@ -0,0 +1,817 @@
+/*-------------------------------------------------------------------------
+ *
+ * nodeHashAgg.c
+ *	  Routines to handle hashed aggregate nodes.
+ *
+ *	  HashAgg computes GROUP BY aggregates over unsorted input.  Each
+ *	  input tuple is hashed on its group columns and looked up in a hash
+ *	  table holding one entry per group; the entry keeps a copy of the
+ *	  group's first tuple (for projecting the group columns) and the
+ *	  transition values of every aggregate, which are advanced with the
+ *	  same per-aggregate machinery nodeAgg.c uses.  Once all input has
+ *	  been read the entries are finalized and returned in bucket order.
+ *
+ *	  The table is limited to SortMem kilobytes.  When it grows past
+ *	  that, it is closed to new groups: tuples of groups already in the
+ *	  table keep being aggregated in memory, while tuples of any other
+ *	  group are written to one of HASHAGG_NBATCH batch files chosen by
+ *	  the high bits of their hash value.  After the table has been
+ *	  emitted, each batch file is aggregated by a pass of its own,
+ *	  using the next bits of the hash value should it need to spill
+ *	  again.  A group always ends up wholly in a single pass.
+ *
+ * Portions Copyright (c) 2000-2024, Myron Scott  <myron@weaverdb.org>
+ * Portions Copyright (c) 1996-2000, PostgreSQL, Inc
+ * Portions Copyright (c) 1994, Regents of the University of California
+ *
+ * IDENTIFICATION
+ *
+ *
+ *-------------------------------------------------------------------------
+ */
+
+
+#include "postgres.h"
+#include "env/env.h"
+#include "access/heapam.h"
+#include "executor/executor.h"
+#include "executor/nodeAgg.h"
+#include "executor/nodeGroup.h"
+#include "executor/nodeHash.h"
+#include "executor/nodeHashAgg.h"
+#include "miscadmin.h"
+#include "optimizer/clauses.h"
+#include "storage/buffile.h"
+#include "utils/memutils.h"
+
+/*
+ * HashAggEntryData - one group in the hash table
+ */
+typedef struct HashAggEntryData
+{
+	struct HashAggEntryData *next;	/* next entry in the same bucket */
+	uint32		hashvalue;		/* hash of the group columns */
+	HeapTuple	firstTuple;		/* copy of the group's first input tuple */
+	AggStatePerGroupData pergroup[1];	/* VARIABLE LENGTH ARRAY */
+} HashAggEntryData;				/* VARIABLE LENGTH STRUCT */
+
+/*
+ * HashAggBatchData - a spilled batch waiting for its own pass
+ */
+typedef struct HashAggBatchData
+{
+	BufFile    *file;			/* tuples of the batch, rewound */
+	int			depth;			/* partitioning level of the batch */
+} HashAggBatchData;
+
+typedef HashAggBatchData *HashAggBatch;
+
+#define HASHAGG_NSLOTS			2
+#define HASHAGG_MIN_BUCKETS		256
+#define HASHAGG_MAX_BUCKETS		(1 << 20)
+#define HASHAGG_FILLFACTOR		2	/* average entries per bucket */
+
+/*
+ * Every spill partitions the overflowing groups by HASHAGG_BATCH_BITS
+ * more bits of the hash value, so a 32 bit hash allows
+ * HASHAGG_MAX_DEPTH levels.  A batch at the last level is aggregated in
+ * memory whatever its size.
+ */
+#define HASHAGG_BATCH_BITS		3
+#define HASHAGG_NBATCH			(1 << HASHAGG_BATCH_BITS)
+#define HASHAGG_MAX_DEPTH		(32 / HASHAGG_BATCH_BITS)
+
+#define HASHAGG_ENTRYSIZE(numaggs) \
+	MAXALIGN(offsetof(HashAggEntryData, pergroup) + \
+			 (numaggs) * sizeof(AggStatePerGroupData))
+
+static void hashagg_filltable(HashAgg *node);
+static HashAggEntry hashagg_lookup(HashAgg *node, HeapTuple tuple,
+			   uint32 hashvalue);
+static HashAggEntry hashagg_newentry(HashAgg *node, HeapTuple tuple,
+				 uint32 hashvalue);
+static void hashagg_growtable(HashAggState *hashstate);
+static HashAggEntry hashagg_nextentry(HashAggState *hashstate);
+static void hashagg_resettable(HashAggState *hashstate, int nbuckets);
+static bool hashagg_nextbatch(HashAggState *hashstate);
+static void hashagg_spilltuple(HashAggState *hashstate, HeapTuple tuple,
+				   uint32 hashvalue);
+static void hashagg_queuespill(HashAggState *hashstate);
+static TupleTableSlot *hashagg_readtuple(BufFile *file,
+				  TupleTableSlot *tupleSlot);
+static void hashagg_closefiles(HashAggState *hashstate);
+static uint32 hashagg_hashtuple(HeapTuple tuple, TupleDesc tupdesc,
+				  int numCols, AttrNumber *grpColIdx,
+				  HashKeyFunc *hashfunctions);
+
+
+/* ---------------------------------------
+ *
+ * ExecHashAgg -
+ *
+ *	  On the first call, and whenever the groups of the previous pass have
+ *	  all been returned, ExecHashAgg reads the input of the next pass into
+ *	  the hash table.  Each call then returns the projection of one group
+ *	  that satisfies node->plan.qual (the HAVING clause).
+ *
+ * ------------------------------------------
+ */
+TupleTableSlot *
+ExecHashAgg(HashAgg *node)
+{
+	HashAggState *hashstate;
+	ExprContext *econtext;
+	ProjectionInfo *projInfo;
+	TupleTableSlot *resultSlot;
+	HashAggEntry entry;
+	MemoryContext oldcxt;
+	bool		isDone;
+
+	hashstate = node->hashaggstate;
+	econtext = hashstate->csstate.cstate.cs_ExprContext;
+	projInfo = hashstate->csstate.cstate.cs_ProjInfo;
+
+	for (;;)
+	{
+		if (hashstate->agg_done)
+			return NULL;
+
+		if (!hashstate->hashagg_filled)
+		{
+			hashagg_filltable(node);
+			hashstate->hashagg_filled = true;
+			hashstate->hashagg_nextbucket = 0;
+			hashstate->hashagg_nextentry = NULL;
+		}
+
+		entry = hashagg_nextentry(hashstate);
+		if (entry == NULL)
+		{
+			/* this pass is done, go on to the next spilled batch */
+			if (!hashagg_nextbatch(hashstate))
+			{
+				hashstate->agg_done = true;
+				return NULL;
+			}
+			continue;
+		}
+
+		/*
+		 * Finalize the group's aggregates into the expression context.
+		 * Any values the final functions allocate are only needed until
+		 * the projection below, so they go in the scratch context.
+		 */
+		MemoryContextResetAndDeleteChildren(hashstate->hashagg_tmpCxt);
+		oldcxt = MemoryContextSwitchTo(hashstate->hashagg_tmpCxt);
+		ExecAggFinalizeGroup(hashstate->peragg, entry->pergroup,
+							 hashstate->numaggs,
+							 econtext->ecxt_aggvalues,
+							 econtext->ecxt_aggnulls);
+		MemoryContextSwitchTo(oldcxt);
+
+		/*
+		 * Form the result from the aggregate values and the group's
+		 * representative input tuple.
+		 */
+		ExecStoreTuple(entry->firstTuple,
+					   hashstate->csstate.css_ScanTupleSlot, false);
+		econtext->ecxt_scantuple = hashstate->csstate.css_ScanTupleSlot;
+
+		resultSlot = ExecProject(projInfo, &isDone);
+
+		if (ExecQual(node->plan.qual, econtext, false))
+			return resultSlot;
+	}
+}
+
+/*
+ * hashagg_filltable
+ *
+ *	Aggregate all the input of the current pass --- the outer plan for
+ *	the first pass, a spilled batch file for later ones.
+ */
+static void
+hashagg_filltable(HashAgg *node)
+{
+	HashAggState *hashstate = node->hashaggstate;
+	ExprContext *econtext = hashstate->csstate.cstate.cs_ExprContext;
+	TupleTableSlot *scanslot = hashstate->csstate.css_ScanTupleSlot;
+	TupleDesc	tupdesc = ExecGetScanType(&hashstate->csstate);
+	Plan	   *outerPlan = outerPlan(node);
+	MemoryContext oldcxt;
+
+	for (;;)
+	{
+		TupleTableSlot *slot;
+		HeapTuple	tuple;
+		uint32		hashvalue;
+		HashAggEntry entry;
+
+		MemoryContextResetAndDeleteChildren(hashstate->hashagg_tmpCxt);
+
+		if (hashstate->hashagg_infile == NULL)
+		{
+			slot = ExecProcNode(outerPlan);
+			if (TupIsNull(slot))
+				break;
+		}
+		else
+		{
+			/* tuples read back only live until the next one */
+			oldcxt = MemoryContextSwitchTo(hashstate->hashagg_tmpCxt);
+			slot = hashagg_readtuple(hashstate->hashagg_infile, scanslot);
+			MemoryContextSwitchTo(oldcxt);
+			if (slot == NULL)
+				break;
+		}
+		tuple = slot->val;
+
+		oldcxt = MemoryContextSwitchTo(hashstate->hashagg_tmpCxt);
+		hashvalue = hashagg_hashtuple(tuple, tupdesc,
+									  node->numCols, node->grpColIdx,
+									  hashstate->hashfunctions);
+		entry = hashagg_lookup(node, tuple, hashvalue);
+		MemoryContextSwitchTo(oldcxt);
+
+		if (entry == NULL)
+		{
+			if (hashstate->hashagg_full)
+			{
+				hashagg_spilltuple(hashstate, tuple, hashvalue);
+				continue;
+			}
+			entry = hashagg_newentry(node, tuple, hashvalue);
+		}
+
+		/*
+		 * Evaluate the aggregate inputs in the scratch context, but keep
+		 * the transition values with the entry.
+		 */
+		econtext->ecxt_scantuple = slot;
+		oldcxt = MemoryContextSwitchTo(hashstate->hashagg_tmpCxt);
+		ExecAggAdvanceGroup(hashstate->peragg, entry->pergroup,
+							hashstate->numaggs, econtext,
+							hashstate->hashagg_hashCxt);
+		MemoryContextSwitchTo(oldcxt);
+	}
+
+	ExecClearTuple(scanslot);
+	MemoryContextResetAndDeleteChildren(hashstate->hashagg_tmpCxt);
+
+	/* this pass's input is used up; queue whatever it spilled */
+	if (hashstate->hashagg_infile != NULL)
+	{
+		BufFileClose(hashstate->hashagg_infile);
+		hashstate->hashagg_infile = NULL;
+	}
+	hashagg_queuespill(hashstate);
+}
+
+/*
+ * hashagg_lookup
+ *
+ *	Find the entry of the tuple's group, or NULL if it has none yet.
+ */
+static HashAggEntry
+hashagg_lookup(HashAgg *node, HeapTuple tuple, uint32 hashvalue)
+{
+	HashAggState *hashstate = node->hashaggstate;
+	TupleDesc	tupdesc = ExecGetScanType(&hashstate->csstate);
+	HashAggEntry entry;
+
+	entry = hashstate->hashagg_buckets[hashvalue &
+									   (hashstate->hashagg_nbuckets - 1)];
+	for (; entry != NULL; entry = entry->next)
+	{
+		if (entry->hashvalue == hashvalue &&
+			execTuplesMatch(entry->firstTuple, tuple, tupdesc,
+							node->numCols, node->grpColIdx,
+							hashstate->eqfunctions))
+			return entry;
+	}
+	return NULL;
+}
+
+/*
+ * hashagg_newentry
+ *
+ *	Add a group for the tuple to the table.  Closes the table to further
+ *	groups once it holds more than SortMem.
+ */
+static HashAggEntry
+hashagg_newentry(HashAgg *node, HeapTuple tuple, uint32 hashvalue)
+{
+	HashAggState *hashstate = node->hashaggstate;
+	HashAggEntry entry;
+	HashAggEntry *bucket;
+	MemoryContext oldcxt;
+
+	oldcxt = MemoryContextSwitchTo(hashstate->hashagg_hashCxt);
+	entry = (HashAggEntry) palloc(HASHAGG_ENTRYSIZE(hashstate->numaggs));
+	entry->hashvalue = hashvalue;
+	entry->firstTuple = heap_copytuple(tuple);
+	ExecAggInitGroup(hashstate->peragg, entry->pergroup, hashstate->numaggs);
+	MemoryContextSwitchTo(oldcxt);
+
+	bucket = &hashstate->hashagg_buckets[hashvalue &
+										 (hashstate->hashagg_nbuckets - 1)];
+	entry->next = *bucket;
+	*bucket = entry;
+
+	hashstate->hashagg_ngroups++;
+	hashstate->hashagg_spaceUsed += HASHAGG_ENTRYSIZE(hashstate->numaggs) +
+		MAXALIGN(HEAPTUPLESIZE + tuple->t_len) +
+		hashstate->hashagg_transSpace;
+
+	if (hashstate->hashagg_ngroups >
+		(long) hashstate->hashagg_nbuckets * HASHAGG_FILLFACTOR &&
+		hashstate->hashagg_nbuckets < HASHAGG_MAX_BUCKETS)
+		hashagg_growtable(hashstate);
+
+	if (hashstate->hashagg_spaceUsed > hashstate->hashagg_spaceAllowed &&
+		hashstate->hashagg_depth < HASHAGG_MAX_DEPTH)
+	{
+		elog(DEBUG, "ExecHashAgg: %ld groups exceed SortMem at level %d, spilling",
+			 hashstate->hashagg_ngroups, hashstate->hashagg_depth);
+		hashstate->hashagg_full = true;
+	}
+
+	return entry;
+}
+
+/*
+ * hashagg_growtable
+ *
+ *	Double the number of buckets and redistribute the entries.  The old
+ *	bucket array stays in hashCxt until the next reset.
+ */
+static void
+hashagg_growtable(HashAggState *hashstate)
+{
+	HashAggEntry *oldbuckets = hashstate->hashagg_buckets;
+	int			oldnbuckets = hashstate->hashagg_nbuckets;
+	int			nbuckets = oldnbuckets * 2;
+	HashAggEntry *buckets;
+	int			i;
+
+	buckets = (HashAggEntry *)
+		MemoryContextAlloc(hashstate->hashagg_hashCxt,
+						   nbuckets * sizeof(HashAggEntry));
+	MemSet(buckets, 0, nbuckets * sizeof(HashAggEntry));
+
+	for (i = 0; i < oldnbuckets; i++)
+	{
+		HashAggEntry entry = oldbuckets[i];
+
+		while (entry != NULL)
+		{
+			HashAggEntry next = entry->next;
+			HashAggEntry *bucket = &buckets[entry->hashvalue & (nbuckets - 1)];
+
+			entry->next = *bucket;
+			*bucket = entry;
+			entry = next;
+		}
+	}
+	pfree(oldbuckets);
+
+	hashstate->hashagg_spaceUsed += (nbuckets - oldnbuckets) * sizeof(HashAggEntry);
+	hashstate->hashagg_buckets = buckets;
+	hashstate->hashagg_nbuckets = nbuckets;
+}
+
+/*
+ * hashagg_nextentry
+ *
+ *	Step the output scan to the next entry of the table.
+ */
+static HashAggEntry
+hashagg_nextentry(HashAggState *hashstate)
+{
+	HashAggEntry entry = hashstate->hashagg_nextentry;
+
+	while (entry == NULL)
+	{
+		if (hashstate->hashagg_nextbucket >= hashstate->hashagg_nbuckets)
+			return NULL;
+		entry = hashstate->hashagg_buckets[hashstate->hashagg_nextbucket++];
+	}
+	hashstate->hashagg_nextentry = entry->next;
+	return entry;
+}
+
+/*
+ * hashagg_resettable
+ *
+ *	Throw away all groups and start an empty table of nbuckets buckets.
+ */
+static void
+hashagg_resettable(HashAggState *hashstate, int nbuckets)
+{
+	ExecClearTuple(hashstate->csstate.css_ScanTupleSlot);
+	MemoryContextResetAndDeleteChildren(hashstate->hashagg_hashCxt);
+
+	hashstate->hashagg_buckets = (HashAggEntry *)
+		MemoryContextAlloc(hashstate->hashagg_hashCxt,
+						   nbuckets * sizeof(HashAggEntry));
+	MemSet(hashstate->hashagg_buckets, 0, nbuckets * sizeof(HashAggEntry));
+	hashstate->hashagg_nbuckets = nbuckets;
+	hashstate->hashagg_ngroups = 0;
+	hashstate->hashagg_spaceUsed = nbuckets * sizeof(HashAggEntry);
+	hashstate->hashagg_full = false;
+	hashstate->hashagg_filled = false;
+	hashstate->hashagg_nextbucket = 0;
+	hashstate->hashagg_nextentry = NULL;
+}
+
+/*
+ * hashagg_nextbatch
+ *
+ *	Set up the next spilled batch as the input of a new pass.  Returns
+ *	false when there are none left.
+ */
+static bool
+hashagg_nextbatch(HashAggState *hashstate)
+{
+	HashAggBatch batch;
+
+	if (hashstate->hashagg_pending == NIL)
+		return false;
+
+	batch = (HashAggBatch) lfirst(hashstate->hashagg_pending);
+	hashstate->hashagg_pending = lnext(hashstate->hashagg_pending);
+
+	hashagg_resettable(hashstate, hashstate->hashagg_nbuckets);
+	hashstate->hashagg_infile = batch->file;
+	hashstate->hashagg_depth = batch->depth;
+	pfree(batch);
+
+	return true;
+}
+
+/*
+ * hashagg_spilltuple
+ *
+ *	Write a tuple whose group is not in the closed table to the batch
+ *	file picked by the next HASHAGG_BATCH_BITS bits of its hash value.
+ */
+static void
+hashagg_spilltuple(HashAggState *hashstate, HeapTuple tuple, uint32 hashvalue)
+{
+	int			shift = 32 - HASHAGG_BATCH_BITS * (hashstate->hashagg_depth + 1);
+	int			batchno = (hashvalue >> shift) & (HASHAGG_NBATCH - 1);
+	BufFile    *file = hashstate->hashagg_spill[batchno];
+	size_t		written;
+
+	if (file == NULL)
+	{
+		MemoryContext oldcxt = MemoryContextSwitchTo(GetMemoryContext(hashstate));
+
+		file = BufFileCreateTemp();
+		hashstate->hashagg_spill[batchno] = file;
+		MemoryContextSwitchTo(oldcxt);
+	}
+
+	written = BufFileWrite(file, (void *) tuple, sizeof(HeapTupleData));
+	if (written != sizeof(HeapTupleData))
+		elog(ERROR, "Write to hashagg temp file failed");
+	written = BufFileWrite(file, (void *) tuple->t_data, tuple->t_len);
+	if (written != (size_t) tuple->t_len)
+		elog(ERROR, "Write to hashagg temp file failed");
+}
+
+/*
+ * hashagg_queuespill
+ *
+ *	Rewind the batch files written by the finished pass and queue them
+ *	for passes of their own, one level deeper.
+ */
+static void
+hashagg_queuespill(HashAggState *hashstate)
+{
+	MemoryContext oldcxt;
+	int			i;
+
+	oldcxt = MemoryContextSwitchTo(GetMemoryContext(hashstate));
+	for (i = 0; i < HASHAGG_NBATCH; i++)
+	{
+		BufFile    *file = hashstate->hashagg_spill[i];
+		HashAggBatch batch;
+
+		if (file == NULL)
+			continue;
+		hashstate->hashagg_spill[i] = NULL;
+
+		if (BufFileSeek(file, 0L, SEEK_SET))
+			elog(ERROR, "Failed to rewind hashagg temp file");
+
+		batch = (HashAggBatch) palloc(sizeof(HashAggBatchData));
+		batch->file = file;
+		batch->depth = hashstate->hashagg_depth + 1;
+		hashstate->hashagg_pending = lappend(hashstate->hashagg_pending, batch);
+	}
+	MemoryContextSwitchTo(oldcxt);
+}
+
+/*
+ * hashagg_readtuple
+ *
+ *	Read the next tuple of a batch file into the current memory context,
+ *	store it in tupleSlot and return the slot; NULL at end of file.
+ */
+static TupleTableSlot *
+hashagg_readtuple(BufFile *file, TupleTableSlot *tupleSlot)
+{
+	HeapTupleData htup;
+	size_t		nread;
+	HeapTuple	heapTuple;
+
+	nread = BufFileRead(file, (void *) &htup, sizeof(HeapTupleData));
+	if (nread == 0)
+		return NULL;			/* end of file */
+	if (nread != sizeof(HeapTupleData))
+		elog(ERROR, "Read from hashagg temp file failed");
+	heapTuple = palloc(HEAPTUPLESIZE + htup.t_len);
+	memcpy((char *) heapTuple, (char *) &htup, sizeof(HeapTupleData));
+	heapTuple->t_datamcxt = MemoryContextGetCurrentContext();
+	heapTuple->t_datasrc = NULL;
+	heapTuple->t_info = 0;
+	heapTuple->t_data = (HeapTupleHeader)
+		((char *) heapTuple + HEAPTUPLESIZE);
+	nread = BufFileRead(file, (void *) heapTuple->t_data, htup.t_len);
+	if (nread != (size_t) htup.t_len)
+		elog(ERROR, "Read from hashagg temp file failed");
+	return ExecStoreTuple(heapTuple, tupleSlot, false);
+}
+
+/*
+ * hashagg_closefiles
+ *
+ *	Release every batch file, read or written.
+ */
+static void
+hashagg_closefiles(HashAggState *hashstate)
+{
+	List	   *l;
+	int			i;
+
+	if (hashstate->hashagg_infile != NULL)
+		BufFileClose(hashstate->hashagg_infile);
+	hashstate->hashagg_infile = NULL;
+
+	for (i = 0; i < HASHAGG_NBATCH; i++)
+	{
+		if (hashstate->hashagg_spill[i] != NULL)
+			BufFileClose(hashstate->hashagg_spill[i]);
+		hashstate->hashagg_spill[i] = NULL;
+	}
+
+	foreach(l, hashstate->hashagg_pending)
+	{
+		HashAggBatch batch = (HashAggBatch) lfirst(l);
+
+		BufFileClose(batch->file);
+		pfree(batch);
+	}
+	freeList(hashstate->hashagg_pending);
+	hashstate->hashagg_pending = NIL;
+}
+
+/*
+ * hashagg_hashtuple
+ *
+ *	Hash the group columns of a tuple.  Nulls hash alike, matching
+ *	execTuplesMatch, which treats them as equal.  Each value goes through
+ *	the hash function of its type, the one hash join uses, so values that
+ *	compare equal but are stored differently land in the same group.
+ */
+static uint32
+hashagg_hashtuple(HeapTuple tuple, TupleDesc tupdesc,
+				  int numCols, AttrNumber *grpColIdx,
+				  HashKeyFunc *hashfunctions)
+{
+	uint32		hashkey = 0;
+	int			i;
+
+	for (i = 0; i < numCols; i++)
+	{
+		AttrNumber	att = grpColIdx[i];
+		Form_pg_attribute attr = tupdesc->attrs[att - 1];
+		Datum		value;
+		bool		isNull;
+
+		/* rotate so that equal values in different columns differ */
+		hashkey = (hashkey << 1) | (hashkey >> 31);
+
+		value = HeapGetAttr(tuple, att, tupdesc, &isNull);
+		if (!isNull)
+			hashkey ^= (*hashfunctions[i]) (value, attr->attlen);
+	}
+
+	/*
+	 * Mix the bits so that both the low bits (bucket number) and the high
+	 * bits (batch number) depend on the whole key.
+	 */
+	hashkey ^= hashkey >> 16;
+	hashkey *= 0x85ebca6b;
+	hashkey ^= hashkey >> 13;
+	hashkey *= 0xc2b2ae35;
+	hashkey ^= hashkey >> 16;
+
+	return hashkey;
+}
+
+/* -----------------
+ * ExecInitHashAgg
+ *
+ *	Creates the run-time information for the hashed agg node produced by
+ *	the planner and initializes its outer subtree
+ * -----------------
+ */
+bool
+ExecInitHashAgg(HashAgg *node, EState *estate)
+{
+	HashAggState *hashstate;
+	Plan	   *outerPlan;
+	ExprContext *econtext;
+	int			numaggs;
+	int			nbuckets;
+	int			i;
+	List	   *alist;
+
+	/*
+	 * assign the node's execution state
+	 */
+	node->plan.state = estate;
+
+	/*
+	 * create state structure
+	 */
+	hashstate = makeNode(HashAggState);
+	node->hashaggstate = hashstate;
+	hashstate->agg_done = false;
+
+	/*
+	 * find aggregates in targetlist and quals; see ExecInitAgg
+	 */
+	hashstate->aggs = nconc(pull_agg_clause((Node *) node->plan.targetlist),
+							pull_agg_clause((Node *) node->plan.qual));
+	hashstate->numaggs = numaggs = length(hashstate->aggs);
+	if (numaggs <= 0)
+	{
+		elog(DEBUG, "ExecInitHashAgg: could not find any aggregate functions");
+		numaggs = 1;
+	}
+	foreach(alist, hashstate->aggs)
+	{
+		if (((Aggref *) lfirst(alist))->aggdistinct)
+			elog(ERROR, "ExecInitHashAgg: DISTINCT aggregates need sorted input");
+	}
+
+	/*
+	 * assign node's base id and create expression context
+	 */
+	ExecAssignNodeBaseInfo(estate, &hashstate->csstate.cstate);
+	ExecAssignExprContext(estate, &hashstate->csstate.cstate);
+
+	/*
+	 * tuple table initialization
+	 */
+	ExecInitScanTupleSlot(estate, &hashstate->csstate);
+	ExecInitResultTupleSlot(estate, &hashstate->csstate.cstate);
+
+	/*
+	 * Set up aggregate-result storage in the expr context
+	 */
+	econtext = hashstate->csstate.cstate.cs_ExprContext;
+	econtext->ecxt_aggvalues = (Datum *) palloc(sizeof(Datum) * numaggs);
+	MemSet(econtext->ecxt_aggvalues, 0, sizeof(Datum) * numaggs);
+	econtext->ecxt_aggnulls = (bool *) palloc(sizeof(bool) * numaggs);
+	MemSet(econtext->ecxt_aggnulls, 0, sizeof(bool) * numaggs);
+
+	/*
+	 * initialize child nodes
+	 */
+	outerPlan = outerPlan(node);
+	ExecInitNode(outerPlan, estate);
+
+	/* ----------------
+	 *	initialize source tuple type.
+	 * ----------------
+	 */
+	ExecAssignScanTypeFromOuterPlan((Plan *) node, &hashstate->csstate);
+
+	/*
+	 * Initialize result tuple type and projection info.
+	 */
+	ExecAssignResultTypeFromTL((Plan *) node, &hashstate->csstate.cstate);
+	ExecAssignProjectionInfo((Plan *) node, &hashstate->csstate.cstate);
+
+	hashstate->peragg = ExecInitAggregates(hashstate->aggs, numaggs);
+	hashstate->hashagg_transSpace =
+		ExecAggTransitionSpace(hashstate->peragg, hashstate->numaggs);
+
+	hashstate->eqfunctions =
+		execTuplesMatchPrepare(ExecGetScanType(&hashstate->csstate),
+							   node->numCols,
+							   node->grpColIdx);
+	hashstate->hashfunctions = (HashKeyFunc *)
+		palloc(node->numCols * sizeof(HashKeyFunc));
+	for (i = 0; i < node->numCols; i++)
+	{
+		Form_pg_attribute attr =
+			ExecGetScanType(&hashstate->csstate)->attrs[node->grpColIdx[i] - 1];
+
+		hashstate->hashfunctions[i] = ExecHashKeyFunc(attr->atttypid);
+	}
+
+	/*
+	 * Create the hash table, sized for the planner's estimate of the
+	 * number of groups as far as SortMem allows.
+	 */
+	hashstate->hashagg_spaceAllowed = SortMem * 1024L;
+	hashstate->hashagg_hashCxt =
+		AllocSetContextCreate(MemoryContextGetEnv()->QueryContext,
+							  "HashAggContext",
+							  ALLOCSET_DEFAULT_MINSIZE,
+							  ALLOCSET_DEFAULT_INITSIZE,
+							  ALLOCSET_DEFAULT_MAXSIZE);
+	hashstate->hashagg_tmpCxt =
+		AllocSetContextCreate(MemoryContextGetEnv()->QueryContext,
+							  "HashAggTupleContext",
+							  ALLOCSET_DEFAULT_MINSIZE,
+							  ALLOCSET_DEFAULT_INITSIZE,
+							  ALLOCSET_DEFAULT_MAXSIZE);
+
+	nbuckets = HASHAGG_MIN_BUCKETS;
+	while (nbuckets < HASHAGG_MAX_BUCKETS &&
+		   (long) nbuckets * HASHAGG_FILLFACTOR < node->numGroups &&
+		   (long) nbuckets * 2 * sizeof(HashAggEntry) <
+		   hashstate->hashagg_spaceAllowed / 16)
+		nbuckets *= 2;
+
+	hashstate->hashagg_spill = (BufFile **)
+		palloc(HASHAGG_NBATCH * sizeof(BufFile *));
+	MemSet(hashstate->hashagg_spill, 0, HASHAGG_NBATCH * sizeof(BufFile *));
+	hashstate->hashagg_pending = NIL;
+	hashstate->hashagg_infile = NULL;
+	hashstate->hashagg_depth = 0;
+
+	hashagg_resettable(hashstate, nbuckets);
+
+	return TRUE;
+}
+
+int
+ExecCountSlotsHashAgg(HashAgg *node)
+{
+	return ExecCountSlotsNode(outerPlan(node)) +
+	ExecCountSlotsNode(innerPlan(node)) +
+	HASHAGG_NSLOTS;
+}
+
+void
+ExecEndHashAgg(HashAgg *node)
+{
+	HashAggState *hashstate = node->hashaggstate;
+	Plan	   *outerPlan;
+
+	hashagg_closefiles(hashstate);
+
+	ExecFreeProjectionInfo(&hashstate->csstate.cstate);
+
+	outerPlan = outerPlan(node);
+	ExecEndNode(outerPlan);
+
+	/* clean up tuple table */
+	ExecClearTuple(hashstate->csstate.css_ScanTupleSlot);
+
+	MemoryContextDelete(hashstate->hashagg_hashCxt);
+	MemoryContextDelete(hashstate->hashagg_tmpCxt);
+	hashstate->hashagg_buckets = NULL;
+}
+
+void
+ExecReScanHashAgg(HashAgg *node, ExprContext *exprCtxt)
+{
+	HashAggState *hashstate = node->hashaggstate;
+	ExprContext *econtext = hashstate->csstate.cstate.cs_ExprContext;
+
+	/*
+	 * The transition values are consumed as the groups are returned, so
+	 * the table always has to be built again.
+	 */
+	hashagg_closefiles(hashstate);
+	hashagg_resettable(hashstate, hashstate->hashagg_nbuckets);
+	hashstate->hashagg_depth = 0;
+	hashstate->agg_done = false;
+	MemSet(econtext->ecxt_aggvalues, 0, sizeof(Datum) * hashstate->numaggs);
+	MemSet(econtext->ecxt_aggnulls, 0, sizeof(bool) * hashstate->numaggs);
+
+	/*
+	 * if chgParam of subnode is not null then plan will be re-scanned by
+	 * first ExecProcNode.
+	 */
+	if (((Plan *) node)->lefttree->chgParam == NULL)
+		ExecReScan(((Plan *) node)->lefttree, exprCtxt);
+}
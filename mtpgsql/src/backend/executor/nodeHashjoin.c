@@ -15,20 +15,156 @@
  */
 
 
+#include <pthread.h>
+#include <errno.h>
+
 #include "postgres.h"
 #include "env/env.h"
+#include "env/dolhelper.h"
+#include "env/freespace.h"
+#include "access/heapam.h"
 #include "executor/executor.h"
 #include "executor/nodeHash.h"
 #include "executor/nodeHashjoin.h"
 #include "optimizer/clauses.h"
+#include "utils/memutils.h"
+
+/*
+ * Parallel hash join
+ *
+ * When the planner asked for helpers and both inputs are plain
+ * sequential scans, the inner relation is divided into chunks of
+ * HJ_PARALLEL_CHUNK_BLOCKS that the main thread and the DOL helpers
+ * claim until none are left.  Each one applies the scan qual, projects
+ * the tuple and links it into the shared bucket array under the lock of
+ * the bucket's stripe.  Once all of them are done the helpers go on to
+ * claim chunks of the outer relation and probe the finished table, it
+ * is only read from then on.  Every match is copied into one of the
+ * helper's two exchange buffers, the main thread takes full buffers,
+ * checks the join qual and projects.
+ *
+ * Table tuples come from a context per worker so that no allocation is
+ * shared between threads.  The parallel join never batches, a build
+ * that grows past the memory allowed is thrown away and the join runs
+ * serially instead.
+ */
+#define HJ_PARALLEL_CHUNK_BLOCKS	64
+#define HJ_PARALLEL_STRIPES			64
+#define HJ_EXCHANGE_SIZE			(8 * BLCKSZ)
+
+typedef enum
+{
+	HJ_PHASE_BUILD,
+	HJ_PHASE_PROBE,
+	HJ_PHASE_STOP
+} HJParallelPhase;
+
+typedef struct HJExchange
+{
+	bool		full;			/* owned by the main thread until emptied */
+	Size		used;
+	char	   *data;
+} HJExchange;
+
+/*
+ * one match handed to the main thread, the outer tuple's data follows
+ * at the next MAXALIGN boundary
+ */
+typedef struct HJMatch
+{
+	HashJoinTuple inner;
+	HeapTupleData outer;
+} HJMatch;
+
+typedef struct HJWorker
+{
+	struct HashJoinParallelData *shared;
+	DolConnection conn;			/* NULL for the main thread */
+	MemoryContext tuplecxt;		/* tuples it adds to the table */
+	long		spaceUsed;
+	int			filling;		/* exchange being written */
+	HJExchange	exchange[2];
+	bool		built;
+	bool		done;
+} HJWorker;
+
+typedef struct HashJoinParallelData
+{
+	HashJoinTable hashtable;
+	MemoryContext cxt;
+	Snapshot	snapshot;
+	ParamListInfo params;
+	ParamExecData *paramexec;
+	List	   *rangetable;
+	Plan	   *innerscan;
+	Plan	   *outerscan;
+	Oid			innerrelid;
+	Oid			outerrelid;
+	List	   *hashclauses;
+	HJParallelPhase phase;
+	BlockNumber nblocks;
+	BlockNumber nextblock;
+	long		spaceUsed;
+	bool		overflow;
+	int			nworkers;		/* helpers, workers[0] is the main thread */
+	int			current;		/* helper to look at first for a full
+								 * exchange */
+	HJExchange *reading;
+	Size		readpos;
+	pthread_mutex_t guard;
+	pthread_cond_t gate;
+	pthread_mutex_t stripes[HJ_PARALLEL_STRIPES];
+	HJWorker	workers[HJ_PARALLEL_MAX_WORKERS + 1];
+} HashJoinParallelData;
+
+typedef HashJoinParallelData *HashJoinParallel;
+
+/* what a thread needs to scan and project one of the inputs */
+typedef struct HJScanState
+{
+	ExprContext *econtext;
+	TupleTableSlot *scanslot;
+	TupleTableSlot *projslot;
+	TupleTableSlot *innerslot;
+	List	   *tlist;
+	List	   *qual;			/* private copies, the function caches */
+	List	   *hashclauses;	/* are filled in by this thread */
+	Datum	   *values;
+	char	   *nulls;
+	MemoryContext parentcxt;
+	MemoryContext tuplecxt;
+} HJScanState;
 
 static TupleTableSlot *ExecHashJoinOuterGetTuple(Plan *node,
-						  HashJoinState *hjstate);
+						  HashJoinState *hjstate,
+						  uint32 *hashvalue);
 static TupleTableSlot *ExecHashJoinGetSavedTuple(HashJoinState *hjstate,
 						  BufFile *file,
+						  uint32 *hashvalue,
 						  TupleTableSlot *tupleSlot);
-static int	ExecHashJoinGetBatch(int bucketno, HashJoinTable hashtable);
 static int	ExecHashJoinNewBatch(HashJoinState *hjstate);
+static bool ExecHashJoinParallelBuild(HashJoin *node, HashJoinState *hjstate);
+static TupleTableSlot *ExecHashJoinParallel(HashJoin *node, HashJoinState *hjstate);
+static void ExecHashJoinParallelEnd(HashJoinState *hjstate);
+static bool hj_parallelscan(Plan *plan);
+static void *hj_parallelworker(void *arg);
+static void hj_parallelbuild(HJWorker *worker);
+static void hj_parallelprobe(HJWorker *worker);
+static void hj_parallelwait(HashJoinParallel shared, bool untildone);
+static bool hj_claimchunk(HashJoinParallel shared, long space,
+			  BlockNumber *start, BlockNumber *count);
+static void hj_initscanstate(HJScanState *state, HashJoinParallel shared,
+				 Plan *scan, TupleDesc scandesc);
+static List *hj_copyquals(List *quals);
+static bool hj_clearfcache(Node *node, void *context);
+static TupleTableSlot *hj_makeslot(TupleDesc desc);
+static HeapTuple hj_scantuple(HJScanState *state, HeapTuple htup);
+static void hj_parallelinsert(HJWorker *worker, HeapTuple heapTuple,
+				  uint32 hashvalue);
+static bool hj_exchangeput(HJWorker *worker, HeapTuple outer,
+			   HashJoinTuple inner);
+static bool hj_exchangeswitch(HJWorker *worker, bool last);
+static HJMatch *hj_nextmatch(HashJoinParallel shared);
 
 
 /* ----------------------------------------------------------------
@@ -48,18 +184,16 @@ ExecHashJoin(HashJoin *node)
 	Plan	   *outerNode;
 	Hash	   *hashNode;
 	List	   *hjclauses;
-	Expr	   *clause;
 	List	   *qual;
 //	ScanDirection dir;
 	TupleTableSlot *inntuple;
-	Var		   *outerVar;
 	ExprContext *econtext;
 	HashJoinTable hashtable;
 	HeapTuple	curtuple;
 	TupleTableSlot *outerTupleSlot;
 //	TupleTableSlot *innerTupleSlot;
-	Var		   *innerhashkey;
-	int			i;
+	uint32		hashvalue;
+	int			batchno;
 	bool		hashPhaseDone;
 
 	/* ----------------
@@ -68,7 +202,6 @@ ExecHashJoin(HashJoin *node)
 	 */
 	hjstate = node->hashjoinstate;
 	hjclauses = node->hashclauses;
-	clause = lfirst(hjclauses);
 //	estate = node->join.state;
 	qual = node->join.qual;
 	hashNode = (Hash *) innerPlan(node);
@@ -111,36 +244,32 @@ ExecHashJoin(HashJoin *node)
 			 * create the hash table
 			 * ----------------
 			 */
-			hashtable = ExecHashTableCreate(hashNode);
+			hashtable = ExecHashTableCreate(hashNode, hjclauses);
 			hjstate->hj_HashTable = hashtable;
-			innerhashkey = hashNode->hashkey;
-			hjstate->hj_InnerHashKey = innerhashkey;
 
 			/* ----------------
-			 * execute the Hash node, to build the hash table
+			 * execute the Hash node, to build the hash table,
+			 * unless the helpers build it in parallel
 			 * ----------------
 			 */
 			hashNode->hashstate->hashtable = hashtable;
-			ExecProcNode((Plan *) hashNode);
+			if (!ExecHashJoinParallelBuild(node, hjstate))
+				ExecProcNode((Plan *) hashNode);
+			hashtable->nbatch_outstart = hashtable->nbatch;
 		}
 		node->hashdone = true;
-		/* ----------------
-		 * Open temp files for outer batches, if needed.
-		 * Note that file buffers are palloc'd in regular executor context.
-		 * ----------------
-		 */
-		for (i = 0; i < hashtable->nbatch; i++)
-			hashtable->outerBatchFile[i] = BufFileCreateTemp();
 	}
 	else if (hashtable == NULL)
 		return NULL;
 
+	if (hjstate->hj_Parallel != NULL)
+		return ExecHashJoinParallel(node, hjstate);
+
 	/* ----------------
 	 *	Now get an outer tuple and probe into the hash table for matches
 	 * ----------------
 	 */
 	outerTupleSlot = hjstate->jstate.cs_OuterTupleSlot;
-	outerVar = get_leftop(clause);
 
 	for (;;)
 	{
@@ -150,7 +279,8 @@ ExecHashJoin(HashJoin *node)
 		 */
 		if (TupIsNull(outerTupleSlot))
 		{
-			outerTupleSlot = ExecHashJoinOuterGetTuple(outerNode,hjstate);
+			outerTupleSlot = ExecHashJoinOuterGetTuple(outerNode, hjstate,
+													   &hashvalue);
 			if (TupIsNull(outerTupleSlot))
 			{
 
@@ -167,35 +297,30 @@ ExecHashJoin(HashJoin *node)
 			 * for this tuple from the hash table
 			 */
 			econtext->ecxt_outertuple = outerTupleSlot;
-			hjstate->hj_CurBucketNo = ExecHashGetBucket(hashtable, econtext,outerVar);
+			hjstate->hj_CurHashValue = hashvalue;
+			ExecHashGetBucketAndBatch(hashtable, hashvalue,
+									  &hjstate->hj_CurBucketNo, &batchno);
 			hjstate->hj_CurTuple = NULL;
 
 			/* ----------------
 			 *	Now we've got an outer tuple and the corresponding hash bucket,
-			 *	but this tuple may not belong to the current batch.
-			 *	This need only be checked in the first pass.
+			 *	but this tuple may not belong to the current batch.  In a
+			 *	later pass this happens when the number of batches grew
+			 *	after the tuple was saved.
 			 * ----------------
 			 */
-			if (hashtable->curbatch == 0)
+			if (batchno != hashtable->curbatch)
 			{
-				int			batch = ExecHashJoinGetBatch(hjstate->hj_CurBucketNo,
-														 hashtable);
-
-				if (batch > 0)
-				{
-
-					/*
-					 * Need to postpone this outer tuple to a later batch.
-					 * Save it in the corresponding outer-batch file.
-					 */
-					int			batchno = batch - 1;
-
-					hashtable->outerBatchSize[batchno]++;
-					ExecHashJoinSaveTuple(outerTupleSlot->val,
-									 hashtable->outerBatchFile[batchno]);
-					ExecClearTuple(outerTupleSlot);
-					continue;	/* loop around for a new outer tuple */
-				}
+				/*
+				 * Need to postpone this outer tuple to a later batch.
+				 * Save it in the corresponding outer-batch file.
+				 */
+				Assert(batchno > hashtable->curbatch);
+				hashtable->outerBatchSize[batchno]++;
+				ExecHashJoinSaveTuple(outerTupleSlot->val, hashvalue,
+									  &hashtable->outerBatchFile[batchno]);
+				ExecClearTuple(outerTupleSlot);
+				continue;		/* loop around for a new outer tuple */
 			}
 		}
 
@@ -338,7 +463,8 @@ ExecInitHashJoin(HashJoin *node, EState *estate)
 	hjstate->hj_HashTable = (HashJoinTable) NULL;
 	hjstate->hj_CurBucketNo = 0;
 	hjstate->hj_CurTuple = (HashJoinTuple) NULL;
-	hjstate->hj_InnerHashKey = (Var *) NULL;
+	hjstate->hj_CurHashValue = 0;
+	hjstate->hj_Parallel = NULL;
 
 	hjstate->jstate.cs_OuterTupleSlot = (TupleTableSlot *) NULL;
 	hjstate->jstate.cs_TupFromTlist = (bool) false;
@@ -372,9 +498,12 @@ ExecEndHashJoin(HashJoin *node)
 	hjstate = node->hashjoinstate;
 
 	/* ----------------
-	 * free hash table in case we end plan before all tuples are retrieved
+	 * free hash table in case we end plan before all tuples are retrieved,
+	 * the helpers must be stopped first
 	 * ---------------
 	 */
+	if (hjstate->hj_Parallel)
+		ExecHashJoinParallelEnd(hjstate);
 	if (hjstate->hj_HashTable)
 	{
 		ExecHashTableDestroy(hjstate->hj_HashTable);
@@ -414,22 +543,42 @@ ExecEndHashJoin(HashJoin *node)
  *
  *		get the next outer tuple for hashjoin: either by
  *		executing a plan node as in the first pass, or from
- *		the tmp files for the hashjoin batches.
+ *		the tmp files for the hashjoin batches.  The hash value
+ *		of the tuple goes to *hashvalue.
+ *
+ *		In the first pass, tuples with a null key and tuples whose
+ *		hash value misses the bloom filter cannot join and are
+ *		skipped.  The filter is only consulted when the join has
+ *		batches, it is what keeps such tuples out of the batch files.
  * ----------------------------------------------------------------
  */
 
 static TupleTableSlot *
-ExecHashJoinOuterGetTuple(Plan *node, HashJoinState *hjstate)
+ExecHashJoinOuterGetTuple(Plan *node, HashJoinState *hjstate,
+						  uint32 *hashvalue)
 {
 	HashJoinTable hashtable = hjstate->hj_HashTable;
 	int			curbatch = hashtable->curbatch;
+	ExprContext *econtext = hjstate->jstate.cs_ExprContext;
 	TupleTableSlot *slot;
 
 	if (curbatch == 0)
 	{							/* if it is the first pass */
-		slot = ExecProcNode(node);
-		if (!TupIsNull(slot))
+		for (;;)
+		{
+			slot = ExecProcNode(node);
+			if (TupIsNull(slot))
+				break;
+
+			econtext->ecxt_outertuple = slot;
+			if (!ExecHashGetHashValue(hashtable, econtext,
+									  hashtable->outerkeys, hashvalue))
+				continue;
+			if (hashtable->nbatch > 1 &&
+				!ExecHashBloomTest(hashtable, *hashvalue))
+				continue;
 			return slot;
+		}
 
 		/*
 		 * We have just reached the end of the first pass. Try to switch
@@ -442,13 +591,17 @@ ExecHashJoinOuterGetTuple(Plan *node, HashJoinState *hjstate)
 	 * Try to read from a temp file. Loop allows us to advance to new
 	 * batch as needed.
 	 */
-	while (curbatch <= hashtable->nbatch)
+	while (curbatch < hashtable->nbatch)
 	{
-		slot = ExecHashJoinGetSavedTuple(hjstate,
-								 hashtable->outerBatchFile[curbatch - 1],
-										 hjstate->hj_OuterTupleSlot);
-		if (!TupIsNull(slot))
-			return slot;
+		if (hashtable->outerBatchFile[curbatch] != NULL)
+		{
+			slot = ExecHashJoinGetSavedTuple(hjstate,
+											 hashtable->outerBatchFile[curbatch],
+											 hashvalue,
+											 hjstate->hj_OuterTupleSlot);
+			if (!TupIsNull(slot))
+				return slot;
+		}
 		curbatch = ExecHashJoinNewBatch(hjstate);
 	}
 
@@ -466,15 +619,19 @@ ExecHashJoinOuterGetTuple(Plan *node, HashJoinState *hjstate)
 static TupleTableSlot *
 ExecHashJoinGetSavedTuple(HashJoinState *hjstate,
 						  BufFile *file,
+						  uint32 *hashvalue,
 						  TupleTableSlot *tupleSlot)
 {
 	HeapTupleData htup;
 	size_t		nread;
 	HeapTuple	heapTuple;
 
-	nread = BufFileRead(file, (void *) &htup, sizeof(HeapTupleData));
+	nread = BufFileRead(file, (void *) hashvalue, sizeof(uint32));
 	if (nread == 0)
 		return NULL;			/* end of file */
+	if (nread != sizeof(uint32))
+		elog(ERROR, "Read from hashjoin temp file failed");
+	nread = BufFileRead(file, (void *) &htup, sizeof(HeapTupleData));
 	if (nread != sizeof(HeapTupleData))
 		elog(ERROR, "Read from hashjoin temp file failed");
 	heapTuple = palloc(HEAPTUPLESIZE + htup.t_len);
@@ -500,125 +657,125 @@ static int
 ExecHashJoinNewBatch(HashJoinState *hjstate)
 {
 	HashJoinTable hashtable = hjstate->hj_HashTable;
-	int			nbatch = hashtable->nbatch;
 	int			newbatch = hashtable->curbatch + 1;
-	long	   *innerBatchSize = hashtable->innerBatchSize;
-	long	   *outerBatchSize = hashtable->outerBatchSize;
 	BufFile    *innerFile;
 	TupleTableSlot *slot;
-	ExprContext *econtext;
-	Var		   *innerhashkey;
+	uint32		hashvalue;
 
-	if (newbatch > 1)
+	if (newbatch > 1 && hashtable->outerBatchFile[newbatch - 1] != NULL)
 	{
 
 		/*
 		 * We no longer need the previous outer batch file; close it right
 		 * away to free disk space.
 		 */
-		BufFileClose(hashtable->outerBatchFile[newbatch - 2]);
-		hashtable->outerBatchFile[newbatch - 2] = NULL;
+		BufFileClose(hashtable->outerBatchFile[newbatch - 1]);
+		hashtable->outerBatchFile[newbatch - 1] = NULL;
 	}
 
 	/* --------------
-	 *	We can skip over any batches that are empty on either side.
-	 *	Release associated temp files right away.
+	 *	We can skip over any batches that are empty on either side and
+	 *	release their temp files right away, but only while the other
+	 *	side's file cannot hold tuples of a later batch.  Once nbatch
+	 *	has grown, a file written before the growth may hold tuples of
+	 *	batch newbatch + the old nbatch, which are re-routed as the
+	 *	file is read and must not be thrown away.
 	 * --------------
 	 */
-	while (newbatch <= nbatch &&
-		   (innerBatchSize[newbatch - 1] == 0L ||
-			outerBatchSize[newbatch - 1] == 0L))
+	while (newbatch < hashtable->nbatch &&
+		   (hashtable->innerBatchSize[newbatch] == 0L ||
+			hashtable->outerBatchSize[newbatch] == 0L))
 	{
-		BufFileClose(hashtable->innerBatchFile[newbatch - 1]);
-		hashtable->innerBatchFile[newbatch - 1] = NULL;
-		BufFileClose(hashtable->outerBatchFile[newbatch - 1]);
-		hashtable->outerBatchFile[newbatch - 1] = NULL;
+		if (hashtable->outerBatchSize[newbatch] != 0L &&
+			hashtable->nbatch != hashtable->nbatch_outstart)
+			break;
+		if (hashtable->innerBatchSize[newbatch] != 0L &&
+			hashtable->nbatch != hashtable->nbatch_original)
+			break;
+		if (hashtable->innerBatchFile[newbatch] != NULL)
+			BufFileClose(hashtable->innerBatchFile[newbatch]);
+		hashtable->innerBatchFile[newbatch] = NULL;
+		if (hashtable->outerBatchFile[newbatch] != NULL)
+			BufFileClose(hashtable->outerBatchFile[newbatch]);
+		hashtable->outerBatchFile[newbatch] = NULL;
 		newbatch++;
 	}
 
-	if (newbatch > nbatch)
+	hashtable->curbatch = newbatch;
+	if (newbatch >= hashtable->nbatch)
 		return newbatch;		/* no more batches */
 
 	/*
 	 * Rewind inner and outer batch files for this batch, so that we can
-	 * start reading them.
+	 * start reading them.  Either may be missing when the batch is only
+	 * kept for the tuples that are passed on.
 	 */
-	if (BufFileSeek(hashtable->outerBatchFile[newbatch - 1], 0L, SEEK_SET))
+	if (hashtable->outerBatchFile[newbatch] != NULL &&
+		BufFileSeek(hashtable->outerBatchFile[newbatch], 0L, SEEK_SET))
 		elog(ERROR, "Failed to rewind hash temp file");
 
-	innerFile = hashtable->innerBatchFile[newbatch - 1];
+	innerFile = hashtable->innerBatchFile[newbatch];
 
-	if (BufFileSeek(innerFile,  0L, SEEK_SET))
+	if (innerFile != NULL && BufFileSeek(innerFile,  0L, SEEK_SET))
 		elog(ERROR, "Failed to rewind hash temp file");
 
 	/*
-	 * Reload the hash table with the new inner batch
+	 * Reload the hash table with the new inner batch.  Should the batch
+	 * outgrow SortMem, the number of batches doubles and part of it goes
+	 * on to a later batch.
 	 */
-	ExecHashTableReset(hashtable, innerBatchSize[newbatch - 1]);
-
-	econtext = hjstate->jstate.cs_ExprContext;
-	innerhashkey = hjstate->hj_InnerHashKey;
+	ExecHashTableReset(hashtable, hashtable->innerBatchSize[newbatch]);
 
-	while ((slot = ExecHashJoinGetSavedTuple(hjstate,
+	while (innerFile != NULL &&
+		   (slot = ExecHashJoinGetSavedTuple(hjstate,
 											 innerFile,
+											 &hashvalue,
 											 hjstate->hj_HashTupleSlot))
 		   && !TupIsNull(slot))
 	{
-		econtext->ecxt_innertuple = slot;
-		ExecHashTableInsert(hashtable, econtext, innerhashkey);
+		ExecHashTableInsert(hashtable, slot->val, hashvalue);
 	}
 
 	/*
 	 * after we build the hash table, the inner batch file is no longer
 	 * needed
 	 */
-	BufFileClose(innerFile);
-	hashtable->innerBatchFile[newbatch - 1] = NULL;
+	if (innerFile != NULL)
+		BufFileClose(innerFile);
+	hashtable->innerBatchFile[newbatch] = NULL;
 
-	hashtable->curbatch = newbatch;
 	return newbatch;
 }
 
-/* ----------------------------------------------------------------
- *		ExecHashJoinGetBatch
- *
- *		determine the batch number for a bucketno
- *		+----------------+-------+-------+ ... +-------+
- *		0			  nbuckets						 totalbuckets
- * batch		 0			 1		 2	   ...
- * ----------------------------------------------------------------
- */
-static int
-ExecHashJoinGetBatch(int bucketno, HashJoinTable hashtable)
-{
-	int			b;
-
-	if (bucketno < hashtable->nbuckets || hashtable->nbatch == 0)
-		return 0;
-
-	b = (hashtable->nbatch * (bucketno - hashtable->nbuckets)) /
-		(hashtable->totalbuckets - hashtable->nbuckets);
-	return b + 1;
-}
-
 /* ----------------------------------------------------------------
  *		ExecHashJoinSaveTuple
  *
- *		save a tuple to a tmp file.
+ *		save a tuple to a tmp file, creating the file if *fileptr
+ *		is still NULL.
  *
- * The data recorded in the file for each tuple is an image of its
- * HeapTupleData (with meaningless t_data pointer) followed by the
- * HeapTupleHeader and tuple data.
+ * The data recorded in the file for each tuple is its hash value, an
+ * image of its HeapTupleData (with meaningless t_data pointer) followed
+ * by the HeapTupleHeader and tuple data.
  * ----------------------------------------------------------------
  */
 
 void
-ExecHashJoinSaveTuple(HeapTuple heapTuple,BufFile *file)
+ExecHashJoinSaveTuple(HeapTuple heapTuple, uint32 hashvalue, BufFile **fileptr)
 {
+	BufFile    *file = *fileptr;
 	size_t		written;
 
-	written = BufFileWrite(file, (void *) heapTuple, sizeof(HeapTupleData));
+	if (file == NULL)
+	{
+		/* First write to this batch file, so open it. */
+		file = BufFileCreateTemp();
+		*fileptr = file;
+	}
 
+	written = BufFileWrite(file, (void *) &hashvalue, sizeof(uint32));
+	if (written != sizeof(uint32))
+		elog(ERROR, "Write to hashjoin temp file failed");
+	written = BufFileWrite(file, (void *) heapTuple, sizeof(HeapTupleData));
 	if (written != sizeof(HeapTupleData))
 		elog(ERROR, "Write to hashjoin temp file failed");
 	written = BufFileWrite(file, (void *) heapTuple->t_data, heapTuple->t_len);
@@ -640,6 +797,8 @@ ExecReScanHashJoin(HashJoin *node, ExprContext *exprCtxt)
 	 * Unfortunately, currently we have to destroy hashtable in all
 	 * cases...
 	 */
+	if (hjstate->hj_Parallel)
+		ExecHashJoinParallelEnd(hjstate);
 	if (hjstate->hj_HashTable)
 	{
 		ExecHashTableDestroy(hjstate->hj_HashTable);
@@ -648,7 +807,7 @@ ExecReScanHashJoin(HashJoin *node, ExprContext *exprCtxt)
 
 	hjstate->hj_CurBucketNo = 0;
 	hjstate->hj_CurTuple = (HashJoinTuple) NULL;
-	hjstate->hj_InnerHashKey = (Var *) NULL;
+	hjstate->hj_CurHashValue = 0;
 
 	hjstate->jstate.cs_OuterTupleSlot = (TupleTableSlot *) NULL;
 	hjstate->jstate.cs_TupFromTlist = (bool) false;
@@ -662,3 +821,745 @@ ExecReScanHashJoin(HashJoin *node, ExprContext *exprCtxt)
 	if (((Plan *) node)->righttree->chgParam == NULL)
 		ExecReScan(((Plan *) node)->righttree, exprCtxt);
 }
+
+/* ----------------------------------------------------------------
+ *		ExecHashJoinParallelBuild
+ *
+ *		start the helpers of a parallel join and build the hash table
+ *		with them.  Returns false when the join has to run serially,
+ *		the hash table is empty then.  On success the helpers have
+ *		moved on to probing.
+ * ----------------------------------------------------------------
+ */
+static bool
+ExecHashJoinParallelBuild(HashJoin *node, HashJoinState *hjstate)
+{
+	HashJoinTable hashtable = hjstate->hj_HashTable;
+	Plan	   *innerscan = outerPlan((Plan *) innerPlan(node));
+	Plan	   *outerscan = outerPlan((Plan *) node);
+	EState	   *estate = node->join.state;
+	HashJoinParallel shared;
+	MemoryContext oldcxt;
+	int			nworkers = node->parallel;
+	int			i;
+
+	if (nworkers <= 0 || hashtable->nbatch > 1)
+		return false;
+	if (!hj_parallelscan(innerscan) || !hj_parallelscan(outerscan))
+		return false;
+	if (nworkers > HJ_PARALLEL_MAX_WORKERS)
+		nworkers = HJ_PARALLEL_MAX_WORKERS;
+
+	oldcxt = MemoryContextSwitchTo(hashtable->hashCxt);
+
+	shared = (HashJoinParallel) palloc(sizeof(HashJoinParallelData));
+	MemSet(shared, 0, sizeof(HashJoinParallelData));
+	shared->hashtable = hashtable;
+	shared->cxt = hashtable->hashCxt;
+	shared->snapshot = estate->es_snapshot;
+	shared->params = estate->es_param_list_info;
+	shared->paramexec = estate->es_param_exec_vals;
+	shared->rangetable = estate->es_range_table;
+	shared->innerscan = innerscan;
+	shared->outerscan = outerscan;
+	shared->innerrelid = RelationGetRelid(((SeqScan *) innerscan)->scanstate->css_currentRelation);
+	shared->outerrelid = RelationGetRelid(((SeqScan *) outerscan)->scanstate->css_currentRelation);
+	shared->hashclauses = node->hashclauses;
+	shared->phase = HJ_PHASE_BUILD;
+	shared->nblocks = RelationGetNumberOfBlocks(((SeqScan *) innerscan)->scanstate->css_currentRelation);
+	shared->nextblock = 0;
+
+	shared->workers[0].shared = shared;
+	shared->workers[0].tuplecxt = AllocSetContextCreate(hashtable->batchCxt,
+														"ParallelHashContext",
+												   ALLOCSET_DEFAULT_MINSIZE,
+												  ALLOCSET_DEFAULT_INITSIZE,
+												  ALLOCSET_DEFAULT_MAXSIZE);
+
+	for (i = 0; i < nworkers; i++)
+	{
+		DolConnection conn = GetDolConnection();
+		HJWorker   *worker;
+
+		if (conn == NULL)
+			break;
+
+		worker = &shared->workers[++shared->nworkers];
+		worker->shared = shared;
+		worker->conn = conn;
+		worker->tuplecxt = AllocSetContextCreate(hashtable->batchCxt,
+												 "ParallelHashContext",
+												 ALLOCSET_DEFAULT_MINSIZE,
+												 ALLOCSET_DEFAULT_INITSIZE,
+												 ALLOCSET_DEFAULT_MAXSIZE);
+		worker->exchange[0].data = palloc(HJ_EXCHANGE_SIZE);
+		worker->exchange[1].data = palloc(HJ_EXCHANGE_SIZE);
+	}
+
+	MemoryContextSwitchTo(oldcxt);
+
+	if (shared->nworkers == 0)
+	{
+		/* no helper free, nothing gained over the serial join */
+		MemoryContextDelete(shared->workers[0].tuplecxt);
+		pfree(shared);
+		return false;
+	}
+
+	pthread_mutex_init(&shared->guard, NULL);
+	pthread_cond_init(&shared->gate, NULL);
+	for (i = 0; i < HJ_PARALLEL_STRIPES; i++)
+		pthread_mutex_init(&shared->stripes[i], NULL);
+
+	hjstate->hj_Parallel = shared;
+	for (i = 1; i <= shared->nworkers; i++)
+		ProcessDolCommand(shared->workers[i].conn, hj_parallelworker, &shared->workers[i]);
+
+	hj_parallelbuild(&shared->workers[0]);
+
+	hj_parallelwait(shared, false);
+
+	if (shared->overflow)
+	{
+		/*
+		 * the inner relation is larger than the plan expected, start over
+		 * serially so that the join can batch
+		 */
+		ExecHashJoinParallelEnd(hjstate);
+		ExecHashTableReset(hashtable, 0L);
+		return false;
+	}
+
+	pthread_mutex_lock(&shared->guard);
+	hashtable->spaceUsed = 0;
+	for (i = 0; i <= shared->nworkers; i++)
+		hashtable->spaceUsed += shared->workers[i].spaceUsed;
+	shared->phase = HJ_PHASE_PROBE;
+	shared->nextblock = 0;
+	shared->nblocks = RelationGetNumberOfBlocks(((SeqScan *) outerscan)->scanstate->css_currentRelation);
+	shared->current = 1;
+	pthread_cond_broadcast(&shared->gate);
+	pthread_mutex_unlock(&shared->guard);
+
+	return true;
+}
+
+/* ----------------------------------------------------------------
+ *		ExecHashJoinParallel
+ *
+ *		return the next joined tuple of a parallel join.  The helpers
+ *		have matched on the hash clauses, the join qual is checked here.
+ * ----------------------------------------------------------------
+ */
+static TupleTableSlot *
+ExecHashJoinParallel(HashJoin *node, HashJoinState *hjstate)
+{
+	ExprContext *econtext = hjstate->jstate.cs_ExprContext;
+	List	   *qual = node->join.qual;
+	HJMatch    *match;
+
+	while ((match = hj_nextmatch(hjstate->hj_Parallel)) != NULL)
+	{
+		TupleTableSlot *outerTupleSlot;
+
+		outerTupleSlot = ExecStoreTuple(&match->outer, hjstate->hj_OuterTupleSlot, false);
+		econtext->ecxt_outertuple = outerTupleSlot;
+		econtext->ecxt_innertuple = ExecStoreTuple(&match->inner->htup,
+												   hjstate->hj_HashTupleSlot,
+												   false);
+
+		if (ExecQual(qual, econtext, false))
+		{
+			TupleTableSlot *result;
+			bool		isDone;
+
+			hjstate->jstate.cs_OuterTupleSlot = outerTupleSlot;
+			result = ExecProject(hjstate->jstate.cs_ProjInfo, &isDone);
+			hjstate->jstate.cs_TupFromTlist = !isDone;
+			return result;
+		}
+	}
+
+	ExecHashJoinParallelEnd(hjstate);
+	ExecHashTableDestroy(hjstate->hj_HashTable);
+	hjstate->hj_HashTable = NULL;
+	return NULL;
+}
+
+/* ----------------------------------------------------------------
+ *		ExecHashJoinParallelEnd
+ *
+ *		stop the helpers and wait until they have let go of the hash
+ *		table and the exchanges.
+ * ----------------------------------------------------------------
+ */
+static void
+ExecHashJoinParallelEnd(HashJoinState *hjstate)
+{
+	HashJoinParallel shared = hjstate->hj_Parallel;
+	int			i;
+
+	pthread_mutex_lock(&shared->guard);
+	shared->phase = HJ_PHASE_STOP;
+	pthread_cond_broadcast(&shared->gate);
+	pthread_mutex_unlock(&shared->guard);
+
+	hjstate->hj_Parallel = NULL;
+	hj_parallelwait(shared, true);
+
+	pthread_cond_destroy(&shared->gate);
+	pthread_mutex_destroy(&shared->guard);
+	for (i = 0; i < HJ_PARALLEL_STRIPES; i++)
+		pthread_mutex_destroy(&shared->stripes[i]);
+
+	for (i = 1; i <= shared->nworkers; i++)
+	{
+		pfree(shared->workers[i].exchange[0].data);
+		pfree(shared->workers[i].exchange[1].data);
+	}
+	pfree(shared);
+}
+
+/*
+ * a scan the helpers can divide: a sequential scan of a relation with
+ * no subplans whose target list only picks columns
+ */
+static bool
+hj_parallelscan(Plan *plan)
+{
+	List	   *tl;
+
+	if (plan == NULL || nodeTag(plan) != T_SeqScan)
+		return false;
+	if (outerPlan(plan) != NULL || plan->subPlan != NIL || plan->targetlist == NIL)
+		return false;
+	if (((SeqScan *) plan)->scanstate->css_currentRelation == NULL)
+		return false;
+
+	foreach(tl, plan->targetlist)
+	{
+		TargetEntry *tle = (TargetEntry *) lfirst(tl);
+
+		if (tle->expr == NULL || !IsA(tle->expr, Var) ||
+			((Var *) tle->expr)->varattno == InvalidAttrNumber)
+			return false;
+	}
+	return true;
+}
+
+/*
+ * wait for the helpers to finish the build, or with untildone to be done
+ * altogether.  A helper that errors out goes back to waiting without
+ * finishing.
+ */
+static void
+hj_parallelwait(HashJoinParallel shared, bool untildone)
+{
+	int			i;
+
+	pthread_mutex_lock(&shared->guard);
+	for (i = 1; i <= shared->nworkers; i++)
+	{
+		HJWorker   *worker = &shared->workers[i];
+
+		while (!(untildone ? worker->done : worker->built))
+		{
+			struct timespec waittime;
+
+			ptimeout(&waittime, 1000);
+			if (pthread_cond_timedwait(&shared->gate, &shared->guard, &waittime) == ETIMEDOUT &&
+				!(untildone ? worker->done : worker->built) &&
+				!IsDolConnectionRunning(worker->conn))
+			{
+				pthread_mutex_unlock(&shared->guard);
+				elog(ERROR, "parallel hash join worker stopped before finishing");
+			}
+		}
+	}
+	pthread_mutex_unlock(&shared->guard);
+}
+
+/*
+ * body of a helper, it builds with the main thread, waits for the
+ * others and then probes until the outer relation is used up.
+ */
+static void *
+hj_parallelworker(void *arg)
+{
+	HJWorker   *worker = (HJWorker *) arg;
+	HashJoinParallel shared = worker->shared;
+	bool		probe;
+
+	hj_parallelbuild(worker);
+
+	pthread_mutex_lock(&shared->guard);
+	worker->built = true;
+	pthread_cond_broadcast(&shared->gate);
+	while (shared->phase == HJ_PHASE_BUILD)
+	{
+		struct timespec waittime;
+
+		ptimeout(&waittime, 1000);
+		pthread_cond_timedwait(&shared->gate, &shared->guard, &waittime);
+		if (CheckForCancel())
+		{
+			pthread_mutex_unlock(&shared->guard);
+			elog(ERROR, "Query Cancelled");
+		}
+	}
+	probe = (shared->phase == HJ_PHASE_PROBE);
+	pthread_mutex_unlock(&shared->guard);
+
+	if (probe)
+		hj_parallelprobe(worker);
+
+	pthread_mutex_lock(&shared->guard);
+	worker->done = true;
+	pthread_cond_broadcast(&shared->gate);
+	pthread_mutex_unlock(&shared->guard);
+
+	return NULL;
+}
+
+/*
+ * claim chunks of the inner relation and add what passes the scan qual
+ * to the table.
+ */
+static void
+hj_parallelbuild(HJWorker *worker)
+{
+	HashJoinParallel shared = worker->shared;
+	HashJoinTable hashtable = shared->hashtable;
+	Relation	rel = heap_open(shared->innerrelid, AccessShareLock);
+	HeapScanDesc scan = heap_beginscan(rel, shared->snapshot, 0, NULL);
+	HJScanState state;
+	HeapTuple	htup;
+	BlockNumber start;
+	BlockNumber count;
+	long		reported = 0;
+
+	hj_initscanstate(&state, shared, shared->innerscan, RelationGetDescr(rel));
+	state.econtext->ecxt_innertuple = state.projslot;
+
+	while (hj_claimchunk(shared, worker->spaceUsed - reported, &start, &count))
+	{
+		reported = worker->spaceUsed;
+		heap_setscanlimits(scan, start, count);
+		while (HeapTupleIsValid(htup = heap_getnext(scan)))
+		{
+			HeapTuple	tuple;
+			uint32		hashvalue;
+
+			if (CheckForCancel())
+				elog(ERROR, "Query Cancelled");
+
+			MemoryContextResetAndDeleteChildren(state.tuplecxt);
+			MemoryContextSwitchTo(state.tuplecxt);
+
+			tuple = hj_scantuple(&state, htup);
+			if (tuple != NULL &&
+				ExecHashGetHashValue(hashtable, state.econtext,
+									 hashtable->innerkeys, &hashvalue))
+				hj_parallelinsert(worker, tuple, hashvalue);
+		}
+	}
+
+	MemoryContextSwitchTo(state.parentcxt);
+	MemoryContextDelete(state.tuplecxt);
+
+	heap_endscan(scan);
+	heap_close(rel, AccessShareLock);
+}
+
+/*
+ * claim chunks of the outer relation and hand every match with the
+ * hash clauses to the main thread.
+ */
+static void
+hj_parallelprobe(HJWorker *worker)
+{
+	HashJoinParallel shared = worker->shared;
+	HashJoinTable hashtable = shared->hashtable;
+	Relation	rel = heap_open(shared->outerrelid, AccessShareLock);
+	HeapScanDesc scan = heap_beginscan(rel, shared->snapshot, 0, NULL);
+	HJScanState state;
+	HeapTuple	htup;
+	BlockNumber start;
+	BlockNumber count;
+	bool		stopped = false;
+
+	hj_initscanstate(&state, shared, shared->outerscan, RelationGetDescr(rel));
+	state.econtext->ecxt_outertuple = state.projslot;
+	state.econtext->ecxt_innertuple = state.innerslot;
+
+	while (!stopped && hj_claimchunk(shared, 0, &start, &count))
+	{
+		heap_setscanlimits(scan, start, count);
+		while (!stopped && HeapTupleIsValid(htup = heap_getnext(scan)))
+		{
+			HeapTuple	tuple;
+			HashJoinTuple hashTuple;
+			uint32		hashvalue;
+			int			bucketno;
+			int			batchno;
+
+			if (CheckForCancel())
+				elog(ERROR, "Query Cancelled");
+
+			MemoryContextResetAndDeleteChildren(state.tuplecxt);
+			MemoryContextSwitchTo(state.tuplecxt);
+
+			tuple = hj_scantuple(&state, htup);
+			if (tuple == NULL ||
+				!ExecHashGetHashValue(hashtable, state.econtext,
+									  hashtable->outerkeys, &hashvalue))
+				continue;
+
+			ExecHashGetBucketAndBatch(hashtable, hashvalue, &bucketno, &batchno);
+			for (hashTuple = hashtable->buckets[bucketno];
+				 hashTuple != NULL && !stopped;
+				 hashTuple = hashTuple->next)
+			{
+				if (hashTuple->hashvalue != hashvalue)
+					continue;
+				ExecStoreTuple(&hashTuple->htup, state.innerslot, false);
+				if (ExecQual(state.hashclauses, state.econtext, false))
+					stopped = !hj_exchangeput(worker, tuple, hashTuple);
+			}
+		}
+	}
+
+	MemoryContextSwitchTo(state.parentcxt);
+	MemoryContextDelete(state.tuplecxt);
+
+	heap_endscan(scan);
+	heap_close(rel, AccessShareLock);
+
+	/* hand over what is left */
+	if (!stopped && worker->exchange[worker->filling].used > 0)
+		hj_exchangeswitch(worker, true);
+}
+
+/*
+ * the next chunk of the relation of the current phase.  space is what
+ * the caller added to the table since its last claim, no more chunks
+ * are given out once the table has grown too large.
+ */
+static bool
+hj_claimchunk(HashJoinParallel shared, long space, BlockNumber *start, BlockNumber *count)
+{
+	bool		claimed = false;
+
+	pthread_mutex_lock(&shared->guard);
+	shared->spaceUsed += space;
+	if (shared->phase == HJ_PHASE_BUILD &&
+		shared->spaceUsed > shared->hashtable->spaceAllowed)
+		shared->overflow = true;
+
+	if (shared->phase != HJ_PHASE_STOP && !shared->overflow &&
+		shared->nextblock < shared->nblocks)
+	{
+		*start = shared->nextblock;
+		/* the last chunk runs to the end of the relation */
+		if (shared->nblocks - shared->nextblock > HJ_PARALLEL_CHUNK_BLOCKS)
+			*count = HJ_PARALLEL_CHUNK_BLOCKS;
+		else
+			*count = InvalidBlockNumber - *start;
+		shared->nextblock += HJ_PARALLEL_CHUNK_BLOCKS;
+		claimed = true;
+	}
+	pthread_mutex_unlock(&shared->guard);
+
+	return claimed;
+}
+
+/*
+ * set up the expression context and slots of one thread.  The quals are
+ * copied into the current context, the function caches of the plan's
+ * own quals belong to the main thread.
+ */
+static void
+hj_initscanstate(HJScanState *state, HashJoinParallel shared, Plan *scan, TupleDesc scandesc)
+{
+	ExprContext *econtext = makeNode(ExprContext);
+	TupleDesc	projdesc = ExecGetTupType(scan);
+
+	econtext->ecxt_param_list_info = shared->params;
+	econtext->ecxt_param_exec_vals = shared->paramexec;
+	econtext->ecxt_range_table = shared->rangetable;
+
+	state->econtext = econtext;
+	state->scanslot = hj_makeslot(scandesc);
+	state->projslot = hj_makeslot(projdesc);
+	state->innerslot = hj_makeslot(ExecGetTupType(shared->innerscan));
+	state->tlist = scan->targetlist;
+	state->qual = hj_copyquals(scan->qual);
+	state->hashclauses = hj_copyquals(shared->hashclauses);
+	state->values = (Datum *) palloc(projdesc->natts * sizeof(Datum));
+	state->nulls = (char *) palloc(projdesc->natts * sizeof(char));
+	state->parentcxt = MemoryContextGetCurrentContext();
+	state->tuplecxt = SubSetContextCreate(state->parentcxt, "ParallelHashTupleContext");
+}
+
+static List *
+hj_copyquals(List *quals)
+{
+	List	   *copy = (List *) copyObject(quals);
+
+	hj_clearfcache((Node *) copy, NULL);
+	return copy;
+}
+
+static bool
+hj_clearfcache(Node *node, void *context)
+{
+	if (node == NULL)
+		return false;
+	if (IsA(node, Expr))
+	{
+		Node	   *oper = ((Expr *) node)->oper;
+
+		if (oper != NULL && IsA(oper, Oper))
+			((Oper *) oper)->op_fcache = NULL;
+		else if (oper != NULL && IsA(oper, Func))
+			((Func *) oper)->func_fcache = NULL;
+	}
+	return expression_tree_walker(node, hj_clearfcache, context);
+}
+
+static TupleTableSlot *
+hj_makeslot(TupleDesc desc)
+{
+	TupleTableSlot *slot = makeNode(TupleTableSlot);
+
+	slot->ttc_tupleDescriptor = desc;
+	slot->ttc_descIsNew = true;
+	return slot;
+}
+
+/*
+ * apply the scan qual to a heap tuple and project it the way the scan
+ * node would.  NULL if the qual fails.
+ */
+static HeapTuple
+hj_scantuple(HJScanState *state, HeapTuple htup)
+{
+	ExprContext *econtext = state->econtext;
+	HeapTuple	tuple;
+	List	   *tl;
+
+	econtext->ecxt_scantuple = ExecStoreTuple(htup, state->scanslot, false);
+	if (state->qual != NIL && !ExecQual(state->qual, econtext, false))
+		return NULL;
+
+	foreach(tl, state->tlist)
+	{
+		TargetEntry *tle = (TargetEntry *) lfirst(tl);
+		int			resno = tle->resdom->resno - 1;
+		bool		isNull;
+		bool		byval;
+		int			length;
+
+		state->values[resno] = ExecEvalVar((Var *) tle->expr, econtext,
+										   &isNull, &byval, &length);
+		state->nulls[resno] = (isNull) ? 'n' : ' ';
+	}
+
+	tuple = heap_formtuple(state->projslot->ttc_tupleDescriptor,
+						   state->values, state->nulls);
+	ExecStoreTuple(tuple, state->projslot, false);
+	return tuple;
+}
+
+/*
+ * link a tuple into the shared table, the stripe lock of its bucket
+ * keeps the other builders out of the chain.
+ */
+static void
+hj_parallelinsert(HJWorker *worker, HeapTuple heapTuple, uint32 hashvalue)
+{
+	HashJoinParallel shared = worker->shared;
+	HashJoinTable hashtable = shared->hashtable;
+	HashJoinTuple hashTuple;
+	pthread_mutex_t *stripe;
+	int			hashTupleSize;
+	int			bucketno;
+	int			batchno;
+
+	ExecHashGetBucketAndBatch(hashtable, hashvalue, &bucketno, &batchno);
+
+	hashTupleSize = MAXALIGN(sizeof(*hashTuple)) + heapTuple->t_len;
+	hashTuple = (HashJoinTuple) MemoryContextAlloc(worker->tuplecxt,
+												   hashTupleSize);
+	hashTuple->hashvalue = hashvalue;
+	memcpy((char *) &hashTuple->htup,
+		   (char *) heapTuple,
+		   sizeof(hashTuple->htup));
+	hashTuple->htup.t_datamcxt = hashtable->batchCxt;
+	hashTuple->htup.t_datasrc = NULL;
+	hashTuple->htup.t_info = 0;
+	hashTuple->htup.t_data = (HeapTupleHeader)
+		(((char *) hashTuple) + MAXALIGN(sizeof(*hashTuple)));
+	memcpy((char *) hashTuple->htup.t_data,
+		   (char *) heapTuple->t_data,
+		   heapTuple->t_len);
+
+	stripe = &shared->stripes[bucketno & (HJ_PARALLEL_STRIPES - 1)];
+	pthread_mutex_lock(stripe);
+	hashTuple->next = hashtable->buckets[bucketno];
+	hashtable->buckets[bucketno] = hashTuple;
+	pthread_mutex_unlock(stripe);
+
+	worker->spaceUsed += hashTupleSize;
+}
+
+/*
+ * copy a match into the exchange being filled.  false once the main
+ * thread has stopped the join.
+ */
+static bool
+hj_exchangeput(HJWorker *worker, HeapTuple outer, HashJoinTuple inner)
+{
+	HJExchange *xchg = &worker->exchange[worker->filling];
+	Size		len = MAXALIGN(sizeof(HJMatch)) + MAXALIGN(outer->t_len);
+	HJMatch    *match;
+
+	if (len > HJ_EXCHANGE_SIZE)
+		elog(ERROR, "parallel hash join: tuple of %u bytes is too large", outer->t_len);
+
+	if (xchg->used + len > HJ_EXCHANGE_SIZE)
+	{
+		if (!hj_exchangeswitch(worker, false))
+			return false;
+		xchg = &worker->exchange[worker->filling];
+	}
+
+	match = (HJMatch *) (xchg->data + xchg->used);
+	match->inner = inner;
+	memcpy((char *) &match->outer, (char *) outer, sizeof(HeapTupleData));
+	memcpy(((char *) match) + MAXALIGN(sizeof(HJMatch)),
+		   (char *) outer->t_data,
+		   outer->t_len);
+	xchg->used += len;
+
+	return true;
+}
+
+/*
+ * pass the exchange being filled to the main thread and wait for the
+ * other one to be emptied, unless this is the last.  false once the
+ * main thread has stopped the join.
+ */
+static bool
+hj_exchangeswitch(HJWorker *worker, bool last)
+{
+	HashJoinParallel shared = worker->shared;
+	bool		stopped;
+
+	pthread_mutex_lock(&shared->guard);
+	worker->exchange[worker->filling].full = true;
+	pthread_cond_broadcast(&shared->gate);
+	worker->filling = 1 - worker->filling;
+	while (!last && worker->exchange[worker->filling].full &&
+		   shared->phase != HJ_PHASE_STOP)
+	{
+		struct timespec waittime;
+
+		ptimeout(&waittime, 1000);
+		pthread_cond_timedwait(&shared->gate, &shared->guard, &waittime);
+		if (CheckForCancel())
+		{
+			pthread_mutex_unlock(&shared->guard);
+			elog(ERROR, "Query Cancelled");
+		}
+	}
+	stopped = (shared->phase == HJ_PHASE_STOP);
+	pthread_mutex_unlock(&shared->guard);
+
+	return !stopped;
+}
+
+/*
+ * the next match from the helpers, NULL when all of them are done.  An
+ * exchange is given back once every match in it has been returned.
+ */
+static HJMatch *
+hj_nextmatch(HashJoinParallel shared)
+{
+	for (;;)
+	{
+		HJExchange *xchg = shared->reading;
+		int			i;
+
+		if (xchg != NULL)
+		{
+			if (shared->readpos < xchg->used)
+			{
+				HJMatch    *match = (HJMatch *) (xchg->data + shared->readpos);
+
+				shared->readpos += MAXALIGN(sizeof(HJMatch)) + MAXALIGN(match->outer.t_len);
+				match->outer.t_data = (HeapTupleHeader)
+					(((char *) match) + MAXALIGN(sizeof(HJMatch)));
+				match->outer.t_datamcxt = shared->cxt;
+				match->outer.t_datasrc = NULL;
+				match->outer.t_info = 0;
+				return match;
+			}
+
+			pthread_mutex_lock(&shared->guard);
+			xchg->used = 0;
+			xchg->full = false;
+			pthread_cond_broadcast(&shared->gate);
+			pthread_mutex_unlock(&shared->guard);
+			shared->reading = NULL;
+		}
+
+		pthread_mutex_lock(&shared->guard);
+		while (shared->reading == NULL)
+		{
+			bool		alldone = true;
+			struct timespec waittime;
+
+			for (i = 0; i < shared->nworkers && shared->reading == NULL; i++)
+			{
+				HJWorker   *worker = &shared->workers[1 + (shared->current - 1 + i) % shared->nworkers];
+
+				if (worker->exchange[0].full)
+					shared->reading = &worker->exchange[0];
+				else if (worker->exchange[1].full)
+					shared->reading = &worker->exchange[1];
+				else if (!worker->done)
+					alldone = false;
+			}
+			if (shared->reading != NULL)
+			{
+				shared->current = 1 + (shared->current - 1 + i) % shared->nworkers;
+				shared->readpos = 0;
+				break;
+			}
+			if (alldone)
+			{
+				pthread_mutex_unlock(&shared->guard);
+				return NULL;
+			}
+
+			ptimeout(&waittime, 1000);
+			if (pthread_cond_timedwait(&shared->gate, &shared->guard, &waittime) == ETIMEDOUT)
+			{
+				for (i = 1; i <= shared->nworkers; i++)
+				{
+					HJWorker   *worker = &shared->workers[i];
+
+					if (!worker->done && !worker->exchange[0].full &&
+						!worker->exchange[1].full &&
+						!IsDolConnectionRunning(worker->conn))
+					{
+						pthread_mutex_unlock(&shared->guard);
+						elog(ERROR, "parallel hash join worker stopped before finishing");
+					}
+				}
+			}
+		}
+		pthread_mutex_unlock(&shared->guard);
+	}
+}
@@ -330,6 +330,7 @@ ExecEndSeqScan(SeqScan *node)
 	 *		  is freed at end-transaction time.  -cim 6/2/91
 	 * ----------------
 	 */
+	ExecScanJavaBatchEnd(scanstate);
 	ExecFreeProjectionInfo(&scanstate->cstate);
 
 	/* ----------------
@@ -376,6 +377,8 @@ ExecSeqReScan(SeqScan *node, ExprContext *exprCtxt)
 	scanstate = node->scanstate;
 	estate = node->plan.state;
 
+	ExecScanJavaBatchReset(scanstate);
+
 	if ((outerPlan = outerPlan((Plan *) node)) != NULL)
 	{
 		/* we are scanning a subplan */
@@ -433,6 +436,9 @@ ExecSeqMarkPos(SeqScan *node)
 	 *
 	 * ----------------
 	 */
+	if (ExecScanJavaBatchPending(scanstate))
+		elog(ERROR, "ExecSeqMarkPos: scan is reading ahead for java functions");
+
 	scan = scanstate->css_currentScanDesc;
 	heap_markpos(scan);
 
@@ -460,6 +460,7 @@ _copyHashJoin(HashJoin *from)
 	 */
 	Node_Copy(from, newnode, hashclauses);
 	newnode->hashjoinop = from->hashjoinop;
+	newnode->parallel = from->parallel;
 
 	/*
 	 * We must add subplans in hashclauses to the new plan's subPlan list
@@ -580,6 +581,25 @@ _copyAgg(Agg *from)
 	return newnode;
 }
 
+/* ---------------
+ *	_copyHashAgg
+ * --------------
+ */
+static HashAgg *
+_copyHashAgg(HashAgg *from)
+{
+	HashAgg    *newnode = makeNode(HashAgg);
+
+	CopyPlanFields((Plan *) from, (Plan *) newnode);
+
+	newnode->numCols = from->numCols;
+	newnode->grpColIdx = palloc(from->numCols * sizeof(AttrNumber));
+	memcpy(newnode->grpColIdx, from->grpColIdx, from->numCols * sizeof(AttrNumber));
+	newnode->numGroups = from->numGroups;
+
+	return newnode;
+}
+
 /* ---------------
  *	_copyGroupClause
  * --------------
@@ -1331,6 +1351,7 @@ _copyHashPath(HashPath *from)
 	 * ----------------
 	 */
 	Node_Copy(from, newnode, path_hashclauses);
+	newnode->path_workers = from->path_workers;
 
 	return newnode;
 }
@@ -1788,6 +1809,9 @@ copyObject(void *from)
 		case T_Agg:
 			retval = _copyAgg(from);
 			break;
+		case T_HashAgg:
+			retval = _copyHashAgg(from);
+			break;
 		case T_GroupClause:
 			retval = _copyGroupClause(from);
 			break;
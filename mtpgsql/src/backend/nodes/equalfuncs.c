@@ -451,6 +451,8 @@ _equalHashPath(HashPath *a, HashPath *b)
 		return false;
 	if (!equal(a->path_hashclauses, b->path_hashclauses))
 		return false;
+	if (a->path_workers != b->path_workers)
+		return false;
 	return true;
 }
 
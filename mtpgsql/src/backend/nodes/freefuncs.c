@@ -436,6 +436,20 @@ _freeAgg(Agg *node)
 	pfree(node);
 }
 
+/* ---------------
+ *	_freeHashAgg
+ * --------------
+ */
+static void
+_freeHashAgg(HashAgg *node)
+{
+	FreePlanFields((Plan *) node);
+
+	pfree(node->grpColIdx);
+
+	pfree(node);
+}
+
 /* ---------------
  *	_freeGroupClause
  * --------------
@@ -1257,6 +1271,9 @@ freeObject(void *node)
 		case T_Agg:
 			_freeAgg(node);
 			break;
+		case T_HashAgg:
+			_freeHashAgg(node);
+			break;
 		case T_GroupClause:
 			_freeGroupClause(node);
 			break;
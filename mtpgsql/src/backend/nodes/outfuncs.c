@@ -448,6 +448,10 @@ _outHashJoin(StringInfo str, HashJoin *node)
 	appendStringInfo(str,
 					 " :hashdone %d ",
 					 node->hashdone);
+
+	appendStringInfo(str,
+					 " :parallel %d ",
+					 node->parallel);
 }
 
 static void
@@ -607,6 +611,21 @@ _outAgg(StringInfo str, Agg *node)
 	_outPlanInfo(str, (Plan *) node);
 }
 
+static void
+_outHashAgg(StringInfo str, HashAgg *node)
+{
+	int			i;
+
+	appendStringInfo(str, " HASHAGG ");
+	_outPlanInfo(str, (Plan *) node);
+
+	appendStringInfo(str, " :numCols %d :numGroups %ld :grpColIdx ",
+					 node->numCols,
+					 node->numGroups);
+	for (i = 0; i < node->numCols; i++)
+		appendStringInfo(str, "%d ", (int) node->grpColIdx[i]);
+}
+
 static void
 _outGroup(StringInfo str, Group *node)
 {
@@ -1160,6 +1179,8 @@ _outHashPath(StringInfo str, HashPath *node)
 
 	appendStringInfo(str, " :path_hashclauses ");
 	_outNode(str, node->path_hashclauses);
+
+	appendStringInfo(str, " :path_workers %d ", node->path_workers);
 }
 
 /*
@@ -1543,6 +1564,9 @@ _outNode(StringInfo str, void *obj)
 			case T_Agg:
 				_outAgg(str, obj);
 				break;
+			case T_HashAgg:
+				_outHashAgg(str, obj);
+				break;
 			case T_Group:
 				_outGroup(str, obj);
 				break;
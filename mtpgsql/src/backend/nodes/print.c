@@ -335,6 +335,9 @@ plannode_type(Plan *p)
 		case T_Agg:
 			return "AGG";
 			break;
+		case T_HashAgg:
+			return "HASHAGG";
+			break;
 		case T_Unique:
 			return "UNIQUE";
 			break;
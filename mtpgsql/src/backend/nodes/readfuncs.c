@@ -437,6 +437,10 @@ _readHashJoin()
 	token = lsptok(NULL, &length);		/* eat hashdone */
 	local_node->hashdone = false;
 
+	token = lsptok(NULL, &length);		/* eat :parallel */
+	token = lsptok(NULL, &length);		/* get parallel */
+	local_node->parallel = atoi(token);
+
 	return local_node;
 }
 
@@ -1694,6 +1698,10 @@ _readHashPath()
 	token = lsptok(NULL, &length);		/* get :path_hashclauses */
 	local_node->path_hashclauses = nodeRead(true);		/* now read it */
 
+	token = lsptok(NULL, &length);		/* get :path_workers */
+	token = lsptok(NULL, &length);		/* now read it */
+	local_node->path_workers = atoi(token);
+
 	return local_node;
 }
 
@@ -607,6 +607,68 @@ CostInfo*  costinfo = GetCostInfo();
 }
 
 
+/*
+ * cost_hashagg
+ *	  Determines and returns the cost of grouping and aggregating
+ *	  unsorted input by hashing the group columns (see nodeHashAgg.c).
+ *
+ * The cost of supplying the input data is NOT included; the caller should
+ * add that cost to both startup and total costs returned from this routine!
+ *
+ * Each input tuple is hashed and compared on its group columns and
+ * advances every aggregate, so we charge one cpu_operator_cost per group
+ * column twice and per aggregate once, per input tuple.  No group can be
+ * returned before all of the input has been read, so all of that is
+ * startup cost; returning the groups costs cpu_tuple_cost apiece.
+ *
+ * If the hash table --- one copy of a group's tuple plus its transition
+ * values per group --- exceeds SortMem, the tuples of the groups that do
+ * not fit are written out to batch files and read back once, which we
+ * charge like the batching of a hash join: one unit per page each way.
+ *
+ * 'tuples' is the number of input tuples
+ * 'width' is the average input tuple width in bytes
+ * 'numCols' is the number of group columns
+ * 'numAggs' is the number of aggregates computed per group
+ * 'numGroups' is the estimated number of groups
+ */
+void
+cost_hashagg(Path *path, double tuples, int width,
+			 int numCols, int numAggs, double numGroups)
+{
+	Cost		startup_cost = 0;
+	Cost		run_cost = 0;
+	double		tablebytes;
+	long		hashtablebytes = SortMem * 1024L;
+CostInfo*  costinfo = GetCostInfo();
+
+	if (!costinfo->enable_hashagg)
+		startup_cost += costinfo->disable_cost;
+
+	if (numGroups < 1.0)
+		numGroups = 1.0;
+
+	/* CPU costs */
+	startup_cost += costinfo->cpu_operator_cost * tuples *
+		(2 * numCols + numAggs);
+	run_cost += costinfo->cpu_tuple_cost * numGroups;
+
+	/* disk costs */
+	tablebytes = relation_byte_size(numGroups, width) +
+		numGroups * numAggs * 2.0 * sizeof(Datum);
+	if (tablebytes > hashtablebytes)
+	{
+		double		spillfrac = 1.0 - hashtablebytes / tablebytes;
+		double		spillpages = page_size(tuples * spillfrac, width);
+
+		startup_cost += 2 * spillpages;
+	}
+
+	path->startup_cost = startup_cost;
+	path->total_cost = startup_cost + run_cost;
+}
+
+
 /*
  * cost_nestloop
  *	  Determines and returns the cost of joining two relations using the
@@ -758,13 +820,16 @@ CostInfo*  costinfo = GetCostInfo();
  * 'restrictlist' are the RestrictInfo nodes to be applied at the join
  * 'innerdisbursion' is an estimate of the disbursion statistic
  *				for the inner hash key.
+ * 'nworkers' is the number of helper threads that scan, hash and probe
+ *				alongside the main thread, zero for a serial join.
  */
 void
 cost_hashjoin(Path *path,
 			  Path *outer_path,
 			  Path *inner_path,
 			  List *restrictlist,
-			  Selectivity innerdisbursion)
+			  Selectivity innerdisbursion,
+			  int nworkers)
 {
 	Cost		startup_cost = 0;
 	Cost		run_cost = 0;
@@ -775,20 +840,43 @@ cost_hashjoin(Path *path,
 	double		innerbytes = relation_byte_size(inner_path->parent->rows,
 											  inner_path->parent->width);
 	long		hashtablebytes = SortMem * 1024L;
+	double		nthreads = nworkers + 1;
 	
 CostInfo*  costinfo = GetCostInfo();
 
 	if (!costinfo->enable_hashjoin)
 		startup_cost += costinfo->disable_cost;
 
-	/* cost of source data */
+	if (nworkers > 0)
+	{
+		if (!costinfo->enable_parallelhashjoin)
+			startup_cost += costinfo->disable_cost;
+
+		/*
+		 * the parallel join never batches, an inner relation that does
+		 * not fit is joined serially by the executor
+		 */
+		if (innerbytes > hashtablebytes)
+			startup_cost += costinfo->disable_cost;
+
+		if (!IsDolConnectionAvailable())
+			startup_cost += costinfo->thread_startup_cost * nworkers;
+		else
+			startup_cost += costinfo->delegation_startup_cost * nworkers;
+	}
+
+	/*
+	 * cost of source data.  In a parallel join the scans of both inputs
+	 * are shared by the helpers and the main thread.
+	 */
 	startup_cost += outer_path->startup_cost;
-	run_cost += outer_path->total_cost - outer_path->startup_cost;
-	startup_cost += inner_path->total_cost;
+	run_cost += (outer_path->total_cost - outer_path->startup_cost) / nthreads;
+	startup_cost += inner_path->startup_cost +
+		(inner_path->total_cost - inner_path->startup_cost) / nthreads;
 
 	/* cost of computing hash function: must do it once per input tuple */
-	startup_cost += costinfo->cpu_operator_cost * inner_path->parent->rows;
-	run_cost += costinfo->cpu_operator_cost * outer_path->parent->rows;
+	startup_cost += costinfo->cpu_operator_cost * inner_path->parent->rows / nthreads;
+	run_cost += costinfo->cpu_operator_cost * outer_path->parent->rows / nthreads;
 
 	/*
 	 * The number of tuple comparisons needed is the number of outer
@@ -801,7 +889,8 @@ CostInfo*  costinfo = GetCostInfo();
 	 * We then charge one cpu_operator_cost per tuple comparison.
 	 */
 	run_cost += costinfo->cpu_operator_cost * outer_path->parent->rows *
-		NTUP_PER_BUCKET * ceil(inner_path->parent->rows * innerdisbursion);
+		NTUP_PER_BUCKET * ceil(inner_path->parent->rows * innerdisbursion) /
+		nthreads;
 
 	/*
 	 * Estimate the number of tuples that get through the hashing filter
@@ -17,6 +17,7 @@
 #include "postgres.h"
 
 #include "env/env.h"
+#include "env/properties.h"
 
 #include "access/htup.h"
 #include "catalog/pg_attribute.h"
@@ -28,6 +29,7 @@
 #include "parser/parsetree.h"
 #include "utils/lsyscache.h"
 #include "commands/variable.h"
+#include "executor/hashjoin.h"
 
 static void sort_inner_and_outer(Query *root, RelOptInfo *joinrel,
 					 RelOptInfo *outerrel, RelOptInfo *innerrel,
@@ -45,6 +47,7 @@ static void match_unsorted_inner(Query *root, RelOptInfo *joinrel,
 static void hash_inner_and_outer(Query *root, RelOptInfo *joinrel,
 					 RelOptInfo *outerrel, RelOptInfo *innerrel,
 					 List *restrictlist);
+static bool parallel_hash_input(RelOptInfo *rel);
 static Path *best_innerjoin(List *join_paths, List *outer_relid);
 static Selectivity estimate_disbursion(Query *root, Var *var);
 static List *select_mergejoin_clauses(RelOptInfo *joinrel,
@@ -545,7 +548,7 @@ match_unsorted_inner(Query *root,
 /*
  * hash_inner_and_outer
  *	  Create hashjoin join paths by explicitly hashing both the outer and
- *	  inner join relations of each available hash clause.
+ *	  inner join relations on all the available hash clauses.
  *
  * 'joinrel' is the join relation
  * 'outerrel' is the outer join relation
@@ -562,6 +565,8 @@ hash_inner_and_outer(Query *root,
 {
 	Relids		outerrelids = outerrel->relids;
 	Relids		innerrelids = innerrel->relids;
+	List	   *hashclauses = NIL;
+	Selectivity innerdisbursion = 1.0;
 	List	   *i;
 
 	/*
@@ -572,6 +577,9 @@ hash_inner_and_outer(Query *root,
 	 * can be used with this pair of sub-relations.  This code would need
 	 * to be upgraded if we wanted to allow more-complex expressions in
 	 * hash joins.
+	 *
+	 * The executor hashes on all the clauses at once, so they all go
+	 * into a single path.
 	 */
 	foreach(i, restrictlist)
 	{
@@ -580,8 +588,7 @@ hash_inner_and_outer(Query *root,
 		Var		   *left,
 				   *right,
 				   *inner;
-		List	   *hashclauses;
-		Selectivity innerdisbursion;
+		Selectivity disbursion;
 
 		if (restrictinfo->hashjoinoperator == InvalidOid)
 			continue;			/* not hashjoinable */
@@ -601,35 +608,89 @@ hash_inner_and_outer(Query *root,
 		else
 			continue;			/* no good for these input relations */
 
-		/* always a one-element list of hash clauses */
-		hashclauses = lcons(restrictinfo, NIL);
-
-		/* estimate disbursion of inner var for costing purposes */
-		innerdisbursion = estimate_disbursion(root, inner);
+		hashclauses = lappend(hashclauses, restrictinfo);
 
 		/*
-		 * We consider both the cheapest-total-cost and
-		 * cheapest-startup-cost outer paths.  There's no need to consider
-		 * any but the cheapest- total-cost inner path, however.
+		 * estimate disbursion of inner var for costing purposes.  The
+		 * keys are likely correlated, so take the most selective one
+		 * rather than the product.
 		 */
+		disbursion = estimate_disbursion(root, inner);
+		if (disbursion < innerdisbursion)
+			innerdisbursion = disbursion;
+	}
+
+	if (hashclauses == NIL)
+		return;
+
+	/*
+	 * We consider both the cheapest-total-cost and cheapest-startup-cost
+	 * outer paths.  There's no need to consider any but the cheapest-
+	 * total-cost inner path, however.
+	 */
+	add_path(joinrel, (Path *)
+			 create_hashjoin_path(joinrel,
+								  outerrel->cheapest_total_path,
+								  innerrel->cheapest_total_path,
+								  restrictlist,
+								  hashclauses,
+								  innerdisbursion,
+								  0));
+	if (outerrel->cheapest_startup_path != outerrel->cheapest_total_path)
 		add_path(joinrel, (Path *)
 				 create_hashjoin_path(joinrel,
-									  outerrel->cheapest_total_path,
+									  outerrel->cheapest_startup_path,
 									  innerrel->cheapest_total_path,
 									  restrictlist,
 									  hashclauses,
-									  innerdisbursion));
-		if (outerrel->cheapest_startup_path != outerrel->cheapest_total_path)
+									  innerdisbursion,
+									  0));
+
+	/*
+	 * When both sides are plain sequential scans of base relations the
+	 * helper threads can scan and hash the inner relation and probe with
+	 * the outer one alongside the main thread.
+	 */
+	if (GetCostInfo()->enable_parallelhashjoin &&
+		parallel_hash_input(outerrel) && parallel_hash_input(innerrel))
+	{
+		int			nworkers = HJ_PARALLEL_MAX_WORKERS;
+
+		if (PropertyIsValid("hashjoinworkers"))
+		{
+			nworkers = GetIntProperty("hashjoinworkers");
+			if (nworkers > HJ_PARALLEL_MAX_WORKERS)
+				nworkers = HJ_PARALLEL_MAX_WORKERS;
+		}
+		if (nworkers > 0)
 			add_path(joinrel, (Path *)
 					 create_hashjoin_path(joinrel,
-										  outerrel->cheapest_startup_path,
+										  outerrel->cheapest_total_path,
 										  innerrel->cheapest_total_path,
 										  restrictlist,
 										  hashclauses,
-										  innerdisbursion));
+										  innerdisbursion,
+										  nworkers));
 	}
 }
 
+/*
+ * parallel_hash_input
+ *	  true if the cheapest path of rel is a sequential scan the helpers
+ *	  of a parallel hash join can divide between them.
+ */
+static bool
+parallel_hash_input(RelOptInfo *rel)
+{
+	Path	   *path = rel->cheapest_total_path;
+
+	if (path->pathtype != T_SeqScan)
+		return false;
+	if (length(rel->relids) != 1 || lfirsti(rel->relids) < 0)
+		return false;
+	return true;
+}
+
 /*
  * best_innerjoin
  *	  Find the cheapest index path that has already been identified by
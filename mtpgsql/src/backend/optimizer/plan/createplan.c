@@ -703,10 +703,9 @@ create_hashjoin_node(HashPath *best_path,
 	Var		   *innerhashkey;
 
 	/*
-	 * NOTE: there will always be exactly one hashclause in the list
-	 * best_path->path_hashclauses (cf. hash_inner_and_outer()). We
-	 * represent it as a list anyway, for convenience with routines that
-	 * want to work on lists of clauses.
+	 * best_path->path_hashclauses holds every hashjoinable clause usable
+	 * with this pair of relations (cf. hash_inner_and_outer()), the
+	 * executor hashes on all of them.
 	 */
 	hashclauses = get_actual_clauses(best_path->path_hashclauses);
 
@@ -729,7 +728,10 @@ create_hashjoin_node(HashPath *best_path,
 											   inner_tlist,
 											   (Index) 0));
 
-	/* Now the righthand op of the sole hashclause is the inner hash key. */
+	/*
+	 * The righthand ops of the hashclauses are the inner hash keys, the
+	 * hash node keeps the first one.
+	 */
 	innerhashkey = get_rightop(lfirst(hashclauses));
 
 	/*
@@ -741,6 +743,7 @@ create_hashjoin_node(HashPath *best_path,
 							  hashclauses,
 							  outer_node,
 							  (Plan *) hash_node);
+	join_node->parallel = best_path->path_workers;
 
 	copy_path_costsize(&join_node->join, &best_path->jpath.path);
 
@@ -1302,6 +1305,7 @@ make_hashjoin(List *tlist,
 	plan->righttree = righttree;
 	node->hashclauses = hashclauses;
 	node->hashdone = false;
+	node->parallel = 0;
 
 	return node;
 }
@@ -1440,6 +1444,51 @@ make_agg(List *tlist, List *qual, Plan *lefttree)
 	return node;
 }
 
+/*
+ * make_hashagg
+ *	  Build a HashAgg node computing the aggregates of tlist and qual per
+ *	  group of the grpColIdx columns of lefttree's unsorted output.
+ */
+HashAgg *
+make_hashagg(List *tlist, List *qual, int numCols, AttrNumber *grpColIdx,
+			 Plan *lefttree)
+{
+	HashAgg    *node = makeNode(HashAgg);
+	Plan	   *plan = &node->plan;
+	Path		hashagg_path;	/* dummy for result of cost_hashagg */
+	double		numGroups;
+
+	copy_plan_costsize(plan, lefttree);
+
+	/*
+	 * Estimate the number of groups as 10% of the number of tuples, the
+	 * same guess make_agg makes for sorted grouping.
+	 */
+	numGroups = lefttree->plan_rows * 0.1;
+	if (numGroups < 1.0)
+		numGroups = 1.0;
+
+	cost_hashagg(&hashagg_path, lefttree->plan_rows, lefttree->plan_width,
+				 numCols,
+				 length(pull_agg_clause((Node *) tlist)) +
+				 length(pull_agg_clause((Node *) qual)),
+				 numGroups);
+	plan->startup_cost = hashagg_path.startup_cost + lefttree->total_cost;
+	plan->total_cost = hashagg_path.total_cost + lefttree->total_cost;
+	plan->plan_rows = numGroups;
+
+	plan->state = (EState *) NULL;
+	plan->qual = qual;
+	plan->targetlist = tlist;
+	plan->lefttree = lefttree;
+	plan->righttree = (Plan *) NULL;
+	node->numCols = numCols;
+	node->grpColIdx = grpColIdx;
+	node->numGroups = (long) numGroups;
+
+	return node;
+}
+
 Group *
 make_group(List *tlist,
 		   bool tuplePerGroup,
@@ -19,10 +19,14 @@
 #include "env/env.h"
 #include "access/genam.h"
 #include "access/heapam.h"
+#include "catalog/pg_operator.h"
 #include "catalog/pg_type.h"
+#include "commands/variable.h"
 #include "executor/executor.h"
+#include "executor/nodeHash.h"
 #include "nodes/makefuncs.h"
 #include "optimizer/clauses.h"
+#include "optimizer/cost.h"
 #include "optimizer/internal.h"
 #include "optimizer/paths.h"
 #include "optimizer/planmain.h"
@@ -44,6 +48,9 @@ static Plan *make_groupplan(List *group_tlist, bool tuplePerGroup,
 			   List *groupClause, AttrNumber *grpColIdx,
 			   bool is_presorted, Plan *subplan);
 static Plan *make_sortplan(List *tlist, List *sortcls, Plan *plannode);
+static bool choose_hashed_grouping(Query *parse, List *tlist, Plan *subplan,
+					   AttrNumber *groupColIdx,
+					   List *group_pathkeys, List *sort_pathkeys);
 
 /*****************************************************************************
  *
@@ -247,6 +254,7 @@ union_planner(Query *parse,
 	List	   *group_pathkeys;
 	List	   *sort_pathkeys;
 	Index		rt_index;
+	bool		use_hashagg = false;
 
 	if (parse->unionClause)
 	{
@@ -590,6 +598,21 @@ union_planner(Query *parse,
 			is_sorted = true;	/* no sort needed now */
 			/* current_pathkeys remains unchanged */
 		}
+		else if (parse->hasAggs &&
+				 choose_hashed_grouping(parse, tlist, result_plan,
+										groupColIdx,
+										group_pathkeys, sort_pathkeys))
+		{
+
+			/*
+			 * Aggregate the groups in a hash table instead of sorting.
+			 * The HashAgg node stands in for both the Group and the Agg
+			 * node, and returns the groups in no particular order.
+			 */
+			use_hashagg = true;
+			is_sorted = false;
+			current_pathkeys = NIL;
+		}
 		else
 		{
 
@@ -602,12 +625,19 @@ union_planner(Query *parse,
 			current_pathkeys = group_pathkeys;
 		}
 
-		result_plan = make_groupplan(group_tlist,
-									 tuplePerGroup,
-									 parse->groupClause,
-									 groupColIdx,
-									 is_sorted,
-									 result_plan);
+		if (use_hashagg)
+			result_plan = (Plan *) make_hashagg(tlist,
+												(List *) parse->havingQual,
+												length(parse->groupClause),
+												groupColIdx,
+												result_plan);
+		else
+			result_plan = make_groupplan(group_tlist,
+										 tuplePerGroup,
+										 parse->groupClause,
+										 groupColIdx,
+										 is_sorted,
+										 result_plan);
 	}
 
 	/*
@@ -615,7 +645,7 @@ union_planner(Query *parse,
 	 *
 	 * HAVING clause, if any, becomes qual of the Agg node
 	 */
-	if (parse->hasAggs)
+	if (parse->hasAggs && !use_hashagg)
 	{
 		result_plan = (Plan *) make_agg(tlist,
 										(List *) parse->havingQual,
@@ -817,6 +847,98 @@ make_groupplan(List *group_tlist,
 							   grpColIdx, subplan);
 }
 
+/*
+ * choose_hashed_grouping
+ *		Decide whether to compute GROUP BY aggregates over the unsorted
+ *		subplan output with a HashAgg node rather than with
+ *		Sort/Group/Agg.
+ *
+ * Hashing is only possible when no aggregate is DISTINCT (those sort
+ * their input per group) and every group column hashes consistently with
+ * its equality operator.  nodeHashAgg.c hashes through ExecHashKeyFunc,
+ * which has functions of its own for types such as numeric, bpchar and
+ * the floats and falls back to the raw bytes of the value for the rest,
+ * so a column qualifies if its type has such a function or its equality
+ * operator is marked hashable (equal values have equal bytes).  We then
+ * compare the cost of sorting the input with the cost of hashing
+ * it, counting the extra sort of the groups that HashAgg needs if the
+ * ORDER BY could otherwise have come for free from the grouping sort.
+ */
+static bool
+choose_hashed_grouping(Query *parse, List *tlist, Plan *subplan,
+					   AttrNumber *groupColIdx,
+					   List *group_pathkeys, List *sort_pathkeys)
+{
+	CostInfo   *costinfo = GetCostInfo();
+	int			numCols = length(parse->groupClause);
+	List	   *aggs;
+	List	   *l;
+	int			numAggs;
+	double		numGroups;
+	Path		sorted_p;
+	Path		hashed_p;
+	Path		groupsort_p;
+
+	if (!costinfo->enable_hashagg || groupColIdx == NULL)
+		return false;
+
+	aggs = nconc(pull_agg_clause((Node *) tlist),
+				 pull_agg_clause(parse->havingQual));
+	numAggs = length(aggs);
+	foreach(l, aggs)
+	{
+		if (((Aggref *) lfirst(l))->aggdistinct)
+		{
+			freeList(aggs);
+			return false;
+		}
+	}
+	freeList(aggs);
+
+	foreach(l, parse->groupClause)
+	{
+		GroupClause *grpcl = (GroupClause *) lfirst(l);
+		Node	   *groupexpr = get_sortgroupclause_expr(grpcl, tlist);
+		Oid			typid = exprType(groupexpr);
+		Operator	eq_operator;
+
+		eq_operator = oper("=", typid, typid, true);
+		if (!HeapTupleIsValid(eq_operator))
+			return false;
+		if (!((Form_pg_operator) GETSTRUCT(eq_operator))->oprcanhash &&
+			!ExecHashKeyIsTyped(typid))
+			return false;
+	}
+
+	/* same guess at the number of groups as make_agg and make_hashagg */
+	numGroups = subplan->plan_rows * 0.1;
+	if (numGroups < 1.0)
+		numGroups = 1.0;
+
+	/* Sort, then one comparison per group column per tuple in Group */
+	cost_sort(&sorted_p, group_pathkeys, subplan->plan_rows,
+			  subplan->plan_width);
+	sorted_p.total_cost += costinfo->cpu_operator_cost *
+		subplan->plan_rows * (numCols + numAggs);
+
+	cost_hashagg(&hashed_p, subplan->plan_rows, subplan->plan_width,
+				 numCols, numAggs, numGroups);
+
+	/*
+	 * Sorting for the groups also yields the ORDER BY if that is a prefix
+	 * of the GROUP BY; hashed groups need a sort of their own.
+	 */
+	if (parse->sortClause &&
+		pathkeys_contained_in(sort_pathkeys, group_pathkeys))
+	{
+		cost_sort(&groupsort_p, sort_pathkeys, numGroups,
+				  subplan->plan_width);
+		hashed_p.total_cost += groupsort_p.total_cost;
+	}
+
+	return hashed_p.total_cost < sorted_p.total_cost;
+}
+
 /*
  * make_sortplan
  *	  Add a Sort node to implement an explicit ORDER BY clause.
@@ -135,6 +135,7 @@ set_plan_references(Plan *plan)
 			 */
 			break;
 		case T_Agg:
+		case T_HashAgg:
 		case T_Group:
 			set_uppernode_references(plan, (Index) 0);
 			break;
@@ -678,6 +678,7 @@ SS_finalize_plan(Plan *plan)
 			break;
 
 		case T_Agg:
+		case T_HashAgg:
 		case T_SeqScan:
 		case T_DelegatedSeqScan:
 		case T_NestLoop:
@@ -559,9 +559,11 @@ create_mergejoin_path(RelOptInfo *joinrel,
  * 'outer_path' is the cheapest outer path
  * 'inner_path' is the cheapest inner path
  * 'restrict_clauses' are the RestrictInfo nodes to apply at the join
- * 'hashclauses' is a list of the hash join clause (always a 1-element list)
+ * 'hashclauses' is a list of the hash join clauses
  *		(this should be a subset of the restrict_clauses list)
  * 'innerdisbursion' is an estimate of the disbursion of the inner hash key
+ * 'nworkers' is the number of helper threads building and probing the
+ *		hash table with the main thread, zero for a serial join
  *
  */
 HashPath   *
@@ -570,7 +572,8 @@ create_hashjoin_path(RelOptInfo *joinrel,
 					 Path *inner_path,
 					 List *restrict_clauses,
 					 List *hashclauses,
-					 Selectivity innerdisbursion)
+					 Selectivity innerdisbursion,
+					 int nworkers)
 {
 	HashPath   *pathnode = makeNode(HashPath);
 
@@ -582,12 +585,14 @@ create_hashjoin_path(RelOptInfo *joinrel,
 	/* A hashjoin never has pathkeys, since its ordering is unpredictable */
 	pathnode->jpath.path.pathkeys = NIL;
 	pathnode->path_hashclauses = hashclauses;
+	pathnode->path_workers = nworkers;
 
 	cost_hashjoin(&pathnode->jpath.path,
 				  outer_path,
 				  inner_path,
 				  restrict_clauses,
-				  innerdisbursion);
+				  innerdisbursion,
+				  nworkers);
 
 	return pathnode;
 }
@@ -19,6 +19,11 @@
 #include <math.h>
 #include <signal.h>
 #include <pthread.h>
+#ifdef __linux__
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <errno.h>
+#endif
 
 
 #include "postgres.h"
@@ -64,6 +69,40 @@ BufferDesc *BufferDescriptors;
 static char* BufferBlocks;
 MemoryContext buffer_cxt;
 
+/*
+ *  buffers below NBuffers can be retired to shrink the pool, growing
+ *  brings them back before extending NBuffers.  Growth under flush
+ *  pressure stops at TargetBuffers, which is MaxBuffers until the pool
+ *  is resized.  The guard keeps resizes in order.
+ */
+static int              RetiredBuffers = 0;
+static int              ConfiguredBuffers = 0;
+static int              TargetBuffers = 0;
+static pthread_mutex_t  resize_guard;
+
+#define BUFFER_POOL_MIN     32
+
+/*
+ *  on hosts with more than one memory node, buffer pages and descriptors
+ *  are interleaved across the nodes so no socket holds the whole pool.
+ *  The policy is set on the allocating thread while the pool is built or
+ *  grown, pages are placed when the allocation first touches them.
+ */
+#ifdef __linux__
+#define BUFFER_MPOL_DEFAULT     0
+#define BUFFER_MPOL_INTERLEAVE  3
+#endif
+
+#define BUFFER_MPOL_MAXNODE     1024
+
+static int              numa_nodes = -1;
+static unsigned long    numa_mask = 0;
+static bool             numa_interleave = false;
+/*  policy of the allocating thread, put back when placement ends  */
+static int              saved_mode = 0;
+static unsigned long    saved_mask[BUFFER_MPOL_MAXNODE / (sizeof(unsigned long) * 8)];
+static bool             saved_policy = false;
+
 /*
  * Data Structures:
  *		buffers live in a freelist and a lookup data structure.
@@ -123,6 +162,12 @@ long int	BufferFlushCount;
 long int	LocalBufferFlushCount;
 
 static void InitializeBuffers(int start, int count, char* block);
+static int BufferNumaNodes(void);
+static void BufferPlacementBegin(void);
+static void BufferPlacementEnd(void);
+static void RetireBuffer(BufferDesc* buf);
+static int GrowBufferPool(int count);
+static int TrimBufferPool(int count);
 static void* LockedAlloc(MemoryContext cxt, Size size) {
     void* pointer = MemoryContextAlloc(cxt,size);
     if ( pointer != NULL ) {
@@ -143,6 +188,15 @@ InitBufferPool(IPCKey key)
 	bool		foundBufs = false,foundDescs = false;
 
         if ( MaxBuffers < NBuffers ) MaxBuffers = NBuffers;
+
+        pthread_mutex_init(&resize_guard,&process_mutex_attr);
+        ConfiguredBuffers = NBuffers;
+        numa_interleave = ( BufferNumaNodes() > 1 );
+        if ( PropertyIsValid("buffer_numa") ) {
+            char* placement = GetProperty("buffer_numa");
+            if ( strcasecmp(placement,"interleave") != 0 ) numa_interleave = false;
+        }
+        BufferPlacementBegin();
                 
         if ( key == PrivateIPCKey ) {
             buffer_cxt = AllocSetContextCreate(NULL,"BufferMainMemory",
@@ -173,66 +227,272 @@ InitBufferPool(IPCKey key)
         } else {
                 InitializeBuffers(0,MaxBuffers,BufferBlocks);
         }
+        BufferPlacementEnd();
+        TargetBuffers = MaxBuffers;
         
-        elog(DEBUG,"using %d buffers max buffers %d",NBuffers,MaxBuffers);
+        elog(DEBUG,"using %d buffers max buffers %d memory nodes %d%s",NBuffers,MaxBuffers,
+            numa_nodes,(numa_interleave) ? " interleaved" : "");
 
 	/* Init the rest of the module */
 	InitBufTable(NTables);
 	InitFreeList(!foundDescs);
 }
 
+/*
+ * AddMoreBuffers -- grow the pool by count buffers when flushing can not
+ * keep up, never past the size the pool was last resized to.
+ */
 int
 AddMoreBuffers(int count) {
-    if ( NBuffers == MaxBuffers ) {
-        int i;
-        BufferDesc *buf,*head,*tail;
-        int activate = 0;
-        
-        head = NULL;
-        tail = NULL;
-        
-        for (i = 0; activate < count && i < MaxBuffers; i++)
-        {
-            buf = &BufferDescriptors[i];
-            pthread_mutex_lock(&buf->cntx_lock.guard);
-            if ( buf->locflags & BM_RETIRED ) {
-                activate += 1;
-                buf->data = LockedAlloc(buffer_cxt,BLCKSZ);
-                buf->shadow = LockedAlloc(buffer_cxt,BLCKSZ);
-                buf->locflags &= ~(BM_RETIRED);
-                buf->freeNext = INVALID_DESCRIPTOR;
-                if ( head == NULL ) {
-                    head = buf;
-                    tail = buf;
-                } else {
-                    tail->freeNext = i;
-                    tail = buf;
-                }
-                Assert(buf->data != NULL);
-            }
-            pthread_mutex_unlock(&buf->cntx_lock.guard);
+    int activate = 0;
+
+    pthread_mutex_lock(&resize_guard);
+    if ( count > TargetBuffers - ActiveBuffers() ) count = TargetBuffers - ActiveBuffers();
+    if ( count > 0 ) activate = GrowBufferPool(count);
+    pthread_mutex_unlock(&resize_guard);
+
+    return activate;
+}
+
+/*
+ * ShrinkBufferPool -- retire up to count buffers taken from the
+ * eviction end of the freelist.  Pinned and dirty buffers are not on
+ * the freelist so only clean, unused pages are dropped.  Returns the
+ * number retired.
+ */
+int
+ShrinkBufferPool(int count) {
+    int retired;
+
+    pthread_mutex_lock(&resize_guard);
+    retired = TrimBufferPool(count);
+    pthread_mutex_unlock(&resize_guard);
+
+    return retired;
+}
+
+/*
+ * ResizeBufferPool -- grow or shrink the pool toward buffers active
+ * buffers and return the number active afterward.  Growth under flush
+ * pressure is capped at the new size.
+ */
+int
+ResizeBufferPool(int buffers) {
+    int active;
+
+    pthread_mutex_lock(&resize_guard);
+    if ( buffers > MaxBuffers ) buffers = MaxBuffers;
+    if ( buffers < BUFFER_POOL_MIN ) buffers = BUFFER_POOL_MIN;
+    TargetBuffers = buffers;
+    active = ActiveBuffers();
+    if ( buffers > active ) {
+        GrowBufferPool(buffers - active);
+    } else if ( buffers < active ) {
+        TrimBufferPool(active - buffers);
+    }
+    active = ActiveBuffers();
+    pthread_mutex_unlock(&resize_guard);
+
+    return active;
+}
+
+/*
+ * RestoreBufferPool -- return the pool to the configured size and let it
+ * grow under pressure up to the configured maximum again.
+ */
+int
+RestoreBufferPool(void) {
+    int active = ResizeBufferPool(ConfiguredBuffers);
+
+    pthread_mutex_lock(&resize_guard);
+    TargetBuffers = MaxBuffers;
+    pthread_mutex_unlock(&resize_guard);
+
+    return active;
+}
+
+int
+ActiveBuffers(void) {
+    return NBuffers - RetiredBuffers;
+}
+
+static void
+RetireBuffer(BufferDesc* buf) {
+    pthread_mutex_lock(&buf->cntx_lock.guard);
+    Assert ( buf->locflags & BM_DELETED ) ;
+    buf->locflags |= ( BM_RETIRED | BM_FREE );
+    buf->locflags &= ~( BM_VALID | BM_USED );
+    buf->refCount = 0;
+    buf->pageaccess = 0;
+    buf->bias = 0;
+    buf->freeNext = INVALID_DESCRIPTOR;
+    /*  pages in the initial block stay with the descriptor for reuse  */
+    if ( buffer_cxt != NULL ) {
+        if ( buf->data < BufferBlocks || buf->data > BufferBlocks + ( BLCKSZ * SBuffers ) ) {
+            munlock(buf->data,BLCKSZ);
+            pfree(buf->data);
+            buf->data = NULL;
         }
-        AddBuffersToTail(head);
-        return activate;
-    } else {
-        BufferDesc* buf = NULL;
-        int i=0;
-        if ( buffer_cxt == NULL ) return 0;
-        if ( count > MaxBuffers - NBuffers ) count = MaxBuffers - NBuffers;
-        for (i=NBuffers;i<NBuffers+count;i++) {
-            buf = &BufferDescriptors[i];
-            pthread_mutex_lock(&buf->cntx_lock.guard);
+        if ( buf->shadow < BufferBlocks || buf->shadow > BufferBlocks + ( BLCKSZ * SBuffers ) ) {
+            munlock(buf->shadow,BLCKSZ);
+            pfree(buf->shadow);
+            buf->shadow = NULL;
+        }
+    }
+    pthread_mutex_unlock(&buf->cntx_lock.guard);
+}
+
+/*
+ * bring back retired buffers then extend the pool, caller holds the
+ * resize guard
+ */
+static int
+GrowBufferPool(int count) {
+    int i;
+    BufferDesc *buf,*head,*tail;
+    int activate = 0;
+    int reactivated = 0;
+
+    head = NULL;
+    tail = NULL;
+
+    BufferPlacementBegin();
+    /*  retired buffers come back first  */
+    for (i = 0; RetiredBuffers > reactivated && activate < count && i < NBuffers; i++)
+    {
+        buf = &BufferDescriptors[i];
+        pthread_mutex_lock(&buf->cntx_lock.guard);
+        if ( buf->locflags & BM_RETIRED ) {
+            activate += 1;
+            reactivated += 1;
+            if ( buf->data == NULL ) buf->data = LockedAlloc(buffer_cxt,BLCKSZ);
+            if ( buf->shadow == NULL ) buf->shadow = LockedAlloc(buffer_cxt,BLCKSZ);
             buf->locflags &= ~(BM_RETIRED);
-            buf->data = LockedAlloc(buffer_cxt,BLCKSZ);
-            buf->shadow = LockedAlloc(buffer_cxt,BLCKSZ);
-            pthread_mutex_unlock(&buf->cntx_lock.guard);
+            buf->freeNext = INVALID_DESCRIPTOR;
+            if ( head == NULL ) {
+                head = buf;
+                tail = buf;
+            } else {
+                tail->freeNext = i;
+                tail = buf;
+            }
             Assert(buf->data != NULL);
         }
+        pthread_mutex_unlock(&buf->cntx_lock.guard);
+    }
+    RetiredBuffers -= reactivated;
+    /*  then the pool is extended, only possible with private memory  */
+    while ( buffer_cxt != NULL && activate < count && NBuffers < MaxBuffers ) {
+        buf = &BufferDescriptors[NBuffers];
+        pthread_mutex_lock(&buf->cntx_lock.guard);
+        buf->locflags &= ~(BM_RETIRED);
+        buf->data = LockedAlloc(buffer_cxt,BLCKSZ);
+        buf->shadow = LockedAlloc(buffer_cxt,BLCKSZ);
         buf->freeNext = INVALID_DESCRIPTOR;
-        AddBuffersToTail(&BufferDescriptors[NBuffers]);
-        NBuffers += count;
-        return count;
+        pthread_mutex_unlock(&buf->cntx_lock.guard);
+        Assert(buf->data != NULL);
+        if ( head == NULL ) {
+            head = buf;
+            tail = buf;
+        } else {
+            tail->freeNext = NBuffers;
+            tail = buf;
+        }
+        NBuffers += 1;
+        activate += 1;
     }
+    BufferPlacementEnd();
+
+    if ( head != NULL ) AddBuffersToTail(head);
+    return activate;
+}
+
+/*
+ * retire up to count free buffers, caller holds the resize guard
+ */
+static int
+TrimBufferPool(int count) {
+    int retired = 0;
+
+    if ( count > ActiveBuffers() - BUFFER_POOL_MIN ) count = ActiveBuffers() - BUFFER_POOL_MIN;
+    while ( retired < count ) {
+        BufferDesc* buf = TakeFreeBuffer();
+        if ( buf == NULL ) break;
+        BufTableDelete(buf);
+        RetireBuffer(buf);
+        retired++;
+    }
+    RetiredBuffers += retired;
+
+    elog(DEBUG,"retired %d buffers, %d active",retired,ActiveBuffers());
+    return retired;
+}
+
+/*
+ * number of online memory nodes, the mask of them is kept for the
+ * interleave policy
+ */
+static int
+BufferNumaNodes(void) {
+#ifdef __linux__
+    FILE*   online;
+    char    list[256];
+
+    if ( numa_nodes >= 0 ) return numa_nodes;
+
+    numa_nodes = 1;
+    numa_mask = 1;
+    online = fopen("/sys/devices/system/node/online","r");
+    if ( online == NULL ) return numa_nodes;
+    if ( fgets(list,sizeof(list),online) != NULL ) {
+        char*   pos = list;
+        numa_mask = 0;
+        numa_nodes = 0;
+        while ( *pos >= '0' && *pos <= '9' ) {
+            long first = strtol(pos,&pos,10);
+            long last = first;
+            if ( *pos == '-' ) last = strtol(pos + 1,&pos,10);
+            for (;first <= last && first < (long)(sizeof(numa_mask) * 8);first++) {
+                numa_mask |= (1UL << first);
+                numa_nodes++;
+            }
+            if ( *pos == ',' ) pos++;
+        }
+        if ( numa_nodes == 0 ) {
+            numa_nodes = 1;
+            numa_mask = 1;
+        }
+    }
+    fclose(online);
+#else
+    numa_nodes = 1;
+#endif
+    return numa_nodes;
+}
+
+static void
+BufferPlacementBegin(void) {
+#ifdef __linux__
+    if ( numa_interleave ) {
+        saved_policy = ( syscall(SYS_get_mempolicy,&saved_mode,saved_mask,BUFFER_MPOL_MAXNODE,NULL,0) == 0 );
+        if ( syscall(SYS_set_mempolicy,BUFFER_MPOL_INTERLEAVE,&numa_mask,sizeof(numa_mask) * 8 + 1) != 0 ) {
+            elog(DEBUG,"buffer pool -- interleave policy not set errno:%d",errno);
+        }
+    }
+#endif
+}
+
+static void
+BufferPlacementEnd(void) {
+#ifdef __linux__
+    if ( numa_interleave ) {
+        if ( !saved_policy || saved_mode == BUFFER_MPOL_DEFAULT ) {
+            syscall(SYS_set_mempolicy,BUFFER_MPOL_DEFAULT,NULL,0);
+        } else if ( syscall(SYS_set_mempolicy,saved_mode,saved_mask,BUFFER_MPOL_MAXNODE + 1) != 0 ) {
+            elog(DEBUG,"buffer pool -- memory policy not restored errno:%d",errno);
+        }
+    }
+#endif
 }
 
 int
@@ -330,7 +590,7 @@ BufferShmemSize()
             if ( NTables < 0 || NTables > 9 ) {
                 NTables = 1;
             }
-        }   
+        }
 	/* size of shmem index hash table */
 	size += hash_estimate_size(SHMEM_INDEX_SIZE,SHMEM_INDEX_ENTRYSIZE);
 
@@ -259,8 +259,8 @@ static long InitiateFlush() {
         FlushBlock.flushing = false;
         pthread_cond_broadcast(&FlushBlock.flush_wait);
         if ( iflushed ) {
-            if ( FlushBlock.flush_count++ > 0 && NBuffers < MaxBuffers ) {
-                AddMoreBuffers(NBuffers * addscale);
+            if ( FlushBlock.flush_count++ > 0 && ActiveBuffers() < MaxBuffers ) {
+                AddMoreBuffers(ActiveBuffers() * addscale);
                 FlushBlock.flush_count = 0;
             }
         }
@@ -423,6 +423,63 @@ void PutFreeBuffer(BufferDesc* bufHdr) {
     if ( put ) SetHead(bufHdr);
 }
 
+/*
+ * TakeFreeBuffer() -- take the buffer at the eviction end of the freelist
+ * without waiting, NULL when there are none.  The buffer is returned
+ * pinned and invalid, as GetFreeBuffer does, for the pool to retire it.
+ */
+BufferDesc * TakeFreeBuffer() {
+    FreeList*   lists[2];
+    int         l;
+
+    lists[0] = MasterList;
+    lists[1] = IndexList;
+
+    for (l = 0; l < 2; l++) {
+        FreeList* which = lists[l];
+        if ( which == NULL ) continue;
+
+        pthread_mutex_lock(&which->guard);
+        while ( which->head != INVALID_DESCRIPTOR ) {
+            BufferDesc* head = &BufferDescriptors[which->head];
+
+            pthread_mutex_lock(&head->cntx_lock.guard);
+            Assert((head->locflags & BM_FREE));
+            which->head = head->freeNext;
+            head->locflags &= ~(BM_FREE);
+            head->freeNext = DETACHED_DESCRIPTOR;
+            which->last = head->buf_id;
+            if ( which->head == which->tail ) {
+                which->tail = INVALID_DESCRIPTOR;
+            }
+            if ( head->refCount > 0 ) {
+                /*  pinned since it was freed, the unpin puts it back  */
+                head->locflags &= ~(BM_USED);
+                pthread_mutex_unlock(&head->cntx_lock.guard);
+                continue;
+            }
+            head->locflags &= ~(BM_VALID | BM_USED);
+            head->refCount = 1;
+            head->pageaccess = 1;
+            pthread_mutex_unlock(&head->cntx_lock.guard);
+            pthread_mutex_unlock(&which->guard);
+            return head;
+        }
+        pthread_mutex_unlock(&which->guard);
+    }
+    return NULL;
+}
+
+/*
+ * IsFreeListWaiting() -- true if a thread is waiting on an empty freelist.
+ * Read without the guard, it is only a hint for the trickle writer.
+ */
+bool IsFreeListWaiting() {
+    if ( MasterList == NULL ) return false;
+    if ( MasterList->waiting > 0 ) return true;
+    return ( IndexList != NULL && IndexList->waiting > 0 );
+}
+
 /*
  * GetFreeBuffer() -- get the 'next' buffer from the freelist.
  *
@@ -92,7 +92,9 @@ typedef struct vfd {
     int fileMode; /* mode to pass to open(2) */
     int refCount; /*  counting references  */
     int key;
+    int inflight; /* positional reads and writes using fd */
     pthread_mutex_t pin;
+    pthread_cond_t idle; /* signalled when inflight drops to zero */
     pthread_t owner;
 } Vfd;
 
@@ -179,6 +181,8 @@ static bool HashDropFD(Vfd* target);
 static bool ActivateFile(Vfd* file);
 static void RetireFile(Vfd* file);
 static bool CheckFileAccess(Vfd* target);
+static int AcquireDescriptor(Vfd* target);
+static void ReleaseDescriptor(Vfd* target, bool dirty);
 
 static bool ReleaseFileIfNeeded(void);
 
@@ -266,6 +270,22 @@ RetireFile(Vfd* vfdP) {
         return;
     }
 
+    /*  the pin is held, wait out positional I/O still using the descriptor  */
+    if (vfdP->inflight > 0) {
+        pthread_t owner = vfdP->owner;
+        int key = vfdP->key;
+
+        vfdP->owner = 0;
+        while (vfdP->inflight > 0) {
+            pthread_cond_wait(&vfdP->idle, &vfdP->pin);
+        }
+        vfdP->owner = owner;
+        vfdP->key = key;
+        if (vfdP->fd == VFD_CLOSED) {
+            return;
+        }
+    }
+
     /* save the seek position */
     vfdP->seekPos = (long) lseek(vfdP->fd, 0L, SEEK_CUR);
     vfdP->usage_count = 0;
@@ -503,6 +523,7 @@ InitializeBlock(int start) {
         target->refCount = 0;
         target->pooled = false;
         pthread_mutex_init(&target->pin, &pinattr);
+        pthread_cond_init(&target->idle, NULL);
     }
     return start;
 }
@@ -951,6 +972,153 @@ FileWrite(File file, char *buffer, int amount) {
     return request;
 }
 
+/*
+ * FileReadAt --- read at an absolute offset without touching the seek
+ * position.  The file does not need to be pinned, any number of threads
+ * may read one file at once.  Returns the bytes read, short only at end
+ * of file, or -1.
+ */
+int
+FileReadAt(File file, char *buffer, int amount, long offset) {
+    Vfd* target = GetVirtualFD(file);
+    int request = amount;
+    int fd;
+
+    Assert(FileIsValid(file));
+
+    errno = 0;
+
+    fd = AcquireDescriptor(target);
+    if (fd == VFD_CLOSED) return -1;
+
+    while (amount > 0) {
+        ssize_t blit = pread(fd, buffer, amount, offset);
+        if (blit < 0) {
+            /*  the caller reports errno, keep it past the notice  */
+            int save_errno = errno;
+            elog(NOTICE, "bad read file: %s loc: %ld err: %s", target->fileName, offset, strerror(save_errno));
+            ReleaseDescriptor(target, false);
+            errno = save_errno;
+            return -1;
+        } else if (blit == 0) {
+            /* EOF  */
+            break;
+        }
+        amount -= blit;
+        buffer += blit;
+        offset += blit;
+    }
+
+    ReleaseDescriptor(target, false);
+
+    return (request - amount);
+}
+
+/*
+ * FileWriteAt --- write at an absolute offset, the counterpart of
+ * FileReadAt.
+ */
+int
+FileWriteAt(File file, char *buffer, int amount, long offset) {
+    Vfd* target = GetVirtualFD(file);
+    int request = amount;
+    int fd;
+
+    Assert(FileIsValid(file));
+
+    errno = 0;
+
+    fd = AcquireDescriptor(target);
+    if (fd == VFD_CLOSED) return -1;
+
+    while (amount > 0) {
+        ssize_t blit = pwrite(fd, buffer, amount, offset);
+        if (blit < 0) {
+            int save_errno = errno;
+            elog(NOTICE, "bad write file: %s loc: %ld err: %s", target->fileName, offset, strerror(save_errno));
+            ReleaseDescriptor(target, false);
+            errno = save_errno;
+            return -1;
+        } else if (blit == 0) {
+            elog(NOTICE, "partial write %s", target->fileName);
+            break;
+        }
+        buffer += blit;
+        amount -= blit;
+        offset += blit;
+    }
+
+    /* mark the file as needing fsync */
+    ReleaseDescriptor(target, (request != amount));
+
+    return (request - amount);
+}
+
+/*
+ * FilePrefetch --- tell the kernel a range of the file will be read soon.
+ * Only a hint, returns 0 when it was given or is not supported.
+ */
+int
+FilePrefetch(File file, long offset, long amount) {
+    int result = 0;
+#ifdef POSIX_FADV_WILLNEED
+    Vfd* target = GetVirtualFD(file);
+    int fd;
+
+    Assert(FileIsValid(file));
+
+    fd = AcquireDescriptor(target);
+    if (fd == VFD_CLOSED) return -1;
+
+    result = posix_fadvise(fd, offset, amount, POSIX_FADV_WILLNEED);
+
+    ReleaseDescriptor(target, false);
+#endif
+    return result;
+}
+
+/*
+ * the pin is only held while the file is opened and the access counted,
+ * not across the I/O.  A thread that already has the file pinned uses
+ * its pin.
+ */
+static int
+AcquireDescriptor(Vfd* target) {
+    bool pinned = pthread_equal(target->owner, pthread_self());
+    int fd = VFD_CLOSED;
+
+    if (!pinned) {
+        pthread_mutex_lock(&target->pin);
+        target->owner = pthread_self();
+    }
+
+    if (CheckFileAccess(target)) {
+        fd = target->fd;
+        target->inflight++;
+    }
+
+    if (!pinned) {
+        target->owner = 0;
+        pthread_mutex_unlock(&target->pin);
+    }
+
+    return fd;
+}
+
+static void
+ReleaseDescriptor(Vfd* target, bool dirty) {
+    bool pinned = pthread_equal(target->owner, pthread_self());
+
+    if (!pinned) pthread_mutex_lock(&target->pin);
+
+    if (dirty) target->fdstate |= FD_DIRTY;
+    if (--target->inflight == 0) {
+        pthread_cond_broadcast(&target->idle);
+    }
+
+    if (!pinned) pthread_mutex_unlock(&target->pin);
+}
+
 long
 FileSeek(File file, long offset, int whence) {
     Vfd* target = GetVirtualFD(file);
@@ -1328,7 +1496,7 @@ ReleaseFileIfNeeded() {
                     /* only trylock  */
                     continue;
                 }
-                if (target->fd == VFD_CLOSED) {
+                if (target->fd == VFD_CLOSED || target->inflight > 0) {
                     pthread_mutex_unlock(&target->pin);
                     continue;
                 }
@@ -1355,7 +1523,7 @@ ReleaseFileIfNeeded() {
 
         if (target != NULL) {
             pthread_mutex_lock(&target->pin);
-            if (target->sweep_valid && target->fd != VFD_CLOSED) {
+            if (target->sweep_valid && target->fd != VFD_CLOSED && target->inflight == 0) {
                 RetireFile(target);
             }
             pthread_mutex_unlock(&target->pin);
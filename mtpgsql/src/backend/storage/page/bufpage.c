@@ -16,11 +16,13 @@
 
 
 #include <sys/file.h>
+#include <time.h>
 
 #include "postgres.h"
 
 #include "storage/bufpage.h"
 #include "env/pg_crc.h"
+#include "env/properties.h"
 
 bool        disable_crc = true;
 
@@ -28,6 +30,21 @@ static void PageIndexTupleDeleteAdjustLinePointers(PageHeader phdr,
 									   char *location, Size size);
 
 static bool PageManagerShuffle = true;	/* default is shuffle mode */
+
+/*
+ *  a full checksum is a CRC32C of every byte after the checksum word,
+ *  tagged in the high word.  Untagged checksums are the sampled CRC64 of
+ *  the last 64 bytes of every 1K from the line pointers on, pages
+ *  written before full checksums still verify against it.
+ */
+#define PAGE_CHECKSUM_FULL		UINT64CONST(0x4352433200000000)
+#define PAGE_CHECKSUM_TAG_MASK	UINT64CONST(0xFFFFFFFF00000000)
+
+static int  full_checksums = -1;
+
+static bool PageFullChecksums(void);
+static uint64 PageSampledChecksum(Page page);
+static uint64 PageFullChecksum(Page page);
 	
 static void PageSetLinePointerCount(Page page,Size loc);
 
@@ -405,6 +422,11 @@ DisableCRC(bool enable) {
 	return prev != disable_crc;
 }
 
+bool
+PageChecksumsEnabled(void) {
+    return !disable_crc;
+}
+
 /*
  *----------------------------------------------------------------
  * PageIndexTupleDelete
@@ -537,19 +559,47 @@ bool PageIsEmpty(Page page)
         }
 }
 
+/*
+ *  the page_checksum property set to sampled keeps writing the old
+ *  checksum, for going back to a build without full checksums
+ */
+static bool PageFullChecksums(void)
+{
+    if ( full_checksums < 0 ) {
+        char* kind = GetProperty("page_checksum");
+        full_checksums = ( kind != NULL && strcasecmp(kind,"sampled") == 0 ) ? 0 : 1;
+    }
+    return ( full_checksums > 0 );
+}
+
+static uint64 PageSampledChecksum(Page page)
+{
+    PageHeader ph = (PageHeader)page;
+    long len = BLCKSZ - ((unsigned long)&ph->pd_linp - (unsigned long)page);
+
+    return (uint64)checksum_block((unsigned char*)&ph->pd_linp,len);
+}
+
+static uint64 PageFullChecksum(Page page)
+{
+    PageHeader ph = (PageHeader)page;
+    long len = BLCKSZ - ((unsigned long)&ph->pd_lower - (unsigned long)page);
+
+    return PAGE_CHECKSUM_FULL | crc32c_block((unsigned char*)&ph->pd_lower,len);
+}
+
 crc64 PageInsertChecksum(Page page)
 {
     PageHeader ph = (PageHeader)page;
-    long len = BLCKSZ;
 
     if ( disable_crc ) {
         ph->checksum = InvalidCRC64;
-        return ph->checksum;
+    } else if ( PageFullChecksums() ) {
+        ph->checksum = PageFullChecksum(page);
     } else {
-        len = len - ((unsigned long)&ph->pd_linp - (unsigned long)page);
-        ph->checksum = (uint64)checksum_block((unsigned char*)&ph->pd_linp,len); 
-        return (crc64)ph->checksum;
+        ph->checksum = PageSampledChecksum(page);
     }
+    return (crc64)ph->checksum;
 }
 
 crc64 PageInsertInvalidChecksum(Page page)
@@ -561,18 +611,56 @@ crc64 PageInsertInvalidChecksum(Page page)
 
 bool PageConfirmChecksum(Page page)
 {
-    crc64 checksum,confirm;
     PageHeader ph = (PageHeader)page;
     
     if ( disable_crc ) return true;
 
     if ( ph->checksum == InvalidCRC64 || ph->checksum == InitCRC64 ) return true;
 
-    int len = BLCKSZ;
-    len = len - ((unsigned long)&ph->pd_linp - (unsigned long)page);
-    checksum = ph->checksum;
-    confirm = (crc64)checksum_block((unsigned char*)&ph->pd_linp,len); 
-    return eq_crc64(checksum,confirm);
+    if ( (ph->checksum & PAGE_CHECKSUM_TAG_MASK) == PAGE_CHECKSUM_FULL &&
+            ph->checksum == PageFullChecksum(page) ) {
+        return true;
+    }
+    /*  a sampled checksum can carry the tag by chance, try it as well  */
+    return eq_crc64((crc64)ph->checksum,(crc64)PageSampledChecksum(page));
+}
+
+/*
+ *  time both checksums over a page of random bytes and report the cost
+ *  of each per page
+ */
+void PageChecksumBenchmark(int pages)
+{
+    Page            page = palloc(BLCKSZ);
+    struct timespec start, end;
+    volatile uint64 sink = 0;
+    double          full, sampled;
+    int             i;
+
+    if ( pages <= 0 ) pages = 100000;
+
+    for (i = 0; i < BLCKSZ; i++) {
+        ((unsigned char*)page)[i] = (unsigned char)random();
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (i = 0; i < pages; i++) {
+        sink ^= PageFullChecksum(page);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    full = ((end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec)) / pages;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (i = 0; i < pages; i++) {
+        sink ^= PageSampledChecksum(page);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    sampled = ((end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec)) / pages;
+
+    elog(NOTICE, "page checksum benchmark -- %d pages of %d bytes, full crc32c (%s): %.1f ns/page, sampled crc64: %.1f ns/page",
+        pages, BLCKSZ, crc32c_implementation(), full, sampled);
+
+    pfree(page);
 }
 
 bool PageChecksumIsInvalid(Page page) {
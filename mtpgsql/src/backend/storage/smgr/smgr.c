@@ -52,6 +52,7 @@ typedef struct f_smgr {
     int (*smgr_commitlog) (void);
     int (*smgr_expirelogs) (void);
     int (*smgr_replaylogs) (void);
+    int (*smgr_prefetch) (SmgrInfo info, BlockNumber blocknum, int count); /* may be NULL */
 } f_smgr;
 
 /*
@@ -70,7 +71,7 @@ static f_smgr smgrsw[] = {
     {vfdinit, vfdshutdown, vfdcreate, vfdunlink, vfdextend, vfdopen, vfdclose,
         vfdread, vfdwrite, vfdflush, vfdmarkdirty,
         vfdnblocks, vfdtruncate, vfdsync, vfdcommit, vfdabort, vfdbeginlog, vfdlog, vfdcommitlog,
-        vfdexpirelogs, vfdreplaylogs},
+        vfdexpirelogs, vfdreplaylogs, vfdprefetch},
 #ifdef ZFS
     /* zfs dmu layer */
     {zfsinit, zfsshutdown, zfscreate, zfsunlink, zfsextend, zfsopen, zfsclose,
@@ -376,6 +377,21 @@ smgrnblocks(SmgrInfo info) {
     return info->nblocks;
 }
 
+/*
+ *	smgrprefetch() -- Hint that count blocks starting at blocknum will
+ *					  be read soon.
+ *
+ *		The read is started in the background where the storage manager
+ *		can, nothing happens where it cannot.
+ */
+int
+smgrprefetch(SmgrInfo info, BlockNumber blocknum, int count) {
+    if (smgrsw[info->which].smgr_prefetch == NULL || count <= 0)
+        return SM_SUCCESS;
+
+    return (*(smgrsw[info->which].smgr_prefetch)) (info, blocknum, count);
+}
+
 /*
  *	smgrtruncate() -- Truncate supplied relation to a specified number
  *						of blocks
@@ -19,6 +19,9 @@
 #include <unistd.h>
 #include <fcntl.h>
 #include <sys/file.h>
+#ifdef __linux__
+#include <sys/vfs.h>
+#endif
 
 
 #include "postgres.h"
@@ -31,6 +34,9 @@
 #include "utils/relcache.h"
 #include "env/properties.h"
 #include "utils/lzf.h"
+#include "utils/hsearch.h"
+#include "utils/memutils.h"
+#include "storage/bufpage.h"
 
 #undef DIAGNOSTIC
 
@@ -54,6 +60,7 @@ static union  logbuffer {
         int64    segments;
         bool    completed;
         bool    compressed;
+        bool    imageless;  /* only the blocks written are listed */
         pthread_t   owner;
     } LogHeader;
     char        block[BLCKSZ];
@@ -73,6 +80,30 @@ static union segmentstore {
 
 static int max_blocks;
 
+/*
+ *  block counts shared by every thread with the relation open.  Each
+ *  SmgrInfo holds a reference to the entry for its relation in info->info
+ *  so a count is read without a lookup, a lock or a system call.  Only
+ *  extend, truncate and unlink change an entry, under its guard; readers
+ *  load the count as is.  A count of -1 is not known yet and is measured
+ *  from the file the next time it is asked for.
+ */
+typedef struct vfdsizekey {
+	Oid		relid;
+	Oid		dbid;
+} VfdSizeKey;
+
+typedef struct vfdsize {
+	VfdSizeKey      key;
+	int             refs;       /* SmgrInfos pointing here */
+	pthread_mutex_t guard;
+	volatile long   nblocks;
+} VfdSize;
+
+static HTAB*            size_table;
+static pthread_mutex_t  size_access;
+static MemoryContext    size_cxt;
+
 
 /*  block cache space, created in the init script  */
 
@@ -80,6 +111,11 @@ static char*        scratch_space;
 static int          scratch_loc = 0;
 static bool         compress_log = FALSE;
 static bool         log_index = TRUE;
+/*
+ *  with atomic block writes a page is never torn, only the blocks about
+ *  to be written are logged so a crash can still be checked for them
+ */
+static bool         log_images = TRUE;
 
 /* routines declared here */
 static BlockNumber _vfdnblocks(File file, Size blcksz);
@@ -87,11 +123,22 @@ static int _vfddumplogtodisk(void);
 
 static bool _vfdreplaylogfile(File logfile, bool indexonly);
 static long _vfdreplaysegment(File logfile,bool indexingonly, bool compressed);
+static long _vfdverifysegment(File logfile,bool indexingonly);
+static bool _vfdlogimages(void);
+static bool _vfdcopyonwrite(char* path);
 
 static File _openlogfile(char* path, bool replay);
 
 static void  vfd_log(char* pattern, ...);
 
+static void* _vfdsizealloc(Size size, void* cxt);
+static void _vfdsizefree(void* pointer, void* cxt);
+static VfdSize* _vfdsizeattach(SmgrInfo info);
+static void _vfdsizedetach(VfdSize* size);
+static void _vfdsizegrow(VfdSize* size, long nblocks);
+static void _vfdsizereset(VfdSize* size, long nblocks);
+static void _vfdsizeforget(Oid dbid, Oid relid);
+
 
 
 
@@ -144,9 +191,30 @@ vfdinit()
       if ( PropertyIsValid("vfdcompress_log") ) {
           compress_log = GetBoolProperty("vfdcompress_log");
       }  
+
+      log_images = _vfdlogimages();
       
     log_file = _openlogfile(logfile_path, false);
 
+    if ( size_table == NULL ) {
+        HASHCTL ctl;
+
+        size_cxt = AllocSetContextCreate((MemoryContext) NULL,
+                                        "VfdSizeMemoryContext",
+                                        ALLOCSET_DEFAULT_MINSIZE,
+                                        ALLOCSET_DEFAULT_INITSIZE,
+                                        ALLOCSET_DEFAULT_MAXSIZE);
+        memset(&ctl, 0, sizeof(HASHCTL));
+        ctl.keysize = sizeof(VfdSizeKey);
+        ctl.entrysize = sizeof(VfdSize);
+        ctl.hash = tag_hash;
+        ctl.alloc = _vfdsizealloc;
+        ctl.free = _vfdsizefree;
+        ctl.hcxt = size_cxt;
+        size_table = hash_create("vfd size hash", 256, &ctl, HASH_ELEM | HASH_ALLOC | HASH_FUNCTION | HASH_CONTEXT);
+        pthread_mutex_init(&size_access, &process_mutex_attr);
+    }
+
     max_blocks = ((sizeof(SegmentStore) - MAXALIGN((char*)&SegmentStore - (char*)&SegmentStore.header.blocks)) / sizeof(SmgrData));
     log_count = 0;
         
@@ -166,6 +234,7 @@ vfdshutdown()
         LogBuffer.LogHeader.log_id = log_count;
         LogBuffer.LogHeader.completed = false;
         LogBuffer.LogHeader.compressed = compress_log;
+        LogBuffer.LogHeader.imageless = !log_images;
         LogBuffer.LogHeader.segments = 0;  
 
         log_pos = FileSeek(log_file,0,SEEK_END);
@@ -218,6 +287,7 @@ vfdcreate(SmgrInfo info)
 	}
 	info->unlinked = false;
         info->fd = fd;
+        info->info = _vfdsizeattach(info);
 
 	pfree(path);
 
@@ -257,6 +327,10 @@ vfdunlink(SmgrInfo info)
 
 	FileUnlink(fd);
 
+        _vfdsizereset(info->info, -1);
+        _vfdsizedetach(info->info);
+        info->info = NULL;
+
 	/* be sure to mark relation closed && unlinked */
 	info->fd = -1;
 	info->unlinked = true;
@@ -309,6 +383,7 @@ vfdextend(SmgrInfo info, char *buffer, int count)
                 }
                 FileUnpin(fd, 1);
                 FileBaseSync(fd,pos);
+                _vfdsizereset(info->info, -1);
                 return SM_FAIL;
             }
         }
@@ -316,6 +391,7 @@ vfdextend(SmgrInfo info, char *buffer, int count)
         FileUnpin(fd, 1);
         
         info->nblocks = (BlockNumber)((pos / BLCKSZ) + count);
+        _vfdsizegrow(info->info, info->nblocks);
 
 	return SM_SUCCESS;
 }
@@ -352,6 +428,7 @@ vfdopen(SmgrInfo info)
         Assert(strcmp(path,FileGetName(fd)) == 0);
 	info->unlinked = false;
         info->fd = fd;
+        info->info = _vfdsizeattach(info);
 
 	pfree(path);
 
@@ -379,6 +456,8 @@ vfdclose(SmgrInfo info)
 	FileClose(fd);
 
 	info->fd = -1;
+        _vfdsizedetach(info->info);
+        info->info = NULL;
 
 	return SM_SUCCESS;
 }
@@ -393,6 +472,7 @@ int
 vfdread(SmgrInfo info, BlockNumber blocknum, char *buffer)
 {
 	long		seekpos;
+	long		checkpos = 0;
 	int		blit = 0;
         File            fd = info->fd;
         int status =  SM_SUCCESS;
@@ -405,37 +485,32 @@ vfdread(SmgrInfo info, BlockNumber blocknum, char *buffer)
             return SM_FAIL;
         }
 
-        FilePin(fd, 3);
         Assert(strstr(FileGetName(fd),NameStr(info->relname))!=NULL);
-	if (FileSeek(fd, seekpos, SEEK_SET) != seekpos) {
-            elog(NOTICE,"bad read seek filename:%s, %ld db:%s,rel:%s,blk no.:%lu",FileGetName(fd),seekpos,NameStr(info->dbname),NameStr(info->relname),blocknum);
-            status = SM_FAIL_SEEK;
-        } else {
-            blit = FileRead(fd, buffer, BLCKSZ);
-            if (blit < 0) {
-                elog(NOTICE,"bad read %d filename:%s, db:%s,rel:%s,blk no.:%lu",errno,FileGetName(fd),NameStr(info->dbname),NameStr(info->relname),blocknum);
-                status = SM_FAIL_BASE;
-            } else if ( blit == 0 ) {
-                long checkpos = FileSeek(fd,0L,SEEK_END);
-                MemSet(buffer, 0, BLCKSZ);
-                if ( seekpos >= checkpos ) {
-                    if ( seekpos > checkpos ) {
-                        elog(NOTICE,"read past end of file filename: %s, rel: %s %ld %ld",FileGetName(fd), NameStr(info->relname),seekpos,checkpos);
-                    }
-                    status = SM_FAIL_EOF;
-                } else {
-                    if (FileSeek(fd, seekpos, SEEK_SET) != seekpos) {
-                        elog(NOTICE,"read past end of file filename: %s, rel: %s %ld %ld",FileGetName(fd), NameStr(info->relname),seekpos,checkpos);
-                        status = SM_FAIL_SEEK;
-                    }
-                }
-            } else if ( blit != BLCKSZ ) {
-                elog(NOTICE,"bad read %d filename:%s,db:%s,rel:%s,blk no.:%lu,read length:%d",errno,FileGetName(fd),NameStr(info->dbname),NameStr(info->relname),blocknum,blit);
-                status = SM_FAIL_BASE;
+        blit = FileReadAt(fd, buffer, BLCKSZ, seekpos);
+        if ( blit == 0 ) {
+            /*  only reached past the end, pin to find out how far  */
+            FilePin(fd, 3);
+            checkpos = FileSeek(fd,0L,SEEK_END);
+            FileUnpin(fd, 3);
+            /*  the file grew since the read, try once more  */
+            if ( seekpos < checkpos ) {
+                blit = FileReadAt(fd, buffer, BLCKSZ, seekpos);
             }
         }
+        if (blit < 0) {
+            elog(NOTICE,"bad read %d filename:%s, db:%s,rel:%s,blk no.:%lu",errno,FileGetName(fd),NameStr(info->dbname),NameStr(info->relname),blocknum);
+            status = SM_FAIL_BASE;
+        } else if ( blit == 0 ) {
+            MemSet(buffer, 0, BLCKSZ);
+            if ( seekpos > checkpos ) {
+                elog(NOTICE,"read past end of file filename: %s, rel: %s %ld %ld",FileGetName(fd), NameStr(info->relname),seekpos,checkpos);
+            }
+            status = SM_FAIL_EOF;
+        } else if ( blit != BLCKSZ ) {
+            elog(NOTICE,"bad read %d filename:%s,db:%s,rel:%s,blk no.:%lu,read length:%d",errno,FileGetName(fd),NameStr(info->dbname),NameStr(info->relname),blocknum,blit);
+            status = SM_FAIL_BASE;
+        }
 
-        FileUnpin(fd, 3);
 	return status;
 }
 
@@ -453,17 +528,10 @@ vfdwrite(SmgrInfo info, BlockNumber blocknum, char *buffer)
 
 	seekpos = (long) (BLCKSZ * (blocknum));
 
-        FilePin(fd, 4);
-	if (FileSeek(fd, seekpos, SEEK_SET) != seekpos) {
-                FileUnpin(fd, 4);
-		return SM_FAIL;
-        }
-
 	status = SM_SUCCESS;
-	if (FileWrite(fd, buffer, BLCKSZ) != BLCKSZ)
+	if (FileWriteAt(fd, buffer, BLCKSZ, seekpos) != BLCKSZ)
 		status = SM_FAIL;
 
-        FileUnpin(fd, 4);
 	return status;
 }
 
@@ -483,26 +551,37 @@ vfdflush(SmgrInfo info, BlockNumber blocknum, char *buffer)
 
 	seekpos = (long) (BLCKSZ * (blocknum));
 
-        FilePin(fd, 5);
-	if (FileSeek(fd, seekpos, SEEK_SET) != seekpos) {
-            FileUnpin(fd, 5);
-		return SM_FAIL;
-        }
-
-	/* write and sync the block */
+	/* write and sync the block, the sync needs the file pinned */
 	status = SM_SUCCESS;
-	if (FileWrite(fd, buffer, BLCKSZ) == BLCKSZ ) {
+	if (FileWriteAt(fd, buffer, BLCKSZ, seekpos) == BLCKSZ ) {
+            FilePin(fd, 5);
             if (FileSync(fd) < 0) {
 		status = SM_FAIL;
             }
+            FileUnpin(fd, 5);
         } else {
             status = SM_FAIL;
         }
             
-        FileUnpin(fd, 5);
 	return status;
 }
 
+/*
+ *	vfdprefetch() -- Start reading blocks the caller will want soon.
+ */
+int
+vfdprefetch(SmgrInfo info, BlockNumber blocknum, int count)
+{
+        File            fd = info->fd;
+
+        if ( fd < 0 ) return SM_FAIL;
+
+        if ( FilePrefetch(fd, (long) BLCKSZ * blocknum, (long) BLCKSZ * count) != 0 ) {
+            return SM_FAIL;
+        }
+        return SM_SUCCESS;
+}
+
 /*
  *	vfdmarkdirty() -- Mark the specified block "dirty" (ie, needs fsync).
  *
@@ -532,11 +611,16 @@ int
 vfdnblocks(SmgrInfo info)
 {
 	File        fd = info->fd;
-        BlockNumber         count = InvalidBlockNumber;
-        FilePin(fd, 6);
-	count = _vfdnblocks(fd, BLCKSZ);
+        VfdSize*    size = info->info;
+        long        count = (size != NULL) ? size->nblocks : -1;
+
+        if ( count < 0 ) {
+            FilePin(fd, 6);
+            count = _vfdnblocks(fd, BLCKSZ);
+            FileUnpin(fd, 6);
+            _vfdsizegrow(size, count);
+        }
         info->nblocks = count;
-        FileUnpin(fd, 6);
         return SM_SUCCESS;
 }
 
@@ -595,6 +679,7 @@ vfdtruncate(SmgrInfo info, long nblocks)
         
         FileBaseSync(fd,nblocks * BLCKSZ);
         info->nblocks = nblocks;
+        _vfdsizereset(info->info, nblocks);
 
         FileUnpin(fd, 7);
 
@@ -651,6 +736,113 @@ _vfdnblocks(File file, Size blcksz)
 	return (BlockNumber) (len / blcksz);
 }
 
+static void*
+_vfdsizealloc(Size size, void* cxt)
+{
+	return MemoryContextAlloc(cxt, size);
+}
+
+static void
+_vfdsizefree(void* pointer, void* cxt)
+{
+	pfree(pointer);
+}
+
+static VfdSize*
+_vfdsizeattach(SmgrInfo info)
+{
+	VfdSizeKey      key;
+	VfdSize*        size;
+	bool            found;
+
+	memset(&key, 0, sizeof(VfdSizeKey));
+	key.relid = info->relid;
+	key.dbid = info->dbid;
+
+	pthread_mutex_lock(&size_access);
+	size = (VfdSize*) hash_search(size_table, (char*) &key, HASH_ENTER, &found);
+	if ( size == NULL ) {
+		pthread_mutex_unlock(&size_access);
+		elog(FATAL, "vfd size hash corrupted");
+	}
+	if ( !found ) {
+		size->refs = 0;
+		size->nblocks = -1;
+		pthread_mutex_init(&size->guard, &process_mutex_attr);
+	}
+	size->refs++;
+	pthread_mutex_unlock(&size_access);
+
+	return size;
+}
+
+static void
+_vfdsizedetach(VfdSize* size)
+{
+	VfdSizeKey      key;
+	bool            found;
+
+	if ( size == NULL ) return;
+
+	pthread_mutex_lock(&size_access);
+	if ( --size->refs == 0 ) {
+		key = size->key;
+		pthread_mutex_destroy(&size->guard);
+		hash_search(size_table, (char*) &key, HASH_REMOVE, &found);
+	}
+	pthread_mutex_unlock(&size_access);
+}
+
+/*
+ *  raise the count, extensions that finish out of order cannot
+ *  shrink it.
+ */
+static void
+_vfdsizegrow(VfdSize* size, long nblocks)
+{
+	if ( size == NULL ) return;
+
+	pthread_mutex_lock(&size->guard);
+	if ( size->nblocks < 0 || nblocks > size->nblocks ) {
+		size->nblocks = nblocks;
+	}
+	pthread_mutex_unlock(&size->guard);
+}
+
+static void
+_vfdsizereset(VfdSize* size, long nblocks)
+{
+	if ( size == NULL ) return;
+
+	pthread_mutex_lock(&size->guard);
+	size->nblocks = nblocks;
+	pthread_mutex_unlock(&size->guard);
+}
+
+/*
+ *  the file was changed outside of the smgr, measure it again
+ */
+static void
+_vfdsizeforget(Oid dbid, Oid relid)
+{
+	VfdSizeKey      key;
+	VfdSize*        size;
+	bool            found;
+
+	if ( size_table == NULL ) return;
+
+	memset(&key, 0, sizeof(VfdSizeKey));
+	key.relid = relid;
+	key.dbid = dbid;
+
+	pthread_mutex_lock(&size_access);
+	size = (VfdSize*) hash_search(size_table, (char*) &key, HASH_FIND, &found);
+	if ( size != NULL && found ) {
+		_vfdsizereset(size, -1);
+	}
+	pthread_mutex_unlock(&size_access);
+}
+
 
 int
 vfdbeginlog() {        
@@ -658,6 +850,7 @@ vfdbeginlog() {
     LogBuffer.LogHeader.log_id = log_count++;
     LogBuffer.LogHeader.completed = false;
     LogBuffer.LogHeader.compressed = compress_log;
+    LogBuffer.LogHeader.imageless = !log_images;
     LogBuffer.LogHeader.segments = 0;  
     FilePin(log_file,0); 
     log_pos = FileSeek(log_file,0,SEEK_END);
@@ -681,7 +874,9 @@ vfdlog(SmgrInfo info,BlockNumber block, char* buffer) {
     
     info->nblocks = block;
     memmove(SegmentStore.header.blocks + SegmentStore.header.count,info,sizeof(SmgrData)); 
-    if ( compress_log ) {
+    if ( !log_images ) {
+        /*  the block goes to its relation once, in place  */
+    } else if ( compress_log ) {
         put = lzf_compress(buffer,BLCKSZ,scratch_space + scratch_loc + 4,BLCKSZ-1);
         if ( !put ) {
             put = BLCKSZ;
@@ -710,7 +905,7 @@ _vfddumplogtodisk() {
     SegmentStore.header.seg_id = LogBuffer.LogHeader.segments++;
     FilePin(log_file,0);
     ret += FileWrite(log_file,SegmentStore.data,BLCKSZ);
-    ret += FileWrite(log_file,scratch_space,scratch_loc);
+    if ( scratch_loc > 0 ) ret += FileWrite(log_file,scratch_space,scratch_loc);
     scratch_loc = 0;
     SegmentStore.header.count = 0;
     FileUnpin(log_file,0); 
@@ -829,7 +1024,9 @@ _vfdreplaylogfile(File logfile, bool indexonly) {
             (LogBuffer.LogHeader.completed) ? "true":"false",LogBuffer.LogHeader.segments);   
         
         for ( count=0;count<LogBuffer.LogHeader.segments;count++) {
-            long add =  _vfdreplaysegment(logfile,indexonly,LogBuffer.LogHeader.compressed);
+            long add = ( LogBuffer.LogHeader.imageless ) ?
+                _vfdverifysegment(logfile,indexonly) :
+                _vfdreplaysegment(logfile,indexonly,LogBuffer.LogHeader.compressed);
             if ( add < 0 ) {
                 vfd_log("exiting due to invalid segment");
                 break;
@@ -918,6 +1115,7 @@ _vfdreplaysegment(File logfile,bool indexingonly, bool compressed) {
                 if ( fd > 0 ) {
                     FileSeek(fd,info->nblocks * BLCKSZ,SEEK_SET);
                     FileWrite(fd,write_block,BLCKSZ);
+                    _vfdsizeforget(cdb,crel);
                     if (info->relkind == RELKIND_INDEX ) {
                         smgraddrecoveredpage(NameStr(info->dbname),cdb,crel,info->nblocks);
                     }
@@ -934,6 +1132,148 @@ _vfdreplaysegment(File logfile,bool indexingonly, bool compressed) {
         return total; 
 }
 
+/*
+ *  a log without page images only lists the blocks that were being
+ *  written.  Each one is read back and checked against its checksum, a
+ *  torn index page is rebuilt by recovery, a torn heap page is reported
+ *  and left to the heap_corruption handling when it is read.
+ */
+static long
+_vfdverifysegment(File logfile,bool indexingonly) {
+        int count = 0;
+        long ret = 0;
+        File fd = -1;
+        Oid crel = 0,cdb = 0;
+        char* read_block = scratch_space;
+        int torn = 0;
+
+        ret = FileRead(logfile,SegmentStore.data,BLCKSZ);
+
+        if ( ret != BLCKSZ ) {
+            return -1;
+        }
+
+        if ( SegmentStore.header.segment_magic != SEGMENT_MAGIC ) {
+            vfd_log("VFD Seg ID: %d segment is invalid skipping",SegmentStore.header.seg_id);
+            return -1;
+        }
+
+        vfd_log("VFD Seg ID: %d verify count: %d",SegmentStore.header.seg_id,SegmentStore.header.count);
+
+        for (count=0;count<SegmentStore.header.count;count++) {
+            SmgrInfo info = &SegmentStore.header.blocks[count];
+
+            if ( indexingonly ) {
+                if (info->relkind == RELKIND_INDEX ) {
+                        smgraddrecoveredpage(NameStr(info->dbname),info->dbid,info->relid,info->nblocks);
+                }
+                continue;
+            }
+
+            if ( cdb != info->dbid || crel != info->relid) {
+                char* path = relpath_blind(NameStr(info->dbname),NameStr(info->relname),info->dbid,info->relid);
+                if ( fd > 0 ) {
+                    FileUnpin(fd,0);
+                    FileClose(fd);
+                }
+                fd = FileNameOpenFile(path, O_RDONLY | O_LARGEFILE, 0600);
+                if ( fd >= 0 ) {
+                    FilePin(fd,0);
+                    cdb = info->dbid;
+                    crel = info->relid;
+                }
+                pfree(path);
+            }
+
+            if ( fd < 0 ) {
+                vfd_log("%s-%s not opened, block not verified",NameStr(info->dbname),NameStr(info->relname));
+                continue;
+            }
+
+            FileSeek(fd,info->nblocks * BLCKSZ,SEEK_SET);
+            if ( FileRead(fd,read_block,BLCKSZ) != BLCKSZ ) {
+                /*  never made it to disk, the relation was not extended  */
+                continue;
+            }
+            if ( PageIsNew((Page)read_block) || PageConfirmChecksum((Page)read_block) ) {
+                continue;
+            }
+
+            torn++;
+            if (info->relkind == RELKIND_INDEX ) {
+                smgraddrecoveredpage(NameStr(info->dbname),cdb,crel,info->nblocks);
+            } else {
+                elog(NOTICE, "torn page found in recovery %s-%s block:%ld",
+                    NameStr(info->relname),NameStr(info->dbname),info->nblocks);
+            }
+        }
+        if ( fd > 0 ) {
+            FileUnpin(fd,0);
+            FileClose(fd);
+        }
+        if ( torn > 0 ) {
+            vfd_log("VFD Seg ID: %d torn pages: %d",SegmentStore.header.seg_id,torn);
+        }
+
+        return BLCKSZ;
+}
+
+/*
+ *  the shadowlog property picks what is logged ahead of a write.  full,
+ *  the default, logs a copy of every page.  verify only lists the
+ *  blocks, for storage that writes a block atomically.  auto does the
+ *  same when the data directory is on a copy-on-write filesystem.
+ *  Without page checksums a torn page can not be found so full pages
+ *  are logged whatever is asked for.
+ */
+static bool
+_vfdlogimages() {
+    char*   mode = GetProperty("shadowlog");
+    bool    verify = false;
+
+    if ( mode == NULL || strcasecmp(mode,"full") == 0 ) {
+        return TRUE;
+    } else if ( strcasecmp(mode,"verify") == 0 ) {
+        verify = true;
+    } else if ( strcasecmp(mode,"auto") == 0 ) {
+        verify = _vfdcopyonwrite(DataDir);
+        if ( !verify ) {
+            elog(DEBUG,"shadow log -- %s is not copy-on-write, logging full pages",DataDir);
+        }
+    } else {
+        elog(NOTICE,"shadow log -- unknown mode %s, logging full pages",mode);
+    }
+
+    if ( verify && !PageChecksumsEnabled() ) {
+        elog(NOTICE,"shadow log -- page checksums are off, logging full pages");
+        verify = false;
+    }
+    if ( verify ) {
+        elog(DEBUG,"shadow log -- logging written blocks only");
+    }
+    return !verify;
+}
+
+static bool
+_vfdcopyonwrite(char* path) {
+#ifdef __linux__
+    struct statfs   fs;
+
+    if ( statfs(path,&fs) != 0 ) {
+        return false;
+    }
+    switch ( (unsigned long)fs.f_type ) {
+        case 0x9123683EUL:  /*  btrfs  */
+        case 0x2FC12FC1UL:  /*  zfs  */
+            return true;
+        default:
+            return false;
+    }
+#else
+    return false;
+#endif
+}
+
 void  vfd_log(char* pattern, ...) {
     char            msg[256];
     va_list         args;
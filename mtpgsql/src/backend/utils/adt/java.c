@@ -23,6 +23,7 @@
 #include "utils/syscache.h"
 #include "catalog/pg_proc.h"
 #include "access/blobstorage.h"
+#include "lib/stringinfo.h"
 
 static          Datum
                 ConvertFromJavaArg(Oid type, jvalue val, bool* isNull);
@@ -41,6 +42,7 @@ static pthread_key_t   attaches;
 #define INV_TAG_INT8        20
 #define INV_TAG_FLOAT8      701
 #define INV_TAG_BOOL        16
+#define INV_TAG_VARCHAR     1043
 #define INV_TAG_JAVA_OBJECT 1830
 #define INV_TAG_NULL        -1
 #define INV_TAG_ERROR       -99   // Error payload written by Java invoker
@@ -50,6 +52,11 @@ static pthread_key_t   attaches;
  */
 static void* java_ffm_invoker = NULL;
 
+/* batched counterpart set via WRegisterJavaBatchInvoker, used by
+ * fmgr_cached_javaA_batch to pass many rows in one upcall.
+ */
+static void* java_ffm_batch_invoker = NULL;
+
 static jclass loader_class;
 static jmethodID loader_out;
 static jmethodID loader_in;
@@ -111,6 +118,33 @@ static int  CallJavaInvokerWithGrowableResult(InvokerFn fn,
                                               char **resultBufOut, int *resultLenOut);
 static int  InspectWrittenResultSize(const char *buf, int bufSize);
 
+/* Batched FFM invoker
+ *
+ *   int batchInvoker(
+ *       const char *className,
+ *       const char *methodName,
+ *       const char *methodDesc,
+ *       int         isStatic,
+ *       const char *argData,     // columnar block per JavaCallProtocol batch v1
+ *       int         argDataLen,
+ *       char       *resultOut,
+ *       int         resultSize   // bytes writable at resultOut
+ *   );
+ *
+ * Returns 0 when the results were written, the number of bytes needed
+ * when resultSize is too small and a negative value with an error
+ * result written when the call failed.
+ *
+ * Java side: JavaFunctionInvoker.createBatchUpcallStub()
+ */
+typedef int (*BatchInvokerFn)(const char*, const char*, const char*, int, const char*, int, char*, int);
+
+static void InvokeJavaBatchViaFFMInvoker(JavaFunction def, int nargs, int nrows, int *rows,
+                                         Datum **args, Datum *results, bool *isNull);
+static void BuildBatchArgBlock(JavaFunction def, int nargs, int nrows, int *rows, Datum **args, StringInfo block);
+static Datum ParseBatchResultValue(JavaFunction def, const char *buf, int bufLen, int *offset, bool *isNull);
+static int  InvokerTagForType(Oid type);
+
 static void FunctionCacheInit() {
     HASHCTL ctl;
     JNIEnv* jenv;
@@ -155,6 +189,13 @@ WRegisterJavaFunctionInvoker(void* invokerFn)
     java_ffm_invoker = invokerFn;
 }
 
+/* Called from FFM client path to register the batched upcall invoker. */
+void
+WRegisterJavaBatchInvoker(void* invokerFn)
+{
+    java_ffm_batch_invoker = invokerFn;
+}
+
 void
 DetachThread(void* thread) {
     (*jvm)->DetachCurrentThread(jvm);
@@ -473,6 +514,266 @@ ParseInvokerResult(const char* buf, int bufLen, Oid returnType, jvalue* out)
     }
 }
 
+/*
+ * Batched FFM call.  rows lists the nrows row indexes of the argument
+ * columns to send, each result is stored back at its row index.  When
+ * the result buffer is too small the invoker keeps the results it made
+ * and reports the size needed, the retry picks them up without calling
+ * the method again.
+ */
+static void
+InvokeJavaBatchViaFFMInvoker(JavaFunction def, int nargs, int nrows, int *rows,
+                             Datum **args, Datum *results, bool *isNull)
+{
+    BatchInvokerFn fn = (BatchInvokerFn) java_ffm_batch_invoker;
+    StringInfoData block;
+    char       *resultBuf;
+    int         resultSize;
+    int         count;
+    int         offset;
+    int         rc;
+    int         i;
+
+    initStringInfo(&block);
+    BuildBatchArgBlock(def, nargs, nrows, rows, args, &block);
+
+    /* room for fixed width results, objects and strings may need more */
+    resultSize = 4 + nrows * 16;
+    if (resultSize < 16384)
+        resultSize = 16384;
+    resultBuf = palloc(resultSize);
+
+    rc = fn(def->className ? def->className : "",
+            def->methodName ? def->methodName : "",
+            def->methodDesc ? def->methodDesc : "",
+            def->isStatic ? 1 : 0,
+            block.data, block.len, resultBuf, resultSize);
+
+    if (rc > 0) {
+        pfree(resultBuf);
+        resultSize = rc;
+        resultBuf = palloc(resultSize);
+        rc = fn(def->className ? def->className : "",
+                def->methodName ? def->methodName : "",
+                def->methodDesc ? def->methodDesc : "",
+                def->isStatic ? 1 : 0,
+                block.data, block.len, resultBuf, resultSize);
+    }
+    pfree(block.data);
+
+    if (rc != 0) {
+        bool    dummy;
+
+        /* an error result carries the message, parsing it raises the error */
+        offset = 4;
+        if (rc < 0 && resultSize >= 12 && *(int*)resultBuf > 0)
+            ParseBatchResultValue(def, resultBuf, resultSize, &offset, &dummy);
+        elog(ERROR, "Java batch invocation failed (rc=%d)", rc);
+    }
+
+    memcpy(&count, resultBuf, 4);
+    if (count != nrows)
+        elog(ERROR, "Java batch invocation returned %d results for %d rows", count, nrows);
+
+    offset = 4;
+    for (i = 0; i < nrows; i++)
+        results[rows[i]] = ParseBatchResultValue(def, resultBuf, resultSize, &offset, &isNull[rows[i]]);
+
+    pfree(resultBuf);
+}
+
+/*
+ * Build a batch v1 arg block.  The block is columnar, all the values of
+ * one argument follow its tag:
+ *
+ *   [int32 numRows][int32 numArgs]
+ *   for each arg:
+ *       [int32 typeTag]
+ *       numRows values, packed for INT4/INT8/FLOAT8/BOOL,
+ *       [int32 length][bytes] each for VARCHAR and JAVA_OBJECT
+ */
+static void
+BuildBatchArgBlock(JavaFunction def, int nargs, int nrows, int *rows, Datum **args, StringInfo block)
+{
+    int         x;
+    int         i;
+
+    appendBinaryStringInfo(block, (char*) &nrows, 4);
+    appendBinaryStringInfo(block, (char*) &nargs, 4);
+
+    for (x = 0; x < nargs; x++) {
+        Oid     argtype = (x < def->nargs) ? def->argTypes[x] : InvalidOid;
+        int     tag = InvokerTagForType(argtype);
+
+        appendBinaryStringInfo(block, (char*) &tag, 4);
+
+        for (i = 0; i < nrows; i++) {
+            Datum   val = args[x][rows[i]];
+
+            switch (argtype) {
+                case INT4OID:
+                    {
+                        int32   v = DatumGetInt32(val);
+                        appendBinaryStringInfo(block, (char*) &v, 4);
+                        break;
+                    }
+                case INT8OID:
+                case FLOAT8OID:
+                    appendBinaryStringInfo(block, (char*) DatumGetPointer(val), 8);
+                    break;
+                case BOOLOID:
+                    {
+                        char    v = DatumGetChar(val) ? 1 : 0;
+                        appendBinaryStringInfo(block, &v, 1);
+                        break;
+                    }
+                case TEXTOID:
+                case VARCHAROID:
+                    {
+                        bytea  *v = (bytea*) DatumGetPointer(val);
+                        int     len = VARSIZE(v) - VARHDRSZ;
+
+                        appendBinaryStringInfo(block, (char*) &len, 4);
+                        appendBinaryStringInfo(block, VARDATA(v), len);
+                        break;
+                    }
+                case JAVAOID:
+                    {
+                        bytea  *v = (bytea*) DatumGetPointer(val);
+                        int     len = VARSIZE(v) - VARHDRSZ;
+
+                        if ( ISINDIRECT(v) ) {
+                            Datum   pipe;
+                            char   *data;
+                            char   *pos;
+                            int     seg = 0;
+
+                            len = sizeof_indirect_blob(val);
+                            data = palloc(len);
+                            pos = data;
+                            pipe = open_read_pipeline_blob(val, true);
+                            while ( read_pipeline_segment_blob(pipe, pos, &seg, sizeof_max_tuple_blob()) ) {
+                                pos += seg;
+                            }
+                            close_read_pipeline_blob(pipe);
+                            appendBinaryStringInfo(block, (char*) &len, 4);
+                            appendBinaryStringInfo(block, data, len);
+                            pfree(data);
+                        } else {
+                            appendBinaryStringInfo(block, (char*) &len, 4);
+                            appendBinaryStringInfo(block, VARDATA(v), len);
+                        }
+                        break;
+                    }
+            }
+        }
+    }
+}
+
+/*
+ * Read the next value of a batch result block at *offset and convert it
+ * to the return type of def.  Values use the v1 [tag][length][bytes]
+ * layout.  JAVA_OBJECT results are already in the serialized form of the
+ * java type so they are copied without going through javain.
+ */
+static Datum
+ParseBatchResultValue(JavaFunction def, const char *buf, int bufLen, int *offset, bool *isNull)
+{
+    Datum       result = PointerGetDatum(NULL);
+    const char *data;
+    int         tag;
+    int         vlen;
+
+    if (*offset + 8 > bufLen)
+        elog(ERROR, "Java batch result truncated");
+    memcpy(&tag, buf + *offset, 4);
+    memcpy(&vlen, buf + *offset + 4, 4);
+    if (vlen < 0 || *offset + 8 + vlen > bufLen)
+        elog(ERROR, "Java batch result truncated");
+    data = buf + *offset + 8;
+    *offset += 8 + vlen;
+
+    *isNull = false;
+    if (tag == INV_TAG_ERROR) {
+        char   *msg = palloc(vlen + 1);
+
+        memcpy(msg, data, vlen);
+        msg[vlen] = '\0';
+        elog(ERROR, "Java function error: %s", msg);
+    }
+    if (tag == INV_TAG_NULL) {
+        *isNull = true;
+        return result;
+    }
+    if (tag != InvokerTagForType(def->returnType))
+        elog(ERROR, "Java batch result tag %d does not match return type %lu", tag, def->returnType);
+
+    switch (tag) {
+        case INV_TAG_INT4:
+            {
+                int32   v;
+                memcpy(&v, data, 4);
+                result = Int32GetDatum(v);
+                break;
+            }
+        case INV_TAG_INT8:
+        case INV_TAG_FLOAT8:
+            {
+                void   *v = palloc(8);
+                memcpy(v, data, 8);
+                result = PointerGetDatum(v);
+                break;
+            }
+        case INV_TAG_BOOL:
+            result = CharGetDatum(data[0] != 0);
+            break;
+        case INV_TAG_VARCHAR:
+            {
+                bytea  *v = palloc(vlen + VARHDRSZ + 1);
+
+                SETVARSIZE(v, vlen + VARHDRSZ);
+                memcpy(VARDATA(v), data, vlen);
+                VARDATA(v)[vlen] = '\0';
+                result = PointerGetDatum(v);
+                break;
+            }
+        case INV_TAG_JAVA_OBJECT:
+            {
+                bytea  *v = palloc(vlen + VARHDRSZ);
+
+                SETVARSIZE(v, vlen + VARHDRSZ);
+                memcpy(VARDATA(v), data, vlen);
+                result = PointerGetDatum(v);
+                break;
+            }
+    }
+
+    return result;
+}
+
+static int
+InvokerTagForType(Oid type)
+{
+    switch (type) {
+        case INT4OID:
+            return INV_TAG_INT4;
+        case INT8OID:
+            return INV_TAG_INT8;
+        case FLOAT8OID:
+            return INV_TAG_FLOAT8;
+        case BOOLOID:
+            return INV_TAG_BOOL;
+        case TEXTOID:
+        case VARCHAROID:
+            return INV_TAG_VARCHAR;
+        case JAVAOID:
+            return INV_TAG_JAVA_OBJECT;
+        default:
+            elog(ERROR, "java argument not valid");
+    }
+    return INV_TAG_NULL;
+}
+
 void SetJavaObjectLoader(const char* l) {
     JNIEnv* jenv;
 
@@ -726,6 +1027,49 @@ fmgr_cached_javaA(JavaFunction jinfo, int nargs, Datum *args, Oid* returnType, b
 
 }
 
+/*
+ * call jinfo for nrows rows at once.  args and argnulls hold one column
+ * of nrows entries per argument, results and isNull get one entry per
+ * row.  When the client registered a batch invoker the rows go to Java
+ * in a single upcall.  The batch block has no null marker, so rows with
+ * a null argument, and every row without a batch invoker, are called
+ * one at a time exactly as fmgr_cached_javaA would be.
+ */
+void
+fmgr_cached_javaA_batch(JavaFunction jinfo, int nargs, int nrows, Datum **args, bool **argnulls,
+                        Datum *results, bool *isNull)
+{
+        int        *rows = palloc(sizeof(int) * nrows);
+        int         ncalls = 0;
+        Datum       rowargs[FUNC_MAX_ARGS];
+        int         r;
+        int         x;
+
+        for (r = 0; r < nrows; r++) {
+            bool    single = (java_ffm_batch_invoker == NULL);
+
+            for (x = 0; x < nargs; x++) {
+                if (argnulls[x][r])
+                    single = true;
+            }
+            results[r] = PointerGetDatum(NULL);
+            isNull[r] = false;
+            if (single) {
+                for (x = 0; x < nargs; x++)
+                    rowargs[x] = args[x][r];
+                results[r] = fmgr_cached_javaA(jinfo, nargs, rowargs, NULL, &isNull[r]);
+            } else {
+                rows[ncalls++] = r;
+            }
+        }
+
+        if (ncalls > 0) {
+            InvokeJavaBatchViaFFMInvoker(jinfo, nargs, ncalls, rows, args, results, isNull);
+        }
+
+        pfree(rows);
+}
+
 jvalue
 ConvertToJavaArg(Oid type, Datum val)
 {
@@ -44,6 +44,8 @@
 #include "utils/syscache.h"
 #include "version.h"
 #include "env/freespace.h"
+#include "env/visibilitymap.h"
+#include "access/blobstorage.h"
 #include "env/poolsweep.h"
 
 #ifdef MULTIBYTE
@@ -337,6 +339,8 @@ InitPostgres(const char *dbname)
         DBCreateWriterThread(SYNC_MODE);
  	InitializeTransactionSystem();		/* pg_log,etc init/crash recovery here */
         InitFreespace();
+        InitVisibilityMap();
+        InitBlobStorage();
 
 
         InitializeDol();                              /* Division of Labor System init */
@@ -73,6 +73,15 @@
  * on-the-fly as the caller repeatedly calls tuplesort_gettuple; this
  * saves one cycle of writing all the data out to disk and reading it in.
  *
+ * The memory array holds SortTuples rather than bare tuple pointers.  The
+ * leading sort key is extracted once, when the tuple is loaded or read
+ * back from tape, and kept next to the pointer so that most comparisons
+ * are settled without touching the tuple.  Keys of the int2, int4, oid and
+ * date types are compared inline instead of through fmgr.  For text and
+ * numeric keys we store an abbreviated key instead: an integer whose order
+ * agrees with the full value wherever the two integers differ.  Only ties
+ * on the abbreviated key go to the type's comparison function.
+ *
  *
  * Portions Copyright (c) 2000-2024, Myron Scott  <myron@weaverdb.org>
  * Portions Copyright (c) 1996-2000, PostgreSQL, Inc
@@ -101,6 +110,7 @@
 #include "utils/syscache.h"
 #include "utils/catcache.h"
 #include "utils/relcache.h"
+#include "utils/numeric.h"
 
 /*
  * Possible states of a Tuplesort object.  These denote the states that
@@ -123,6 +133,30 @@ typedef enum
 #define MAXTAPES		7		/* Knuth's T */
 #define TAPERANGE		(MAXTAPES-1)	/* Knuth's P */
 
+/*
+ * The objects we actually sort.  tuple points to the palloc'd tuple,
+ * datum1/isnull1 cache the leading sort key of that tuple (or its
+ * abbreviated form, see SORTKEY_ABBREV).
+ */
+typedef struct
+{
+	void	   *tuple;			/* the tuple proper */
+	Datum		datum1;			/* value of first key column */
+	bool		isnull1;		/* is first key column NULL? */
+} SortTuple;
+
+/*
+ * How datum1 is compared.
+ */
+typedef enum
+{
+	SORTKEY_FMGR,				/* datum1 is the key, call the comparator */
+	SORTKEY_INLINE,				/* datum1 is a pass-by-value key compared
+								 * by key1cmp, the result is final */
+	SORTKEY_ABBREV				/* datum1 is an abbreviated key compared
+								 * by key1cmp, ties need the full key */
+} SortKeyKind;
+
 /*
  * Private state of a Tuplesort operation.
  */
@@ -143,15 +177,17 @@ struct Tuplesortstate
 	 * Function to compare two tuples; result is per qsort() convention, ie,
 	 * <0, 0, >0 according as a<b, a=b, a>b.
 	 */
-	int			(*comparetup) (Tuplesortstate *state, const void *a, const void *b);
+	int			(*comparetup) (Tuplesortstate *state, const SortTuple *a,
+										   const SortTuple *b);
 
 	/*
-	 * Function to copy a supplied input tuple into palloc'd space. (NB:
-	 * we assume that a single pfree() is enough to release the tuple
-	 * later, so the representation must be "flat" in one palloc chunk.)
-	 * state->availMem must be decreased by the amount of space used.
+	 * Function to copy a supplied input tuple into palloc'd space and set
+	 * up the SortTuple pointing at it. (NB: we assume that a single
+	 * pfree() is enough to release the tuple later, so the representation
+	 * must be "flat" in one palloc chunk.) state->availMem must be
+	 * decreased by the amount of space used.
 	 */
-	void	   *(*copytup) (Tuplesortstate *state, void *tup);
+	void		(*copytup) (Tuplesortstate *state, SortTuple *stup, void *tup);
 
 	/*
 	 * Function to write a stored tuple onto tape.	The representation of
@@ -160,15 +196,16 @@ struct Tuplesortstate
 	 * writing the tuple, pfree() it, and increase state->availMem by the
 	 * amount of memory space thereby released.
 	 */
-	void		(*writetup) (Tuplesortstate *state, int tapenum, void *tup);
+	void		(*writetup) (Tuplesortstate *state, int tapenum, SortTuple *stup);
 
 	/*
 	 * Function to read a stored tuple from tape back into memory. 'len'
-	 * is the already-read length of the stored tuple.	Create and return
-	 * a palloc'd copy, and decrease state->availMem by the amount of
-	 * memory space consumed.
+	 * is the already-read length of the stored tuple.	Create a palloc'd
+	 * copy, set up stup for it (including the leading key), and decrease
+	 * state->availMem by the amount of memory space consumed.
 	 */
-	void	   *(*readtup) (Tuplesortstate *state, int tapenum, unsigned int len);
+	void		(*readtup) (Tuplesortstate *state, SortTuple *stup,
+										int tapenum, unsigned int len);
 
 	/*
 	 * Obtain memory space occupied by a stored tuple.	(This routine is
@@ -178,7 +215,18 @@ struct Tuplesortstate
 	unsigned int (*tuplesize) (Tuplesortstate *state, void *tup);
 
 	/*
-	 * This array holds pointers to tuples in sort memory.	If we are in
+	 * How the leading key cached in each SortTuple is compared.  key1cmp
+	 * is only used for SORTKEY_INLINE and SORTKEY_ABBREV, key1reverse
+	 * flips its result for descending sort operators.  key1abbrev makes
+	 * the abbreviated key from a non-NULL key value.
+	 */
+	SortKeyKind key1kind;
+	int			(*key1cmp) (Datum a, Datum b);
+	Datum		(*key1abbrev) (Datum key);
+	bool		key1reverse;
+
+	/*
+	 * This array holds the SortTuples of tuples in sort memory.  If we are in
 	 * state INITIAL, the tuples are in no particular order; if we are in
 	 * state SORTEDINMEM, the tuples are in final sorted order; in states
 	 * BUILDRUNS and FINALMERGE, the tuples are organized in "heap" order
@@ -187,7 +235,7 @@ struct Tuplesortstate
 	 * entries beyond TAPERANGE are never in the heap and are used to hold
 	 * pre-read tuples.)  In state SORTEDONTAPE, the array is not used.
 	 */
-	void	  **memtuples;		/* array of pointers to palloc'd tuples */
+	SortTuple  *memtuples;		/* array of SortTuples for palloc'd tuples */
 	int			memtupcount;	/* number of tuples currently present */
 	int			memtupsize;		/* allocated length of memtuples array */
 
@@ -294,9 +342,9 @@ struct Tuplesortstate
 };
 
 #define COMPARETUP(state,a,b)	((*(state)->comparetup) (state, a, b))
-#define COPYTUP(state,tup)	((*(state)->copytup) (state, tup))
-#define WRITETUP(state,tape,tup)	((*(state)->writetup) (state, tape, tup))
-#define READTUP(state,tape,len) ((*(state)->readtup) (state, tape, len))
+#define COPYTUP(state,stup,tup)	((*(state)->copytup) (state, stup, tup))
+#define WRITETUP(state,tape,stup)	((*(state)->writetup) (state, tape, stup))
+#define READTUP(state,stup,tape,len) ((*(state)->readtup) (state, stup, tape, len))
 #define TUPLESIZE(state,tup)	((*(state)->tuplesize) (state, tup))
 #define LACKMEM(state)		((state)->availMem < 0)
 #define USEMEM(state,amt)	((state)->availMem -= (amt))
@@ -336,8 +384,9 @@ struct Tuplesortstate
  * We count space requested for tuples against the SortMem limit.
  * Fixed-size space (primarily the LogicalTapeSet I/O buffers) is not
  * counted, nor do we count the variable-size memtuples and memtupindex
- * arrays.	(Even though those could grow pretty large, they should be
- * small compared to the tuples proper, so this is not unreasonable.)
+ * arrays, nor any abbreviated key (it lives in the SortTuple).  (Even
+ * though those could grow pretty large, they should be small compared
+ * to the tuples proper, so this is not unreasonable.)
  *
  * The major deficiency in this approach is that it ignores palloc overhead.
  * The memory space actually allocated for a palloc chunk is always more
@@ -376,7 +425,7 @@ typedef struct
 
 
 static Tuplesortstate *tuplesort_begin_common(bool randomAccess);
-static void puttuple_common(Tuplesortstate *state, void *tuple);
+static void puttuple_common(Tuplesortstate *state, SortTuple *tuple);
 static void inittapes(Tuplesortstate *state);
 static void selectnewtape(Tuplesortstate *state);
 static void mergeruns(Tuplesortstate *state);
@@ -384,32 +433,49 @@ static void mergeonerun(Tuplesortstate *state);
 static void beginmerge(Tuplesortstate *state);
 static void mergepreread(Tuplesortstate *state);
 static void dumptuples(Tuplesortstate *state, bool alltuples);
-static void tuplesort_heap_insert(Tuplesortstate *state, void *tuple,
+static void tuplesort_heap_insert(Tuplesortstate *state, SortTuple *tuple,
 					  int tupleindex, bool checkIndex);
 static void tuplesort_heap_siftup(Tuplesortstate *state, bool checkIndex);
 static unsigned int getlen(Tuplesortstate *state, int tapenum, bool eofOK);
 static void markrunend(Tuplesortstate *state, int tapenum);
 static int	qsort_comparetup(const void *a, const void *b);
+static void selectkey1(Tuplesortstate *state, RegProcedure proc);
+static int	comparekey1(Tuplesortstate *state, const SortTuple *a,
+			const SortTuple *b, bool *decided);
+static int	cmp_int2(Datum a, Datum b);
+static int	cmp_int4(Datum a, Datum b);
+static int	cmp_oid(Datum a, Datum b);
+#ifndef USE_LOCALE
+static int	cmp_abbrev(Datum a, Datum b);
+static Datum abbrev_text(Datum key);
+#endif
+#ifdef _LP64
+static int	cmp_abbrev_signed(Datum a, Datum b);
+static Datum abbrev_numeric(Datum key);
+#endif
 static int comparetup_heap(Tuplesortstate *state,
-				const void *a, const void *b);
-static void *copytup_heap(Tuplesortstate *state, void *tup);
-static void writetup_heap(Tuplesortstate *state, int tapenum, void *tup);
-static void *readtup_heap(Tuplesortstate *state, int tapenum,
-			 unsigned int len);
+				const SortTuple *a, const SortTuple *b);
+static void getkey1_heap(Tuplesortstate *state, SortTuple *stup);
+static void copytup_heap(Tuplesortstate *state, SortTuple *stup, void *tup);
+static void writetup_heap(Tuplesortstate *state, int tapenum, SortTuple *stup);
+static void readtup_heap(Tuplesortstate *state, SortTuple *stup,
+			 int tapenum, unsigned int len);
 static unsigned int tuplesize_heap(Tuplesortstate *state, void *tup);
 static int comparetup_index(Tuplesortstate *state,
-				 const void *a, const void *b);
-static void *copytup_index(Tuplesortstate *state, void *tup);
-static void writetup_index(Tuplesortstate *state, int tapenum, void *tup);
-static void *readtup_index(Tuplesortstate *state, int tapenum,
-			  unsigned int len);
+				 const SortTuple *a, const SortTuple *b);
+static void getkey1_index(Tuplesortstate *state, SortTuple *stup);
+static void copytup_index(Tuplesortstate *state, SortTuple *stup, void *tup);
+static void writetup_index(Tuplesortstate *state, int tapenum, SortTuple *stup);
+static void readtup_index(Tuplesortstate *state, SortTuple *stup,
+			  int tapenum, unsigned int len);
 static unsigned int tuplesize_index(Tuplesortstate *state, void *tup);
 static int comparetup_datum(Tuplesortstate *state,
-				 const void *a, const void *b);
-static void *copytup_datum(Tuplesortstate *state, void *tup);
-static void writetup_datum(Tuplesortstate *state, int tapenum, void *tup);
-static void *readtup_datum(Tuplesortstate *state, int tapenum,
-			  unsigned int len);
+				 const SortTuple *a, const SortTuple *b);
+static void getkey1_datum(Tuplesortstate *state, SortTuple *stup);
+static void copytup_datum(Tuplesortstate *state, SortTuple *stup, void *tup);
+static void writetup_datum(Tuplesortstate *state, int tapenum, SortTuple *stup);
+static void readtup_datum(Tuplesortstate *state, SortTuple *stup,
+			  int tapenum, unsigned int len);
 static unsigned int tuplesize_datum(Tuplesortstate *state, void *tup);
 
 /*
@@ -477,10 +543,15 @@ tuplesort_begin_common(bool randomAccess)
 
 	state->memtupcount = 0;
 	state->memtupsize = 1024;	/* initial guess */
-	state->memtuples = (void **) palloc(state->memtupsize * sizeof(void *));
+	state->memtuples = (SortTuple *) palloc(state->memtupsize * sizeof(SortTuple));
 
 	state->memtupindex = NULL;	/* until and unless needed */
 
+	state->key1kind = SORTKEY_FMGR;	/* tuplesort_begin_xxx may do better */
+	state->key1cmp = NULL;
+	state->key1abbrev = NULL;
+	state->key1reverse = false;
+
 	state->currentRun = 0;
 
 	/* Algorithm D variables will be initialized by inittapes, if needed */
@@ -512,6 +583,9 @@ tuplesort_begin_heap(TupleDesc tupDesc,
 	state->nKeys = nkeys;
 	state->scanKeys = keys;
 
+	if (!(keys[0].sk_flags & SK_COMMUTE))
+		selectkey1(state, keys[0].sk_procedure);
+
 	return state;
 }
 
@@ -533,6 +607,8 @@ tuplesort_begin_index(Relation indexRel,
 	state->indexScanKey = _bt_mkscankey_nodata(indexRel);
 	state->enforceUnique = enforceUnique;
 
+	selectkey1(state, state->indexScanKey[0].sk_procedure);
+
 	return state;
 }
 
@@ -559,6 +635,8 @@ tuplesort_begin_datum(Oid datumType,
 	state->datumTypeLen = typeLen(typeInfo);
 	state->datumTypeByVal = typeByVal(typeInfo);
 
+	selectkey1(state, state->sortOpFn.fn_oid);
+
 	return state;
 }
 
@@ -595,11 +673,12 @@ tuplesort_puttuple(Tuplesortstate *state, void *tuple)
 	 * Copy the given tuple into memory we control, and decrease availMem.
 	 * Then call the code shared with the Datum case.
 	 */
+	SortTuple	stup;
 	MemoryContext old = MemoryContextSwitchTo(state->data_cxt);
-	tuple = COPYTUP(state, tuple);
+	COPYTUP(state, &stup, tuple);
 	MemoryContextSwitchTo(old);
 
-	puttuple_common(state, tuple);
+	puttuple_common(state, &stup);
 }
 
 /*
@@ -611,6 +690,7 @@ void
 tuplesort_putdatum(Tuplesortstate *state, Datum val, bool isNull)
 {
 	DatumTuple *tuple;
+	SortTuple	stup;
         MemoryContext old = MemoryContextSwitchTo(state->data_cxt);
 	/*
 	 * Build pseudo-tuple carrying the datum, and decrease availMem.
@@ -640,15 +720,18 @@ tuplesort_putdatum(Tuplesortstate *state, Datum val, bool isNull)
 		tuple->isNull = false;
 	}
 
+	stup.tuple = (void *) tuple;
+	getkey1_datum(state, &stup);
+
         MemoryContextSwitchTo(old);
-	puttuple_common(state, (void *) tuple);
+	puttuple_common(state, &stup);
 }
 
 /*
  * Shared code for tuple and datum cases.
  */
 static void
-puttuple_common(Tuplesortstate *state, void *tuple)
+puttuple_common(Tuplesortstate *state, SortTuple *tuple)
 {
 	switch (state->status)
 	{
@@ -661,12 +744,12 @@ puttuple_common(Tuplesortstate *state, void *tuple)
 			{
 				/* Grow the unsorted array as needed. */
 				state->memtupsize *= 2;
-				state->memtuples = (void **)
+				state->memtuples = (SortTuple *)
 					repalloc(state->memtuples,
-							 state->memtupsize * sizeof(void *));
+							 state->memtupsize * sizeof(SortTuple));
 			}
 
-			state->memtuples[state->memtupcount++] = tuple;
+			state->memtuples[state->memtupcount++] = *tuple;
 
 			/*
 			 * Done if we still fit in available memory.
@@ -700,7 +783,7 @@ puttuple_common(Tuplesortstate *state, void *tuple)
 			 * this point; see dumptuples.
 			 */
 			Assert(state->memtupcount > 0);
-			if (COMPARETUP(state, tuple, state->memtuples[0]) >= 0)
+			if (COMPARETUP(state, tuple, &state->memtuples[0]) >= 0)
 				tuplesort_heap_insert(state, tuple, state->currentRun, true);
 			else
 				tuplesort_heap_insert(state, tuple, state->currentRun + 1, true);
@@ -735,7 +818,7 @@ tuplesort_performsort(Tuplesortstate *state)
 			{
 				TupleSortGetEnv()->qsort_tuplesortstate = state;
 				qsort((void *) state->memtuples, state->memtupcount,
-					  sizeof(void *), qsort_comparetup);
+					  sizeof(SortTuple), qsort_comparetup);
 			}
 			state->current = 0;
 			state->eof_reached = false;
@@ -774,7 +857,7 @@ tuplesort_gettuple(Tuplesortstate *state, bool forward,
 				   bool *should_free)
 {
 	unsigned int tuplen;
-	void	   *tup;
+	SortTuple	stup;
 
 	switch (state->status)
 	{
@@ -784,7 +867,7 @@ tuplesort_gettuple(Tuplesortstate *state, bool forward,
 			if (forward)
 			{
 				if (state->current < state->memtupcount)
-					return state->memtuples[state->current++];
+					return state->memtuples[state->current++].tuple;
 				state->eof_reached = true;
 				return NULL;
 			}
@@ -805,7 +888,7 @@ tuplesort_gettuple(Tuplesortstate *state, bool forward,
 					if (state->current <= 0)
 						return NULL;
 				}
-				return state->memtuples[state->current - 1];
+				return state->memtuples[state->current - 1].tuple;
 			}
 			break;
 
@@ -818,8 +901,8 @@ tuplesort_gettuple(Tuplesortstate *state, bool forward,
 					return NULL;
 				if ((tuplen = getlen(state, state->result_tape, true)) != 0)
 				{
-					tup = READTUP(state, state->result_tape, tuplen);
-					return tup;
+					READTUP(state, &stup, state->result_tape, tuplen);
+					return stup.tuple;
 				}
 				else
 				{
@@ -896,8 +979,8 @@ tuplesort_gettuple(Tuplesortstate *state, bool forward,
 									  state->result_tape,
 									  tuplen))
 				elog(ERROR, "tuplesort_gettuple: bogus tuple len in backward scan");
-			tup = READTUP(state, state->result_tape, tuplen);
-			return tup;
+			READTUP(state, &stup, state->result_tape, tuplen);
+			return stup.tuple;
 
 		case TSS_FINALMERGE:
 			Assert(forward);
@@ -911,9 +994,10 @@ tuplesort_gettuple(Tuplesortstate *state, bool forward,
 				int			srcTape = state->memtupindex[0];
 				unsigned int tuplen;
 				int			tupIndex;
-				void	   *newtup;
+				void	   *tup;
+				SortTuple	newtup;
 
-				tup = state->memtuples[0];
+				tup = state->memtuples[0].tuple;
 				/* returned tuple is no longer counted in our memory space */
 				tuplen = TUPLESIZE(state, tup);
 				state->availMem += tuplen;
@@ -942,7 +1026,7 @@ tuplesort_gettuple(Tuplesortstate *state, bool forward,
 					state->mergelast[srcTape] = 0;
 				state->memtupindex[tupIndex] = state->mergefreelist;
 				state->mergefreelist = tupIndex;
-				tuplesort_heap_insert(state, newtup, srcTape, false);
+				tuplesort_heap_insert(state, &newtup, srcTape, false);
 				return tup;
 			}
 			return NULL;
@@ -1027,7 +1111,12 @@ inittapes(Tuplesortstate *state)
 	ntuples = state->memtupcount;
 	state->memtupcount = 0;		/* make the heap empty */
 	for (j = 0; j < ntuples; j++)
-		tuplesort_heap_insert(state, state->memtuples[j], 0, false);
+	{
+		/* inserting may overwrite entry j, so copy it out first */
+		SortTuple	stup = state->memtuples[j];
+
+		tuplesort_heap_insert(state, &stup, 0, false);
+	}
 	Assert(state->memtupcount == ntuples);
 
 	state->currentRun = 0;
@@ -1214,7 +1303,7 @@ mergeonerun(Tuplesortstate *state)
 	int			destTape = state->tp_tapenum[TAPERANGE];
 	int			srcTape;
 	int			tupIndex;
-	void	   *tup;
+	SortTuple	tup;
 	long		priorAvail,
 				spaceFreed;
 
@@ -1235,7 +1324,7 @@ mergeonerun(Tuplesortstate *state)
 		/* write the tuple to destTape */
 		priorAvail = state->availMem;
 		srcTape = state->memtupindex[0];
-		WRITETUP(state, destTape, state->memtuples[0]);
+		WRITETUP(state, destTape, &state->memtuples[0]);
 		/* writetup adjusted total free space, now fix per-tape space */
 		spaceFreed = state->availMem - priorAvail;
 		state->mergeavailmem[srcTape] += spaceFreed;
@@ -1256,7 +1345,7 @@ mergeonerun(Tuplesortstate *state)
 			state->mergelast[srcTape] = 0;
 		state->memtupindex[tupIndex] = state->mergefreelist;
 		state->mergefreelist = tupIndex;
-		tuplesort_heap_insert(state, tup, srcTape, false);
+		tuplesort_heap_insert(state, &tup, srcTape, false);
 	}
 
 	/*
@@ -1332,7 +1421,7 @@ beginmerge(Tuplesortstate *state)
 	for (srcTape = 0; srcTape < MAXTAPES; srcTape++)
 	{
 		int			tupIndex = state->mergenext[srcTape];
-		void	   *tup;
+		SortTuple	tup;
 
 		if (tupIndex)
 		{
@@ -1342,7 +1431,7 @@ beginmerge(Tuplesortstate *state)
 				state->mergelast[srcTape] = 0;
 			state->memtupindex[tupIndex] = state->mergefreelist;
 			state->mergefreelist = tupIndex;
-			tuplesort_heap_insert(state, tup, srcTape, false);
+			tuplesort_heap_insert(state, &tup, srcTape, false);
 		}
 	}
 }
@@ -1361,7 +1450,7 @@ mergepreread(Tuplesortstate *state)
 {
 	int			srcTape;
 	unsigned int tuplen;
-	void	   *tup;
+	SortTuple	tup;
 	int			tupIndex;
 	long		priorAvail,
 				spaceUsed;
@@ -1395,7 +1484,7 @@ mergepreread(Tuplesortstate *state)
 				state->mergeactive[srcTape] = false;
 				break;
 			}
-			tup = READTUP(state, srcTape, tuplen);
+			READTUP(state, &tup, srcTape, tuplen);
 			/* find or make a free slot in memtuples[] for it */
 			tupIndex = state->mergefreelist;
 			if (tupIndex)
@@ -1407,9 +1496,9 @@ mergepreread(Tuplesortstate *state)
 				if (tupIndex >= state->memtupsize)
 				{
 					state->memtupsize *= 2;
-					state->memtuples = (void **)
+					state->memtuples = (SortTuple *)
 						repalloc(state->memtuples,
-								 state->memtupsize * sizeof(void *));
+								 state->memtupsize * sizeof(SortTuple));
 					state->memtupindex = (int *)
 						repalloc(state->memtupindex,
 								 state->memtupsize * sizeof(int));
@@ -1460,7 +1549,7 @@ dumptuples(Tuplesortstate *state, bool alltuples)
 		 */
 		Assert(state->memtupcount > 0);
 		WRITETUP(state, state->tp_tapenum[state->destTape],
-				 state->memtuples[0]);
+				 &state->memtuples[0]);
 		tuplesort_heap_siftup(state, true);
 
 		/*
@@ -1584,17 +1673,17 @@ tuplesort_restorepos(Tuplesortstate *state)
 
 #define HEAPCOMPARE(tup1,index1,tup2,index2) \
 	(checkIndex && (index1 != index2) ? index1 - index2 : \
-	 COMPARETUP(state, tup1, tup2))
+	 COMPARETUP(state, &(tup1), &(tup2)))
 
 /*
  * Insert a new tuple into an empty or existing heap, maintaining the
  * heap invariant.
  */
 static void
-tuplesort_heap_insert(Tuplesortstate *state, void *tuple,
+tuplesort_heap_insert(Tuplesortstate *state, SortTuple *tuple,
 					  int tupleindex, bool checkIndex)
 {
-	void	  **memtuples;
+	SortTuple  *memtuples;
 	int		   *memtupindex;
 	int			j;
 
@@ -1604,9 +1693,9 @@ tuplesort_heap_insert(Tuplesortstate *state, void *tuple,
 	if (state->memtupcount >= state->memtupsize)
 	{
 		state->memtupsize *= 2;
-		state->memtuples = (void **)
+		state->memtuples = (SortTuple *)
 			repalloc(state->memtuples,
-					 state->memtupsize * sizeof(void *));
+					 state->memtupsize * sizeof(SortTuple));
 		state->memtupindex = (int *)
 			repalloc(state->memtupindex,
 					 state->memtupsize * sizeof(int));
@@ -1623,14 +1712,14 @@ tuplesort_heap_insert(Tuplesortstate *state, void *tuple,
 	{
 		int			i = (j - 1) >> 1;
 
-		if (HEAPCOMPARE(tuple, tupleindex,
+		if (HEAPCOMPARE(*tuple, tupleindex,
 						memtuples[i], memtupindex[i]) >= 0)
 			break;
 		memtuples[j] = memtuples[i];
 		memtupindex[j] = memtupindex[i];
 		j = i;
 	}
-	memtuples[j] = tuple;
+	memtuples[j] = *tuple;
 	memtupindex[j] = tupleindex;
 }
 
@@ -1641,9 +1730,9 @@ tuplesort_heap_insert(Tuplesortstate *state, void *tuple,
 static void
 tuplesort_heap_siftup(Tuplesortstate *state, bool checkIndex)
 {
-	void	  **memtuples = state->memtuples;
+	SortTuple  *memtuples = state->memtuples;
 	int		   *memtupindex = state->memtupindex;
-	void	   *tuple;
+	SortTuple	tuple;
 	int			tupindex,
 				i,
 				n;
@@ -1709,25 +1798,253 @@ markrunend(Tuplesortstate *state, int tapenum)
 static int
 qsort_comparetup(const void *a, const void *b)
 {
-	/* The passed pointers are pointers to void * ... */
+	/* The passed pointers are pointers to SortTuples ... */
 
-	return COMPARETUP(TupleSortGetEnv()->qsort_tuplesortstate, *(void **) a, *(void **) b);
+	return COMPARETUP(TupleSortGetEnv()->qsort_tuplesortstate,
+					  (const SortTuple *) a, (const SortTuple *) b);
 }
 
 
+/*
+ * Leading key support
+ */
+
+/*
+ * selectkey1 - decide how the leading key cached in SortTuples is compared.
+ *
+ * proc is the comparison function of the leading key: a "<" or ">"
+ * operator for heap and Datum sorts, a btree 3-way comparator for index
+ * sorts.  Functions not listed here are left to fmgr.
+ */
+static void
+selectkey1(Tuplesortstate *state, RegProcedure proc)
+{
+	switch (proc)
+	{
+		case F_INT2GT:
+			state->key1reverse = true;
+			/* FALLTHROUGH */
+		case F_INT2LT:
+		case F_BTINT2CMP:
+			state->key1kind = SORTKEY_INLINE;
+			state->key1cmp = cmp_int2;
+			break;
+		case F_INT4GT:
+		case F_DATE_GT:
+			state->key1reverse = true;
+			/* FALLTHROUGH */
+		case F_INT4LT:
+		case F_BTINT4CMP:
+		case F_DATE_LT:
+		case F_DATE_CMP:
+			state->key1kind = SORTKEY_INLINE;
+			state->key1cmp = cmp_int4;
+			break;
+		case F_BTOIDCMP:
+			state->key1kind = SORTKEY_INLINE;
+			state->key1cmp = cmp_oid;
+			break;
+#ifndef USE_LOCALE
+		/* with USE_LOCALE text is ordered by strcoll() */
+		case F_TEXT_GT:
+			state->key1reverse = true;
+			/* FALLTHROUGH */
+		case F_TEXT_LT:
+		case F_BTTEXTCMP:
+			state->key1kind = SORTKEY_ABBREV;
+			state->key1cmp = cmp_abbrev;
+			state->key1abbrev = abbrev_text;
+			break;
+#endif
+#ifdef _LP64
+		case F_NUMERIC_GT:
+			state->key1reverse = true;
+			/* FALLTHROUGH */
+		case F_NUMERIC_LT:
+		case F_NUMERIC_CMP:
+			state->key1kind = SORTKEY_ABBREV;
+			state->key1cmp = cmp_abbrev_signed;
+			state->key1abbrev = abbrev_numeric;
+			break;
+#endif
+		default:
+			break;
+	}
+}
+
+/*
+ * comparekey1 - compare the leading keys cached in two SortTuples.
+ *
+ * *decided is set when the result is final for the leading key: one or
+ * both keys are NULL, the keys are compared inline, or the abbreviated
+ * keys differ.  Otherwise the caller must compare the full key values.
+ */
+static int
+comparekey1(Tuplesortstate *state, const SortTuple *a, const SortTuple *b,
+			bool *decided)
+{
+	int			result;
+
+	if (a->isnull1 || b->isnull1)
+	{
+		*decided = true;
+		if (!b->isnull1)
+			return 1;			/* NULL sorts after non-NULL */
+		if (!a->isnull1)
+			return -1;
+		return 0;
+	}
+
+	if (state->key1kind == SORTKEY_FMGR)
+	{
+		*decided = false;
+		return 0;
+	}
+
+	result = (*state->key1cmp) (a->datum1, b->datum1);
+	if (state->key1reverse)
+		result = -result;
+	*decided = (result != 0 || state->key1kind == SORTKEY_INLINE);
+	return result;
+}
+
+static int
+cmp_int2(Datum a, Datum b)
+{
+	int16		x = DatumGetInt16(a);
+	int16		y = DatumGetInt16(b);
+
+	return (x > y) ? 1 : ((x < y) ? -1 : 0);
+}
+
+static int
+cmp_int4(Datum a, Datum b)
+{
+	int32		x = DatumGetInt32(a);
+	int32		y = DatumGetInt32(b);
+
+	return (x > y) ? 1 : ((x < y) ? -1 : 0);
+}
+
+static int
+cmp_oid(Datum a, Datum b)
+{
+	Oid			x = DatumGetObjectId(a);
+	Oid			y = DatumGetObjectId(b);
+
+	return (x > y) ? 1 : ((x < y) ? -1 : 0);
+}
+
+#ifndef USE_LOCALE
+static int
+cmp_abbrev(Datum a, Datum b)
+{
+	return (a > b) ? 1 : ((a < b) ? -1 : 0);
+}
+
+/*
+ * abbrev_text - the first sizeof(Datum) bytes of a text value, packed so
+ * that comparing the results as unsigned integers agrees with bttextcmp.
+ * Shorter values are padded with zero bytes.
+ */
+static Datum
+abbrev_text(Datum key)
+{
+	struct varlena *value = (struct varlena *) DatumGetPointer(key);
+	unsigned char *data = (unsigned char *) VARDATA(value);
+	int			len = VARSIZE(value) - VARHDRSZ;
+	Datum		result = 0;
+	int			i;
+
+	for (i = 0; i < sizeof(Datum); i++)
+	{
+		result <<= 8;
+		if (i < len)
+			result |= data[i];
+	}
+	return result;
+}
+#endif
+
+#ifdef _LP64
+static int
+cmp_abbrev_signed(Datum a, Datum b)
+{
+	long		x = (long) a;
+	long		y = (long) b;
+
+	return (x > y) ? 1 : ((x < y) ? -1 : 0);
+}
+
+#define NUMERIC_ABBREV_DIGITS	12	/* 10^12 < 2^40 */
+
+/*
+ * abbrev_numeric - a signed integer that orders like the numeric value.
+ *
+ * Past the leading zeroes, the decimal weight of the first digit and the
+ * next NUMERIC_ABBREV_DIGITS digits order positive values.  Negative
+ * values get the negated key and zero is 0.  NaN gets LONG_MAX, above
+ * any value's key, so sorts put NaN last.  The numeric operators find
+ * NaN equal to everything, but they are only consulted on ties, where
+ * either both keys or neither are NaN.
+ */
+static Datum
+abbrev_numeric(Datum key)
+{
+	Numeric		num = (Numeric) DatumGetPointer(key);
+	int			ndigits = (num->varlen - NUMERIC_HDRSZ) * 2;
+	long		weight = num->n_weight;
+	long		digits = 0;
+	long		result;
+	int			i = 0;
+	int			n;
+
+#define NUMERIC_DIGIT(num, i) \
+	(((i) & 1) ? ((num)->n_data[(i) >> 1] & 0x0f) : ((num)->n_data[(i) >> 1] >> 4))
+
+	if (NUMERIC_IS_NAN(num))
+		return (Datum) LONG_MAX;
+
+	while (i < ndigits && NUMERIC_DIGIT(num, i) == 0)
+	{
+		i++;
+		weight--;
+	}
+	if (i == ndigits)
+		return (Datum) 0;
+
+	for (n = 0; n < NUMERIC_ABBREV_DIGITS; n++, i++)
+		digits = digits * 10 + ((i < ndigits) ? NUMERIC_DIGIT(num, i) : 0);
+
+	/* weight is at least -(32768 + ndigits), keep the key positive */
+	result = ((weight + 65536) << 40) | digits;
+
+	return (Datum) ((NUMERIC_SIGN(num) == NUMERIC_NEG) ? -result : result);
+
+#undef NUMERIC_DIGIT
+}
+#endif
+
+
 /*
  * Routines specialized for HeapTuple case
  */
 
 static int
-comparetup_heap(Tuplesortstate *state, const void *a, const void *b)
+comparetup_heap(Tuplesortstate *state, const SortTuple *a, const SortTuple *b)
 {
-	HeapTuple	ltup = (HeapTuple) a;
-	HeapTuple	rtup = (HeapTuple) b;
+	HeapTuple	ltup = (HeapTuple) a->tuple;
+	HeapTuple	rtup = (HeapTuple) b->tuple;
 	TupleDesc	tupDesc = state->tupDesc;
 	int			nkey;
+	bool		decided;
+	int			result;
 
-	for (nkey = 0; nkey < state->nKeys; nkey++)
+	result = comparekey1(state, a, b, &decided);
+	if (result != 0)
+		return result;
+
+	for (nkey = (decided ? 1 : 0); nkey < state->nKeys; nkey++)
 	{
 		ScanKey		scanKey = state->scanKeys + nkey;
 		AttrNumber	attno = scanKey->sk_attno;
@@ -1735,13 +2052,23 @@ comparetup_heap(Tuplesortstate *state, const void *a, const void *b)
 					rattr;
 		bool		isnull1,
 					isnull2;
-		int			result;
 
-		lattr = HeapGetAttr(ltup, attno, tupDesc, &isnull1);
+		if (nkey == 0 && state->key1kind == SORTKEY_FMGR)
+		{
+			/* cached in the SortTuple, and known to be non-NULL */
+			lattr = a->datum1;
+			isnull1 = false;
+			rattr = b->datum1;
+			isnull2 = false;
+		}
+		else
+		{
+			lattr = HeapGetAttr(ltup, attno, tupDesc, &isnull1);
+			rattr = HeapGetAttr(rtup, attno, tupDesc, &isnull2);
+		}
                 if ( tupDesc->attrs[attno-1]->attstorage == 'e' && !isnull1 && ISINDIRECT(lattr) ) 
                     lattr = PointerGetDatum(rebuild_indirect_blob(lattr));
 	
-		rattr = HeapGetAttr(rtup, attno, tupDesc, &isnull2);
                 if ( tupDesc->attrs[attno-1]->attstorage == 'e' && !isnull2 && ISINDIRECT(rattr) ) 
                     rattr = PointerGetDatum(rebuild_indirect_blob(rattr));
                 
@@ -1771,13 +2098,38 @@ comparetup_heap(Tuplesortstate *state, const void *a, const void *b)
 	return 0;
 }
 
-static void *
-copytup_heap(Tuplesortstate *state, void *tup)
+/*
+ * Extract the leading key of a heap tuple into its SortTuple.
+ */
+static void
+getkey1_heap(Tuplesortstate *state, SortTuple *stup)
+{
+	HeapTuple	tuple = (HeapTuple) stup->tuple;
+	AttrNumber	attno = state->scanKeys[0].sk_attno;
+
+	stup->datum1 = HeapGetAttr(tuple, attno, state->tupDesc, &stup->isnull1);
+	if (state->key1kind != SORTKEY_ABBREV || stup->isnull1)
+		return;
+
+	if (state->tupDesc->attrs[attno - 1]->attstorage == 'e' && ISINDIRECT(stup->datum1))
+	{
+		bytea	   *value = rebuild_indirect_blob(stup->datum1);
+
+		stup->datum1 = (*state->key1abbrev) (PointerGetDatum(value));
+		pfree(value);
+	}
+	else
+		stup->datum1 = (*state->key1abbrev) (stup->datum1);
+}
+
+static void
+copytup_heap(Tuplesortstate *state, SortTuple *stup, void *tup)
 {
 	HeapTuple	tuple = (HeapTuple) tup;
 
 	USEMEM(state, HEAPTUPLESIZE + tuple->t_len);
-	return (void *) heap_copytuple(tuple);
+	stup->tuple = (void *) heap_copytuple(tuple);
+	getkey1_heap(state, stup);
 }
 
 /*
@@ -1785,9 +2137,9 @@ copytup_heap(Tuplesortstate *state, void *tup)
  */
 
 static void
-writetup_heap(Tuplesortstate *state, int tapenum, void *tup)
+writetup_heap(Tuplesortstate *state, int tapenum, SortTuple *stup)
 {
-	HeapTuple	tuple = (HeapTuple) tup;
+	HeapTuple	tuple = (HeapTuple) stup->tuple;
 	unsigned int tuplen;
 
 	tuplen = tuple->t_len + sizeof(tuplen);
@@ -1803,8 +2155,9 @@ writetup_heap(Tuplesortstate *state, int tapenum, void *tup)
 	heap_freetuple(tuple);
 }
 
-static void *
-readtup_heap(Tuplesortstate *state, int tapenum, unsigned int len)
+static void
+readtup_heap(Tuplesortstate *state, SortTuple *stup,
+			 int tapenum, unsigned int len)
 {
 	unsigned int tuplen = len - sizeof(unsigned int) + HEAPTUPLESIZE;
 	HeapTuple	tuple = (HeapTuple) palloc(tuplen);
@@ -1825,7 +2178,8 @@ readtup_heap(Tuplesortstate *state, int tapenum, unsigned int len)
 		if (LogicalTapeRead(state->tapeset, tapenum, (void *) &tuplen,
 							sizeof(tuplen)) != sizeof(tuplen))
 			elog(ERROR, "tuplesort: unexpected end of data");
-	return (void *) tuple;
+	stup->tuple = (void *) tuple;
+	getkey1_heap(state, stup);
 }
 
 static unsigned int
@@ -1847,35 +2201,53 @@ tuplesize_heap(Tuplesortstate *state, void *tup)
  */
 
 static int
-comparetup_index(Tuplesortstate *state, const void *a, const void *b)
+comparetup_index(Tuplesortstate *state, const SortTuple *a, const SortTuple *b)
 {
 
 	/*
 	 * This is almost the same as _bt_tuplecompare(), but we need to keep
 	 * track of whether any null fields are present.
 	 */
-	IndexTuple	tuple1 = (IndexTuple) a;
-	IndexTuple	tuple2 = (IndexTuple) b;
+	IndexTuple	tuple1 = (IndexTuple) a->tuple;
+	IndexTuple	tuple2 = (IndexTuple) b->tuple;
 	Relation	rel = state->indexRel;
 	int			keysz = RelationGetNumberOfAttributes(rel);
 	ScanKey		scankey = state->indexScanKey;
 	TupleDesc	tupDes;
 	int			i;
 	bool		equal_hasnull = false;
+	bool		decided;
+	int32		compare;
 
 	tupDes = RelationGetDescr(rel);
 
-	for (i = 1; i <= keysz; i++)
+	compare = comparekey1(state, a, b, &decided);
+	if (compare != 0)
+		return (int) compare;
+	if (decided && a->isnull1)
+		equal_hasnull = true;
+
+	for (i = (decided ? 2 : 1); i <= keysz; i++)
 	{
 		ScanKey		entry = &scankey[i - 1];
 		Datum		attrDatum1,
 					attrDatum2;
 		bool		isFirstNull,
 					isSecondNull;
-		int32		compare;
 
-		attrDatum1 = index_getattr(tuple1, i, tupDes, &isFirstNull);
-		attrDatum2 = index_getattr(tuple2, i, tupDes, &isSecondNull);
+		if (i == 1 && state->key1kind == SORTKEY_FMGR)
+		{
+			/* cached in the SortTuple, and known to be non-NULL */
+			attrDatum1 = a->datum1;
+			isFirstNull = false;
+			attrDatum2 = b->datum1;
+			isSecondNull = false;
+		}
+		else
+		{
+			attrDatum1 = index_getattr(tuple1, i, tupDes, &isFirstNull);
+			attrDatum2 = index_getattr(tuple2, i, tupDes, &isSecondNull);
+		}
 
 		/* see comments about NULLs handling in btbuild */
 		if (isFirstNull)		/* attr in tuple1 is NULL */
@@ -1919,8 +2291,22 @@ comparetup_index(Tuplesortstate *state, const void *a, const void *b)
 	return 0;
 }
 
-static void *
-copytup_index(Tuplesortstate *state, void *tup)
+/*
+ * Extract the leading key of an index tuple into its SortTuple.
+ */
+static void
+getkey1_index(Tuplesortstate *state, SortTuple *stup)
+{
+	IndexTuple	tuple = (IndexTuple) stup->tuple;
+
+	stup->datum1 = index_getattr(tuple, 1, RelationGetDescr(state->indexRel),
+								 &stup->isnull1);
+	if (state->key1kind == SORTKEY_ABBREV && !stup->isnull1)
+		stup->datum1 = (*state->key1abbrev) (stup->datum1);
+}
+
+static void
+copytup_index(Tuplesortstate *state, SortTuple *stup, void *tup)
 {
 	IndexTuple	tuple = (IndexTuple) tup;
 	unsigned int tuplen = IndexTupleSize(tuple);
@@ -1930,13 +2316,14 @@ copytup_index(Tuplesortstate *state, void *tup)
 	newtuple = (IndexTuple) palloc(tuplen);
 	memcpy(newtuple, tuple, tuplen);
 
-	return (void *) newtuple;
+	stup->tuple = (void *) newtuple;
+	getkey1_index(state, stup);
 }
 
 static void
-writetup_index(Tuplesortstate *state, int tapenum, void *tup)
+writetup_index(Tuplesortstate *state, int tapenum, SortTuple *stup)
 {
-	IndexTuple	tuple = (IndexTuple) tup;
+	IndexTuple	tuple = (IndexTuple) stup->tuple;
 	unsigned int tuplen;
 
 	tuplen = IndexTupleSize(tuple) + sizeof(tuplen);
@@ -1952,8 +2339,9 @@ writetup_index(Tuplesortstate *state, int tapenum, void *tup)
 	pfree(tuple);
 }
 
-static void *
-readtup_index(Tuplesortstate *state, int tapenum, unsigned int len)
+static void
+readtup_index(Tuplesortstate *state, SortTuple *stup,
+			  int tapenum, unsigned int len)
 {
 	unsigned int tuplen = len - sizeof(unsigned int);
 	IndexTuple	tuple = (IndexTuple) palloc(tuplen);
@@ -1966,7 +2354,8 @@ readtup_index(Tuplesortstate *state, int tapenum, unsigned int len)
 		if (LogicalTapeRead(state->tapeset, tapenum, (void *) &tuplen,
 							sizeof(tuplen)) != sizeof(tuplen))
 			elog(ERROR, "tuplesort: unexpected end of data");
-	return (void *) tuple;
+	stup->tuple = (void *) tuple;
+	getkey1_index(state, stup);
 }
 
 static unsigned int
@@ -1984,42 +2373,48 @@ tuplesize_index(Tuplesortstate *state, void *tup)
  */
 
 static int
-comparetup_datum(Tuplesortstate *state, const void *a, const void *b)
+comparetup_datum(Tuplesortstate *state, const SortTuple *a, const SortTuple *b)
 {
-	DatumTuple *ltup = (DatumTuple *) a;
-	DatumTuple *rtup = (DatumTuple *) b;
+	DatumTuple *ltup = (DatumTuple *) a->tuple;
+	DatumTuple *rtup = (DatumTuple *) b->tuple;
+	bool		decided;
+	int			result;
 
-	if (ltup->isNull)
-	{
-		if (!rtup->isNull)
-			return 1;			/* NULL sorts after non-NULL */
-		return 0;
-	}
-	else if (rtup->isNull)
-		return -1;
-	else
-	{
-		int			result;
-
-		if (!(result = -DatumGetInt32((*fmgr_faddr_2(&state->sortOpFn)) (ltup->val,rtup->val))))
-			result = DatumGetInt32((*fmgr_faddr_2(&state->sortOpFn)) (rtup->val,ltup->val));
+	result = comparekey1(state, a, b, &decided);
+	if (decided)
 		return result;
-	}
+
+	if (!(result = -DatumGetInt32((*fmgr_faddr_2(&state->sortOpFn)) (ltup->val,rtup->val))))
+		result = DatumGetInt32((*fmgr_faddr_2(&state->sortOpFn)) (rtup->val,ltup->val));
+	return result;
 }
 
-static void *
-copytup_datum(Tuplesortstate *state, void *tup)
+/*
+ * Set up the leading key of a DatumTuple, which is the datum itself.
+ */
+static void
+getkey1_datum(Tuplesortstate *state, SortTuple *stup)
+{
+	DatumTuple *tuple = (DatumTuple *) stup->tuple;
+
+	stup->datum1 = tuple->val;
+	stup->isnull1 = tuple->isNull;
+	if (state->key1kind == SORTKEY_ABBREV && !stup->isnull1)
+		stup->datum1 = (*state->key1abbrev) (stup->datum1);
+}
+
+static void
+copytup_datum(Tuplesortstate *state, SortTuple *stup, void *tup)
 {
 	/* Not currently needed */
 	elog(ERROR, "copytup_datum() should not be called");
-	return NULL;
 }
 
 static void
-writetup_datum(Tuplesortstate *state, int tapenum, void *tup)
+writetup_datum(Tuplesortstate *state, int tapenum, SortTuple *stup)
 {
-	DatumTuple *tuple = (DatumTuple *) tup;
-	unsigned int tuplen = tuplesize_datum(state, tup);
+	DatumTuple *tuple = (DatumTuple *) stup->tuple;
+	unsigned int tuplen = tuplesize_datum(state, tuple);
 	unsigned int writtenlen = tuplen + sizeof(unsigned int);
 
 	LogicalTapeWrite(state->tapeset, tapenum,
@@ -2034,8 +2429,9 @@ writetup_datum(Tuplesortstate *state, int tapenum, void *tup)
 	pfree(tuple);
 }
 
-static void *
-readtup_datum(Tuplesortstate *state, int tapenum, unsigned int len)
+static void
+readtup_datum(Tuplesortstate *state, SortTuple *stup,
+			  int tapenum, unsigned int len)
 {
 	unsigned int tuplen = len - sizeof(unsigned int);
 	DatumTuple *tuple = (DatumTuple *) palloc(tuplen);
@@ -2052,7 +2448,8 @@ readtup_datum(Tuplesortstate *state, int tapenum, unsigned int len)
 	if (!tuple->isNull && !state->datumTypeByVal)
 		tuple->val = PointerGetDatum(((char *) tuple) +
 									 MAXALIGN(sizeof(DatumTuple)));
-	return (void *) tuple;
+	stup->tuple = (void *) tuple;
+	getkey1_datum(state, stup);
 }
 
 static unsigned int
@@ -18,6 +18,7 @@
 #include "storage/itemptr.h"
 #include "utils/rel.h"
 #include "access/htup.h"
+#include "nodes/pg_list.h"
 
 #define SIZE_SPAN 0  /*  span the blobs based on size, greatest to smallest  */
 #define LOC_SPAN -1  /*  span the blobs based on location, only the ones that should be stored locally in the same relation  */
@@ -35,6 +36,13 @@ BlockNumber store_tuple_blob(Relation rel, HeapTuple direct, int16 attnum);
 BlockNumber span_buffered_blob(Relation rel,HeapTuple direct);
 
 HeapTuple vacuum_respan_tuple_blob(Relation rel, HeapTuple tuple, bool exclude_self);
+bool vacuum_reap_segment_blob(Relation rel, HeapTuple tuple, List** released);
+void vacuum_release_segment_blobs(Relation rel, List* released);
+
+void InitBlobStorage(void);
+void AtEOXact_Blobs(bool isCommit);
+void SweepBlobExtents(void);
+void DropBlobExtents(Relation rel);
 
 uint64 sizeof_tuple_blob(Relation rel, HeapTuple tuple);
 int sizeof_max_tuple_blob(void);
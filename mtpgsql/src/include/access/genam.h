@@ -19,6 +19,7 @@
 #include "access/itup.h"
 #include "access/relscan.h"
 #include "access/sdir.h"
+#include "env/tidstore.h"
 
 typedef struct index_globals {
 /*   from hash.c    */
@@ -51,7 +52,7 @@ BlockNumber index_recoverpage(Relation rel,BlockNumber page);
 			 ItemPointer heap_t_ctid,
 			 Relation heapRel, bool is_put);
 /* extern */  void index_delete(Relation relation, ItemPointer indexItem);
-/* extern */  TupleCount index_bulkdelete(Relation relation,int delcount, ItemPointerData* del_heappointers);
+/* extern */  TupleCount index_bulkdelete(Relation relation,int delcount, TidStore deadtids);
 /* extern */  IndexScanDesc index_beginscan(Relation relation, bool scanFromEnd,
 				uint16 numberOfKeys, ScanKey key);
 /* extern */  void index_rescan(IndexScanDesc scan, bool scanFromEnd, ScanKey key);
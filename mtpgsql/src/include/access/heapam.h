@@ -270,6 +270,7 @@ fastgetattr(HeapTuple tup, int attnum, TupleDesc tupleDesc,
 /* extern */ void heap_rescan(HeapScanDesc scan, ScanKey key);
 /* extern */ void heap_endscan(HeapScanDesc scan);
 /* extern */ HeapTuple heap_getnext(HeapScanDesc scandesc);
+/* extern */ void heap_setscanlimits(HeapScanDesc scan, BlockNumber startblock, BlockNumber numblocks);
 /* extern */ bool heap_fetch(Relation relation, Snapshot snapshot, HeapTuple tup, Buffer *userbuf);
 /* extern */ ItemPointerData heap_get_latest_tid(Relation relation, Snapshot snapshot, ItemPointer tid);
 /* extern */ Oid	heap_insert(Relation relation, HeapTuple tup);
@@ -29,8 +29,8 @@ typedef struct IndexTupleData
 	 * t_info is layed out in the following fashion:
 	 *
 	 * 15th (leftmost) bit: "has nulls" bit 14th bit: "has varlenas" bit 13th
-	 * bit: "has rules" bit - (removed ay 11/94) bits 12-0 bit: size of
-	 * tuple.
+	 * bit: "has rules" bit - (removed ay 11/94), now the btree "posting
+	 * list" bit bits 12-0 bit: size of tuple.
 	 */
 
 	unsigned short t_info;		/* various info about tuple */
@@ -88,6 +88,7 @@ typedef struct PredInfo
 #define INDEX_SIZE_MASK 0x1FFF
 #define INDEX_NULL_MASK 0x8000
 #define INDEX_VAR_MASK	0x4000
+#define INDEX_POSTING_MASK	0x2000
 
 #define IndexTupleSize(itup)	((Size) (((IndexTuple) (itup))->t_info & 0x1FFF))
 #define IndexTupleDSize(itup)	((Size) ((itup).t_info & 0x1FFF))
@@ -20,6 +20,8 @@
 #include "access/relscan.h"
 #include "access/sdir.h"
 #include "access/funcindex.h"
+#include "env/dolhelper.h"
+#include "env/tidstore.h"
 
 /*
  *	BTPageOpaqueData -- At the end of every page, we store a pointer
@@ -116,6 +118,8 @@ typedef struct BTScanOpaqueData
 	int			numberOfRequiredKeys;	/* number of keys that must be
 										 * matched to continue the scan */
 	ScanKey		keyData;		/* array of scan keys */
+	int			btso_curpost;	/* index of the heap TID of the current item last
+								 * returned, -1 if none */
 } BTScanOpaqueData;
 
 typedef BTScanOpaqueData *BTScanOpaque;
@@ -160,6 +164,39 @@ typedef BTItemData *BTItem;
                                 ItemPointerGetOffsetNumber(&i1->bti_itup.t_tid) == \
                                 ItemPointerGetOffsetNumber(&i2->bti_itup.t_tid) )
 
+/*
+ *	Posting list items.  On the leaf level of a non-unique index a run of
+ *	items with identical keys may be stored as a single BTItem carrying the
+ *	INDEX_POSTING_MASK bit in t_info.  The key data is followed, at a
+ *	MAXALIGN'ed offset, by an array of heap TIDs.  For such an item t_tid
+ *	does not point at the heap: its block number holds the byte offset of
+ *	the TID array and its offset number holds the number of TIDs.  Posting
+ *	items are made by _bt_load() during a bulk build and by _bt_dedup()
+ *	before a leaf page is split; the TIDs keep the order the original items
+ *	had on the page.  Pivot keys (high keys copied upward, downlinks) never
+ *	carry a posting list, see _bt_formitem().
+ */
+#define BTItemIsPosting(bti) \
+	(((bti)->bti_itup.t_info & INDEX_POSTING_MASK) != 0)
+#define BTItemGetNPosting(bti) \
+	((int) ItemPointerGetOffsetUnchecked(&(bti)->bti_itup.t_tid))
+#define BTItemGetPostingOffset(bti) \
+	((Size) ItemPointerGetBlockNumber(&(bti)->bti_itup.t_tid))
+#define BTItemGetPosting(bti, n) \
+	(((ItemPointer) ((char *) (bti) + BTItemGetPostingOffset(bti))) + (n))
+#define BTItemGetNTids(bti) \
+	(BTItemIsPosting(bti) ? BTItemGetNPosting(bti) : 1)
+#define BTItemGetHeapTid(bti, n) \
+	(BTItemIsPosting(bti) ? BTItemGetPosting(bti, n) : &(bti)->bti_itup.t_tid)
+
+/*
+ * Posting items are kept to half the largest allowed item so that a page
+ * of them can still be split sensibly.
+ */
+#define BTMaxPostingSize \
+	(((BLCKSZ - sizeof(PageHeaderData) - \
+	   MAXALIGN(sizeof(BTPageOpaqueData))) / 3 - sizeof(ItemIdData)) / 2)
+
 /*
  *	BTStackData -- As we descend a tree, we push the (key, pointer)
  *	pairs from internal nodes onto a private stack.  If we split a
@@ -256,6 +293,22 @@ typedef BTStackData *BTStack;
 
 #define BTORDER_PROC	1
 
+/*
+ *	Scan keys whose BTORDER_PROC is one of the builtin fixed-width
+ *	comparators are tagged by _bt_setcmptype() so that _bt_compare()
+ *	can compare the datums inline instead of jumping through sk_func.
+ */
+
+#define BTCMP_FMGR		0
+#define BTCMP_INT2		1
+#define BTCMP_INT4		2
+#define BTCMP_INT8		3
+#define BTCMP_OID		4
+#define BTCMP_FLOAT8	5
+#define BTCMP_NAME		6
+#define BTCMP_CHAR		7
+#define BTCMP_BOOL		8
+
 /*
  * prototypes for functions in nbtree.c (external entry points for btree)
  */
@@ -276,7 +329,7 @@ PG_EXTERN Datum btmarkpos(IndexScanDesc s);
 PG_EXTERN Datum btrestrpos(IndexScanDesc s);
 /* stubs */
 PG_EXTERN Datum btdelete(Relation rel, ItemPointer tid);
-PG_EXTERN Datum btbulkdelete(Relation rel,int delcount,ItemPointerData* del_heappointers);
+PG_EXTERN Datum btbulkdelete(Relation rel,int delcount,TidStore deadtids);
 
 /*
  * prototypes for functions in nbtinsert.c
@@ -330,22 +383,31 @@ PG_EXTERN StrategyNumber _bt_getstrat(Relation rel, AttrNumber attno,
  */
 PG_EXTERN ScanKey _bt_mkscankey(Relation rel, IndexTuple itup);
 PG_EXTERN ScanKey _bt_mkscankey_nodata(Relation rel);
+PG_EXTERN void _bt_setcmptype(ScanKey entry);
 PG_EXTERN void _bt_freeskey(ScanKey skey);
 PG_EXTERN void _bt_freestack(BTStack stack);
 PG_EXTERN void _bt_orderkeys(IndexScanDesc scan);
 PG_EXTERN bool _bt_checkkeys(IndexScanDesc scan, IndexTuple tuple,
 			  ScanDirection dir, bool *continuescan);
 PG_EXTERN BTItem _bt_formitem(IndexTuple itup);
+PG_EXTERN Size _bt_keysize(BTItem btitem);
+PG_EXTERN bool _bt_keysequal(BTItem a, BTItem b);
+PG_EXTERN BTItem _bt_formposting(BTItem base, ItemPointer tids, int ntids);
 /*
  * prototypes for functions in nbtsort.c
  */
 
 typedef struct BTSpool BTSpool; /* opaque type known only within nbtsort.c */
+typedef struct BTExchange BTExchange;	/* runs passed from a build worker */
 
 PG_EXTERN BTSpool *_bt_spoolinit(Relation index, bool isunique);
 PG_EXTERN void _bt_spooldestroy(BTSpool *btspool);
 PG_EXTERN void _bt_spool(BTItem btitem, BTSpool *btspool);
 PG_EXTERN void _bt_spoolmerge(BTSpool *dest, BTSpool *src);
-PG_EXTERN void _bt_leafbuild(BTSpool *btspool);
+PG_EXTERN void _bt_spoolattach(BTSpool *dest, BTSpool *src);
+PG_EXTERN void _bt_leafbuild(BTSpool *btspool, bool isunique);
+PG_EXTERN BTExchange *_bt_exchangeinit(DolConnection worker);
+PG_EXTERN void _bt_spoolexport(BTExchange *xchg, BTSpool *live, BTSpool *dead);
+PG_EXTERN void _bt_spoolattachexchange(BTSpool *dest, BTExchange *xchg);
 
 #endif   /* NBTREE_H */
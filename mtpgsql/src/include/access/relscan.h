@@ -30,6 +30,9 @@ typedef struct HeapScanDescData
 	uint16		rs_cdelta;		/* current delta in chain */
 	uint16		rs_nkeys;		/* number of attributes in keys */
 	ScanKey		rs_key;			/* key descriptors */
+	BlockNumber	rs_startblock;	/* first block to scan */
+	BlockNumber	rs_endblock;	/* block to stop at, InvalidBlockNumber
+								 * for end of relation */
 } HeapScanDescData;
 
 typedef HeapScanDescData *HeapScanDesc;
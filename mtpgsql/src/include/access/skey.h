@@ -30,6 +30,7 @@ typedef struct ScanKeyData
 	FmgrInfo	sk_func;
 	int32		sk_nargs;
 	Datum		sk_argument;	/* data to compare */
+	int16		sk_cmptype;		/* access method fast compare, 0 = sk_func */
 } ScanKeyData;
 
 typedef ScanKeyData *ScanKey;
@@ -45,6 +45,8 @@ typedef struct cost {
 	bool 			enable_nestloop;
 	bool 			enable_mergejoin;
 	bool			enable_hashjoin;
+	bool			enable_hashagg;
+	bool			enable_parallelhashjoin;
 /* statics */
 	bool 			enable_geqo;
 	int 			geqo_rels;
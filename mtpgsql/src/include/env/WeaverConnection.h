@@ -111,6 +111,10 @@ typedef struct preparedplan {
 
     InputOutput*        slot;
 
+    OutputSegment*      segment;        /* columnar output, see WOutputSegment */
+    HeapTuple           segment_held;   /* row that did not fit the last fetch */
+    TupleDesc           segment_desc;
+
     OpaquePreparedStatement   next;
 } PreparedPlan;
 
@@ -125,6 +129,15 @@ LIB_EXTERN bool
 TransferToRegistered(InputOutput* output, Form_pg_attribute desc, Datum value, bool isnull);
 LIB_EXTERN bool
 TransferColumnName(InputOutput* output, Form_pg_attribute desc);
+
+#define SEGMENT_TRANSFERRED     0
+#define SEGMENT_TYPE_MISMATCH   1
+#define SEGMENT_FULL            2
+
+LIB_EXTERN void
+LayoutOutputSegment(OutputSegment* segment, long size);
+LIB_EXTERN int
+TransferToSegment(OutputSegment* segment, int col, int row, Form_pg_attribute desc, Datum value, bool isnull);
 #ifdef __cplusplus
 }
 #endif
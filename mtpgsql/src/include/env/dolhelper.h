@@ -28,6 +28,8 @@ PG_EXTERN void ProcessDolCommand(DolConnection conn,void*(*start_routine)(void*)
 
 PG_EXTERN bool IsDolConnectionAvailable(void);
 
+PG_EXTERN bool IsDolConnectionRunning(DolConnection conn);
+
 PG_EXTERN void ShutdownDolHelpers(void);
 
 PG_EXTERN void CancelDolHelpers(void);
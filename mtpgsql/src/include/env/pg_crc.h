@@ -158,5 +158,7 @@ extern const uint64 pg_crc64_table[];
 
 PG_EXTERN bool eq_crc64(crc64 c1,crc64 c2);
 PG_EXTERN crc64 checksum_block(unsigned char* block,int len);
+PG_EXTERN uint32 crc32c_block(unsigned char* block,int len);
+PG_EXTERN const char* crc32c_implementation(void);
 
 #endif   /* PG_CRC_H */
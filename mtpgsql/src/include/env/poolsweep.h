@@ -48,6 +48,7 @@ void PausePoolsweep(void);
 bool IsPoolsweepPaused(void);
 void ResumePoolsweep(void);
 void PrintPoolsweepMemory(void);
+void PoolsweepDelayPoint(int pages);
 
 #ifdef __cplusplus
 }
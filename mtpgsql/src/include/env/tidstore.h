@@ -0,0 +1,40 @@
+/*-------------------------------------------------------------------------
+ *
+ * tidstore.h
+ *	  compact set of heap tuple ids keyed by block
+ *
+ * Vacuum collects the dead tuples of a relation here and the index bulk
+ * delete routines test index entries against it.  Each block with dead
+ * tuples costs one small entry, either a list of offsets or a bitmap
+ * of them, reached through a two level directory indexed by block
+ * number, so a membership test is a couple of array lookups.
+ *
+ * Pages are added whole, one call per heap page.  Once filled the store
+ * is only read, so any number of threads may test it at once.
+ *
+ * Portions Copyright (c) 2000-2024, Myron Scott  <myron@weaverdb.org>
+ *
+ *-------------------------------------------------------------------------
+ */
+#ifndef TIDSTORE_H
+#define TIDSTORE_H
+
+#include "storage/block.h"
+#include "storage/off.h"
+#include "storage/itemptr.h"
+
+typedef struct TidStoreData *TidStore;
+
+PG_EXTERN TidStore TidStoreCreate(Size maxbytes);
+PG_EXTERN void TidStoreDestroy(TidStore store);
+PG_EXTERN void TidStoreReset(TidStore store);
+
+PG_EXTERN bool TidStoreAddPage(TidStore store, BlockNumber blkno,
+				OffsetNumber *offsets, int noffsets);
+PG_EXTERN bool TidStoreIsMember(TidStore store, ItemPointer tid);
+PG_EXTERN bool TidStoreIsFull(TidStore store, BlockNumber blkno);
+
+PG_EXTERN int TidStoreNextPage(TidStore store, BlockNumber *blkno,
+				OffsetNumber *offsets);
+
+#endif	 /* TIDSTORE_H */
@@ -0,0 +1,43 @@
+/*-------------------------------------------------------------------------
+ *
+ *	visibilitymap.h 
+ *		per-relation map of heap pages whose tuples are visible to all
+ *
+ * Portions Copyright (c) 2000-2024, Myron Scott  <myron@weaverdb.org>
+ *
+ * IDENTIFICATION
+ *		 
+ *
+ *-------------------------------------------------------------------------
+ */
+#ifndef _VISIBILITYMAP_H_
+#define _VISIBILITYMAP_H_
+
+
+#include "c.h"
+#include "postgres.h"
+#include "config.h"
+#include "utils/rel.h"
+#include "utils/relcache.h"
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+void InitVisibilityMap(void);
+void ShutdownVisibilityMap(void);
+
+bool VisibilityMapTest(Relation rel, BlockNumber blk);
+uint32 VisibilityMapGetSequence(Relation rel, BlockNumber blk);
+bool VisibilityMapSet(Relation rel, BlockNumber blk, uint32 sequence);
+void VisibilityMapClear(Relation rel, BlockNumber blk);
+void VisibilityMapTruncate(Relation rel, BlockNumber nblocks);
+void VisibilityMapFlush(Relation rel);
+void VisibilityMapForget(Relation rel);
+void AtEOXact_VisibilityMap(bool isCommit);
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif
@@ -103,6 +103,9 @@ PG_EXTERN TupleTableSlot *ExecProject(ProjectionInfo *projInfo, bool *isDone);
  * prototypes from functions in execScan.c
  */
 PG_EXTERN TupleTableSlot *ExecScan(Scan *node, TupleTableSlot *(*accessMtd) ());
+PG_EXTERN bool ExecScanJavaBatchPending(CommonScanState *scanstate);
+PG_EXTERN void ExecScanJavaBatchReset(CommonScanState *scanstate);
+PG_EXTERN void ExecScanJavaBatchEnd(CommonScanState *scanstate);
 
 /*
  * prototypes from functions in execTuples.c
@@ -16,6 +16,7 @@
 #define HASHJOIN_H
 
 #include "access/htup.h"
+#include "nodes/pg_list.h"
 #include "storage/buffile.h"
 
 /* ----------------------------------------------------------------
@@ -44,24 +45,45 @@ typedef struct HashJoinTupleData
 {
 	struct HashJoinTupleData *next;		/* link to next tuple in same
 										 * bucket */
+	uint32		hashvalue;		/* hash of the join keys */
 	HeapTupleData htup;			/* tuple header */
 } HashJoinTupleData;
 
 typedef HashJoinTupleData *HashJoinTuple;
 
+/*
+ * most helper threads a parallel hash join asks for, the main thread
+ * works alongside them
+ */
+#define HJ_PARALLEL_MAX_WORKERS		3
+
+/*
+ * hash function for one join key, chosen by the key's datatype
+ */
+typedef uint32 (*HashKeyFunc) (Datum key, int len);
+
 typedef struct HashTableData
 {
-	int			nbuckets;		/* buckets in use during this batch */
-	int			totalbuckets;	/* total number of (virtual) buckets */
+	int			nbuckets;		/* buckets in the in-memory table */
 	HashJoinTuple *buckets;		/* buckets[i] is head of list of tuples */
 	/* buckets array is per-batch storage, as are all the tuples */
 
-	int			nbatch;			/* number of batches; 0 means 1-pass join */
+	/*
+	 * A tuple's bucket is its hash value modulo nbuckets and its batch is
+	 * the quotient modulo nbatch.  nbatch is a power of two, so doubling
+	 * it while the join runs sends each tuple of batch b either to b or
+	 * to b + the old nbatch, never to a batch that is already done.
+	 */
+	int			nbatch;			/* number of batches; 1 means 1-pass join */
+	int			maxbatch;		/* nbatch may not grow past this */
 	int			curbatch;		/* current batch #, or 0 during 1st pass */
+	int			nbatch_original;	/* nbatch when the inner scan began */
+	int			nbatch_outstart;	/* nbatch when the outer scan began */
 
 	/*
-	 * all these arrays are allocated for the life of the hash join, but
-	 * only if nbatch > 0:
+	 * all these arrays have nbatch entries and live for the life of the
+	 * hash join.  Entry 0 is never used, a file is created the first time
+	 * a tuple is written to its batch.
 	 */
 	BufFile   **innerBatchFile; /* buffered virtual temp file per batch */
 	BufFile   **outerBatchFile; /* buffered virtual temp file per batch */
@@ -71,22 +93,39 @@ typedef struct HashTableData
 								 * file */
 
 	/*
-	 * Info about the datatype being hashed.  We assume that the inner and
-	 * outer sides of the hash are the same type, or at least
-	 * binary-compatible types.
+	 * The join keys, one per hash clause, with the hash function for each.
+	 * We assume that the inner and outer sides of a clause are the same
+	 * type, or at least binary-compatible types.
+	 */
+	int			nkeys;
+	List	   *innerkeys;		/* inner Vars, righthand ops of the clauses */
+	List	   *outerkeys;		/* outer Vars, lefthand ops of the clauses */
+	HashKeyFunc *hashfuncs;
+
+	/*
+	 * Bytes of tuples in the in-memory table.  Once spaceUsed passes
+	 * spaceAllowed the number of batches is doubled and the tuples that
+	 * now belong to later batches are written out.
+	 */
+	long		spaceUsed;
+	long		spaceAllowed;
+
+	/*
+	 * Bloom filter over the hash values of every inner tuple, built in
+	 * the first pass.  Outer tuples that miss it cannot join and are
+	 * dropped instead of being written to a batch file.
 	 */
-	int16		typLen;
-	bool		typByVal;
+	uint32	   *bloom;
+	uint32		bloomMask;		/* number of bits - 1 */
 
 	/*
-	 * During 1st scan of inner relation, we get tuples from executor. If
-	 * nbatch > 0 then tuples that don't belong in first nbuckets logical
-	 * buckets get dumped into inner-batch temp files. The same statements
-	 * apply for the 1st scan of the outer relation, except we write
-	 * tuples to outer-batch temp files. If nbatch > 0 then we do the
-	 * following for each batch: 1. Read tuples from inner batch file,
-	 * load into hash buckets. 2. Read tuples from outer batch file, match
-	 * to hash buckets and output.
+	 * During 1st scan of inner relation, we get tuples from executor.
+	 * Tuples that don't belong to batch 0 get dumped into inner-batch
+	 * temp files. The same statements apply for the 1st scan of the
+	 * outer relation, except we write tuples to outer-batch temp files.
+	 * Then we do the following for each later batch: 1. Read tuples from
+	 * inner batch file, load into hash buckets. 2. Read tuples from outer
+	 * batch file, match to hash buckets and output.
 	 */
 
 	MemoryContext hashCxt;		/* context for whole-hash-join storage */
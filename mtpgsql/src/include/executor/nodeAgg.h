@@ -16,10 +16,44 @@
 
 #include "nodes/plannodes.h"
 
+/*
+ * AggStatePerGroupData - transition values of one aggregate for one group
+ *
+ * Agg keeps a single array of these, one per aggregate; HashAgg keeps an
+ * array per hash table entry.
+ */
+typedef struct AggStatePerGroupData
+{
+	Datum		value1,			/* current transfer values 1 and 2 */
+				value2;
+	bool		value1IsNull,
+				value2IsNull;
+	bool		noInitValue;	/* true if value1 not set yet */
+
+	/*
+	 * Note: right now, noInitValue always has the same value as
+	 * value1IsNull. But we should keep them separate because once the
+	 * fmgr interface is fixed, we'll need to distinguish a null returned
+	 * by transfn1 from a null we haven't yet replaced with an input
+	 * value.
+	 */
+} AggStatePerGroupData;
+
 PG_EXTERN TupleTableSlot *ExecAgg(Agg *node);
 PG_EXTERN bool ExecInitAgg(Agg *node, EState *estate);
 PG_EXTERN int	ExecCountSlotsAgg(Agg *node);
 PG_EXTERN void ExecEndAgg(Agg *node);
 PG_EXTERN void ExecReScanAgg(Agg *node, ExprContext *exprCtxt);
 
+PG_EXTERN AggStatePerAgg ExecInitAggregates(List *aggs, int numaggs);
+PG_EXTERN void ExecAggInitGroup(AggStatePerAgg peragg,
+				 AggStatePerGroup pergroup, int numaggs);
+PG_EXTERN void ExecAggAdvanceGroup(AggStatePerAgg peragg,
+					AggStatePerGroup pergroup, int numaggs,
+					ExprContext *econtext, MemoryContext transcxt);
+PG_EXTERN Size ExecAggTransitionSpace(AggStatePerAgg peragg, int numaggs);
+PG_EXTERN void ExecAggFinalizeGroup(AggStatePerAgg peragg,
+					 AggStatePerGroup pergroup, int numaggs,
+					 Datum *resultVals, bool *resultNulls);
+
 #endif	 /* NODEAGG_H */
@@ -23,14 +23,19 @@ PG_EXTERN TupleTableSlot *ExecHash(Hash *node);
 PG_EXTERN bool ExecInitHash(Hash *node, EState *estate);
 PG_EXTERN int	ExecCountSlotsHash(Hash *node);
 PG_EXTERN void ExecEndHash(Hash *node);
-PG_EXTERN HashJoinTable ExecHashTableCreate(Hash *node);
+PG_EXTERN HashJoinTable ExecHashTableCreate(Hash *node, List *hashclauses);
 PG_EXTERN void ExecHashTableDestroy(HashJoinTable hashtable);
-PG_EXTERN void ExecHashTableInsert(HashJoinTable hashtable, ExprContext *econtext,
-					Var *hashkey);
-PG_EXTERN int ExecHashGetBucket(HashJoinTable hashtable, ExprContext *econtext,
-				  Var *hashkey);
+PG_EXTERN void ExecHashTableInsert(HashJoinTable hashtable, HeapTuple heapTuple,
+					uint32 hashvalue);
+PG_EXTERN bool ExecHashGetHashValue(HashJoinTable hashtable, ExprContext *econtext,
+				  List *hashkeys, uint32 *hashvalue);
+PG_EXTERN void ExecHashGetBucketAndBatch(HashJoinTable hashtable, uint32 hashvalue,
+				  int *bucketno, int *batchno);
+PG_EXTERN bool ExecHashBloomTest(HashJoinTable hashtable, uint32 hashvalue);
 PG_EXTERN HeapTuple ExecScanHashBucket(HashJoinState *hjstate, List *hjclauses,
 				   ExprContext *econtext);
+PG_EXTERN HashKeyFunc ExecHashKeyFunc(Oid typid);
+PG_EXTERN bool ExecHashKeyIsTyped(Oid typid);
 PG_EXTERN void ExecHashTableReset(HashJoinTable hashtable, long ntuples);
 PG_EXTERN void ExecReScanHash(Hash *node, ExprContext *exprCtxt);
 
@@ -0,0 +1,25 @@
+/*-------------------------------------------------------------------------
+ *
+ * nodeHashAgg.h
+ *	  prototypes for nodeHashAgg.c
+ *
+ *
+ * Portions Copyright (c) 1996-2000, PostgreSQL, Inc
+ * Portions Copyright (c) 1994, Regents of the University of California
+ *
+ *
+ *
+ *-------------------------------------------------------------------------
+ */
+#ifndef NODEHASHAGG_H
+#define NODEHASHAGG_H
+
+#include "nodes/plannodes.h"
+
+PG_EXTERN TupleTableSlot *ExecHashAgg(HashAgg *node);
+PG_EXTERN bool ExecInitHashAgg(HashAgg *node, EState *estate);
+PG_EXTERN int	ExecCountSlotsHashAgg(HashAgg *node);
+PG_EXTERN void ExecEndHashAgg(HashAgg *node);
+PG_EXTERN void ExecReScanHashAgg(HashAgg *node, ExprContext *exprCtxt);
+
+#endif	 /* NODEHASHAGG_H */
@@ -21,7 +21,8 @@ PG_EXTERN TupleTableSlot *ExecHashJoin(HashJoin *node);
 PG_EXTERN bool ExecInitHashJoin(HashJoin *node, EState *estate);
 PG_EXTERN int	ExecCountSlotsHashJoin(HashJoin *node);
 PG_EXTERN void ExecEndHashJoin(HashJoin *node);
-PG_EXTERN void ExecHashJoinSaveTuple( HeapTuple heapTuple, BufFile *file);
+PG_EXTERN void ExecHashJoinSaveTuple(HeapTuple heapTuple, uint32 hashvalue,
+					  BufFile **fileptr);
 PG_EXTERN void ExecReScanHashJoin(HashJoin *node, ExprContext *exprCtxt);
 
 #endif	 /* NODEHASHJOIN_H */
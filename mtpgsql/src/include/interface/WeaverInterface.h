@@ -65,6 +65,47 @@ typedef int (*transferfunc)(void* userenv, int varType, void *varAdd, int varSiz
 typedef struct Connection* OpaqueWConn;
 typedef struct preparedplan* OpaquePreparedStatement;
 
+/*
+ * Columnar output segments
+ *
+ * Instead of one transfer callback per column per row, a client can hand
+ * WOutputSegment a block of memory that WFetchSegment fills with as many
+ * rows as fit.  The client sets ncols, optionally maxrows, and the index
+ * and type (as for WOutputTransfer) of each column; WOutputSegment lays
+ * the block out and fills in the rest.  Every column gets an array of
+ * maxrows values and a null bitmap, bit (row % 8) of byte (row / 8) set
+ * for a null.  Fixed width values are stored as they are, variable
+ * length ones, and char which is text when converted, as an
+ * OutputSegmentVar locating the bytes in the variable area.  Offsets in the header and columns are from the start of the
+ * segment.  The first fetch copies the column names.
+ */
+typedef struct outputsegmentcolumn {
+	int32_t		index;		/* client: result column, from 1 */
+	int32_t		type;		/* client: requested type */
+	int32_t		width;		/* bytes per entry in values */
+	int32_t		reserved;
+	int64_t		values;		/* offset of the value array */
+	int64_t		nulls;		/* offset of the null bitmap */
+	char		name[64];	/* column name */
+} OutputSegmentColumn;
+
+typedef struct outputsegment {
+	int32_t		ncols;		/* client: entries in columns */
+	int32_t		maxrows;	/* client: upper bound or 0, then the rows per fetch */
+	int32_t		nrows;		/* rows filled by the last fetch */
+	int32_t		reserved;
+	int64_t		size;		/* bytes in the segment */
+	int64_t		vardata;	/* offset of the variable area */
+	int64_t		varsize;	/* bytes in the variable area */
+	int64_t		varused;	/* bytes of it filled by the last fetch */
+	OutputSegmentColumn columns[1];
+} OutputSegment;
+
+typedef struct outputsegmentvar {
+	int32_t		offset;		/* from vardata */
+	int32_t		length;
+} OutputSegmentVar;
+
 LIB_EXTERN OpaqueWConn WCreateConnection(const char* name, const char * paslong, const char* connect);
 LIB_EXTERN OpaqueWConn WCreateSubConnection(OpaqueWConn  conn);
 LIB_EXTERN long WDestroyConnection(OpaqueWConn  conn);
@@ -76,6 +117,8 @@ LIB_EXTERN long WBindTransfer(OpaquePreparedStatement stmt, const char* var, int
 LIB_EXTERN long WOutputTransfer(OpaquePreparedStatement stmt, short pos, int type, void* userenv, transferfunc func);
 LIB_EXTERN long WExec(OpaquePreparedStatement conn );
 LIB_EXTERN long WFetch( OpaquePreparedStatement conn );
+LIB_EXTERN long WOutputSegment(OpaquePreparedStatement stmt, void* segment, long size);
+LIB_EXTERN long WFetchSegment(OpaquePreparedStatement stmt);
 LIB_EXTERN long WPrepare(OpaqueWConn conn );
 LIB_EXTERN long WCommit( OpaqueWConn conn );
 LIB_EXTERN long WRollback(OpaqueWConn conn );
@@ -111,6 +154,11 @@ LIB_EXTERN void* WDisconnectStdIO(OpaqueWConn conn);
  * to invoke LANGUAGE 'java' procedures instead of (or in addition to) the old JNI path.
  */
 LIB_EXTERN void WRegisterJavaFunctionInvoker(void* invokerFn);
+/*
+ * Registers the batched form of the invoker, one upcall evaluates a
+ * function over many rows.  Optional, without it rows are called one by one.
+ */
+LIB_EXTERN void WRegisterJavaBatchInvoker(void* invokerFn);
 
 #ifdef __cplusplus
 }
@@ -357,6 +357,7 @@ typedef struct AppendState
  *		currentRelation    relation being scanned
  *		currentScanDesc    current scan descriptor for scan
  *		ScanTupleSlot	   pointer to slot in tuple table holding scan tuple
+ *		JavaBatch		   tuples read ahead to batch java function calls
  *
  *	 CommonState information
  *
@@ -374,6 +375,7 @@ typedef struct CommonScanState
 	Relation	css_currentRelation;
 	HeapScanDesc css_currentScanDesc;
 	TupleTableSlot *css_ScanTupleSlot;
+	struct JavaBatchData *css_JavaBatch;
 } CommonScanState;
 
 /* ----------------
@@ -528,9 +530,11 @@ typedef struct MergeJoinState
  *								tuple, or NULL if starting search
  *								(CurBucketNo and CurTuple are meaningless
  *								 unless OuterTupleSlot is nonempty!)
- *		hj_InnerHashKey			the inner hash key in the hashjoin condition
+ *		hj_CurHashValue			hash value of current outer tuple
  *		hj_OuterTupleSlot		tuple slot for outer tuples
  *		hj_HashTupleSlot		tuple slot for hashed tuples
+ *		hj_Parallel				helpers of a parallel build and probe,
+ *								NULL when the join runs serially
  *
  *	 JoinState information
  *
@@ -550,9 +554,10 @@ typedef struct HashJoinState
 	HashJoinTable hj_HashTable;
 	int			hj_CurBucketNo;
 	HashJoinTuple hj_CurTuple;
-	Var		   *hj_InnerHashKey;
+	uint32		hj_CurHashValue;
 	TupleTableSlot *hj_OuterTupleSlot;
 	TupleTableSlot *hj_HashTupleSlot;
+	struct HashJoinParallelData *hj_Parallel;
 } HashJoinState;
 
 
@@ -603,6 +608,7 @@ typedef struct MaterialState
  * -------------------------
  */
 typedef struct AggStatePerAggData *AggStatePerAgg;		/* private in nodeAgg.c */
+typedef struct AggStatePerGroupData *AggStatePerGroup;	/* see nodeAgg.h */
 
 typedef struct AggState
 {
@@ -610,9 +616,50 @@ typedef struct AggState
 	List	   *aggs;			/* all Aggref nodes in targetlist & quals */
 	int			numaggs;		/* length of list (could be zero!) */
 	AggStatePerAgg peragg;		/* per-Aggref working state */
+	AggStatePerGroup pergroup;	/* transition values of current group */
 	bool		agg_done;		/* indicates completion of Agg scan */
 } AggState;
 
+/* ---------------------
+ *	HashAggState information
+ *
+ *	The hash table entries and their transition values live in
+ *	hashagg_hashCxt, which is reset between batches.  Once the table
+ *	uses more than SortMem, input tuples of groups that are not in the
+ *	table are written to one of several batch files instead and
+ *	aggregated by a later pass.  hashagg_tmpCxt holds per-tuple
+ *	scratch storage.
+ * -------------------------
+ */
+typedef struct HashAggEntryData *HashAggEntry;	/* private in nodeHashAgg.c */
+
+typedef struct HashAggState
+{
+	CommonScanState csstate;	/* its first field is NodeTag */
+	List	   *aggs;			/* all Aggref nodes in targetlist & quals */
+	int			numaggs;		/* length of list (could be zero!) */
+	AggStatePerAgg peragg;		/* per-Aggref working state */
+	FmgrInfo   *eqfunctions;	/* per-field lookup data for equality fns */
+	HashKeyFunc *hashfunctions; /* per-field hash fns, as in hash join */
+	MemoryContext hashagg_hashCxt;	/* entries and transition values */
+	MemoryContext hashagg_tmpCxt;	/* per-tuple scratch storage */
+	HashAggEntry *hashagg_buckets;	/* bucket array, power of 2 long */
+	int			hashagg_nbuckets;
+	long		hashagg_ngroups;	/* entries in the current table */
+	long		hashagg_spaceUsed;	/* approximate bytes held by the table */
+	long		hashagg_spaceAllowed;	/* bytes before we start spilling */
+	Size		hashagg_transSpace;	/* by-ref transition bytes per group */
+	bool		hashagg_full;	/* table is closed to new groups */
+	bool		hashagg_filled; /* current pass has consumed its input */
+	int			hashagg_depth;	/* partitioning level of current pass */
+	BufFile    *hashagg_infile; /* batch being aggregated, or NULL */
+	BufFile   **hashagg_spill;	/* batch files written by this pass */
+	List	   *hashagg_pending;	/* batches still to be aggregated */
+	int			hashagg_nextbucket;		/* output scan position */
+	HashAggEntry hashagg_nextentry;
+	bool		agg_done;		/* indicates completion of HashAgg scan */
+} HashAggState;
+
 /* ---------------------
  *	GroupState information
  *
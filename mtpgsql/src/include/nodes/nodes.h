@@ -51,6 +51,7 @@ typedef enum NodeTag
 	T_Group,
 	T_SubPlan,
 	T_TidScan,
+	T_HashAgg,
 
 	/*---------------------
 	 * TAGS FOR PRIMITIVE NODES (primnodes.h)
@@ -119,6 +120,7 @@ typedef enum NodeTag
 	T_UniqueState,
 	T_HashState,
 	T_TidScanState,
+	T_HashAggState,
 
 	/*---------------------
 	 * TAGS FOR MEMORY NODES (memnodes.h)
@@ -270,6 +270,8 @@ typedef struct HashJoin
 	Oid			hashjoinop;
 	HashJoinState *hashjoinstate;
 	bool		hashdone;
+	int			parallel;		/* helper threads for build and probe,
+								 * zero runs the join serially */
 } HashJoin;
 
 /* ---------------
@@ -282,6 +284,23 @@ typedef struct Agg
 	AggState   *aggstate;
 } Agg;
 
+/* ---------------
+ *	 hashed aggregate node -
+ *		aggregates unsorted input per GROUP BY group by keeping the
+ *		groups in a hash table keyed on the group columns, in place of
+ *		the Sort/Group/Agg stack.  numGroups is the planner's estimate,
+ *		used to size the table.
+ * ---------------
+ */
+typedef struct HashAgg
+{
+	Plan		plan;
+	int			numCols;		/* number of group columns */
+	AttrNumber *grpColIdx;		/* indexes into the target list */
+	long		numGroups;		/* estimated number of groups */
+	HashAggState *hashaggstate;
+} HashAgg;
+
 /* ---------------
  *	 group node -
  *		use for queries with GROUP BY specified.
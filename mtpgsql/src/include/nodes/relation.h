@@ -358,6 +358,7 @@ typedef struct HashPath
 {
 	JoinPath	jpath;
 	List	   *path_hashclauses;		/* join clauses used for hashing */
+	int			path_workers;	/* helper threads building and probing */
 } HashPath;
 
 /*
@@ -54,13 +54,16 @@ PG_EXTERN void cost_delegated_index(Path *path, Query *root,
 		   List *indexQuals, bool is_injoin);
 PG_EXTERN void cost_tidscan(Path *path, RelOptInfo *baserel, List *tideval);
 PG_EXTERN void cost_sort(Path *path, List *pathkeys, double tuples, int width);
+PG_EXTERN void cost_hashagg(Path *path, double tuples, int width,
+			 int numCols, int numAggs, double numGroups);
 PG_EXTERN void cost_nestloop(Path *path, Path *outer_path, Path *inner_path,
 			  List *restrictlist);
 PG_EXTERN void cost_mergejoin(Path *path, Path *outer_path, Path *inner_path,
 			   List *restrictlist,
 			   List *outersortkeys, List *innersortkeys);
 PG_EXTERN void cost_hashjoin(Path *path, Path *outer_path, Path *inner_path,
-			  List *restrictlist, Selectivity innerdisbursion);
+			  List *restrictlist, Selectivity innerdisbursion,
+			  int nworkers);
 PG_EXTERN Cost cost_qual_eval(List *quals);
 PG_EXTERN void set_baserel_size_estimates(Query *root, RelOptInfo *rel);
 PG_EXTERN void set_joinrel_size_estimates(Query *root, RelOptInfo *rel,
@@ -58,7 +58,8 @@ PG_EXTERN HashPath *create_hashjoin_path(RelOptInfo *joinrel,
 					 Path *inner_path,
 					 List *restrict_clauses,
 					 List *hashclauses,
-					 Selectivity innerdisbursion);
+					 Selectivity innerdisbursion,
+					 int nworkers);
 
 /*
  * prototypes for relnode.c
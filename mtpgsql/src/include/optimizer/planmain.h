@@ -47,6 +47,8 @@ PG_EXTERN Plan *create_plan(Query *root, Path *best_path);
 PG_EXTERN Sort *make_sort(List *tlist, Oid nonameid, Plan *lefttree,
 		  int keycount);
 PG_EXTERN Agg *make_agg(List *tlist, List *qual, Plan *lefttree);
+PG_EXTERN HashAgg *make_hashagg(List *tlist, List *qual, int numCols,
+			 AttrNumber *grpColIdx, Plan *lefttree);
 PG_EXTERN Group *make_group(List *tlist, bool tuplePerGroup, int ngrp,
 		   AttrNumber *grpColIdx, Plan *lefttree);
 PG_EXTERN Noname *make_noname(List *tlist, List *pathkeys, Plan *subplan);
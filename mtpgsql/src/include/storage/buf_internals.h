@@ -210,7 +210,9 @@ PG_EXTERN int BiasPinned(BufferDesc* buf);
 PG_EXTERN bool IsWaitingForFlush(unsigned owner);
 PG_EXTERN BufferDesc *GetFreeBuffer(Relation rel);
 PG_EXTERN void PutFreeBuffer(BufferDesc* bufHdr);
+PG_EXTERN BufferDesc *TakeFreeBuffer(void);
 PG_EXTERN void InitFreeList(bool init);
+PG_EXTERN bool IsFreeListWaiting(void);
 
 /* buf_table.c */
 
@@ -138,6 +138,10 @@ PG_EXTERN int	SyncRelation(Relation rel);
 PG_EXTERN void InitBufferPool(IPCKey key);
 PG_EXTERN int AddMoreBuffers(int count);
 PG_EXTERN int RetireBuffers(int start, int count);
+PG_EXTERN int ShrinkBufferPool(int count);
+PG_EXTERN int ResizeBufferPool(int buffers);
+PG_EXTERN int RestoreBufferPool(void);
+PG_EXTERN int ActiveBuffers(void);
 PG_EXTERN void InitThreadBuffer(void);
 
 PG_EXTERN void ResetBufferPool(bool isCommit);
@@ -324,6 +324,8 @@ PG_EXTERN crc64 PageInsertInvalidChecksum(Page page);
 PG_EXTERN bool PageChecksumIsInvalid(Page page);
 PG_EXTERN bool PageChecksumIsInit(Page page);
 PG_EXTERN bool PageConfirmChecksum(Page page);
+PG_EXTERN void PageChecksumBenchmark(int pages);
 PG_EXTERN bool DisableCRC(bool enable);
+PG_EXTERN bool PageChecksumsEnabled(void);
 
 #endif	 /* BUFPAGE_H */
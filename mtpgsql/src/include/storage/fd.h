@@ -68,6 +68,9 @@ PG_EXTERN void FileUnlink(File file);
 PG_EXTERN void FileRename(File file, char* newname);
 PG_EXTERN int	FileRead(File file, char *buffer, int amount);
 PG_EXTERN int	FileWrite(File file, char *buffer, int amount);
+PG_EXTERN int	FileReadAt(File file, char *buffer, int amount, long offset);
+PG_EXTERN int	FileWriteAt(File file, char *buffer, int amount, long offset);
+PG_EXTERN int	FilePrefetch(File file, long offset, long amount);
 PG_EXTERN long FileSeek(File file, long offset, int whence);
 PG_EXTERN int	FileTruncate(File file, long offset);
 PG_EXTERN int   FileBaseSync(File file, long offset);   /*  sync the OS open file pointers with a DB change */
@@ -54,6 +54,7 @@ PG_EXTERN int smgrflush(SmgrInfo info, BlockNumber blocknum,
 		  char *buffer);
 PG_EXTERN int	smgrmarkdirty(SmgrInfo info, BlockNumber blkno);
 PG_EXTERN long	smgrnblocks(SmgrInfo info);
+PG_EXTERN int	smgrprefetch(SmgrInfo info, BlockNumber blocknum, int count);
 PG_EXTERN long	smgrtruncate(SmgrInfo info, long nblocks);
 PG_EXTERN int	smgrsync(SmgrInfo info);
 PG_EXTERN int	smgrcommit(void);
@@ -105,6 +106,7 @@ PG_EXTERN int	vfdwrite(SmgrInfo info, BlockNumber blocknum, char *buffer);
 PG_EXTERN int	vfdflush(SmgrInfo info, BlockNumber blocknum, char *buffer);
 PG_EXTERN int	vfdmarkdirty(SmgrInfo info, BlockNumber blkno);
 PG_EXTERN int	vfdnblocks(SmgrInfo info);
+PG_EXTERN int	vfdprefetch(SmgrInfo info, BlockNumber blocknum, int count);
 PG_EXTERN int	vfdtruncate(SmgrInfo info, long nblocks);
 PG_EXTERN int	vfdsync(SmgrInfo info);
 PG_EXTERN int	vfdcommit(void);
@@ -53,6 +53,12 @@ typedef struct
 								 * of tuples */
 
 	bool		istrusted;		/* trusted fn? */
+
+	bool		javaBatched;	/* javaValue holds the result for the
+								 * current scan tuple, computed ahead by a
+								 * batched java call (see execScan.c) */
+	Datum		javaValue;
+	bool		javaIsNull;
 } FunctionCache,
 		   *FunctionCachePtr;
 
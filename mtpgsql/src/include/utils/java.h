@@ -40,6 +40,8 @@ PG_EXTERN void SetJavaObjectLoader(const char* loader);
 
 PG_EXTERN Datum fmgr_javaA(const char *name, int nargs, Oid* types, Datum* values, Oid* returnType, bool *isNull);
 PG_EXTERN Datum fmgr_cached_javaA(JavaFunction jinfo, int nargs, Datum *args, Oid* returnType, bool *isNull);
+PG_EXTERN void fmgr_cached_javaA_batch(JavaFunction jinfo, int nargs, int nrows, Datum **args, bool **argnulls,
+                        Datum *results, bool *isNull);
 
 PG_EXTERN bool java_instanceof(bytea* obj,bytea* cname);
 PG_EXTERN int32 java_compare(bytea* obj1,bytea* obj2);
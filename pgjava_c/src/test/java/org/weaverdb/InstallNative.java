@@ -72,6 +72,7 @@ public class InstallNative implements BeforeAllCallback, ExtensionContext.Store.
                 prop.setProperty("start_delay", "10");
                 prop.setProperty("stdlog", "TRUE");
                 prop.setProperty("disable_crc", "TRUE");
+                prop.setProperty("blobextentthreshold", Integer.toString(1024 * 1024));
                 
                 WeaverInitializer.initialize(prop);
                 owner = true;
@@ -500,6 +500,41 @@ public class JNITest {
         }
     }
     
+    @org.junit.jupiter.api.Test
+    public void testExtentCommit() throws Exception {
+        Generator generate = new Generator(4 * 1024 * 1024);
+        try (DBReference conn = DBReferenceManager.connect("test")) {
+            conn.execute("create table extentstream (data streaming)");
+            conn.execute("create table mainextent (id int4, value blob in extentstream) inherits (extentstream)");
+            conn.begin();
+            try (Statement s = conn.statement("insert into mainextent(id, value) values ($id, $value)")) {
+                Input<Integer> id = s.linkInput("id", Integer.class);
+                Input<Generator> value = s.linkInputChannel("value", (g, w)-> {
+                    byte[] next = g.read();
+                    OutputStream out = Channels.newOutputStream(w);
+                    while (next != null) {
+                        out.write(next);
+                        next = g.read();
+                    }
+                });
+                id.set(1);
+                value.set(generate);
+                s.execute();
+            }
+            conn.commit();
+        }
+        try (DBReference conn = DBReferenceManager.connect("test")) {
+            MessageDigest digest = MessageDigest.getInstance("SHA-256");
+            try (Statement s = conn.statement("select value from mainextent where id = $id")) {
+                s.linkInput("id", Integer.class).set(1);
+                s.linkOutputChannel(1, ()->Channels.newChannel(new DigestOutputStream(OutputStream.nullOutputStream(), digest)));
+                s.execute();
+                assertTrue(s.fetch());
+                Assertions.assertArrayEquals(generate.getSignature(), digest.digest());
+            }
+        }
+    }
+    
     @org.junit.jupiter.api.Test
     public void testAutoCommit() throws Exception {
         try (DBReference conn = DBReferenceManager.connect("test")) {